@@ -0,0 +1,549 @@
+// Fleet load generator: N virtual readers (virtual_reader.h) speaking the device protocol to
+// the broker stand-in of sim/, against a backend that runs the auth_start / auth_tag_detected /
+// auth_verify flow with a limited number of workers. Taps arrive at random (Poisson) at each
+// reader. Everything runs on the virtual clock of sim/, so a run is reproducible from its seed
+// and an hour of a large fleet takes seconds. The report has the latencies a user at a reader
+// would see, how long verifications waited for a backend worker, the message rates through the
+// broker, and the host time of the firmware's message building and parsing per message.
+//
+//   pio run -e fleet && .pio/build/fleet/program --readers 500 --tap-rate 6 --duration-s 600
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <math.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "mqtt_serialization.h"
+#include "mqtt_topics.h"
+
+#include "sim_broker.h"
+#include "sim_clock.h"
+#include "sim_platform.h"
+
+#include "virtual_reader.h"
+
+#define FLEET_BACKEND "fleet-backend"
+#define FLEET_EVENT_DOC_SIZE 4096
+
+struct Options {
+    uint32_t readers = 50;
+    uint32_t cards = 1000;
+    uint32_t duration_s = 300;     // Virtual
+    float tap_rate = 2.0f;         // Taps per reader per minute
+    uint32_t approach_ms = 1000;   // From auth_start to the tag entering the field
+    uint32_t hold_ms = 500;        // Tag stays in the field after the result
+    uint32_t timeout_s = 10;       // timeout_seconds of auth_start
+    uint32_t workers = 4;          // Backend verifications in parallel
+    uint32_t backend_ms = 10;      // One verification
+    uint32_t broker_ms = 2;
+    uint32_t read_ms = 30;
+    uint32_t auth_ms = 80;
+    uint32_t heartbeat_s = 60;
+    float read_errors = 0.0f;
+    float auth_failures = 0.0f;
+    float lost_commands = 0.0f;
+    float publish_failures = 0.0f;
+    uint32_t outage_every_s = 0;   // A random reader loses its link this often
+    uint32_t outage_ms = 10000;
+    bool msgpack = false;
+    uint32_t seed = 1;
+    uint32_t tick_us = SIM_TICK_US;
+};
+
+// A tap at one reader, as the backend and the person at the reader see it
+struct Tap {
+    bool active;
+    char request_id[MAX_UUID_LENGTH + 1];
+    uint32_t card;
+    int64_t next_us;     // Next tap, while none is active
+    int64_t sent_us;     // auth_start
+    int64_t mode_us;     // Reader armed
+    int64_t placed_us;   // Tag in the field
+    int64_t detected_us;
+    int64_t result_us;
+    int64_t removed_us;
+    EventType result;
+};
+
+struct VerifyJob {
+    uint32_t reader;
+    std::string request_id;
+    std::string tag_uid;
+    int64_t queued_us;
+};
+
+struct Tallies {
+    uint32_t taps;
+    uint32_t success;
+    uint32_t failed;
+    uint32_t error;    // auth_error, busy or the reader's timeout
+    uint32_t missing;  // No result before the backend gave up
+    uint32_t events;
+    uint32_t unparsed;
+    uint32_t outages;
+};
+
+static Options options;
+static std::vector<std::unique_ptr<VirtualReader>> readers;
+static std::vector<MQTTTopicBuilder> reader_topics;  // The backend's, by reader
+static std::map<std::string, uint32_t> reader_index;
+static std::vector<Tap> taps;
+static std::vector<std::string> card_uids;
+static std::vector<std::string> card_keys;
+static std::map<std::string, uint32_t> card_index;
+static std::deque<VerifyJob> verify_queue;
+static std::vector<int64_t> worker_free_us;
+static std::vector<VerifyJob> worker_job;
+static int backend = -1;
+static Tallies tallies;
+static LatencyHistogram command_latency_ms;  // auth_start -> mode auth
+static LatencyHistogram detect_latency_ms;   // Tag in the field -> auth_tag_detected at the backend
+static LatencyHistogram result_latency_ms;   // Tag in the field -> result at the backend
+static LatencyHistogram queue_wait_ms;       // auth_tag_detected -> a worker takes it
+static DynamicJsonDocument event_doc(FLEET_EVENT_DOC_SIZE);
+static std::vector<int64_t> outage_end_us;
+static int64_t next_outage_us = 0;
+static uint64_t readers_ns = 0;
+static uint64_t backend_ns = 0;
+
+static uint64_t hostNanos() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Exponential inter-arrival time of a Poisson process with the tap rate of a reader
+static int64_t nextTapDelay() {
+    double uniform = (sim_random() + 1.0) / 4294967297.0;
+    return (int64_t)(-log(uniform) * 60e6 / options.tap_rate);
+}
+
+// ===== Backend =====
+
+static void publishCommand(uint32_t reader, MQTTTopic topic, CommandType type, const char* requestId,
+                           const std::string& payload) {
+    char timestamp[32];
+    generateTimestamp(timestamp, sizeof(timestamp));
+    const char* deviceId = readers[reader]->deviceId();
+
+    std::string message = "{\"version\":\"" MQTT_PROTOCOL_VERSION "\",\"timestamp\":\"";
+    message += timestamp;
+    message += "\",\"device_id\":\"";
+    message += deviceId;
+    message += "\",\"event_type\":\"";
+    message += commandTypeToString(type);
+    message += "\",\"request_id\":\"";
+    message += requestId;
+    message += "\",\"payload\":";
+    message += payload;
+    message += "}";
+
+    sim_broker_publish(backend, reader_topics[reader].topic(topic), message.c_str(), message.size(), false);
+}
+
+static void startTap(uint32_t reader) {
+    Tap& tap = taps[reader];
+    tap.active = true;
+    tap.card = sim_random() % options.cards;
+    generateUUID(tap.request_id, sizeof(tap.request_id));
+    tap.sent_us = sim_now_us();
+    tap.mode_us = tap.placed_us = tap.detected_us = tap.result_us = tap.removed_us = 0;
+    tap.result = EventType::UNKNOWN;
+    tallies.taps++;
+
+    publishCommand(reader, MQTTTopic::AUTH_START, CommandType::AUTH_START, tap.request_id,
+                   "{\"timeout_seconds\":" + std::to_string(options.timeout_s) + "}");
+}
+
+static void handleEvent(JsonObject message) {
+    EventType type = stringToEventType(message["event_type"] | "");
+    std::map<std::string, uint32_t>::const_iterator found = reader_index.find(message["device_id"] | "");
+    if (type == EventType::UNKNOWN || found == reader_index.end()) {
+        return;
+    }
+    tallies.events++;
+
+    uint32_t reader = found->second;
+    Tap& tap = taps[reader];
+    if (!tap.active || strcmp(message["request_id"] | "", tap.request_id) != 0) {
+        return;  // Heartbeats, status, tags removed after the tap
+    }
+
+    JsonObject payload = message["payload"];
+    switch (type) {
+    case EventType::MODE_CHANGE:
+        if (tap.mode_us == 0 && strcmp(payload["mode"] | "", "auth") == 0) {
+            tap.mode_us = sim_now_us();
+            command_latency_ms.record((uint32_t)((tap.mode_us - tap.sent_us) / 1000));
+        }
+        break;
+    case EventType::AUTH_TAG_DETECTED: {
+        tap.detected_us = sim_now_us();
+        if (tap.placed_us != 0) {
+            detect_latency_ms.record((uint32_t)((tap.detected_us - tap.placed_us) / 1000));
+        }
+        VerifyJob job;
+        job.reader = reader;
+        job.request_id = tap.request_id;
+        job.tag_uid = payload["tag_uid"] | "";
+        job.queued_us = sim_now_us();
+        verify_queue.push_back(job);
+        break;
+    }
+    case EventType::AUTH_SUCCESS:
+    case EventType::AUTH_FAILED:
+    case EventType::AUTH_ERROR:
+        // A read error leaves the reader armed for the next tap; the backend counts the first outcome
+        if (tap.result == EventType::UNKNOWN) {
+            tap.result = type;
+            tap.result_us = sim_now_us();
+            if (tap.placed_us != 0) {
+                result_latency_ms.record((uint32_t)((tap.result_us - tap.placed_us) / 1000));
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void receiveEvent(const char* topic, const char* payload, size_t length) {
+    (void)topic;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(payload);
+    DeserializationError error = decodeDocument(event_doc, data, length, detectEncoding(data, length));
+    if (error) {
+        tallies.unparsed++;
+        return;
+    }
+    if (stringToEventType(event_doc["event_type"] | "") == EventType::BATCH) {
+        for (JsonObject event : event_doc["payload"]["events"].as<JsonArray>()) {
+            handleEvent(event);
+        }
+    } else {
+        handleEvent(event_doc.as<JsonObject>());
+    }
+}
+
+// Verifications wait for a free worker; a worker answers backend_ms after it took the job
+static void serveVerifications() {
+    for (size_t worker = 0; worker < worker_free_us.size(); worker++) {
+        if (!worker_job[worker].request_id.empty() && worker_free_us[worker] <= sim_now_us()) {
+            const VerifyJob& job = worker_job[worker];
+            std::map<std::string, uint32_t>::const_iterator card = card_index.find(job.tag_uid);
+            std::string key = card != card_index.end() ? card_keys[card->second] : std::string(32, '0');
+            publishCommand(job.reader, MQTTTopic::AUTH_VERIFY, CommandType::AUTH_VERIFY, job.request_id.c_str(),
+                           "{\"tag_uid\":\"" + job.tag_uid + "\",\"key\":\"" + key +
+                               "\",\"user_data\":{\"username\":\"fleet\",\"context\":\"load\"}}");
+            worker_job[worker].request_id.clear();
+        }
+        if (worker_job[worker].request_id.empty() && !verify_queue.empty()) {
+            worker_job[worker] = verify_queue.front();
+            verify_queue.pop_front();
+            queue_wait_ms.record((uint32_t)((sim_now_us() - worker_job[worker].queued_us) / 1000));
+            worker_free_us[worker] = sim_now_us() + (int64_t)options.backend_ms * 1000;
+        }
+    }
+}
+
+// ===== The people at the readers =====
+
+static void recordResult(EventType result) {
+    switch (result) {
+    case EventType::AUTH_SUCCESS:
+        tallies.success++;
+        break;
+    case EventType::AUTH_FAILED:
+        tallies.failed++;
+        break;
+    case EventType::UNKNOWN:
+        tallies.missing++;
+        break;
+    default:
+        tallies.error++;
+        break;
+    }
+}
+
+static void driveTap(uint32_t reader) {
+    Tap& tap = taps[reader];
+    VirtualReader& device = *readers[reader];
+    int64_t now = sim_now_us();
+
+    if (!tap.active) {
+        if (now >= tap.next_us) {
+            startTap(reader);
+        }
+        return;
+    }
+
+    if (tap.placed_us == 0 && now >= tap.sent_us + (int64_t)options.approach_ms * 1000) {
+        device.placeTag(card_uids[tap.card].c_str());
+        tap.placed_us = now;
+    }
+    if (tap.result != EventType::UNKNOWN && tap.removed_us == 0 &&
+        now >= tap.result_us + (int64_t)options.hold_ms * 1000) {
+        device.removeTag();
+        tap.removed_us = now;
+    }
+
+    // Done once the tag is gone; the backend gives up a while after the reader would have
+    bool done = tap.removed_us != 0;
+    bool expired = now >= tap.sent_us + ((int64_t)options.timeout_s + 5) * 1000000;
+    if (done || expired) {
+        if (!done) {
+            device.removeTag();
+        }
+        // After an error or no result the reader may still be armed
+        if (tap.result != EventType::AUTH_SUCCESS && tap.result != EventType::AUTH_FAILED) {
+            publishCommand(reader, MQTTTopic::AUTH_CANCEL, CommandType::AUTH_CANCEL, tap.request_id, "{}");
+        }
+        recordResult(tap.result);
+        tap.active = false;
+        tap.next_us = now + nextTapDelay();
+    }
+}
+
+static void driveOutages() {
+    int64_t now = sim_now_us();
+    for (size_t reader = 0; reader < outage_end_us.size(); reader++) {
+        if (outage_end_us[reader] != 0 && now >= outage_end_us[reader]) {
+            sim_broker_set_link(sim_broker_find(readers[reader]->deviceId()), true);
+            outage_end_us[reader] = 0;
+        }
+    }
+    if (options.outage_every_s == 0 || now < next_outage_us) {
+        return;
+    }
+    uint32_t reader = sim_random() % readers.size();
+    if (outage_end_us[reader] == 0) {
+        sim_broker_set_link(sim_broker_find(readers[reader]->deviceId()), false);
+        outage_end_us[reader] = now + (int64_t)options.outage_ms * 1000;
+        tallies.outages++;
+    }
+    next_outage_us = now + (int64_t)options.outage_every_s * 1000000;
+}
+
+static void fleetTick() {
+    uint64_t started = hostNanos();
+    for (std::unique_ptr<VirtualReader>& reader : readers) {
+        reader->loop();
+    }
+    uint64_t backendStarted = hostNanos();
+    readers_ns += backendStarted - started;
+
+    sim_broker_poll(backend);
+    serveVerifications();
+    backend_ns += hostNanos() - backendStarted;
+
+    driveOutages();
+    for (uint32_t reader = 0; reader < readers.size(); reader++) {
+        driveTap(reader);
+    }
+}
+
+// ===== Setup and report =====
+
+static void usage() {
+    printf("usage: program [options]\n"
+           "  --readers N --cards N --duration-s S --tap-rate TAPS_PER_MIN --seed N --tick-us US\n"
+           "  --approach-ms MS --hold-ms MS --timeout-s S --heartbeat-s S --msgpack\n"
+           "  --workers N --backend-ms MS --broker-ms MS --read-ms MS --auth-ms MS\n"
+           "  --read-errors P --auth-failures P --lost-commands P --publish-failures P  (0..1)\n"
+           "  --outage-every-s S --outage-ms MS\n");
+}
+
+static bool parseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--msgpack") == 0) {
+            options.msgpack = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        uint32_t number = (uint32_t)atol(value);
+        float probability = (float)atof(value);
+        if (strcmp(name, "--readers") == 0) {
+            options.readers = number;
+        } else if (strcmp(name, "--cards") == 0) {
+            options.cards = number;
+        } else if (strcmp(name, "--duration-s") == 0) {
+            options.duration_s = number;
+        } else if (strcmp(name, "--tap-rate") == 0) {
+            options.tap_rate = probability;
+        } else if (strcmp(name, "--approach-ms") == 0) {
+            options.approach_ms = number;
+        } else if (strcmp(name, "--hold-ms") == 0) {
+            options.hold_ms = number;
+        } else if (strcmp(name, "--timeout-s") == 0) {
+            options.timeout_s = number;
+        } else if (strcmp(name, "--workers") == 0) {
+            options.workers = number;
+        } else if (strcmp(name, "--backend-ms") == 0) {
+            options.backend_ms = number;
+        } else if (strcmp(name, "--broker-ms") == 0) {
+            options.broker_ms = number;
+        } else if (strcmp(name, "--read-ms") == 0) {
+            options.read_ms = number;
+        } else if (strcmp(name, "--auth-ms") == 0) {
+            options.auth_ms = number;
+        } else if (strcmp(name, "--heartbeat-s") == 0) {
+            options.heartbeat_s = number;
+        } else if (strcmp(name, "--read-errors") == 0) {
+            options.read_errors = probability;
+        } else if (strcmp(name, "--auth-failures") == 0) {
+            options.auth_failures = probability;
+        } else if (strcmp(name, "--lost-commands") == 0) {
+            options.lost_commands = probability;
+        } else if (strcmp(name, "--publish-failures") == 0) {
+            options.publish_failures = probability;
+        } else if (strcmp(name, "--outage-every-s") == 0) {
+            options.outage_every_s = number;
+        } else if (strcmp(name, "--outage-ms") == 0) {
+            options.outage_ms = number;
+        } else if (strcmp(name, "--seed") == 0) {
+            options.seed = number;
+        } else if (strcmp(name, "--tick-us") == 0) {
+            options.tick_us = number;
+        } else {
+            return false;
+        }
+    }
+    return options.readers > 0 && options.cards > 0 && options.workers > 0 && options.tap_rate > 0 &&
+           options.timeout_s >= 1 && options.timeout_s <= 300 && options.heartbeat_s > 0 && options.tick_us > 0;
+}
+
+static void createCards() {
+    for (uint32_t i = 0; i < options.cards; i++) {
+        char uid[MAX_TAG_UID_LENGTH + 1];
+        snprintf(uid, sizeof(uid), "04:%02X:%02X:%02X:%02X:5A:80:00", (unsigned)(i >> 24) & 0xFF,
+                 (unsigned)(i >> 16) & 0xFF, (unsigned)(i >> 8) & 0xFF, (unsigned)i & 0xFF);
+        char key[33];
+        for (int j = 0; j < 16; j++) {
+            snprintf(key + j * 2, 3, "%02X", (unsigned)(sim_random() & 0xFF));
+        }
+        card_index[uid] = i;
+        card_uids.push_back(uid);
+        card_keys.push_back(key);
+    }
+}
+
+static void createReaders() {
+    VirtualReaderConfig config;
+    config.read_us = options.read_ms * 1000;
+    config.auth_us = options.auth_ms * 1000;
+    config.heartbeat_ms = options.heartbeat_s * 1000;
+    config.read_errors = options.read_errors;
+    config.auth_failures = options.auth_failures;
+    config.lost_commands = options.lost_commands;
+    config.encoding = options.msgpack ? PayloadEncoding::MSGPACK : PayloadEncoding::JSON;
+
+    taps.resize(options.readers);
+    reader_topics.resize(options.readers);
+    outage_end_us.assign(options.readers, 0);
+    for (uint32_t i = 0; i < options.readers; i++) {
+        char deviceId[32];
+        snprintf(deviceId, sizeof(deviceId), "fleet-reader-%04u", (unsigned)i);
+        readers.push_back(std::unique_ptr<VirtualReader>(new VirtualReader(deviceId, config)));
+        reader_index[deviceId] = i;
+        reader_topics[i].setDeviceId(deviceId);
+        sim_broker_set_publish_failures(sim_broker_find(deviceId), options.publish_failures);
+
+        memset(&taps[i], 0, sizeof(taps[i]));
+        taps[i].next_us = nextTapDelay();
+    }
+}
+
+// The event topics of every reader, not the commands the backend sends
+static void subscribeBackend() {
+    MQTTTopicBuilder topics;
+    topics.setDeviceId("+");
+    for (uint8_t topic = (uint8_t)MQTTTopic::REGISTER_SUCCESS; topic < (uint8_t)MQTTTopic::ALL_COMMANDS; topic++) {
+        sim_broker_subscribe(backend, topics.topic((MQTTTopic)topic));
+    }
+}
+
+static void printHistogram(const char* name, const LatencyHistogram& histogram) {
+    printf("%-22s n=%u mean=%u p50<=%u p99<=%u max=%u ms\n", name, histogram.count(), histogram.mean(),
+           histogram.percentile(50), histogram.percentile(99), histogram.max());
+}
+
+static void printReport(double wallSeconds) {
+    const SimBrokerStats& broker = sim_broker_stats();
+    double virtualSeconds = sim_now_us() / 1e6;
+
+    VirtualReaderStats total;
+    memset(&total, 0, sizeof(total));
+    uint32_t online = 0;
+    for (const std::unique_ptr<VirtualReader>& reader : readers) {
+        const VirtualReaderStats& stats = reader->stats();
+        total.connects += stats.connects;
+        total.commands += stats.commands;
+        total.rejected += stats.rejected;
+        total.lost += stats.lost;
+        total.events += stats.events;
+        total.publish_failures += stats.publish_failures;
+        total.taps += stats.taps;
+        total.build_ns += stats.build_ns;
+        total.parse_ns += stats.parse_ns;
+        online += reader->online() ? 1 : 0;
+    }
+
+    printf("\n=== fleet: %u readers, %.1f taps/min each, %u workers x %u ms ===\n", options.readers, options.tap_rate,
+           options.workers, options.backend_ms);
+    printf("virtual %.0f s, wall %.2f s (%.0fx)\n", virtualSeconds, wallSeconds,
+           wallSeconds > 0 ? virtualSeconds / wallSeconds : 0.0);
+    printf("taps %u: success %u, failed %u, error %u, missing %u (%.2f taps/s)\n", tallies.taps, tallies.success,
+           tallies.failed, tallies.error, tallies.missing, virtualSeconds > 0 ? tallies.taps / virtualSeconds : 0.0);
+    printHistogram("auth_start -> mode", command_latency_ms);
+    printHistogram("tag -> tag_detected", detect_latency_ms);
+    printHistogram("tag -> result", result_latency_ms);
+    printHistogram("verify queue wait", queue_wait_ms);
+    printf("backend: %u events (%.1f/s), %u unparsed, %zu verifications still queued\n", tallies.events,
+           virtualSeconds > 0 ? tallies.events / virtualSeconds : 0.0, tallies.unparsed, verify_queue.size());
+    printf("broker: published %u (%.1f/s), failed %u, delivered %u, lost %u, wills %u\n", broker.published,
+           virtualSeconds > 0 ? broker.published / virtualSeconds : 0.0, broker.failed, broker.delivered, broker.lost,
+           broker.wills);
+    printf("readers: %u online, %u connects, %u outages, commands %u (rejected %u, lost %u), events %u, "
+           "publish failures %u\n",
+           online, total.connects, tallies.outages, total.commands, total.rejected, total.lost, total.events,
+           total.publish_failures);
+    printf("host: readers %.1f ms, backend %.1f ms; build %.2f us/event, parse %.2f us/command\n", readers_ns / 1e6,
+           backend_ns / 1e6, total.events > 0 ? total.build_ns / 1e3 / total.events : 0.0,
+           total.commands > total.lost ? total.parse_ns / 1e3 / (total.commands - total.lost) : 0.0);
+}
+
+int main(int argc, char** argv) {
+    if (!parseOptions(argc, argv)) {
+        usage();
+        return 2;
+    }
+
+    sim_seed(options.seed);
+    sim_set_tick(options.tick_us);
+    sim_broker_set_latency((int64_t)options.broker_ms * 1000);
+    sim_set_tick_hook(fleetTick);
+
+    backend = sim_broker_client(FLEET_BACKEND, receiveEvent);
+    sim_broker_connect(backend, nullptr, nullptr, false);
+    subscribeBackend();
+    worker_free_us.assign(options.workers, 0);
+    worker_job.resize(options.workers);
+
+    createCards();
+    createReaders();
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    sim_run((int64_t)options.duration_s * 1000000);
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    printReport(wallSeconds);
+    return 0;
+}
@@ -0,0 +1,324 @@
+#include <chrono>
+
+#include "virtual_reader.h"
+#include "sim_broker.h"
+#include "sim_clock.h"
+#include "sim_platform.h"
+
+#define VIRTUAL_READER_FIRMWARE "1.0.0-fleet"
+
+static uint64_t hostNanos() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+VirtualReader::VirtualReader(const char* deviceId, const VirtualReaderConfig& config)
+    : config(config), state(State::IDLE), deadline_us(0), busy_until_us(0), tag_taken(false),
+      tag_placed_us(0), started_us(sim_now_us()), operations(0) {
+    memset(&counters, 0, sizeof(counters));
+    strlcpy(device_id, deviceId, sizeof(device_id));
+    snprintf(will_topic, sizeof(will_topic), "device/%s/register", deviceId);  // As the firmware sets it
+    request_id[0] = '\0';
+    tag_uid[0] = '\0';
+    user_data.clear();
+
+    // Readers boot at different times, so their heartbeats are spread over the interval
+    next_heartbeat_us = started_us + (int64_t)(sim_random() % (config.heartbeat_ms + 1)) * 1000;
+
+    builder.setDeviceId(device_id);
+    builder.setEncoding(config.encoding);
+    topics.setDeviceId(device_id);
+    client = sim_broker_client(device_id, [this](const char* topic, const char* payload, size_t length) {
+        receive(topic, payload, length);
+    });
+}
+
+bool VirtualReader::online() const {
+    return sim_broker_connected(client);
+}
+
+DeviceMode VirtualReader::mode() const {
+    return state == State::IDLE ? DeviceMode::IDLE : DeviceMode::AUTH;
+}
+
+void VirtualReader::loop() {
+    if (!sim_broker_connected(client)) {
+        connect();
+    }
+    sim_broker_poll(client);
+
+    int64_t now = sim_now_us();
+    switch (state) {
+    case State::AUTH_WAIT_CARD:
+        if (tag_uid[0] != '\0' && !tag_taken) {
+            tag_taken = true;
+            counters.taps++;
+            state = State::READING;
+            busy_until_us = now + config.read_us;
+        }
+        break;
+    case State::READING:
+        if (now < busy_until_us) {
+            break;
+        }
+        if (sim_chance(config.read_errors)) {
+            // Like a card that left the field during the read: the reader waits for the next tap
+            postError("NFC timeout", ErrorCode::NFC_TIMEOUT, ErrorComponent::NFC);
+            state = State::AUTH_WAIT_CARD;
+            break;
+        }
+        {
+            TagDetectedPayload tagPayload;
+            tagPayload.clear();
+            strlcpy(tagPayload.tag_uid, tag_uid, sizeof(tagPayload.tag_uid));
+            strlcpy(tagPayload.message, "Tag detected. Awaiting verification.", sizeof(tagPayload.message));
+            uint64_t started = hostNanos();
+            const char* message = builder.buildTagDetected(request_id, tagPayload);
+            counters.build_ns += hostNanos() - started;
+            publish(topics.authTagDetected(), message, false);
+        }
+        state = State::AUTH_WAIT_VERIFY;
+        break;
+    case State::AUTHENTICATING:
+        if (now >= busy_until_us) {
+            finishAuth(!sim_chance(config.auth_failures));
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (state != State::IDLE && now >= deadline_us) {
+        postError("Operation timed out", ErrorCode::TIMEOUT_EXCEEDED, ErrorComponent::DEVICE);
+        endAuth(DeviceMode::AUTH);
+    }
+
+    if (online() && now >= next_heartbeat_us) {
+        sendHeartbeat();
+        next_heartbeat_us = now + (int64_t)config.heartbeat_ms * 1000;
+    }
+}
+
+void VirtualReader::placeTag(const char* tagUid) {
+    strlcpy(tag_uid, tagUid, sizeof(tag_uid));
+    tag_taken = false;
+    tag_placed_us = sim_now_us();
+}
+
+void VirtualReader::removeTag() {
+    if (tag_uid[0] == '\0') {
+        return;
+    }
+    if (tag_taken) {
+        TagRemovedPayload removedPayload;
+        removedPayload.clear();
+        strlcpy(removedPayload.tag_uid, tag_uid, sizeof(removedPayload.tag_uid));
+        removedPayload.present_ms = (uint32_t)((sim_now_us() - tag_placed_us) / 1000);
+
+        char requestId[MAX_UUID_LENGTH + 1];
+        if (state != State::IDLE) {
+            strlcpy(requestId, request_id, sizeof(requestId));
+        } else {
+            generateUUID(requestId, sizeof(requestId));
+        }
+        uint64_t started = hostNanos();
+        const char* message = builder.buildTagRemoved(requestId, removedPayload);
+        counters.build_ns += hostNanos() - started;
+        publish(topics.tagRemoved(), message, false);
+    }
+    tag_uid[0] = '\0';
+    tag_taken = false;
+}
+
+// Same session setup as network.cpp: will, the command wildcard, status online (retained)
+void VirtualReader::connect() {
+    if (!sim_broker_connect(client, will_topic, "disconnect", true)) {
+        return;
+    }
+    counters.connects++;
+    sim_broker_subscribe(client, topics.allCommands());
+
+    StatusChangePayload statusPayload;
+    statusPayload.clear();
+    statusPayload.status = DeviceStatus::ONLINE;
+    strlcpy(statusPayload.firmware_version, VIRTUAL_READER_FIRMWARE, sizeof(statusPayload.firmware_version));
+    strlcpy(statusPayload.ip_address, "10.0.0.2", sizeof(statusPayload.ip_address));
+
+    char requestId[MAX_UUID_LENGTH + 1];
+    generateUUID(requestId, sizeof(requestId));
+    uint64_t started = hostNanos();
+    const char* message = builder.buildStatusChange(requestId, statusPayload);
+    counters.build_ns += hostNanos() - started;
+    publish(topics.status(), message, true);
+}
+
+// The wildcard also delivers what the reader publishes; like network.cpp those are dropped
+// on the topic alone
+void VirtualReader::receive(const char* topic, const char* payload, size_t length) {
+    CommandType type = commandForTopic(topics.route(topic, strlen(topic)));
+    if (type == CommandType::UNKNOWN) {
+        return;
+    }
+    counters.commands++;
+    if (sim_chance(config.lost_commands)) {
+        counters.lost++;
+        return;
+    }
+
+    uint64_t started = hostNanos();
+    bool parsed = parser.parse(reinterpret_cast<const uint8_t*>(payload), length);
+    counters.parse_ns += hostNanos() - started;
+    if (!parsed) {
+        counters.rejected++;
+        return;
+    }
+
+    switch (type) {
+    case CommandType::AUTH_START: {
+        AuthStartPayload authPayload;
+        started = hostNanos();
+        bool valid = parser.parseAuthStart(authPayload);
+        counters.parse_ns += hostNanos() - started;
+        if (valid) {
+            startAuth(authPayload);
+        } else {
+            counters.rejected++;
+        }
+        break;
+    }
+    case CommandType::AUTH_VERIFY: {
+        AuthVerifyPayload verifyPayload;
+        started = hostNanos();
+        bool valid = parser.parseAuthVerify(verifyPayload);
+        counters.parse_ns += hostNanos() - started;
+        if (valid) {
+            verify(verifyPayload);
+        } else {
+            counters.rejected++;
+        }
+        break;
+    }
+    case CommandType::AUTH_CANCEL:
+        if (state != State::IDLE && strcmp(parser.getRequestId(), request_id) == 0) {
+            endAuth(DeviceMode::AUTH);
+        } else {
+            counters.rejected++;
+        }
+        break;
+    default:
+        counters.rejected++;  // Only the auth flow is modelled
+        break;
+    }
+}
+
+void VirtualReader::startAuth(const AuthStartPayload& payload) {
+    const char* requestId = parser.getRequestId();
+    if (state != State::IDLE && strcmp(requestId, request_id) != 0) {
+        ErrorPayload errorPayload;
+        errorPayload.clear();
+        strlcpy(errorPayload.error, "Reader busy", sizeof(errorPayload.error));
+        errorPayload.error_code = ErrorCode::NFC_DEVICE_BUSY;
+        errorPayload.retry_possible = true;
+        uint64_t started = hostNanos();
+        const char* message = builder.buildAuthError(requestId, errorPayload);
+        counters.build_ns += hostNanos() - started;
+        publish(topics.authError(), message, false);
+        return;
+    }
+
+    // A repeated start re-arms the running auth
+    DeviceMode previous = mode();
+    strlcpy(request_id, requestId, sizeof(request_id));
+    deadline_us = sim_now_us() + (int64_t)payload.timeout_seconds * 1000000;
+    tag_taken = false;  // A tag already lying on the reader counts for the new operation
+    state = State::AUTH_WAIT_CARD;
+    postModeChange(DeviceMode::AUTH, previous);
+}
+
+void VirtualReader::verify(const AuthVerifyPayload& payload) {
+    if (state != State::AUTH_WAIT_VERIFY || strcmp(parser.getRequestId(), request_id) != 0) {
+        counters.rejected++;
+        return;
+    }
+    user_data = payload.user_data;
+    state = State::AUTHENTICATING;
+    busy_until_us = sim_now_us() + config.auth_us;
+}
+
+void VirtualReader::finishAuth(bool authenticated) {
+    const char* message;
+    uint64_t started = hostNanos();
+    if (authenticated) {
+        AuthSuccessPayload authPayload;
+        authPayload.clear();
+        strlcpy(authPayload.tag_uid, tag_uid, sizeof(authPayload.tag_uid));
+        authPayload.authenticated = true;
+        strlcpy(authPayload.message, "Authentication successful", sizeof(authPayload.message));
+        authPayload.user_data = user_data;
+        message = builder.buildAuthSuccess(request_id, authPayload);
+    } else {
+        AuthFailedPayload failedPayload;
+        failedPayload.clear();
+        strlcpy(failedPayload.tag_uid, tag_uid, sizeof(failedPayload.tag_uid));
+        strlcpy(failedPayload.reason, "Invalid credentials or key mismatch", sizeof(failedPayload.reason));
+        message = builder.buildAuthFailed(request_id, failedPayload);
+    }
+    counters.build_ns += hostNanos() - started;
+    publish(authenticated ? topics.authSuccess() : topics.authFailed(), message, false);
+
+    operations++;
+    endAuth(DeviceMode::AUTH);
+}
+
+void VirtualReader::endAuth(DeviceMode previous) {
+    postModeChange(DeviceMode::IDLE, previous);
+    state = State::IDLE;
+    request_id[0] = '\0';
+    user_data.clear();
+}
+
+void VirtualReader::postError(const char* text, ErrorCode code, ErrorComponent component) {
+    ErrorPayload errorPayload;
+    errorPayload.clear();
+    strlcpy(errorPayload.error, text, sizeof(errorPayload.error));
+    errorPayload.error_code = code;
+    errorPayload.retry_possible = true;
+    errorPayload.component = component;
+    uint64_t started = hostNanos();
+    const char* message = builder.buildAuthError(request_id, errorPayload);
+    counters.build_ns += hostNanos() - started;
+    publish(topics.authError(), message, false);
+}
+
+void VirtualReader::postModeChange(DeviceMode mode, DeviceMode previous) {
+    ModeChangePayload modePayload;
+    modePayload.mode = mode;
+    modePayload.previous_mode = previous;
+    uint64_t started = hostNanos();
+    const char* message = builder.buildModeChange(request_id, modePayload);
+    counters.build_ns += hostNanos() - started;
+    publish(topics.mode(), message, true);
+}
+
+void VirtualReader::publish(const char* topic, const char* message, bool retained) {
+    if (message == nullptr || !sim_broker_publish(client, topic, message, builder.length(), retained)) {
+        counters.publish_failures++;
+        return;
+    }
+    counters.events++;
+}
+
+void VirtualReader::sendHeartbeat() {
+    HeartbeatPayload heartbeat;
+    heartbeat.clear();
+    heartbeat.uptime_seconds = (unsigned long)((sim_now_us() - started_us) / 1000000);
+    heartbeat.operations_completed = operations;
+    heartbeat.rf_taps = counters.taps;
+
+    char requestId[MAX_UUID_LENGTH + 1];
+    generateUUID(requestId, sizeof(requestId));
+    uint64_t started = hostNanos();
+    const char* message = builder.buildHeartbeat(requestId, heartbeat);
+    counters.build_ns += hostNanos() - started;
+    publish(topics.heartbeat(), message, false);
+}
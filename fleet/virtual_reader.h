@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "mqtt_protocol.h"
+
+// A reader as the backend sees it: the device side of the MQTT protocol, spoken with the
+// firmware's MQTTMessageBuilder, MQTTMessageParser and MQTTTopicBuilder on the broker stand-in
+// of sim_broker.h. The protocol is the firmware's; the card side is a model in which reading
+// and authenticating a tag take a fixed time and fail with the configured probabilities.
+// Like the firmware it runs one auth at a time: auth_start arms it, a tag in the field goes to
+// the backend as auth_tag_detected, auth_verify decides the tap, auth_cancel and the timeout
+// end it. It has no session queue and no publish queue: an auth_start while busy is answered
+// with NFC_DEVICE_BUSY, a failed publish is lost.
+
+struct VirtualReaderConfig {
+    uint32_t read_us;       // Detect and read a tag
+    uint32_t auth_us;       // Authenticate the tag with the key of auth_verify
+    uint32_t heartbeat_ms;
+    float read_errors;      // The read fails (auth_error), the reader waits for the next tap
+    float auth_failures;    // The tag is refused (auth_failed)
+    float lost_commands;    // A command never reaches the reader's state machine
+    PayloadEncoding encoding;  // Of the events
+};
+
+struct VirtualReaderStats {
+    uint32_t connects;
+    uint32_t commands;
+    uint32_t rejected;  // Unparsable, or not expected in the current state
+    uint32_t lost;
+    uint32_t events;
+    uint32_t publish_failures;
+    uint32_t taps;
+    uint64_t build_ns;  // Host time in MQTTMessageBuilder
+    uint64_t parse_ns;  // Host time in MQTTMessageParser
+};
+
+class VirtualReader {
+public:
+    VirtualReader(const char* deviceId, const VirtualReaderConfig& config);
+
+    const char* deviceId() const { return device_id; }
+    bool online() const;
+    DeviceMode mode() const;
+
+    // Once per tick: (re)connects, handles the commands that arrived, finishes the card work
+    // that is due and sends the heartbeat
+    void loop();
+
+    // A tag enters the RF field; it is taken once, like the firmware ignores a tag that stays
+    void placeTag(const char* tagUid);
+    void removeTag();
+
+    const VirtualReaderStats& stats() const { return counters; }
+
+private:
+    enum class State : uint8_t {
+        IDLE,
+        AUTH_WAIT_CARD,
+        READING,
+        AUTH_WAIT_VERIFY,
+        AUTHENTICATING,
+    };
+
+    void connect();
+    void receive(const char* topic, const char* payload, size_t length);
+    void startAuth(const AuthStartPayload& payload);
+    void verify(const AuthVerifyPayload& payload);
+    void finishAuth(bool authenticated);
+    void endAuth(DeviceMode previous);
+    void postError(const char* text, ErrorCode code, ErrorComponent component);
+    void postModeChange(DeviceMode mode, DeviceMode previous);
+    void publish(const char* topic, const char* message, bool retained);
+    void sendHeartbeat();
+
+    VirtualReaderConfig config;
+    MQTTMessageBuilder builder;
+    MQTTMessageParser parser;
+    MQTTTopicBuilder topics;
+    VirtualReaderStats counters;
+    int client;
+    char device_id[MAX_DEVICE_ID_LENGTH + 1];
+    char will_topic[MAX_DEVICE_ID_LENGTH + 20];
+
+    State state;
+    char request_id[MAX_UUID_LENGTH + 1];
+    int64_t deadline_us;
+    int64_t busy_until_us;  // End of the card work of READING and AUTHENTICATING
+    UserData user_data;     // Of auth_verify, echoed in auth_success
+
+    char tag_uid[MAX_TAG_UID_LENGTH + 1];  // Empty while no tag is in the field
+    bool tag_taken;
+    int64_t tag_placed_us;
+
+    int64_t started_us;
+    int64_t next_heartbeat_us;
+    uint32_t operations;
+};
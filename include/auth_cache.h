@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mqtt_schema.h"
+
+// Offline authorization cache: tag UID -> expected card key, permissions and expiry.
+// Filled by auth_cache_sync commands from the backend and persisted in NVS, so a tap
+// can be decided on the device without the auth_tag_detected/AUTH_VERIFY round trip.
+// Owned by the NFC task; not thread safe.
+
+#define AUTH_CACHE_CAPACITY 64 // Power of two (open addressing)
+
+// Expiry can only be checked once the wall clock is set; before this time
+// entries with an expiry are treated as misses and the online flow is used.
+#define AUTH_CACHE_MIN_VALID_TIME 1577836800UL // 2020-01-01T00:00:00Z
+
+struct AuthCacheEntry
+{
+  uint8_t uid[8]; // Binary UID as returned by ReadCard, zero padded
+  uint8_t key[16];
+  uint32_t permissions; // AUTH_PERMISSION_* bits
+  uint32_t expires_at;  // Unix time in seconds, 0 = never expires
+  char username[MAX_CACHE_USERNAME_LENGTH + 1];
+};
+
+// Load the persisted cache
+void auth_cache_begin();
+
+// Apply one sync message and persist the result. Returns false if the cache is full.
+bool auth_cache_apply(const AuthCacheSyncPayload &sync);
+
+// Copy the valid (known and not expired) authorization for uid into entry
+bool auth_cache_find(const uint8_t uid[8], AuthCacheEntry *entry);
+
+size_t auth_cache_size();
+void auth_cache_clear();
@@ -59,6 +59,7 @@ bool ReadCard(byte u8_UID[8], kCard *pk_Card);
 bool WaitForCard(kUser *pk_User, kCard *pk_Card);
 bool customize_card(const char *user_buff, const unsigned char *encript_key, unsigned char *ID, kCard *pk_Card);
 bool authenticate_user(unsigned char *ID, char *user_buffer, kCard *pk_Card, unsigned char *key_ret);
+int authenticate_user_keys(unsigned char *ID, char *user_buffer, kCard *pk_Card, const unsigned char (*expected_keys)[enc_key_length], uint8_t key_count);
 bool IsDesfireTimeout();
 
 // DESFire-specific (if needed)
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// Tracks the tag in the RF field across polls, so a tag left on the reader is
+// handled once instead of on every poll, and its removal can be reported.
+// Owned by the NFC task. Times are millis() values.
+
+// A tag that was already handled is ignored while it stays in the field and when it comes back
+// within CARD_DUPLICATE_WINDOW_MS. It counts as removed after it was missing for
+// CARD_REMOVED_DEBOUNCE_MS (one missed poll at the edge of the field is not a removal).
+#define CARD_DUPLICATE_WINDOW_MS 2000
+#define CARD_REMOVED_DEBOUNCE_MS 200
+
+struct CardPresence
+{
+  uint8_t uid[8];
+  uint32_t first_seen_ms;
+  uint32_t last_seen_ms;
+  bool present;
+  bool handled; // A detection was already reported for this tag
+};
+
+// A poll returned uid. Returns true if the tag should be processed: a new tag, or the present
+// tag until card_presence_mark_handled() (again after card_presence_rearm()).
+bool card_presence_seen(const uint8_t uid[8], uint32_t now);
+
+// The tag in the field was processed, it is ignored while it stays on the reader
+void card_presence_mark_handled();
+
+// A poll returned uid while a different tag is present, i.e. the tag was swapped without an
+// empty poll in between. Returns true and copies the presence data of the previous tag to
+// replaced, which counts as removed; card_presence_seen() then takes uid as a new tag.
+bool card_presence_replaced(const uint8_t uid[8], CardPresence *replaced);
+
+// A poll found no tag. Returns true once when the present tag counts as removed
+// and copies its presence data to removed.
+bool card_presence_absent(CardPresence *removed, uint32_t now);
+
+// Let the tag in the field be processed once more (a new operation was started)
+void card_presence_rearm();
+
+bool card_presence_present();
+
+// Forget the tag in the field
+void card_presence_clear();
@@ -33,6 +33,48 @@ void run_config_portal();
 
 #define qos 1
 
+// FreeRTOS task layout: the network task shares core 0 with the WiFi stack,
+// the NFC task has core 1 to itself so network stalls never delay a tap.
+#define NETWORK_TASK_CORE 0
+#define NETWORK_TASK_STACK_SIZE 8192
+#define NETWORK_TASK_PRIORITY 1
+#define NFC_TASK_CORE 1
+#define NFC_TASK_STACK_SIZE 8192
+#define NFC_TASK_PRIORITY 1
+
+// How long success/fail feedback stays on the display (the reader keeps working meanwhile)
+#define FEEDBACK_DURATION_MS 1000
+
+// Pending deadlines of the reader (operation timeout, verify timeout, session end)
+#define READER_DEADLINE_CAPACITY 8
+
+// Events produced while the broker is unreachable are kept in the flash event journal
+// (event_journal.h) and replayed after the reconnect: EVENT_JOURNAL_REPLAY_BATCH events
+// every EVENT_JOURNAL_REPLAY_INTERVAL_MS.
+#define EVENT_JOURNAL_REPLAY_BATCH 4
+#define EVENT_JOURNAL_REPLAY_INTERVAL_MS 50
+
+// Messages of the publish queue sent per network loop
+#define PUBLISH_QUEUE_BATCH 4
+
+// Publish the events that are waiting together as one "batch" message (devices/<id>/batch)
+// instead of one message each, e.g. the result of a tap and the mode change back to idle.
+// The backend must understand batch messages. Retained state (status, mode) still gets its
+// own retained publish, delayed so that the state changes of one tap coalesce.
+#define BATCH_EVENTS false
+#define BATCH_MAX_EVENTS 4
+#define STATE_PUBLISH_DELAY_MS 1000
+
+// Heartbeat with the telemetry of telemetry.h, while connected
+#define HEARTBEAT_INTERVAL_MS 60000
+
+// Timing breakdown of every tap on the debug/trace topic (tap_trace.h)
+#define TRACE_TAPS false
+
+// Time of the event timestamps (time_service.h)
+#define SNTP_SERVER "pool.ntp.org"
+#define SNTP_VALID_AFTER 1735689600 // 2025-01-01, the system clock is earlier until SNTP set it
+
 #define SCREEN_WIDTH 128 // OLED display width, in pixels
 #define SCREEN_HEIGHT 64 // OLED display height, in pixels
 
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "mqtt_types.h"
+
+// What happens when a deadline fires
+enum class DeadlineKind : uint8_t {
+    OPERATION,  // timeout_seconds of a start command -> TIMEOUT_EXCEEDED
+    VERIFY,     // Waiting for AUTH_VERIFY within a session
+    SESSION     // Duration of a continuous auth session
+};
+
+struct Deadline {
+    uint32_t due_ms;
+    DeadlineKind kind;
+    char request_id[MAX_UUID_LENGTH + 1];
+};
+
+// Fixed-capacity binary min-heap of deadlines keyed by request_id.
+// Checking for an expired deadline only looks at the root, so polling it from
+// the loop is O(1); arming and cancelling are O(N) for the key lookup plus O(log N).
+// Times are millis() values and compared with signed differences, so wrap-around is fine.
+template <size_t N>
+class DeadlineHeap {
+private:
+    Deadline items[N];
+    size_t count;
+
+    static bool before(const Deadline& a, const Deadline& b) {
+        return (int32_t)(a.due_ms - b.due_ms) < 0;
+    }
+
+    void swap(size_t a, size_t b) {
+        Deadline tmp = items[a];
+        items[a] = items[b];
+        items[b] = tmp;
+    }
+
+    void siftUp(size_t i) {
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (!before(items[i], items[parent])) {
+                break;
+            }
+            swap(i, parent);
+            i = parent;
+        }
+    }
+
+    void siftDown(size_t i) {
+        for (;;) {
+            size_t smallest = i;
+            size_t left = 2 * i + 1;
+            size_t right = left + 1;
+            if (left < count && before(items[left], items[smallest])) {
+                smallest = left;
+            }
+            if (right < count && before(items[right], items[smallest])) {
+                smallest = right;
+            }
+            if (smallest == i) {
+                break;
+            }
+            swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    void removeAt(size_t i) {
+        count--;
+        if (i == count) {
+            return;
+        }
+        items[i] = items[count];
+        siftDown(i);
+        siftUp(i);
+    }
+
+    int find(const char* requestId, DeadlineKind kind) const {
+        for (size_t i = 0; i < count; i++) {
+            if (items[i].kind == kind && strcmp(items[i].request_id, requestId) == 0) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+public:
+    DeadlineHeap() : count(0) {}
+
+    // Arm (or re-arm) the deadline of kind for requestId. Returns false if the heap is full.
+    bool arm(const char* requestId, DeadlineKind kind, uint32_t dueMs) {
+        int existing = find(requestId, kind);
+        if (existing >= 0) {
+            removeAt((size_t)existing);
+        }
+        if (count == N) {
+            return false;
+        }
+        Deadline& d = items[count];
+        d.due_ms = dueMs;
+        d.kind = kind;
+        strncpy(d.request_id, requestId, sizeof(d.request_id) - 1);
+        d.request_id[sizeof(d.request_id) - 1] = '\0';
+        siftUp(count++);
+        return true;
+    }
+
+    void cancel(const char* requestId, DeadlineKind kind) {
+        int i = find(requestId, kind);
+        if (i >= 0) {
+            removeAt((size_t)i);
+        }
+    }
+
+    // Cancel every deadline of requestId. Removing one at a time would move unscanned items
+    // into scanned slots, so the survivors are compacted and the heap rebuilt in O(N).
+    void cancel(const char* requestId) {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(items[i].request_id, requestId) != 0) {
+                items[kept++] = items[i];
+            }
+        }
+        if (kept == count) {
+            return;
+        }
+        count = kept;
+        for (size_t i = count / 2; i-- > 0;) {
+            siftDown(i);
+        }
+    }
+
+    // Pop the earliest deadline if it is due at nowMs
+    bool popExpired(uint32_t nowMs, Deadline& expired) {
+        if (count == 0 || (int32_t)(nowMs - items[0].due_ms) < 0) {
+            return false;
+        }
+        expired = items[0];
+        removeAt(0);
+        return true;
+    }
+
+    const Deadline* next() const { return count ? &items[0] : nullptr; }
+    size_t size() const { return count; }
+    void clear() { count = 0; }
+    static size_t capacity() { return N; }
+};
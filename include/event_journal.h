@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Append-only journal of outgoing events in flash, so events survive broker outages and restarts.
+// Records are appended to a ring of sectors; sectors are used round robin and only erased when
+// the ring wraps onto them, which spreads the erase cycles evenly (wear levelling).
+// The oldest unacknowledged record is replayed with peek() and deleted with ack() once published.
+// Owned by the network task; not thread safe.
+
+#ifndef EVENT_JOURNAL_SECTORS
+#define EVENT_JOURNAL_SECTORS 16 // 4 KB flash sectors: 64 KB
+#endif
+
+// What happens when the ring is full of unacknowledged records
+#define EVENT_JOURNAL_DROP_OLDEST 0 // Erase the oldest sector, its events are lost
+#define EVENT_JOURNAL_DROP_NEWEST 1 // Reject the new event
+#ifndef EVENT_JOURNAL_OVERFLOW
+#define EVENT_JOURNAL_OVERFLOW EVENT_JOURNAL_DROP_OLDEST
+#endif
+
+#ifndef EVENT_JOURNAL_FILE
+#define EVENT_JOURNAL_FILE "event_journal.bin" // Native builds only
+#endif
+
+#define EVENT_JOURNAL_MAX_RECORD 1024
+
+// Record flags
+#define EVENT_JOURNAL_RETAINED 0x01
+
+struct EventJournalRecord
+{
+  uint8_t type;  // EventType
+  uint8_t flags; // EVENT_JOURNAL_*
+  uint16_t length;
+};
+
+struct EventJournalStats
+{
+  uint32_t appended;
+  uint32_t acked;
+  uint32_t dropped; // Lost to the overflow policy
+  uint32_t corrupt; // Skipped on replay (torn write, CRC mismatch)
+  uint32_t erases;
+};
+
+// Mount the journal and find the unacknowledged records of the last run
+bool event_journal_begin();
+
+bool event_journal_append(uint8_t type, uint8_t flags, const uint8_t *data, size_t length);
+
+// Copy the oldest unacknowledged record into data (capacity bytes), false if there is none
+bool event_journal_peek(EventJournalRecord *record, uint8_t *data, size_t capacity);
+
+// Delete the record returned by the last peek
+void event_journal_ack();
+
+size_t event_journal_pending();
+const EventJournalStats &event_journal_stats();
+
+// Erase everything
+void event_journal_format();
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+// Non-blocking user feedback (OLED, LCD and later buzzer/LED).
+// Transient feedback such as success/fail stays up for its duration while the
+// NFC task keeps polling and handling commands. Afterwards the base screen of the
+// current reader state is restored. Driven by feedback_loop(); only call from the NFC task.
+
+#define FEEDBACK_TIMER_SLOTS 4
+
+typedef void (*FeedbackCallback)();
+
+// One-shot timer, runs callback from feedback_loop() after delayMs.
+// Returns false if all slots are in use.
+bool feedback_schedule(uint32_t delayMs, FeedbackCallback callback);
+void feedback_cancel(FeedbackCallback callback);
+
+// Screen shown whenever no transient feedback is active. Drawn immediately if possible.
+void feedback_set_base(FeedbackCallback screen);
+
+// Draw screen now and restore the base screen after durationMs
+void feedback_show(FeedbackCallback screen, uint32_t durationMs);
+void feedback_success();
+void feedback_fail();
+
+bool feedback_active();
+
+void feedback_loop();
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Raw storage under the event journal, addressed in bytes and erased in sectors.
+// Writes behave like NOR flash: they can only clear bits, an erase sets a whole sector to 0xFF.
+// The device uses the (otherwise unused) spiffs data partition; native builds use a file
+// of the same layout (EVENT_JOURNAL_FILE) so the journal logic can be tested off target.
+
+// Open the storage and report its geometry, false if there is none
+bool journal_storage_begin(size_t *sectorSize, size_t *sectorCount);
+
+bool journal_storage_read(size_t offset, void *data, size_t length);
+bool journal_storage_write(size_t offset, const void *data, size_t length);
+bool journal_storage_erase(size_t sector);
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+// Single-pass JSON writer into a caller-provided buffer, for messages of a fixed shape.
+// No document, no allocation: keys are string literals whose length is known at compile time
+// and are written as they are; only string values are escaped. The output is compact and
+// escaped exactly like serializeJson() of ArduinoJson 6, so both produce the same bytes.
+// Writing past the end of the buffer stops the writer; overflowed() reports it.
+// The output is always null terminated.
+class JsonWriter {
+private:
+    char* buffer;
+    size_t capacity;  // Without the terminator
+    size_t used;
+    bool overflow;
+    bool comma;  // A value precedes in the current object
+
+    void raw(char c) {
+        if (used < capacity) {
+            buffer[used++] = c;
+        } else {
+            overflow = true;
+        }
+    }
+
+    void raw(const char* data, size_t length) {
+        if (length <= capacity - used) {
+            memcpy(buffer + used, data, length);
+            used += length;
+        } else {
+            overflow = true;
+        }
+    }
+
+    void terminate() {
+        buffer[used] = '\0';
+    }
+
+    void separator() {
+        if (comma) {
+            raw(',');
+        }
+    }
+
+public:
+    JsonWriter(char* out, size_t size) : buffer(out), capacity(size - 1), used(0), overflow(false), comma(false) {
+        terminate();
+    }
+
+    void beginObject() {
+        separator();
+        raw('{');
+        comma = false;
+        terminate();
+    }
+
+    void endObject() {
+        raw('}');
+        comma = true;
+        terminate();
+    }
+    
+    void beginArray() {
+        separator();
+        raw('[');
+        comma = false;
+        terminate();
+    }
+    
+    void endArray() {
+        raw(']');
+        comma = true;
+        terminate();
+    }
+    
+    // A value that is already serialized JSON, written as it is
+    void json(const char* value, size_t length) {
+        separator();
+        raw(value, length);
+        comma = true;
+        terminate();
+    }
+
+    // "name": (name is a string literal that needs no escaping)
+    template <size_t N>
+    void key(const char (&name)[N]) {
+        separator();
+        raw('"');
+        raw(name, N - 1);
+        raw("\":", 2);
+        comma = false;
+    }
+
+    // Values are preceded by a comma inside an array, after a key they are not
+    void string(const char* value) {
+        separator();
+        if (value == nullptr) {
+            raw("null", 4);
+        } else {
+            raw('"');
+            for (const char* c = value; *c != '\0' && !overflow; c++) {
+                switch (*c) {
+                case '"':  raw("\\\"", 2); break;
+                case '\\': raw("\\\\", 2); break;
+                case '\b': raw("\\b", 2); break;
+                case '\f': raw("\\f", 2); break;
+                case '\n': raw("\\n", 2); break;
+                case '\r': raw("\\r", 2); break;
+                case '\t': raw("\\t", 2); break;
+                default:   raw(*c); break;
+                }
+            }
+            raw('"');
+        }
+        comma = true;
+        terminate();
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type number(T value) {
+        separator();
+        if (value < 0) {
+            raw('-');
+            digits(0 - (uint64_t)value);
+        } else {
+            digits((uint64_t)value);
+        }
+        comma = true;
+        terminate();
+    }
+
+    void boolean(bool value) {
+        separator();
+        if (value) {
+            raw("true", 4);
+        } else {
+            raw("false", 5);
+        }
+        comma = true;
+        terminate();
+    }
+
+    // "name":value
+    template <size_t N>
+    void field(const char (&name)[N], const char* value) {
+        key(name);
+        string(value);
+    }
+
+    template <size_t N>
+    void field(const char (&name)[N], bool value) {
+        key(name);
+        boolean(value);
+    }
+
+    template <size_t N, typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type field(const char (&name)[N], T value) {
+        key(name);
+        number(value);
+    }
+
+    // "name":{
+    template <size_t N>
+    void beginObject(const char (&name)[N]) {
+        key(name);
+        beginObject();
+    }
+    
+    // "name":[
+    template <size_t N>
+    void beginArray(const char (&name)[N]) {
+        key(name);
+        beginArray();
+    }
+    
+    // Start over with an empty buffer
+    void reset() {
+        used = 0;
+        overflow = false;
+        comma = false;
+        terminate();
+    }
+    
+    // Take back everything written after position() returned mark, e.g. an array element
+    // that did not fit
+    size_t position() const { return used; }
+    void rewind(size_t mark) {
+        used = mark;
+        overflow = false;
+        comma = mark > 0 && buffer[mark - 1] != '{' && buffer[mark - 1] != '[' && buffer[mark - 1] != ':';
+        terminate();
+    }
+    
+    // Bytes left before the buffer is full
+    size_t available() const { return capacity - used; }
+
+    bool overflowed() const { return overflow; }
+
+    // Bytes written, 0 after an overflow
+    size_t length() const { return overflow ? 0 : used; }
+
+    const char* c_str() const { return buffer; }
+
+private:
+    void digits(uint64_t value) {
+        char reversed[20];
+        size_t count = 0;
+        do {
+            reversed[count++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (count > 0) {
+            raw(reversed[--count]);
+        }
+    }
+};
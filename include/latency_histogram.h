@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Fixed-memory streaming histogram with power-of-two buckets.
+// Bucket 0 counts zero, bucket b counts values in [2^(b-1), 2^b).
+// Recording never allocates and costs a count-leading-zeros plus a few adds,
+// so it can sit on the hot path. Percentiles are resolved to the bucket's upper bound.
+class LatencyHistogram {
+public:
+    static const uint8_t BUCKETS = 32;
+
+private:
+    uint32_t counts[BUCKETS];
+    uint32_t total;
+    uint64_t sum;
+    uint32_t maxValue;
+
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        memset(counts, 0, sizeof(counts));
+        total = 0;
+        sum = 0;
+        maxValue = 0;
+    }
+
+    void record(uint32_t value) {
+        uint8_t bucket = value == 0 ? 0 : (uint8_t)(32 - __builtin_clz(value));
+        if (bucket >= BUCKETS) {
+            bucket = BUCKETS - 1;
+        }
+        counts[bucket]++;
+        total++;
+        sum += value;
+        if (value > maxValue) {
+            maxValue = value;
+        }
+    }
+
+    uint32_t count() const { return total; }
+    uint32_t max() const { return maxValue; }
+    uint32_t mean() const { return total ? (uint32_t)(sum / total) : 0; }
+
+    // Upper bound of the bucket holding the p-th percentile (p = 0..100)
+    uint32_t percentile(uint8_t p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint32_t rank = (uint32_t)(((uint64_t)total * p + 99) / 100);
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint32_t seen = 0;
+        for (uint8_t b = 0; b < BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank) {
+                if (b == BUCKETS - 1) {
+                    return maxValue;
+                }
+                uint32_t upper = b == 0 ? 0 : (1UL << b) - 1;
+                return upper < maxValue ? upper : maxValue;
+            }
+        }
+        return maxValue;
+    }
+};
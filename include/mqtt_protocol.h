@@ -5,6 +5,7 @@
 #include "mqtt_schema.h"
 #include "mqtt_types.h"
 #include "mqtt_serialization.h"
+#include "mqtt_topics.h"
 
 // MQTT Message Builder - helps construct messages to send
 class MQTTMessageBuilder {
@@ -12,6 +13,14 @@ private:
     char deviceId[MAX_DEVICE_ID_LENGTH + 1];
     StaticJsonDocument<MQTT_EVENT_DOC_SIZE> doc;
     char buffer[1024];
+    size_t messageLength;
+    int64_t eventTimeMs;
+    bool eventTimeSynced;
+    TimestampFormatter timestamps;
+    PayloadEncoding encoding;
+    char batchBuffer[1024];
+    JsonWriter batch;
+    uint8_t batchCount;
     
 public:
     MQTTMessageBuilder();
@@ -19,6 +28,22 @@ public:
     // Set the device ID for all messages
     void setDeviceId(const char* id);
     
+    // Timestamp of the following messages in Unix milliseconds, e.g. for events that
+    // were buffered while offline. 0 stamps each message with the time it is built.
+    // A time taken before the first time sync (synced false) is flagged in the envelope.
+    void setEventTime(int64_t unixMs, bool synced = true) {
+        eventTimeMs = unixMs;
+        eventTimeSynced = synced;
+    }
+    
+    // Encoding of the following messages. MessagePack messages are binary (not null terminated)
+    // and carry MQTT_PROTOCOL_VERSION_MSGPACK; use length() for their size.
+    void setEncoding(PayloadEncoding payloadEncoding) { encoding = payloadEncoding; }
+    PayloadEncoding getEncoding() const { return encoding; }
+    
+    // Size in bytes of the last built message
+    size_t length() const { return messageLength; }
+    
     // Build event messages (Device → Service)
     const char* buildStatusChange(const char* requestId, const StatusChangePayload& payload);
     const char* buildModeChange(const char* requestId, const ModeChangePayload& payload);
@@ -31,27 +56,54 @@ public:
     const char* buildReadSuccess(const char* requestId, const ReadSuccessPayload& payload);
     const char* buildReadError(const char* requestId, const ErrorPayload& payload);
     const char* buildHeartbeat(const char* requestId, const HeartbeatPayload& payload);
+    const char* buildTagRemoved(const char* requestId, const TagRemovedPayload& payload);
+    const char* buildTapTrace(const char* requestId, const TapTracePayload& payload);
+    
+    // Batched events: one "batch" message whose payload.events holds complete event messages,
+    // so a consumer hands each element to its handler for that event type. Start a batch,
+    // build each event as usual and add it, then finish the batch. JSON only.
+    void beginBatch(const char* requestId);
+    // Add the message built last; false if it does not fit (the batch is unchanged) or the
+    // encoding is not JSON
+    bool addToBatch();
+    uint8_t batchSize() const { return batchCount; }
+    // The batch message, nullptr if it could not be built; length() is its size
+    const char* endBatch();
     
 private:
+    // JSON messages of payloads with a writer are written straight into the buffer,
+    // everything else goes through the document
     const char* buildMessage(EventType eventType, const char* requestId, 
                             bool (*serializePayload)(JsonObject, const void*), 
+                            bool (*writePayload)(JsonWriter&, const void*),
                             const void* payload);
 };
 
 // MQTT Message Parser - helps parse received command messages
 class MQTTMessageParser {
 private:
-    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
-    MQTTMessageEnvelope envelope;
+    StaticJsonDocument<MQTT_COMMAND_INPLACE_DOC_SIZE> doc;
+    char input[MQTT_COMMAND_BUFFER_SIZE];
+    MQTTEnvelopeView envelope;
+    PayloadEncoding encoding;
     
 public:
     MQTTMessageParser();
     
     // Parse a received message
     bool parse(const char* jsonBuffer);
+    // Parse a received JSON or MessagePack message; the protocol version must match the encoding.
+    // The message is copied once into the parser's buffer and parsed there in place.
+    bool parse(const uint8_t* data, size_t length);
+    // Parse in place without any copy: data is modified and must stay untouched until the
+    // payload has been parsed (the envelope and the document point into it)
+    bool parseInPlace(char* data, size_t length);
+    
+    // Encoding of the last parsed message
+    PayloadEncoding getEncoding() const { return encoding; }
     
     // Get the parsed envelope
-    const MQTTMessageEnvelope& getEnvelope() const { return envelope; }
+    const MQTTEnvelopeView& getEnvelope() const { return envelope; }
     
     // Get command type
     CommandType getCommandType() const;
@@ -59,8 +111,10 @@ public:
     // Parse command payloads
     bool parseRegisterStart(RegisterStartPayload& payload);
     bool parseAuthStart(AuthStartPayload& payload);
+    bool parseAuthPrearm(AuthStartPayload& payload);
     bool parseAuthVerify(AuthVerifyPayload& payload);
     bool parseReadStart(ReadStartPayload& payload);
+    bool parseAuthCacheSync(AuthCacheSyncPayload& payload);
     bool isCancel() const;
     bool isReset() const;
     
@@ -68,43 +122,3 @@ public:
     const char* getRequestId() const { return envelope.request_id; }
     const char* getDeviceId() const { return envelope.device_id; }
 };
-
-// Topic Builder - constructs MQTT topic strings
-class MQTTTopicBuilder {
-private:
-    char deviceId[MAX_DEVICE_ID_LENGTH + 1];
-    char topicBuffer[256];
-    
-public:
-    MQTTTopicBuilder();
-    
-    void setDeviceId(const char* id);
-    
-    // Command topics (Subscribe - Service → Device)
-    const char* registerStart();
-    const char* registerCancel();
-    const char* authStart();
-    const char* authVerify();
-    const char* authCancel();
-    const char* readStart();
-    const char* readCancel();
-    const char* reset();
-    
-    // Event topics (Publish - Device → Service)
-    const char* registerSuccess();
-    const char* registerError();
-    const char* authTagDetected();
-    const char* authSuccess();
-    const char* authFailed();
-    const char* authError();
-    const char* readSuccess();
-    const char* readError();
-    
-    // State topics (Publish with retain - Device → Service)
-    const char* status();
-    const char* mode();
-    const char* heartbeat();
-    
-    // Wildcard subscription helpers
-    const char* allCommands();  // Subscribe to all command topics
-};
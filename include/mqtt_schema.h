@@ -16,6 +16,17 @@ struct MQTTMessageEnvelope {
     JsonObject payload;                         // Event-specific payload data
 };
 
+// Envelope of a received message, parsed in place: the strings point into the parser's
+// input buffer and stay valid until the next message is parsed
+struct MQTTEnvelopeView {
+    const char* version;
+    const char* timestamp;
+    const char* device_id;
+    const char* event_type;
+    const char* request_id;
+    JsonObject payload;
+};
+
 // User Data for authentication
 struct UserData {
     char username[MAX_USERNAME_LENGTH + 1];
@@ -42,12 +53,38 @@ struct RegisterStartPayload {
     }
 };
 
-// Auth Start Command
+// Candidate keys per auth_start / auth_prearm
+#define AUTH_START_MAX_KEYS 4
+
+// Key the backend expects for a tag
+struct AuthKeyCandidate {
+    char tag_uid[MAX_TAG_UID_LENGTH + 1];      // Empty -> valid for any tag
+    char key[MAX_HEX_KEY_LENGTH + 1];          // 32-character hex encryption key
+    
+    void clear() {
+        memset(tag_uid, 0, sizeof(tag_uid));
+        memset(key, 0, sizeof(key));
+    }
+};
+
+// Auth Start Command (also used for auth_prearm)
 struct AuthStartPayload {
     int timeout_seconds;                        // Operation timeout in seconds
+    int session_duration_seconds;               // Continuous session: stay armed this long, 0 = no time limit
+    int session_max_taps;                       // Continuous session: stay armed for this many taps, 0 = no limit
+    uint8_t key_count;                          // 0 -> auth_tag_detected / AUTH_VERIFY flow
+    AuthKeyCandidate keys[AUTH_START_MAX_KEYS]; // Optional candidate keys
+    UserData user_data;                         // Echoed when authenticated with a candidate key
     
     void clear() {
         timeout_seconds = 0;
+        session_duration_seconds = 0;
+        session_max_taps = 0;
+        key_count = 0;
+        for (uint8_t i = 0; i < AUTH_START_MAX_KEYS; i++) {
+            keys[i].clear();
+        }
+        user_data.clear();
     }
 };
 
@@ -73,6 +110,44 @@ struct ReadStartPayload {
     }
 };
 
+// Entries per auth_cache_sync message; larger caches are synced in several messages
+#define AUTH_CACHE_SYNC_MAX_ENTRIES 4
+
+// Permission bits of a cached authorization
+#define AUTH_PERMISSION_ACCESS 0x01
+
+// One authorization for the offline auth cache
+struct AuthCacheEntryPayload {
+    char tag_uid[MAX_TAG_UID_LENGTH + 1];      // NFC tag UID
+    char key[MAX_HEX_KEY_LENGTH + 1];          // Expected card key, empty -> revoke the tag
+    uint32_t permissions;                       // AUTH_PERMISSION_* bits
+    uint32_t expires_at;                        // Unix time in seconds, 0 = never expires
+    char username[MAX_CACHE_USERNAME_LENGTH + 1]; // Echoed in auth_success
+    
+    void clear() {
+        memset(tag_uid, 0, sizeof(tag_uid));
+        memset(key, 0, sizeof(key));
+        permissions = 0;
+        expires_at = 0;
+        memset(username, 0, sizeof(username));
+    }
+};
+
+// Auth Cache Sync Command
+struct AuthCacheSyncPayload {
+    bool replace;                               // Drop all cached authorizations first
+    uint8_t entry_count;
+    AuthCacheEntryPayload entries[AUTH_CACHE_SYNC_MAX_ENTRIES];
+    
+    void clear() {
+        replace = false;
+        entry_count = 0;
+        for (uint8_t i = 0; i < AUTH_CACHE_SYNC_MAX_ENTRIES; i++) {
+            entries[i].clear();
+        }
+    }
+};
+
 // Event Payloads (Device → Service)
 
 // Status Change Event
@@ -166,16 +241,57 @@ struct ErrorPayload {
     }
 };
 
-// Heartbeat Event
+// Distribution of a latency, from a LatencyHistogram (percentiles are bucket upper bounds)
+struct HeartbeatLatency {
+    uint32_t count;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t max;
+};
+
+// Taps decided by one DecisionTier
+struct HeartbeatTier {
+    HeartbeatLatency decision_ms;               // Tag detected to result
+    uint32_t pn532_errors;                      // Failed decisions caused by the PN532
+    uint32_t pn532_timeouts;                    // Of these, card too far away
+};
+
+#define HEARTBEAT_TIER_COUNT ((size_t)DecisionTier::COUNT)
+
+// Heartbeat Event. Counters and latencies are totals since boot.
 struct HeartbeatPayload {
     unsigned long uptime_seconds;               // Device uptime in seconds
     float memory_usage_percent;                 // Memory usage percentage
-    unsigned int operations_completed;          // Total operations completed
+    unsigned int operations_completed;          // Total operations completed (taps decided)
+    
+    // Memory
+    uint32_t free_heap;
+    uint32_t min_free_heap;                     // Low-water mark since boot
+    uint32_t largest_free_block;
+    
+    // RF field
+    uint32_t rf_polls;                          // Polls of the field for a tag
+    uint32_t rf_taps;                           // New tags found
+    uint32_t rf_pn532_errors;                   // Failed polls
+    uint32_t rf_pn532_timeouts;
+    
+    HeartbeatTier tiers[HEARTBEAT_TIER_COUNT];  // By DecisionTier
+    
+    // Time of one loop iteration of each task
+    HeartbeatLatency reader_loop_us;
+    HeartbeatLatency network_loop_us;
+    
+    // Queue depths
+    uint8_t command_queue;
+    uint8_t control_queue;
+    uint8_t event_queue;
+    uint8_t publish_queue;
+    uint16_t journal_pending;
+    uint32_t command_rejected;                  // Commands answered with NFC_DEVICE_BUSY, lane full
+    uint32_t control_rejected;
     
     void clear() {
-        uptime_seconds = 0;
-        memory_usage_percent = 0.0;
-        operations_completed = 0;
+        memset(this, 0, sizeof(*this));
     }
 };
 
@@ -189,3 +305,36 @@ struct ReadSuccessPayload {
         memset(message, 0, sizeof(message));
     }
 };
+
+// Tag Removed Event
+struct TagRemovedPayload {
+    char tag_uid[MAX_TAG_UID_LENGTH + 1];      // Tag UID
+    uint32_t present_ms;                        // Time the tag was in the RF field
+    
+    void clear() {
+        memset(tag_uid, 0, sizeof(tag_uid));
+        present_ms = 0;
+    }
+};
+
+// One timed step of a tap
+struct TraceSpanRecord {
+    TraceSpan span;
+    uint32_t start_us;                          // Since the tap started
+    uint32_t duration_us;
+};
+
+#define TAP_TRACE_MAX_SPANS 12
+
+// Tap Trace Event (debug): where the time of one tap went
+struct TapTracePayload {
+    int64_t started_us;                         // esp_timer time of the tap start (not sent)
+    uint32_t total_us;                          // Tap start to the result being shown
+    uint8_t count;
+    uint8_t dropped;                            // Spans that did not fit
+    TraceSpanRecord spans[TAP_TRACE_MAX_SPANS]; // In the order they ended
+    
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+};
@@ -6,26 +6,76 @@
 #include <ArduinoJson.h>
 #include "mqtt_schema.h"
 #include "mqtt_types.h"
+#include "json_writer.h"
 
 // Document sizes for JSON serialization
 // Calculated using https://arduinojson.org/v6/assistant/
 #define MQTT_ENVELOPE_DOC_SIZE 512
-#define MQTT_COMMAND_DOC_SIZE 768
-#define MQTT_EVENT_DOC_SIZE 1024
+// Heartbeat with its telemetry, the largest event: envelope, payload, heap, rf, tiers,
+// loop_us, queues, and the strings the envelope copies
+#define MQTT_HEARTBEAT_LATENCY_SIZE JSON_ARRAY_SIZE(4)
+#define MQTT_HEARTBEAT_DOC_SIZE (JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(8) + JSON_OBJECT_SIZE(3) + \
+                                 JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(HEARTBEAT_TIER_COUNT) + \
+                                 HEARTBEAT_TIER_COUNT * (JSON_OBJECT_SIZE(3) + MQTT_HEARTBEAT_LATENCY_SIZE) + \
+                                 JSON_OBJECT_SIZE(2) + 2 * MQTT_HEARTBEAT_LATENCY_SIZE + JSON_OBJECT_SIZE(7) + 128)
+#define MQTT_EVENT_DOC_SIZE (MQTT_HEARTBEAT_DOC_SIZE > 1024 ? MQTT_HEARTBEAT_DOC_SIZE : 1024)
+// Commands are parsed in place, so the document holds no strings, only its slots
+// (MQTTMessageParser). The most are in auth_cache_sync: envelope, payload, the entries array
+// and the members of AUTH_CACHE_SYNC_MAX_ENTRIES entries. JSON_*_SIZE counts in slots, which
+// are twice as large on 64-bit hosts (sim, native) as on the ESP32.
+#define MQTT_COMMAND_SLOTS_SIZE (JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(2) + \
+                                 JSON_ARRAY_SIZE(AUTH_CACHE_SYNC_MAX_ENTRIES) + \
+                                 AUTH_CACHE_SYNC_MAX_ENTRIES * JSON_OBJECT_SIZE(5))
+#define MQTT_COMMAND_INPLACE_DOC_SIZE (MQTT_COMMAND_SLOTS_SIZE > 768 ? MQTT_COMMAND_SLOTS_SIZE : 768)
+#define MQTT_COMMAND_BUFFER_SIZE 1024 // Largest received command
+// A command deserialized from a read-only string (tests, tools): the document also holds a
+// copy of every string, which together are never longer than the message
+#define MQTT_COMMAND_DOC_SIZE (MQTT_COMMAND_SLOTS_SIZE + MQTT_COMMAND_BUFFER_SIZE)
 
 // Utility functions for generating timestamps and UUIDs
+// Current time of time_service.h
 void generateTimestamp(char* buffer, size_t bufferSize);
+void formatTimestamp(char* buffer, size_t bufferSize, int64_t unixMs);
 void generateUUID(char* buffer, size_t bufferSize);
 
+#define MQTT_TIMESTAMP_LENGTH 24  // 2025-11-11T12:00:00.000Z
+
+// formatTimestamp() for timestamps that mostly fall into the same minute: the date, hours and
+// minutes are formatted once per minute, after that only the seconds and milliseconds digits
+// are written. Same output as formatTimestamp().
+class TimestampFormatter {
+private:
+    int64_t minute;  // Unix minute of prefix
+    char prefix[MQTT_TIMESTAMP_LENGTH + 1];  // 2025-11-11T12:00:
+    
+public:
+    TimestampFormatter() : minute(-1) {}
+    
+    void format(char* buffer, size_t bufferSize, int64_t unixMs);
+};
+
+// Payload encoding (JSON or MessagePack)
+// Encoding of a received message, told apart by its first byte (JSON object or MessagePack map)
+PayloadEncoding detectEncoding(const uint8_t* data, size_t length);
+const char* protocolVersionFor(PayloadEncoding encoding);
+// Encoded size, 0 if it does not fit into the buffer. JSON output is null terminated.
+size_t encodeDocument(const JsonDocument& doc, PayloadEncoding encoding, uint8_t* buffer, size_t bufferSize);
+DeserializationError decodeDocument(JsonDocument& doc, const uint8_t* data, size_t length, PayloadEncoding encoding);
+// Zero-copy: the strings of the document point into data, which is modified and must outlive the document
+DeserializationError decodeDocumentInPlace(JsonDocument& doc, char* data, size_t length, PayloadEncoding encoding);
+
 // Message Envelope serialization
 bool serializeEnvelope(const MQTTMessageEnvelope& envelope, char* jsonBuffer, size_t bufferSize);
 bool deserializeEnvelope(const char* jsonBuffer, MQTTMessageEnvelope& envelope, StaticJsonDocument<MQTT_ENVELOPE_DOC_SIZE>& doc);
+bool deserializeEnvelope(const uint8_t* data, size_t length, MQTTMessageEnvelope& envelope, StaticJsonDocument<MQTT_ENVELOPE_DOC_SIZE>& doc);
 
 // Command Payload Deserialization (Service → Device)
 bool deserializeRegisterStart(JsonObject payload, RegisterStartPayload& data);
 bool deserializeAuthStart(JsonObject payload, AuthStartPayload& data);
+bool deserializeAuthPrearm(JsonObject payload, AuthStartPayload& data);
 bool deserializeAuthVerify(JsonObject payload, AuthVerifyPayload& data);
 bool deserializeReadStart(JsonObject payload, ReadStartPayload& data);
+bool deserializeAuthCacheSync(JsonObject payload, AuthCacheSyncPayload& data);
 
 // Event Payload Serialization (Device → Service)
 bool serializeStatusChange(JsonObject payload, const StatusChangePayload& data);
@@ -37,6 +87,27 @@ bool serializeAuthFailed(JsonObject payload, const AuthFailedPayload& data);
 bool serializeError(JsonObject payload, const ErrorPayload& data);
 bool serializeHeartbeat(JsonObject payload, const HeartbeatPayload& data);
 bool serializeReadSuccess(JsonObject payload, const ReadSuccessPayload& data);
+bool serializeTagRemoved(JsonObject payload, const TagRemovedPayload& data);
+bool serializeTapTrace(JsonObject payload, const TapTracePayload& data);
+
+// Event messages written straight into the output buffer (JSON only). The output is byte for
+// byte what serializeJson() gives for the envelope and the serialize* functions above.
+// writeEnvelopeStart() opens the envelope and its payload object, the payload writers add
+// the fields of the payload and writeEnvelopeEnd() closes both. A timestamp taken before the
+// first time sync (the time since boot) is flagged with "time_synced": false.
+void writeEnvelopeStart(JsonWriter& out, const char* timestamp, const char* deviceId,
+                        EventType eventType, const char* requestId, bool timeSynced = true);
+void writeEnvelopeEnd(JsonWriter& out);
+bool writeStatusChange(JsonWriter& out, const StatusChangePayload& data);
+bool writeModeChange(JsonWriter& out, const ModeChangePayload& data);
+bool writeTagDetected(JsonWriter& out, const TagDetectedPayload& data);
+bool writeRegisterSuccess(JsonWriter& out, const RegisterSuccessPayload& data);
+bool writeAuthSuccess(JsonWriter& out, const AuthSuccessPayload& data);
+bool writeAuthFailed(JsonWriter& out, const AuthFailedPayload& data);
+bool writeError(JsonWriter& out, const ErrorPayload& data);
+bool writeReadSuccess(JsonWriter& out, const ReadSuccessPayload& data);
+bool writeTagRemoved(JsonWriter& out, const TagRemovedPayload& data);
+bool writeTapTrace(JsonWriter& out, const TapTracePayload& data);
 
 // Helper functions for payload serialization/deserialization
 bool serializeUserData(JsonObject obj, const UserData& userData);
@@ -44,6 +115,8 @@ bool deserializeUserData(JsonObject obj, UserData& userData);
 
 // Validation functions
 bool isValidTagUID(const char* uid);
+// "04:A1:B2" -> binary, zero padded to binaryLen
+bool tagUidToBinary(const char* uid, uint8_t* binary, size_t binaryLen);
 bool isValidHexKey(const char* key);
 bool isValidUUID(const char* uuid);
 bool isValidDeviceId(const char* deviceId);
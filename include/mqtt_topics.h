@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mqtt_types.h"
+
+// MQTT topics of one device: devices/<device_id>/<suffix>
+enum class MQTTTopic : uint8_t {
+    // Command topics (Subscribe - Service → Device)
+    REGISTER_START,
+    REGISTER_CANCEL,
+    AUTH_START,
+    AUTH_VERIFY,
+    AUTH_CANCEL,
+    READ_START,
+    READ_CANCEL,
+    RESET,
+    AUTH_CACHE_SYNC,
+    AUTH_PREARM,
+    
+    // Event topics (Publish - Device → Service)
+    REGISTER_SUCCESS,
+    REGISTER_ERROR,
+    AUTH_TAG_DETECTED,
+    AUTH_SUCCESS,
+    AUTH_FAILED,
+    AUTH_ERROR,
+    READ_SUCCESS,
+    READ_ERROR,
+    TAG_REMOVED,
+    BATCH,
+    TAP_TRACE,
+    
+    // State topics (Publish with retain - Device → Service)
+    STATUS,
+    MODE,
+    HEARTBEAT,
+    
+    // Wildcard subscription
+    ALL_COMMANDS,
+    
+    COUNT
+};
+
+#define MQTT_TOPIC_COUNT ((size_t)MQTTTopic::COUNT)
+
+// Command topics are in the order of CommandType
+static_assert((int)MQTTTopic::AUTH_PREARM == (int)CommandType::AUTH_PREARM, "command topics out of order");
+
+// Command received on a topic, CommandType::UNKNOWN for the other topics
+inline CommandType commandForTopic(MQTTTopic topic) {
+    return topic <= MQTTTopic::AUTH_PREARM ? (CommandType)topic : CommandType::UNKNOWN;
+}
+// Bytes of all suffixes in the topic table with their terminators (checked against the table
+// in mqtt_topics.cpp, so a new topic that does not update it fails the build)
+#define MQTT_TOPIC_SUFFIX_BYTES 282
+// devices/<device_id>/ with the longest device id
+#define MQTT_TOPIC_PREFIX_MAX (sizeof("devices/") - 1 + MAX_DEVICE_ID_LENGTH + 1)
+// Every topic with the longest device id, back to back
+#define MQTT_TOPIC_ARENA_SIZE (MQTT_TOPIC_COUNT * MQTT_TOPIC_PREFIX_MAX + MQTT_TOPIC_SUFFIX_BYTES)
+
+// Topic Builder - all topics of the device are formatted once by setDeviceId() into one
+// arena, the getters only return pointers into it. The pointers stay valid (and every topic
+// can be held at the same time) until the device id changes.
+class MQTTTopicBuilder {
+private:
+    char arena[MQTT_TOPIC_ARENA_SIZE];
+    uint16_t offsets[MQTT_TOPIC_COUNT];
+    uint16_t prefixLength;  // devices/<device_id>/
+    
+public:
+    MQTTTopicBuilder();
+    
+    void setDeviceId(const char* id);
+    
+    const char* topic(MQTTTopic topic) const { return arena + offsets[(size_t)topic]; }
+    
+    // Topic a message was received on, for a single wildcard subscription. The device prefix is
+    // compared once, the suffix is resolved by switching on the characters that tell the topics
+    // apart and confirmed with one compare. MQTTTopic::COUNT if it is not a topic of this device.
+    MQTTTopic route(const char* topic, size_t length) const;
+    
+    // Command topics (Subscribe - Service → Device)
+    const char* registerStart() const { return topic(MQTTTopic::REGISTER_START); }
+    const char* registerCancel() const { return topic(MQTTTopic::REGISTER_CANCEL); }
+    const char* authStart() const { return topic(MQTTTopic::AUTH_START); }
+    const char* authVerify() const { return topic(MQTTTopic::AUTH_VERIFY); }
+    const char* authCancel() const { return topic(MQTTTopic::AUTH_CANCEL); }
+    const char* readStart() const { return topic(MQTTTopic::READ_START); }
+    const char* readCancel() const { return topic(MQTTTopic::READ_CANCEL); }
+    const char* reset() const { return topic(MQTTTopic::RESET); }
+    const char* authCacheSync() const { return topic(MQTTTopic::AUTH_CACHE_SYNC); }
+    const char* authPrearm() const { return topic(MQTTTopic::AUTH_PREARM); }
+    
+    // Event topics (Publish - Device → Service)
+    const char* registerSuccess() const { return topic(MQTTTopic::REGISTER_SUCCESS); }
+    const char* registerError() const { return topic(MQTTTopic::REGISTER_ERROR); }
+    const char* authTagDetected() const { return topic(MQTTTopic::AUTH_TAG_DETECTED); }
+    const char* authSuccess() const { return topic(MQTTTopic::AUTH_SUCCESS); }
+    const char* authFailed() const { return topic(MQTTTopic::AUTH_FAILED); }
+    const char* authError() const { return topic(MQTTTopic::AUTH_ERROR); }
+    const char* readSuccess() const { return topic(MQTTTopic::READ_SUCCESS); }
+    const char* readError() const { return topic(MQTTTopic::READ_ERROR); }
+    const char* tagRemoved() const { return topic(MQTTTopic::TAG_REMOVED); }
+    const char* batch() const { return topic(MQTTTopic::BATCH); }
+    const char* tapTrace() const { return topic(MQTTTopic::TAP_TRACE); }
+    
+    // State topics (Publish with retain - Device → Service)
+    const char* status() const { return topic(MQTTTopic::STATUS); }
+    const char* mode() const { return topic(MQTTTopic::MODE); }
+    const char* heartbeat() const { return topic(MQTTTopic::HEARTBEAT); }
+    
+    // Wildcard subscription helpers
+    const char* allCommands() const { return topic(MQTTTopic::ALL_COMMANDS); }  // Subscribe to all command topics
+};
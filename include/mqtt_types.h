@@ -7,6 +7,8 @@
 
 // MQTT Protocol Version
 #define MQTT_PROTOCOL_VERSION "1.0"
+// Same schema, payloads encoded as MessagePack instead of JSON
+#define MQTT_PROTOCOL_VERSION_MSGPACK "1.1"
 
 // Maximum lengths for various fields
 #define MAX_TAG_UID_LENGTH 32
@@ -18,6 +20,14 @@
 #define MAX_CONTEXT_LENGTH 256
 #define MAX_FIRMWARE_VERSION_LENGTH 16
 #define MAX_IP_ADDRESS_LENGTH 16
+#define MAX_CACHE_USERNAME_LENGTH 32
+
+// Wire encoding of a message, announced by its protocol version. The firmware itself only
+// sends and accepts JSON: EspMQTTClient passes payloads as NUL-terminated Strings.
+enum class PayloadEncoding {
+    JSON,
+    MSGPACK
+};
 
 // Event Types - Commands (Service → Device)
 enum class CommandType {
@@ -29,6 +39,8 @@ enum class CommandType {
     READ_START,
     READ_CANCEL,
     RESET,
+    AUTH_CACHE_SYNC,
+    AUTH_PREARM,
     UNKNOWN
 };
 
@@ -45,6 +57,9 @@ enum class EventType {
     STATUS_CHANGE,
     MODE_CHANGE,
     HEARTBEAT,
+    TAG_REMOVED,
+    BATCH,  // Several of the above in one message
+    TAP_TRACE,  // Timing breakdown of a tap (debug)
     UNKNOWN
 };
 
@@ -89,6 +104,29 @@ enum class ErrorComponent {
     PROTOCOL
 };
 
+// How a tap was decided (heartbeat telemetry)
+enum class DecisionTier : uint8_t {
+    KEYED,    // Key material of auth_start/auth_prearm
+    CACHED,   // Offline auth cache
+    BACKEND,  // Round trip for auth_verify
+    OFFLINE,  // No backend and not in the cache
+    COUNT
+};
+
+// Timed steps of a tap (tap_trace)
+enum class TraceSpan : uint8_t {
+    READ_CARD,  // Poll that found the tag
+    PICC_AUTH,  // PICC master key authentication
+    APP_AUTH,   // Application authentication and secret check
+    FILE_READ,  // Reading a file of the application
+    CRYPTO,     // Key derivation
+    BACKEND,    // auth_tag_detected to auth_verify
+    DISPLAY,    // Drawing a screen
+    BUILD,      // Serializing a message
+    PUBLISH,    // client.publish()
+    COUNT
+};
+
 // Helper functions to convert enums to/from strings
 const char* commandTypeToString(CommandType type);
 CommandType stringToCommandType(const char* str);
@@ -107,3 +145,6 @@ ErrorCode stringToErrorCode(const char* str);
 
 const char* errorComponentToString(ErrorComponent component);
 ErrorComponent stringToErrorComponent(const char* str);
+
+const char* decisionTierToString(DecisionTier tier);
+const char* traceSpanToString(TraceSpan span);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Network task side of the firmware.
+// Owns the EspMQTTClient, parses commands into ReaderCommands and
+// serializes/publishes the ReaderEvents produced by the NFC task.
+
+struct MqttSettings
+{
+  String url;
+  String usr;
+  String pw;
+  String id;
+  String SSID;
+  String KEY;
+  int port;
+};
+
+// settings must outlive the client (EspMQTTClient keeps the raw pointers)
+void network_begin(const MqttSettings &settings, const String &deviceId);
+void network_loop();
+
+// Safe to call from any task
+bool network_is_online();
+
+// Admission of parsed commands into one lane to the NFC task
+struct CommandLaneStats
+{
+  uint32_t accepted;
+  uint32_t rejected; // Lane full, answered with NFC_DEVICE_BUSY
+  uint8_t depth;     // Depth after the last accepted command
+  uint8_t max_depth;
+};
+
+struct CommandQueueStats
+{
+  CommandLaneStats control;
+  CommandLaneStats commands;
+};
+
+// Maintained by the network task, the rejections also go out with the heartbeat
+void network_print_command_queue_stats();
+
+// Outbound publish queue (see publish_queue.h)
+void network_print_publish_queue_stats();
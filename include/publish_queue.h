@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "latency_histogram.h"
+
+// Outbound messages between serialization and client.publish(), in fixed slots.
+// Two priority classes: retained state (status, mode) goes out before events. A retained
+// message replaces a queued one of the same type, only the latest state is worth sending.
+// Within a class messages go out oldest first; a failed publish is retried after a backoff
+// and holds back the younger messages of its class, so the order on every topic is kept.
+// Owned by the network task; not thread safe.
+
+#ifndef PUBLISH_QUEUE_SLOTS
+#define PUBLISH_QUEUE_SLOTS 8
+#endif
+
+#define PUBLISH_QUEUE_MAX_MESSAGE 1024 // Size of the message builder's buffer
+#define PUBLISH_QUEUE_MAX_ATTEMPTS 3
+#define PUBLISH_QUEUE_RETRY_MS 100 // Doubles with every failed attempt
+
+// Message flags
+#define PUBLISH_RETAINED 0x01
+#define PUBLISH_NO_SPILL 0x02 // Dropped instead of journaled, worthless once late (telemetry)
+
+struct PublishMessage
+{
+  uint8_t type;     // EventType
+  uint8_t flags;    // PUBLISH_*
+  uint8_t attempts; // Failed publishes so far
+  bool used;
+  uint16_t length;
+  uint32_t seq;       // Queue order
+  uint32_t queued_ms; // When it was queued (first queued, for a coalesced message)
+  uint32_t retry_ms;  // Not before
+  char data[PUBLISH_QUEUE_MAX_MESSAGE + 1];
+};
+
+struct PublishQueueStats
+{
+  uint32_t queued;
+  uint32_t published;
+  uint32_t coalesced; // Retained messages replaced by a newer one before they went out
+  uint32_t retries;   // Failed publishes that were retried
+  uint32_t spilled;   // Handed over to the event journal (queue full, out of attempts, offline)
+  uint32_t dropped;   // PUBLISH_NO_SPILL messages taken out instead of spilled
+  uint8_t depth;
+  uint8_t max_depth;
+  LatencyHistogram latency; // ms from queued to published
+};
+
+// Queue a message (data need not be null terminated), false if the queue is full or the
+// message too large. now is millis(). A message is not sent before delay ms have passed; a
+// retained message that replaces a queued one keeps the time that one is due.
+bool publish_queue_push(uint8_t type, uint8_t flags, const char *data, size_t length, uint32_t now,
+                        uint32_t delay = 0);
+
+// Next message that is due: the oldest state message, else the oldest event. nullptr if there
+// is none or the oldest of each class waits for its retry. Without state only events are
+// returned, state waits (while older state is still replayed from the journal).
+PublishMessage *publish_queue_next(uint32_t now, bool withState = true);
+
+// Oldest message regardless of class and retry time, to move it elsewhere
+PublishMessage *publish_queue_oldest();
+
+// Outcome of publishing a message returned by next()
+void publish_queue_published(PublishMessage *message, uint32_t now);
+// Schedules the retry; false once the message is out of attempts (it stays queued)
+bool publish_queue_failed(PublishMessage *message, uint32_t now);
+
+// Take a message out without publishing it, counted as spilled
+void publish_queue_spill(PublishMessage *message);
+// Take a message out without publishing it, counted as dropped
+void publish_queue_drop(PublishMessage *message);
+
+size_t publish_queue_depth();
+const PublishQueueStats &publish_queue_stats();
+
+void publish_queue_clear();
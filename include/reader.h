@@ -0,0 +1,10 @@
+#pragma once
+
+#include "reader_messages.h"
+
+// NFC task side of the firmware.
+// Owns the PN532, the displays and the reader state (mode + card state).
+// Consumes ReaderCommands from reader_commands and produces ReaderEvents on reader_events.
+
+void reader_begin();
+void reader_loop();
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "latency_histogram.h"
+
+// Table-driven reader state machine (states x inputs -> action, next state).
+// The mode (auth/read/register) is folded into the state so every transition is one table row.
+
+enum class ReaderState : uint8_t {
+    IDLE,
+    AUTH_WAIT_CARD,
+    AUTH_WAIT_VERIFY,
+    READ_WAIT_CARD,
+    REGISTER_WAIT_CARD,
+    OFFLINE,  // Idle without a backend: taps are decided by the offline auth cache
+    COUNT,
+    ANY  // Table wildcard: row applies to every state without a more specific row
+};
+
+enum class ReaderInput : uint8_t {
+    AUTH_START,
+    REGISTER_START,
+    READ_START,
+    AUTH_VERIFY,
+    CANCEL,
+    RESET,
+    CARD_DETECTED,
+    CARD_KEYED,         // Detected tag has candidate keys from auth_start/auth_prearm
+    CARD_CACHED,        // Detected tag has a valid offline auth cache entry
+    CARD_OFFLINE,       // Detected tag needs the backend, which is unreachable
+    CARD_TIMEOUT,       // PN532 timeout, card mostly too far away
+    CARD_PN532_ERROR,   // Communication error with the PN532 -> chip is reset
+    CARD_ERROR,         // Any other card error (crypto, authentication)
+    VERIFY_TIMEOUT,     // Backend did not send AUTH_VERIFY in time
+    SESSION_EXPIRED,    // Duration of a continuous auth session is over
+    OPERATION_TIMEOUT,  // timeout_seconds of the start command elapsed
+    NETWORK_LOST,
+    NETWORK_RESTORED,
+    COUNT
+};
+
+// Per-row statistics. Times are microseconds from the monotonic esp_timer clock.
+// dwell: time spent in the source state until the transition fired
+// action: time spent executing the row's action
+struct ReaderTransitionStats {
+    uint32_t count;
+    uint64_t last_at_us;
+    LatencyHistogram dwell;
+    LatencyHistogram action;
+};
+
+#define READER_TRANSITION_LOG_LENGTH 16
+
+// One entry of the recent-transition log
+struct ReaderTransitionRecord {
+    uint64_t at_us;
+    uint8_t row;
+    ReaderState from;
+    ReaderState to;
+};
+
+const char* readerStateToString(ReaderState state);
+const char* readerInputToString(ReaderInput input);
+
+ReaderState reader_state();
+
+// Introspection of the transition table and its timing
+size_t reader_transition_rows();
+bool reader_transition_row(size_t row, ReaderState* from, ReaderInput* input, ReaderState* next);
+const ReaderTransitionStats& reader_transition_stats(size_t row);
+// Copies up to maxRecords of the most recent transitions, oldest first
+size_t reader_recent_transitions(ReaderTransitionRecord* records, size_t maxRecords);
+void reader_reset_transition_stats();
+void reader_print_transition_stats();
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "mqtt_schema.h"
+#include "mqtt_types.h"
+#include "spsc_queue.h"
+
+// Typed messages exchanged between the network task (owns the MQTT client)
+// and the NFC task (owns the PN532, the display and the reader state).
+// JSON never crosses the task boundary: commands are parsed on the network core
+// and events are serialized there as well.
+
+#define READER_COMMAND_QUEUE_LENGTH 4
+#define READER_CONTROL_QUEUE_LENGTH 4
+#define READER_EVENT_QUEUE_LENGTH 8
+
+// Command flags
+#define READER_COMMAND_CANCELLED 0x01  // Start cancelled while it was still queued
+
+// Event flags
+#define READER_EVENT_RESTART_AFTER 0x01  // Restart the device once this event is published
+#define READER_EVENT_TIME_UNSYNCED 0x02  // occurred_ms is the time since boot, taken before the first time sync
+
+// Command parsed by the network task, handled by the NFC task
+struct ReaderCommand {
+    CommandType type;
+    uint8_t flags;
+    char request_id[MAX_UUID_LENGTH + 1];
+    union {
+        RegisterStartPayload register_start;
+        AuthStartPayload auth_start;
+        AuthVerifyPayload auth_verify;
+        ReadStartPayload read_start;
+        AuthCacheSyncPayload auth_cache_sync;
+    } payload;
+};
+
+// Event produced by the NFC task, serialized and published by the network task
+struct ReaderEvent {
+    EventType type;
+    uint8_t flags;
+    int64_t occurred_ms;  // Unix time in ms when the NFC task produced the event, see READER_EVENT_TIME_UNSYNCED
+    char request_id[MAX_UUID_LENGTH + 1];
+    union {
+        StatusChangePayload status_change;
+        ModeChangePayload mode_change;
+        TagDetectedPayload tag_detected;
+        RegisterSuccessPayload register_success;
+        AuthSuccessPayload auth_success;
+        AuthFailedPayload auth_failed;
+        ErrorPayload error;
+        ReadSuccessPayload read_success;
+        TagRemovedPayload tag_removed;
+        TapTracePayload tap_trace;
+    } payload;
+};
+
+typedef SpscQueue<ReaderCommand, READER_COMMAND_QUEUE_LENGTH> ReaderCommandQueue;
+typedef SpscQueue<ReaderCommand, READER_CONTROL_QUEUE_LENGTH> ReaderControlQueue;
+typedef SpscQueue<ReaderEvent, READER_EVENT_QUEUE_LENGTH> ReaderEventQueue;
+
+// Network task -> NFC task. Commands that act on existing sessions (cancel, reset, verify)
+// travel in their own lane, drained ahead of the starts, so a burst of starts can neither
+// delay nor crowd them out.
+extern ReaderControlQueue reader_control;
+extern ReaderCommandQueue reader_commands;
+
+// True for the commands of the reader_control lane
+inline bool isControlCommand(CommandType type) {
+    switch (type) {
+        case CommandType::AUTH_CANCEL:
+        case CommandType::REGISTER_CANCEL:
+        case CommandType::READ_CANCEL:
+        case CommandType::RESET:
+        case CommandType::AUTH_VERIFY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// NFC task -> network task
+extern ReaderEventQueue reader_events;
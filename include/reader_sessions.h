@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mqtt_schema.h"
+#include "mqtt_types.h"
+
+// Pending reader operations, keyed by the request_id of their start command.
+// One session owns the RF field at a time (started); the others wait in arrival order
+// until the reader is free, so a start no longer overwrites the operation in flight.
+// Lookup by request_id hashes into a small open-addressing index.
+// Owned by the NFC task; not thread safe.
+
+#define READER_SESSION_CAPACITY 4
+#define READER_SESSION_SLOTS 8 // Power of two, > READER_SESSION_CAPACITY so probe chains stay short
+
+struct AuthSession
+{
+  uint16_t timeout_seconds;
+  unsigned char tag_uid_binary[8];
+  char key[MAX_HEX_KEY_LENGTH + 1];
+  unsigned char key_binary[16];
+  unsigned char encryption_data[16];
+  // Store user_data to echo back in response
+  char username[64];
+  char context[64];
+  // Candidate keys of auth_start/auth_prearm
+  uint8_t key_count;
+  bool prearmed;                             // auth_prearm: no fallback to AUTH_VERIFY
+  bool candidate_bound[AUTH_START_MAX_KEYS]; // Candidate only applies to candidate_uid
+  unsigned char candidate_uid[AUTH_START_MAX_KEYS][8];
+  unsigned char candidate_key[AUTH_START_MAX_KEYS][16];
+  // user_data of auth_start, restored for every tap of a session
+  char armed_username[64];
+  char armed_context[64];
+  // Continuous session: armed for several taps
+  bool session;
+  bool session_timed;
+  uint32_t session_duration_seconds;
+  uint32_t session_end_ms;
+  uint16_t session_taps_left; // 0 = no tap limit
+};
+
+struct RegisterSession
+{
+  char tag_uid[MAX_TAG_UID_LENGTH + 1];
+  unsigned char tag_uid_binary[8];
+  char key[MAX_HEX_KEY_LENGTH + 1];
+  unsigned char key_binary[16];
+};
+
+struct ReaderSession
+{
+  char request_id[MAX_UUID_LENGTH + 1];
+  DeviceMode mode;
+  bool started;        // Owns the reader, false while queued
+  uint32_t queued_seq; // Arrival order of queued sessions
+  union
+  {
+    AuthSession auth;
+    RegisterSession reg; // Read sessions have no data besides the request_id
+  };
+};
+
+// Session of requestId, reset for mode. An existing session with the same request_id is reused
+// (a repeated start restarts it). Returns nullptr if the table is full.
+ReaderSession *reader_session_open(const char *requestId, DeviceMode mode);
+
+ReaderSession *reader_session_find(const char *requestId);
+
+// Oldest session that has not started yet, or nullptr
+ReaderSession *reader_session_next_queued();
+
+void reader_session_close(ReaderSession *session);
+
+size_t reader_session_count();
+void reader_session_clear();
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Fixed-size lock-free single-producer/single-consumer ring buffer.
+// Used to hand typed commands and events between the NFC task and the network task
+// without locks: the producer only writes head, the consumer only writes tail.
+// N must be a power of two. Indices run freely and wrap with unsigned arithmetic.
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+private:
+    T slots[N];
+    std::atomic<size_t> head;  // next slot to write (producer)
+    std::atomic<size_t> tail;  // next slot to read (consumer)
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Producer side. Returns false if the queue is full.
+    bool push(const T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        slots[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool pop(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) {
+            return false;
+        }
+        item = slots[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: inspect the oldest item without copying it out.
+    // The pointer stays valid until popFront() is called.
+    T* front() {
+        return peek(0);
+    }
+
+    // Consumer side: i-th oldest item, nullptr if there are not that many.
+    // The producer never touches queued items, so the consumer may modify them in place.
+    T* peek(size_t i) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) - t <= i) {
+            return nullptr;
+        }
+        return &slots[(t + i) & (N - 1)];
+    }
+
+    void popFront() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) != t) {
+            tail.store(t + 1, std::memory_order_release);
+        }
+    }
+
+    // Approximate when called from the side that does not own the index being read
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+    bool full() const { return size() == N; }
+    static size_t capacity() { return N; }
+};
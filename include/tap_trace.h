@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_timer.h>
+
+#include "mqtt_schema.h"
+#include "mqtt_types.h"
+
+// Timing breakdown of a tap: spans (esp_timer_get_time() microseconds) of the card operations,
+// the backend round trip and the display, and the network task's serializing and publishing
+// while the tap was going on. The NFC task writes its spans into a fixed ring buffer and hands
+// the finished tap over as a TapTracePayload; the network task keeps its own ring of recent
+// spans and merges it in. Each ring has one writing task, recording a span is two timer reads
+// and a store.
+
+#define TAP_TRACE_NETWORK_SPANS 8
+
+// NFC task
+
+// A poll of the RF field starts. Without a tap in progress the spans of the previous poll are
+// dropped; with one, the spans of the poll are left out (presence checks are not part of it).
+void tap_trace_poll();
+// The poll is done
+void tap_trace_polled();
+// The poll found a new tag: the tap starts with it, its read is the READ_CARD span
+void tap_trace_open();
+void tap_trace_end(TraceSpan span, int64_t started_us);
+// The result of the tap has been shown. false if no tap was in progress.
+bool tap_trace_close(TapTracePayload &trace);
+
+// Times the enclosing block
+class TapTraceScope
+{
+public:
+  explicit TapTraceScope(TraceSpan span) : span(span), started_us(esp_timer_get_time()) {}
+  ~TapTraceScope() { tap_trace_end(span, started_us); }
+
+private:
+  TraceSpan span;
+  int64_t started_us;
+};
+
+// Network task
+void tap_trace_network_span(TraceSpan span, int64_t started_us);
+// Add the network spans that started during the tap
+void tap_trace_merge(TapTracePayload &trace);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "mqtt_schema.h"
+#include "mqtt_types.h"
+
+// Performance counters for the heartbeat, in fixed-memory streaming histograms
+// (latency_histogram.h). Every counter and histogram has one writing task - the NFC task for
+// taps and the RF field, each task for its own loop time - so recording is a plain add
+// without locks. The network task reads them for the heartbeat; such a read may miss an
+// update in flight. Values are totals since boot.
+
+// NFC task
+void telemetry_rf_poll();
+void telemetry_rf_error(bool timeout);
+// A new tag is in the field, starts the decision clock
+void telemetry_tap_detected();
+// Result of the tap; pn532Error/timeout if the PN532 caused a failed decision
+void telemetry_tap_decided(DecisionTier tier, bool pn532Error, bool timeout);
+void telemetry_reader_loop(uint32_t micros);
+
+// Network task
+void telemetry_network_loop(uint32_t micros);
+
+// Counters, latencies and memory; the queue depths are filled in by the caller
+void telemetry_fill_heartbeat(HeartbeatPayload &payload);
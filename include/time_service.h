@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Wall clock for event timestamps: Unix time = monotonic clock + offset. The offset is taken
+// from a time source (SNTP on the device, a stand-in in tests) on every sync; between syncs the
+// time follows the monotonic clock and cannot jump with the system clock. Until the first sync
+// the offset is 0, i.e. the time since boot; such a time can be re-based once synced.
+// Synced by the network task (time_service_loop); time_service_now_ms() can be called from any
+// task, the offset is read under a sequence counter.
+
+#define TIME_SYNC_RETRY_MS 2000       // Until the first sync and after a failed one
+#define TIME_SYNC_INTERVAL_MS 3600000 // Once synced
+
+// Monotonic microseconds, e.g. esp_timer_get_time
+typedef int64_t (*TimeServiceClock)();
+// Current Unix time in ms, false if the source does not know it (yet)
+typedef bool (*TimeServiceSource)(int64_t *unixMs);
+
+struct TimeServiceStats
+{
+  uint32_t syncs;
+  uint32_t failures; // Syncs the source could not answer
+  int64_t last_step_ms; // Correction of the last sync, negative if the clock was ahead
+};
+
+// clock nullptr keeps the monotonic clock of the platform
+void time_service_begin(TimeServiceSource source, TimeServiceClock clock = nullptr);
+// Asks the source once a sync is due
+void time_service_loop();
+// Sets the time, for sources that push it
+void time_service_sync(int64_t unixMs);
+
+int64_t time_service_now_ms();
+// The same, and whether it is Unix time already (synced) or still the time since boot.
+// Both are read together, a sync in between cannot mix them up.
+int64_t time_service_now_ms(bool *synced);
+// A time since boot taken before the first sync as Unix time, false while still unsynced.
+// Only for times taken since this boot.
+bool time_service_rebase(int64_t bootMs, int64_t *unixMs);
+bool time_service_synced();
+const TimeServiceStats &time_service_stats();
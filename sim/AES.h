@@ -0,0 +1,15 @@
+#pragma once
+
+// AES128 of the Crypto library, on the AES implementation of lib/RFID-Secure-Doorlock
+
+#include "AES128.h"
+
+class AES128 {
+public:
+    bool setKey(const uint8_t* key, size_t length) { return length == 16 && cipher.SetKeyData(key, 16, 0); }
+    void encryptBlock(uint8_t* output, const uint8_t* input) { cipher.CryptDataBlock(output, input, KEY_ENCIPHER); }
+    void decryptBlock(uint8_t* output, const uint8_t* input) { cipher.CryptDataBlock(output, input, KEY_DECIPHER); }
+
+private:
+    AES cipher;
+};
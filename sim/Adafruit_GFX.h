@@ -0,0 +1,3 @@
+#pragma once
+
+// Drawing is part of Adafruit_SSD1306 in the simulator
@@ -0,0 +1,3 @@
+#pragma once
+
+// The block ciphers of the Crypto library are in AES.h
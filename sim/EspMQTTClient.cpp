@@ -0,0 +1,137 @@
+#include <EspMQTTClient.h>
+#include <string>
+
+#include "sim_broker.h"
+
+// Header of a PUBLISH packet: fixed header (up to 5 bytes) + topic length
+#define MQTT_PUBLISH_OVERHEAD 7
+
+EspMQTTClient::EspMQTTClient()
+    : handle(-1), name("ESP32"), willRetain(false), connected(false), debugging(false),
+      maxPacketSize(256), connectionCount(0) {
+}
+
+void EspMQTTClient::setWifiCredentials(const char* wifiSsid, const char* wifiPassword) {
+    (void)wifiSsid;
+    (void)wifiPassword;
+}
+
+void EspMQTTClient::setMqttServer(const char* server, const char* username, const char* password, const short port) {
+    (void)server;
+    (void)username;
+    (void)password;
+    (void)port;
+}
+
+void EspMQTTClient::setMqttClientName(const char* name) {
+    this->name = name;
+}
+
+bool EspMQTTClient::setMaxPacketSize(const uint16_t size) {
+    maxPacketSize = size;
+    return true;
+}
+
+void EspMQTTClient::enableDebuggingMessages(const bool enabled) {
+    debugging = enabled;
+}
+
+void EspMQTTClient::enableLastWillMessage(const char* topic, const char* message, const bool retain) {
+    willTopic = topic;
+    willMessage = message;
+    willRetain = retain;
+}
+
+bool EspMQTTClient::isWifiConnected() const {
+    return sim_broker_link_up(handle);
+}
+
+void EspMQTTClient::loop() {
+    if (handle < 0) {
+        handle = sim_broker_find(name.c_str());
+        if (handle < 0) {
+            handle = sim_broker_client(name.c_str(), [this](const char* topic, const char* payload, size_t length) {
+                receive(topic, payload, length);
+            });
+        }
+    }
+
+    if (connected && !sim_broker_connected(handle)) {
+        connected = false;
+        subscriptions.clear();
+        if (debugging) {
+            Serial.println("MQTT!: Lost connection to the broker");
+        }
+    }
+    if (!connected && sim_broker_connect(handle, willTopic.c_str(), willMessage.c_str(), willRetain)) {
+        connected = true;
+        connectionCount++;
+        if (debugging) {
+            Serial.println("MQTT: Connected to the broker");
+        }
+        onConnectionEstablished();
+    }
+    if (connected) {
+        sim_broker_poll(handle);
+    }
+}
+
+bool EspMQTTClient::publish(const String& topic, const String& payload, bool retain) {
+    if (!connected || MQTT_PUBLISH_OVERHEAD + topic.length() + payload.length() > maxPacketSize) {
+        if (debugging) {
+            Serial.print("MQTT! publish failed, is the message too long ? (see setMaxPacketSize()) - topic: ");
+            Serial.println(topic);
+        }
+        return false;
+    }
+    return sim_broker_publish(handle, topic.c_str(), payload.c_str(), payload.length(), retain);
+}
+
+bool EspMQTTClient::subscribe(const String& topic, MessageReceivedCallback messageReceivedCallback, uint8_t qos) {
+    (void)qos;
+    if (!connected || !sim_broker_subscribe(handle, topic.c_str())) {
+        return false;
+    }
+    Subscription subscription = {topic, messageReceivedCallback, nullptr};
+    subscriptions.push_back(subscription);
+    return true;
+}
+
+bool EspMQTTClient::subscribe(const String& topic, MessageReceivedCallbackWithTopic messageReceivedCallback, uint8_t qos) {
+    (void)qos;
+    if (!connected || !sim_broker_subscribe(handle, topic.c_str())) {
+        return false;
+    }
+    Subscription subscription = {topic, nullptr, messageReceivedCallback};
+    subscriptions.push_back(subscription);
+    return true;
+}
+
+bool EspMQTTClient::unsubscribe(const String& topic) {
+    for (size_t i = 0; i < subscriptions.size(); i++) {
+        if (subscriptions[i].topic == topic) {
+            subscriptions.erase(subscriptions.begin() + i);
+            return sim_broker_unsubscribe(handle, topic.c_str());
+        }
+    }
+    return false;
+}
+
+// Dispatched to every matching subscription, like the library does
+void EspMQTTClient::receive(const char* topic, const char* payload, size_t length) {
+    if (MQTT_PUBLISH_OVERHEAD + strlen(topic) + length > maxPacketSize) {
+        return;  // PubSubClient drops what does not fit its buffer
+    }
+    String topicStr(topic);
+    String message(std::string(payload, length));
+    for (size_t i = 0; i < subscriptions.size(); i++) {
+        if (!sim_broker_topic_matches(subscriptions[i].topic.c_str(), topic)) {
+            continue;
+        }
+        if (subscriptions[i].callback) {
+            subscriptions[i].callback(message);
+        } else if (subscriptions[i].callbackWithTopic) {
+            subscriptions[i].callbackWithTopic(topicStr, message);
+        }
+    }
+}
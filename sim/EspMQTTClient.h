@@ -0,0 +1,61 @@
+#pragma once
+
+// EspMQTTClient on the broker stand-in of sim_broker.h. Same interface as the library (the
+// parts the firmware uses) and the same limits: a message larger than the packet size is not
+// published, nor received. The link of the client is controlled by the simulator.
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+typedef std::function<void()> ConnectionEstablishedCallback;
+typedef std::function<void(const String& message)> MessageReceivedCallback;
+typedef std::function<void(const String& topicStr, const String& message)> MessageReceivedCallbackWithTopic;
+
+// Called on every (re)connect, defined by the sketch
+void onConnectionEstablished();
+
+class EspMQTTClient {
+public:
+    EspMQTTClient();
+
+    void setWifiCredentials(const char* wifiSsid, const char* wifiPassword);
+    void setMqttServer(const char* server, const char* username = "", const char* password = "", const short port = 1883);
+    void setMqttClientName(const char* name);
+    bool setMaxPacketSize(const uint16_t size);
+    void enableDebuggingMessages(const bool enabled = true);
+    void enableDrasticResetOnConnectionFailures() {}
+    void enableLastWillMessage(const char* topic, const char* message, const bool retain = false);
+
+    void loop();
+
+    bool isConnected() const { return isWifiConnected() && isMqttConnected(); }
+    bool isWifiConnected() const;
+    bool isMqttConnected() const { return connected; }
+    unsigned int getConnectionEstablishedCount() const { return connectionCount; }
+
+    bool publish(const String& topic, const String& payload, bool retain = false);
+    bool subscribe(const String& topic, MessageReceivedCallback messageReceivedCallback, uint8_t qos = 0);
+    bool subscribe(const String& topic, MessageReceivedCallbackWithTopic messageReceivedCallback, uint8_t qos = 0);
+    bool unsubscribe(const String& topic);
+
+private:
+    struct Subscription {
+        String topic;
+        MessageReceivedCallback callback;
+        MessageReceivedCallbackWithTopic callbackWithTopic;
+    };
+
+    void receive(const char* topic, const char* payload, size_t length);
+
+    int handle;  // Client of the broker stand-in, -1 until the first loop()
+    String name;
+    String willTopic;
+    String willMessage;
+    bool willRetain;
+    bool connected;
+    bool debugging;
+    uint16_t maxPacketSize;
+    unsigned int connectionCount;
+    std::vector<Subscription> subscriptions;
+};
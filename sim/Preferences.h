@@ -0,0 +1,23 @@
+#pragma once
+
+// NVS of the ESP32, kept in memory for the run
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    size_t putBytes(const char* key, const void* value, size_t length);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+    size_t getBytesLength(const char* key);
+    bool remove(const char* key);
+    size_t putString(const char* key, const String& value);
+    String getString(const char* key, const String& defaultValue = String());
+
+private:
+    std::string space;
+    bool readOnly = true;
+    bool opened = false;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define WIFI_STA 1
+
+class IPAddress {
+public:
+    String toString() const { return "10.0.0.2"; }
+};
+
+class WiFiClass {
+public:
+    bool mode(int mode) { (void)mode; return true; }
+    IPAddress localIP() const { return IPAddress(); }
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,8 @@
+#pragma once
+
+// The configuration portal is not part of the simulator (config.cpp is not built)
+
+#include <WiFi.h>
+
+class WiFiManager {
+};
@@ -0,0 +1,643 @@
+// Native simulator of the reader firmware: network.cpp, reader.cpp and the rest of src/ run
+// unchanged against the stand-ins of sim/ - a broker, a PN532 with DESFire cards and a virtual
+// clock (see sim_clock.h). A scripted backend registers a set of cards and then drives taps
+// through one of the auth flows, measuring in virtual time what a user at the reader would see
+// and in host time what the firmware costs per tap.
+//
+//   pio run -e sim && .pio/build/sim/program --scenario backend --taps 200 --cards 8
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LiquidCrystal_I2C.h>
+#include <Adafruit_SSD1306.h>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Secrets.h"
+
+#include "card.h"
+#include "card_presence.h"
+#include "config.h"
+#include "display.h"
+#include "event_journal.h"
+#include "latency_histogram.h"
+#include "mqtt_serialization.h"
+#include "mqtt_topics.h"
+#include "network.h"
+#include "reader.h"
+#include "reader_fsm.h"
+
+#include "sim_broker.h"
+#include "sim_card.h"
+#include "sim_clock.h"
+#include "sim_platform.h"
+
+#define SIM_DEVICE_ID "sim-reader"
+#define SIM_BACKEND "sim-backend"
+#define SIM_EVENT_DOC_SIZE 4096
+
+// Globals of main.cpp and config.cpp, which are not built (FreeRTOS tasks, config portal)
+MqttSettings mqtt_data;
+String clientID = SIM_DEVICE_ID;
+Preferences preferences;
+WiFiManager wm;
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+LiquidCrystal_I2C lcd(0x27, 16, 2);
+
+enum class Scenario : uint8_t {
+    BACKEND,   // auth_start, the backend answers auth_tag_detected with auth_verify
+    KEYED,     // auth_start carries the key of the card
+    CACHED,    // The keys are in the auth cache, synced before the taps
+    READ,      // read_start
+    COMMANDS,  // auth_start and auth_cancel without a card: command -> mode change
+};
+
+struct Options {
+    Scenario scenario = Scenario::BACKEND;
+    uint32_t taps = 100;
+    uint32_t cards = 4;
+    uint32_t backend_ms = 20;   // Think time of the backend before it answers
+    uint32_t broker_ms = 2;     // One way through the broker
+    uint32_t approach_ms = 500; // From the start of the operation to the card entering the field
+    uint32_t hold_ms = 300;     // Card stays in the field after the result
+    uint32_t timeout_s = 10;    // timeout_seconds of the commands
+    uint32_t seed = 1;
+    uint32_t tick_us = SIM_TICK_US;
+    bool fast = false;          // No time for card exchanges and displays
+    bool verbose = false;
+    float timeouts = 0.0f;
+    float poll_errors = 0.0f;
+    float publish_failures = 0.0f;
+    uint32_t outage_every = 0;  // Take the link of the reader down every n taps
+    uint32_t outage_ms = 5000;
+};
+
+struct SimUser {
+    SimCard card;
+    char tag_uid[MAX_TAG_UID_LENGTH + 1];
+    char key[33];
+    char username[16];
+    bool registered;
+    int64_t removed_us;
+};
+
+// Operation in flight: its request_id and what the backend has seen of it so far
+struct Operation {
+    char request_id[MAX_UUID_LENGTH + 1];
+    int64_t sent_us;
+    int64_t mode_us;  // Mode change into the operation's mode
+    int64_t idle_us;  // Mode change back to idle
+    int64_t tap_us;   // Card placed
+    int64_t result_us;
+    EventType result;
+};
+
+struct PendingPublish {
+    int64_t due_us;
+    std::string topic;
+    std::string payload;
+};
+
+struct Tallies {
+    uint32_t success;
+    uint32_t failed;   // auth_failed, a tap that was decided against the card
+    uint32_t error;    // *_error events
+    uint32_t missing;  // No result before the timeout
+    uint32_t events;
+    uint32_t unparsed;
+};
+
+static Options options;
+static std::vector<SimUser> users;
+static MQTTTopicBuilder backend_topics;
+static int backend = -1;
+static int device = -1;
+static std::deque<PendingPublish> outbox;
+static Operation operation;
+static Tallies tallies;
+static LatencyHistogram tap_latency_ms;
+static LatencyHistogram command_latency_ms;
+static DynamicJsonDocument event_doc(SIM_EVENT_DOC_SIZE);
+static int64_t outage_end_us = 0;
+
+static SimUser *findUser(const char *tagUid)
+{
+    for (SimUser &user : users) {
+        if (strcmp(user.tag_uid, tagUid) == 0) {
+            return &user;
+        }
+    }
+    return nullptr;
+}
+
+// ===== Backend =====
+
+static void publishCommand(CommandType type, const char *topic, const char *requestId,
+                           const std::string &payload, uint32_t delayMs = 0)
+{
+    char timestamp[32];
+    generateTimestamp(timestamp, sizeof(timestamp));
+
+    std::string message = "{\"version\":\"" MQTT_PROTOCOL_VERSION "\",\"timestamp\":\"";
+    message += timestamp;
+    message += "\",\"device_id\":\"" SIM_DEVICE_ID "\",\"event_type\":\"";
+    message += commandTypeToString(type);
+    message += "\",\"request_id\":\"";
+    message += requestId;
+    message += "\",\"payload\":";
+    message += payload;
+    message += "}";
+
+    PendingPublish pending;
+    pending.due_us = sim_now_us() + (int64_t)delayMs * 1000;
+    pending.topic = topic;
+    pending.payload = message;
+    outbox.push_back(pending);
+}
+
+static std::string timeoutPayload()
+{
+    return "{\"timeout_seconds\":" + std::to_string(options.timeout_s);
+}
+
+static void answerTagDetected(JsonObject payload)
+{
+    const char *tagUid = payload["tag_uid"] | "";
+    SimUser *user = findUser(tagUid);
+    std::string verify = "{\"tag_uid\":\"" + std::string(tagUid) + "\",\"key\":\"" +
+                         std::string(user != nullptr ? user->key : "00000000000000000000000000000000") +
+                         "\",\"user_data\":{\"username\":\"" +
+                         std::string(user != nullptr ? user->username : "") + "\",\"context\":\"sim\"}}";
+    publishCommand(CommandType::AUTH_VERIFY, backend_topics.authVerify(), operation.request_id, verify,
+                   options.backend_ms);
+}
+
+static void handleEvent(JsonObject message)
+{
+    EventType type = stringToEventType(message["event_type"] | "");
+    if (type == EventType::UNKNOWN) {
+        return;  // The backend's own commands
+    }
+    tallies.events++;
+
+    // Heartbeats, status and the results of taps decided offline carry other request_ids
+    if (operation.request_id[0] == '\0' || strcmp(message["request_id"] | "", operation.request_id) != 0) {
+        return;
+    }
+
+    JsonObject payload = message["payload"];
+    switch (type) {
+    case EventType::MODE_CHANGE:
+        if (strcmp(payload["mode"] | "", "idle") == 0) {
+            operation.idle_us = sim_now_us();
+        } else if (operation.mode_us == 0) {
+            operation.mode_us = sim_now_us();
+        }
+        break;
+    case EventType::AUTH_TAG_DETECTED:
+        if (options.scenario == Scenario::BACKEND) {
+            answerTagDetected(payload);
+        }
+        break;
+    case EventType::REGISTER_SUCCESS:
+    case EventType::REGISTER_ERROR:
+    case EventType::AUTH_SUCCESS:
+    case EventType::AUTH_FAILED:
+    case EventType::AUTH_ERROR:
+    case EventType::READ_SUCCESS:
+    case EventType::READ_ERROR:
+        if (operation.result == EventType::UNKNOWN) {
+            operation.result = type;
+            operation.result_us = sim_now_us();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void receiveEvent(const char *topic, const char *payload, size_t length)
+{
+    MQTTTopic routed = backend_topics.route(topic, strlen(topic));
+    if (routed == MQTTTopic::COUNT || routed < MQTTTopic::REGISTER_SUCCESS) {
+        return;  // Commands, ours
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(payload);
+    DeserializationError error = decodeDocument(event_doc, data, length, detectEncoding(data, length));
+    if (error) {
+        tallies.unparsed++;
+        return;
+    }
+
+    if (routed == MQTTTopic::BATCH) {
+        for (JsonObject event : event_doc["payload"]["events"].as<JsonArray>()) {
+            handleEvent(event);
+        }
+    } else {
+        handleEvent(event_doc.as<JsonObject>());
+    }
+}
+
+// Tick hook: the backend reads its messages and sends what is due, and outages end
+static void backendTick()
+{
+    if (outage_end_us != 0 && sim_now_us() >= outage_end_us) {
+        sim_broker_set_link(device, true);
+        outage_end_us = 0;
+    }
+
+    sim_broker_poll(backend);
+    while (!outbox.empty() && outbox.front().due_us <= sim_now_us()) {
+        const PendingPublish &pending = outbox.front();
+        sim_broker_publish(backend, pending.topic.c_str(), pending.payload.c_str(), pending.payload.size(), false);
+        outbox.pop_front();
+    }
+}
+
+// ===== Operations =====
+
+static void startOperation(CommandType type, const char *topic, const std::string &payload)
+{
+    memset(&operation, 0, sizeof(operation));
+    operation.result = EventType::UNKNOWN;
+    generateUUID(operation.request_id, sizeof(operation.request_id));
+    operation.sent_us = sim_now_us();
+    publishCommand(type, topic, operation.request_id, payload);
+}
+
+static bool modeEntered() { return operation.mode_us != 0; }
+static bool backToIdle() { return operation.idle_us != 0; }
+static bool resultSeen() { return operation.result != EventType::UNKNOWN; }
+
+// Time until the reader takes the card as a new tap: it ignores a card that left the field
+// less than CARD_DUPLICATE_WINDOW_MS ago
+static int64_t duplicateWait(const SimUser &user)
+{
+    if (user.removed_us == 0) {
+        return 0;
+    }
+    int64_t allowed = user.removed_us + (int64_t)(CARD_DUPLICATE_WINDOW_MS + CARD_REMOVED_DEBOUNCE_MS) * 1000;
+    return allowed > sim_now_us() ? allowed - sim_now_us() : 0;
+}
+
+static void recordResult(EventType result)
+{
+    switch (result) {
+    case EventType::AUTH_SUCCESS:
+    case EventType::READ_SUCCESS:
+    case EventType::REGISTER_SUCCESS:
+        tallies.success++;
+        break;
+    case EventType::AUTH_FAILED:
+        tallies.failed++;
+        break;
+    case EventType::UNKNOWN:
+        tallies.missing++;
+        break;
+    default:
+        tallies.error++;
+        break;
+    }
+}
+
+// One tap: the card comes in after approach_ms, the result is awaited, the card stays for
+// hold_ms and leaves. Returns the result, UNKNOWN if none came in time.
+static EventType tap(SimUser &user)
+{
+    sim_run(max((int64_t)options.approach_ms * 1000, duplicateWait(user)));
+
+    sim_card_place(&user.card);
+    operation.tap_us = sim_now_us();
+    if (sim_run((int64_t)options.timeout_s * 1000000, resultSeen)) {
+        tap_latency_ms.record((uint32_t)((operation.result_us - operation.tap_us) / 1000));
+    }
+
+    sim_run((int64_t)options.hold_ms * 1000);
+    sim_card_place(nullptr);
+    user.removed_us = sim_now_us();
+
+    // The reader is back to idle (and done showing the result) before the next operation
+    sim_run((int64_t)options.timeout_s * 1000000, backToIdle);
+    sim_run((int64_t)FEEDBACK_DURATION_MS * 1000);
+    return operation.result;
+}
+
+static void recordModeLatency()
+{
+    if (operation.mode_us != 0) {
+        command_latency_ms.record((uint32_t)((operation.mode_us - operation.sent_us) / 1000));
+    }
+}
+
+static bool registerUser(SimUser &user)
+{
+    std::string payload = "{\"tag_uid\":\"" + std::string(user.tag_uid) + "\",\"key\":\"" + user.key +
+                          "\",\"timeout_seconds\":" + std::to_string(options.timeout_s) + "}";
+    startOperation(CommandType::REGISTER_START, backend_topics.registerStart(), payload);
+    sim_run((int64_t)options.timeout_s * 1000000, modeEntered);
+    return tap(user) == EventType::REGISTER_SUCCESS;
+}
+
+// The auth cache takes AUTH_CACHE_SYNC_MAX_ENTRIES entries per message
+static void syncAuthCache()
+{
+    for (size_t first = 0; first < users.size(); first += AUTH_CACHE_SYNC_MAX_ENTRIES) {
+        std::string payload = std::string("{\"replace\":") + (first == 0 ? "true" : "false") + ",\"entries\":[";
+        for (size_t i = first; i < users.size() && i < first + AUTH_CACHE_SYNC_MAX_ENTRIES; i++) {
+            if (i != first) {
+                payload += ",";
+            }
+            payload += "{\"tag_uid\":\"" + std::string(users[i].tag_uid) + "\",\"key\":\"" + users[i].key +
+                       "\",\"permissions\":1,\"expires_at\":0,\"username\":\"" + users[i].username + "\"}";
+        }
+        payload += "]}";
+
+        char requestId[MAX_UUID_LENGTH + 1];
+        generateUUID(requestId, sizeof(requestId));
+        publishCommand(CommandType::AUTH_CACHE_SYNC, backend_topics.authCacheSync(), requestId, payload);
+    }
+    sim_run(500000);
+}
+
+static void runTap(SimUser &user)
+{
+    switch (options.scenario) {
+    case Scenario::BACKEND:
+    case Scenario::CACHED:
+        startOperation(CommandType::AUTH_START, backend_topics.authStart(), timeoutPayload() + "}");
+        break;
+    case Scenario::KEYED:
+        startOperation(CommandType::AUTH_START, backend_topics.authStart(),
+                       timeoutPayload() + ",\"keys\":[{\"tag_uid\":\"" + user.tag_uid + "\",\"key\":\"" +
+                           user.key + "\"}],\"user_data\":{\"username\":\"" + user.username +
+                           "\",\"context\":\"sim\"}}");
+        break;
+    case Scenario::READ:
+        startOperation(CommandType::READ_START, backend_topics.readStart(), timeoutPayload() + "}");
+        break;
+    case Scenario::COMMANDS:
+        startOperation(CommandType::AUTH_START, backend_topics.authStart(), timeoutPayload() + "}");
+        // A cancel that overtakes its start drops it without a mode change, so it waits for the mode
+        if (sim_run((int64_t)options.timeout_s * 1000000, modeEntered)) {
+            recordModeLatency();
+            publishCommand(CommandType::AUTH_CANCEL, backend_topics.authCancel(), operation.request_id, "{}");
+        }
+        if (sim_run((int64_t)options.timeout_s * 1000000, backToIdle)) {
+            tallies.success++;
+        } else {
+            tallies.missing++;
+        }
+        sim_run((int64_t)FEEDBACK_DURATION_MS * 1000);
+        return;
+    }
+
+    sim_run((int64_t)options.timeout_s * 1000000, modeEntered);
+    recordModeLatency();
+    recordResult(tap(user));
+}
+
+// ===== Setup and report =====
+
+static const char *scenarioName(Scenario scenario)
+{
+    switch (scenario) {
+    case Scenario::BACKEND: return "backend";
+    case Scenario::KEYED: return "keyed";
+    case Scenario::CACHED: return "cached";
+    case Scenario::READ: return "read";
+    case Scenario::COMMANDS: return "commands";
+    }
+    return "?";
+}
+
+static bool parseScenario(const char *name, Scenario &scenario)
+{
+    const Scenario all[] = {Scenario::BACKEND, Scenario::KEYED, Scenario::CACHED, Scenario::READ, Scenario::COMMANDS};
+    for (Scenario candidate : all) {
+        if (strcmp(name, scenarioName(candidate)) == 0) {
+            scenario = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usage()
+{
+    printf("usage: program [options]\n"
+           "  --scenario backend|keyed|cached|read|commands\n"
+           "  --taps N --cards N --seed N --verbose --fast\n"
+           "  --backend-ms MS --broker-ms MS --approach-ms MS --hold-ms MS --timeout-s S --tick-us US\n"
+           "  --timeouts P --poll-errors P --publish-failures P    (probabilities 0..1)\n"
+           "  --outage-every N --outage-ms MS\n");
+}
+
+static bool parseOptions(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *name = argv[i];
+        if (strcmp(name, "--verbose") == 0) {
+            options.verbose = true;
+            continue;
+        }
+        if (strcmp(name, "--fast") == 0) {
+            options.fast = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (strcmp(name, "--scenario") == 0) {
+            if (!parseScenario(value, options.scenario)) {
+                return false;
+            }
+        } else if (strcmp(name, "--taps") == 0) {
+            options.taps = (uint32_t)atol(value);
+        } else if (strcmp(name, "--cards") == 0) {
+            options.cards = (uint32_t)atol(value);
+        } else if (strcmp(name, "--seed") == 0) {
+            options.seed = (uint32_t)atol(value);
+        } else if (strcmp(name, "--backend-ms") == 0) {
+            options.backend_ms = (uint32_t)atol(value);
+        } else if (strcmp(name, "--broker-ms") == 0) {
+            options.broker_ms = (uint32_t)atol(value);
+        } else if (strcmp(name, "--approach-ms") == 0) {
+            options.approach_ms = (uint32_t)atol(value);
+        } else if (strcmp(name, "--hold-ms") == 0) {
+            options.hold_ms = (uint32_t)atol(value);
+        } else if (strcmp(name, "--timeout-s") == 0) {
+            options.timeout_s = (uint32_t)atol(value);
+        } else if (strcmp(name, "--tick-us") == 0) {
+            options.tick_us = (uint32_t)atol(value);
+        } else if (strcmp(name, "--timeouts") == 0) {
+            options.timeouts = (float)atof(value);
+        } else if (strcmp(name, "--poll-errors") == 0) {
+            options.poll_errors = (float)atof(value);
+        } else if (strcmp(name, "--publish-failures") == 0) {
+            options.publish_failures = (float)atof(value);
+        } else if (strcmp(name, "--outage-every") == 0) {
+            options.outage_every = (uint32_t)atol(value);
+        } else if (strcmp(name, "--outage-ms") == 0) {
+            options.outage_ms = (uint32_t)atol(value);
+        } else {
+            return false;
+        }
+    }
+    return options.cards > 0 && options.timeout_s >= 1 && options.timeout_s <= 300 && options.tick_us > 0;
+}
+
+static void createUsers()
+{
+    users.resize(options.cards);
+    for (uint32_t i = 0; i < options.cards; i++) {
+        SimUser &user = users[i];
+        memset(&user, 0, sizeof(user));
+        sim_card_init(user.card, 1000 + i);
+        // As the reader prints it: the 7 byte UID, padded to 8
+        const uint8_t *uid = user.card.uid;
+        snprintf(user.tag_uid, sizeof(user.tag_uid), "%02X:%02X:%02X:%02X:%02X:%02X:%02X:00", uid[0], uid[1],
+                 uid[2], uid[3], uid[4], uid[5], uid[6]);
+        for (int j = 0; j < 16; j++) {
+            snprintf(user.key + j * 2, 3, "%02X", (unsigned)(sim_random() & 0xFF));
+        }
+        snprintf(user.username, sizeof(user.username), "user-%u", (unsigned)i);
+    }
+}
+
+// What setup() of main.cpp does, without the config portal
+static void bootFirmware()
+{
+    remove(EVENT_JOURNAL_FILE);  // A fresh device
+
+    mqtt_data.url = "sim-broker";
+    mqtt_data.id = SIM_DEVICE_ID;
+    mqtt_data.port = 1883;
+
+    network_begin(mqtt_data, clientID);
+    gi_PN532.InitSoftwareSPI(SPI_CLK_PIN, SPI_MISO_PIN, SPI_MOSI_PIN, SPI_CS_PIN, RESET_PIN);
+    InitReader(false);
+#if USE_DESFIRE
+    gi_PiccMasterKey.SetKeyData(SECRET_PICC_MASTER_KEY, sizeof(SECRET_PICC_MASTER_KEY), CARD_KEY_VERSION);
+#endif
+    reader_begin();
+}
+
+static void printHistogram(const char *name, const LatencyHistogram &histogram)
+{
+    printf("%-16s n=%u mean=%u p50<=%u p99<=%u max=%u ms\n", name, histogram.count(), histogram.mean(),
+           histogram.percentile(50), histogram.percentile(99), histogram.max());
+}
+
+// clock: the share of the taps
+static void printReport(uint32_t taps, double wallSeconds, const SimClockStats &clock)
+{
+    const SimCardStats &cards = sim_card_stats();
+    const SimBrokerStats &broker = sim_broker_stats();
+    const SimPlatformStats &platform = sim_platform_stats();
+    double virtualSeconds = sim_now_us() / 1e6;
+
+    printf("\n=== %s: %u taps, %u cards ===\n", scenarioName(options.scenario), taps, options.cards);
+    printf("virtual %.1f s, wall %.2f s (%.0fx), %.1f taps/s\n", virtualSeconds, wallSeconds,
+           wallSeconds > 0 ? virtualSeconds / wallSeconds : 0.0, wallSeconds > 0 ? taps / wallSeconds : 0.0);
+    printf("host per tap: reader %.1f us, network %.1f us (%llu / %llu loops)\n",
+           taps > 0 ? clock.reader_ns / 1e3 / taps : 0.0, taps > 0 ? clock.network_ns / 1e3 / taps : 0.0,
+           (unsigned long long)clock.reader_loops, (unsigned long long)clock.network_loops);
+    printf("results: success %u, failed %u, error %u, missing %u (events %u, unparsed %u)\n", tallies.success,
+           tallies.failed, tallies.error, tallies.missing, tallies.events, tallies.unparsed);
+    printHistogram("tap -> result", tap_latency_ms);
+    printHistogram("command -> mode", command_latency_ms);
+    printf("card: polls %u, detections %u, commands %u, poll errors %u, timeouts %u, rejected %u\n", cards.polls,
+           cards.detections, cards.commands, cards.poll_errors, cards.timeouts, cards.rejected);
+    printf("broker: published %u, failed %u, delivered %u, lost %u, wills %u\n", broker.published, broker.failed,
+           broker.delivered, broker.lost, broker.wills);
+    printf("platform: restarts %u, display frames %u\n", platform.restarts, platform.display_frames);
+
+    // The firmware's own counters, on the serial console
+    bool serial = options.verbose;
+    sim_serial_output(true);
+    network_print_command_queue_stats();
+    network_print_publish_queue_stats();
+    reader_print_transition_stats();
+    sim_serial_output(serial);
+}
+
+int main(int argc, char **argv)
+{
+    if (!parseOptions(argc, argv)) {
+        usage();
+        return 2;
+    }
+
+    sim_seed(options.seed);
+    sim_serial_output(options.verbose);
+    sim_set_tick(options.tick_us);
+    sim_broker_set_latency((int64_t)options.broker_ms * 1000);
+    if (options.fast) {
+        SimCardTiming cardTiming = {0, 0, 0, 0};
+        SimPlatformTiming platformTiming = {0, 0};
+        sim_card_set_timing(cardTiming);
+        sim_set_platform_timing(platformTiming);
+    }
+    createUsers();
+
+    backend_topics.setDeviceId(SIM_DEVICE_ID);
+    backend = sim_broker_client(SIM_BACKEND, receiveEvent);
+    sim_broker_connect(backend, nullptr, nullptr, false);
+    char filter[64];
+    snprintf(filter, sizeof(filter), "devices/%s/#", SIM_DEVICE_ID);
+    sim_broker_subscribe(backend, filter);
+    sim_set_tasks(reader_loop, network_loop);
+    sim_set_tick_hook(backendTick);
+
+    bootFirmware();
+    sim_run(2000000);  // Connects and announces itself
+    device = sim_broker_find(SIM_DEVICE_ID);
+    if (device < 0 || !sim_broker_connected(device)) {
+        printf("reader did not connect to the broker\n");
+        return 1;
+    }
+
+    // Registration is not measured, and runs without faults
+    if (options.scenario != Scenario::COMMANDS && options.scenario != Scenario::READ) {
+        uint32_t registered = 0;
+        for (SimUser &user : users) {
+            user.registered = registerUser(user);
+            registered += user.registered ? 1 : 0;
+        }
+        printf("registered %u of %u cards\n", registered, options.cards);
+    }
+    if (options.scenario == Scenario::CACHED) {
+        syncAuthCache();
+    }
+
+    memset(&tallies, 0, sizeof(tallies));
+    tap_latency_ms.reset();
+    command_latency_ms.reset();
+    SimCardFaults faults = {options.poll_errors, options.timeouts};
+    sim_card_set_faults(faults);
+    sim_broker_set_publish_failures(device, options.publish_failures);
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    SimClockStats clock = sim_clock_stats();
+    for (uint32_t i = 0; i < options.taps; i++) {
+        if (options.outage_every > 0 && i > 0 && i % options.outage_every == 0) {
+            sim_broker_set_link(device, false);
+            outage_end_us = sim_now_us() + (int64_t)options.outage_ms * 1000;
+        }
+        runTap(users[i % users.size()]);
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    const SimClockStats &after = sim_clock_stats();
+    clock.reader_ns = after.reader_ns - clock.reader_ns;
+    clock.network_ns = after.network_ns - clock.network_ns;
+    clock.reader_loops = after.reader_loops - clock.reader_loops;
+    clock.network_loops = after.network_loops - clock.network_loops;
+
+    printReport(options.taps, wallSeconds, clock);
+    return tallies.missing == 0 || options.outage_every > 0 || options.publish_failures > 0 ? 0 : 1;
+}
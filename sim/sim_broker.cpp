@@ -0,0 +1,228 @@
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sim_broker.h"
+#include "sim_clock.h"
+#include "sim_platform.h"
+
+struct SimMessage {
+    int64_t arrives_us;
+    std::string topic;
+    std::string payload;
+};
+
+struct SimClient {
+    std::string name;
+    SimBrokerReceiver receiver;
+    bool link_up;
+    bool connected;
+    float publish_failures;
+    std::string will_topic;
+    std::string will;
+    bool will_retained;
+    std::vector<std::string> filters;
+    std::deque<SimMessage> inbox;
+};
+
+static std::vector<SimClient> clients;
+static std::map<std::string, std::string> retained_messages;
+static int64_t latency_us = 2000;
+static SimBrokerStats stats;
+
+bool sim_broker_topic_matches(const char* filter, const char* topic) {
+    while (*filter != '\0') {
+        if (*filter == '#') {
+            return true;
+        }
+        if (*filter == '+') {
+            while (*topic != '\0' && *topic != '/') {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*topic != *filter) {
+            // "a/#" also matches "a"
+            return *topic == '\0' && filter[0] == '/' && filter[1] == '#' && filter[2] == '\0';
+        }
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
+
+static bool valid(int client) {
+    return client >= 0 && (size_t)client < clients.size();
+}
+
+static bool subscribed(const SimClient& client, const char* topic) {
+    for (size_t i = 0; i < client.filters.size(); i++) {
+        if (sim_broker_topic_matches(client.filters[i].c_str(), topic)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void enqueue(SimClient& client, const std::string& topic, const std::string& payload) {
+    SimMessage message;
+    message.arrives_us = sim_now_us() + latency_us;
+    message.topic = topic;
+    message.payload = payload;
+    client.inbox.push_back(message);
+}
+
+static void route(const std::string& topic, const std::string& payload, bool retained) {
+    stats.published++;
+    if (retained) {
+        if (payload.empty()) {
+            retained_messages.erase(topic);
+        } else {
+            retained_messages[topic] = payload;
+        }
+    }
+    for (size_t i = 0; i < clients.size(); i++) {
+        if (clients[i].connected && subscribed(clients[i], topic.c_str())) {
+            enqueue(clients[i], topic, payload);
+        }
+    }
+}
+
+static void endSession(SimClient& client) {
+    if (!client.connected) {
+        return;
+    }
+    client.connected = false;
+    client.filters.clear();
+    stats.lost += (uint32_t)client.inbox.size();
+    client.inbox.clear();
+    if (!client.will_topic.empty()) {
+        stats.wills++;
+        route(client.will_topic, client.will, client.will_retained);
+    }
+}
+
+int sim_broker_client(const char* name, SimBrokerReceiver receiver) {
+    SimClient client;
+    client.name = name;
+    client.receiver = receiver;
+    client.link_up = true;
+    client.connected = false;
+    client.publish_failures = 0;
+    client.will_retained = false;
+    clients.push_back(client);
+    return (int)clients.size() - 1;
+}
+
+int sim_broker_find(const char* name) {
+    for (size_t i = 0; i < clients.size(); i++) {
+        if (clients[i].name == name) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+bool sim_broker_connect(int client, const char* willTopic, const char* will, bool willRetained) {
+    if (!valid(client) || !clients[client].link_up) {
+        return false;
+    }
+    SimClient& connecting = clients[client];
+    endSession(connecting);  // A new connection takes over the session (clean session)
+    connecting.connected = true;
+    connecting.will_topic = willTopic != nullptr ? willTopic : "";
+    connecting.will = will != nullptr ? will : "";
+    connecting.will_retained = willRetained;
+    return true;
+}
+
+bool sim_broker_connected(int client) {
+    return valid(client) && clients[client].connected;
+}
+
+bool sim_broker_link_up(int client) {
+    return valid(client) && clients[client].link_up;
+}
+
+void sim_broker_set_link(int client, bool up) {
+    if (!valid(client)) {
+        return;
+    }
+    clients[client].link_up = up;
+    if (!up) {
+        endSession(clients[client]);
+    }
+}
+
+bool sim_broker_subscribe(int client, const char* filter) {
+    if (!sim_broker_connected(client)) {
+        return false;
+    }
+    SimClient& subscriber = clients[client];
+    for (size_t i = 0; i < subscriber.filters.size(); i++) {
+        if (subscriber.filters[i] == filter) {
+            return true;
+        }
+    }
+    subscriber.filters.push_back(filter);
+    for (std::map<std::string, std::string>::const_iterator it = retained_messages.begin(); it != retained_messages.end(); ++it) {
+        if (sim_broker_topic_matches(filter, it->first.c_str())) {
+            enqueue(subscriber, it->first, it->second);
+        }
+    }
+    return true;
+}
+
+bool sim_broker_unsubscribe(int client, const char* filter) {
+    if (!sim_broker_connected(client)) {
+        return false;
+    }
+    std::vector<std::string>& filters = clients[client].filters;
+    for (size_t i = 0; i < filters.size(); i++) {
+        if (filters[i] == filter) {
+            filters.erase(filters.begin() + i);
+            return true;
+        }
+    }
+    return true;
+}
+
+bool sim_broker_publish(int client, const char* topic, const char* payload, size_t length, bool retained) {
+    if (!sim_broker_connected(client) || sim_chance(clients[client].publish_failures)) {
+        stats.failed++;
+        return false;
+    }
+    route(topic, std::string(payload, length), retained);
+    return true;
+}
+
+void sim_broker_poll(int client) {
+    if (!valid(client)) {
+        return;
+    }
+    // The receiver may publish (and end sessions), so the client is looked up for every message
+    while (clients[client].connected && !clients[client].inbox.empty() &&
+           clients[client].inbox.front().arrives_us <= sim_now_us()) {
+        SimMessage message = clients[client].inbox.front();
+        clients[client].inbox.pop_front();
+        stats.delivered++;
+        SimBrokerReceiver receiver = clients[client].receiver;
+        receiver(message.topic.c_str(), message.payload.c_str(), message.payload.size());
+    }
+}
+
+void sim_broker_set_latency(int64_t us) {
+    latency_us = us > 0 ? us : 0;
+}
+
+void sim_broker_set_publish_failures(int client, float probability) {
+    if (valid(client)) {
+        clients[client].publish_failures = probability;
+    }
+}
+
+const SimBrokerStats& sim_broker_stats() {
+    return stats;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// In-process stand-in for the MQTT broker. Clients (the firmware's EspMQTTClient, the simulated
+// backend) subscribe with MQTT topic filters ('+' and '#') and publish; a message reaches every
+// connected client with a matching subscription after the broker latency, in publish order,
+// once that client polls (the firmware does in client.loop()). A message matches a client
+// once however many of its subscriptions it matches. Retained messages are kept per topic and
+// go to new subscriptions. A client whose link goes down loses its session: subscriptions and
+// undelivered messages, and its last will is published.
+
+typedef std::function<void(const char* topic, const char* payload, size_t length)> SimBrokerReceiver;
+
+struct SimBrokerStats {
+    uint32_t published;
+    uint32_t failed;     // Publishes of a client without a session, or failed by fault injection
+    uint32_t delivered;
+    uint32_t lost;       // Undelivered when the session of the receiving client ended
+    uint32_t wills;
+};
+
+// Handles stay valid for the whole run
+int sim_broker_client(const char* name, SimBrokerReceiver receiver);
+int sim_broker_find(const char* name);
+
+// Starts a session; false while the link of the client is down
+bool sim_broker_connect(int client, const char* willTopic, const char* will, bool willRetained);
+bool sim_broker_connected(int client);
+bool sim_broker_link_up(int client);
+// The network path of the client; taking it down ends the session
+void sim_broker_set_link(int client, bool up);
+
+bool sim_broker_subscribe(int client, const char* filter);
+bool sim_broker_unsubscribe(int client, const char* filter);
+bool sim_broker_publish(int client, const char* topic, const char* payload, size_t length, bool retained);
+// Hand the messages that have arrived to the receiver of the client
+void sim_broker_poll(int client);
+
+void sim_broker_set_latency(int64_t us);
+// Probability that a publish of the client fails (the connection drops the packet)
+void sim_broker_set_publish_failures(int client, float probability);
+
+bool sim_broker_topic_matches(const char* filter, const char* topic);
+const SimBrokerStats& sim_broker_stats();
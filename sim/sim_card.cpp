@@ -0,0 +1,419 @@
+#include <string.h>
+
+#include "Desfire.h"
+#include "sim_card.h"
+#include "sim_clock.h"
+#include "sim_platform.h"
+
+#define PN532_ERROR_TIMEOUT 0x01
+
+static SimCard* field = nullptr;
+static SimCardTiming timing = {
+    20000,   // Command, ACK and status frames at 10 kHz software SPI
+    30000,   // + the target data
+    35000,   // InDataExchange with a short DESFire frame
+    410000,  // begin() holds the reset for 400 ms
+};
+static SimCardFaults faults;
+static SimCardStats stats;
+
+static void setKey(SimCardKey& key, const uint8_t* data, uint8_t size, uint8_t type, uint8_t version) {
+    memset(&key, 0, sizeof(key));
+    memcpy(key.data, data, size);
+    key.size = size;
+    key.type = type;
+    key.version = version;
+}
+
+static void copyKey(SimCardKey& key, DESFireKey* source) {
+    uint8_t size = (uint8_t)source->GetKeySize(16);  // A simple DES key is stored as k1 k1
+    setKey(key, source->Data(), size, (uint8_t)source->GetKeyType(), source->GetKeyVersion());
+}
+
+// DES keys carry the key version in their parity bits, the card ignores those
+static bool sameKey(const SimCardKey& key, DESFireKey* candidate) {
+    if (candidate == NULL || key.type != candidate->GetKeyType() || key.size != candidate->GetKeySize(16)) {
+        return false;
+    }
+    uint8_t mask = key.type == DF_KEY_AES ? 0xFF : 0xFE;
+    for (uint8_t i = 0; i < key.size; i++) {
+        if ((key.data[i] & mask) != (candidate->Data()[i] & mask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static SimCardApplication* findApplication(SimCard& card, uint32_t aid) {
+    for (int i = 0; i < SIM_CARD_APPLICATIONS; i++) {
+        if (aid != 0 && card.applications[i].aid == aid) {
+            return &card.applications[i];
+        }
+    }
+    return nullptr;
+}
+
+// One command to the card in the field. false if it did not answer: the PN532 reports a timeout.
+static bool exchange(byte& lastError, int commands = 1) {
+    for (int i = 0; i < commands; i++) {
+        stats.commands++;
+        sim_spend(timing.command_us);
+        if (field == nullptr || sim_chance(faults.timeouts)) {
+            stats.timeouts++;
+            lastError = PN532_ERROR_TIMEOUT;
+            if (field != nullptr) {
+                field->authenticated = false;
+            }
+            return false;
+        }
+    }
+    lastError = 0;
+    return true;
+}
+
+// The card answered with an error status; like a DESFire card it drops the authentication
+static bool reject() {
+    stats.rejected++;
+    field->authenticated = false;
+    return false;
+}
+
+void sim_card_init(SimCard& card, uint32_t serial, bool randomId) {
+    memset(&card, 0, sizeof(card));
+    card.uid[0] = 0x04;  // NXP
+    card.uid[1] = (uint8_t)(serial >> 24);
+    card.uid[2] = (uint8_t)(serial >> 16);
+    card.uid[3] = (uint8_t)(serial >> 8);
+    card.uid[4] = (uint8_t)serial;
+    card.uid[5] = 0x5A;
+    card.uid[6] = 0x80;
+    card.random_id = randomId;
+    card.picc_settings = KS_FACTORY_DEFAULT;
+
+    const uint8_t zero[8] = {0};
+    DES factoryKey;
+    factoryKey.SetKeyData(zero, sizeof(zero), 0);
+    copyKey(card.picc_key, &factoryKey);
+    for (int i = 0; i < SIM_CARD_APPLICATIONS; i++) {
+        card.applications[i].file_size = -1;
+    }
+}
+
+void sim_card_place(SimCard* card) {
+    field = card;
+}
+
+SimCard* sim_card_in_field() {
+    return field;
+}
+
+void sim_card_set_timing(const SimCardTiming& value) {
+    timing = value;
+}
+
+void sim_card_set_faults(const SimCardFaults& value) {
+    faults = value;
+}
+
+const SimCardStats& sim_card_stats() {
+    return stats;
+}
+
+// ----- PN532 -----
+
+PN532::PN532() {
+    mu8_DebugLevel = 0;
+    mu8_ClkPin = 0;
+    mu8_MisoPin = 0;
+    mu8_MosiPin = 0;
+    mu8_SselPin = 0;
+    mu8_ResetPin = 0;
+}
+
+void PN532::InitSoftwareSPI(byte u8_Clk, byte u8_Miso, byte u8_Mosi, byte u8_Sel, byte u8_Reset) {
+    mu8_ClkPin = u8_Clk;
+    mu8_MisoPin = u8_Miso;
+    mu8_MosiPin = u8_Mosi;
+    mu8_SselPin = u8_Sel;
+    mu8_ResetPin = u8_Reset;
+}
+
+void PN532::begin() {
+    sim_spend(timing.reset_us);
+}
+
+void PN532::SetDebugLevel(byte level) {
+    mu8_DebugLevel = level;
+}
+
+bool PN532::GetFirmwareVersion(byte* pIcType, byte* pVersionHi, byte* pVersionLo, byte* pFlags) {
+    sim_spend(timing.poll_us);
+    *pIcType = 0x32;
+    *pVersionHi = 1;
+    *pVersionLo = 6;
+    *pFlags = 0x07;
+    return true;
+}
+
+bool PN532::SetPassiveActivationRetries() {
+    sim_spend(timing.poll_us);
+    return true;
+}
+
+bool PN532::SamConfig() {
+    sim_spend(timing.poll_us);
+    return true;
+}
+
+bool PN532::SwitchOffRfField() {
+    return true;
+}
+
+bool PN532::ReadPassiveTargetID(byte* u8_UidBuffer, byte* pu8_UidLength, eCardType* pe_CardType) {
+    stats.polls++;
+    *pu8_UidLength = 0;
+    *pe_CardType = CARD_Unknown;
+    if (sim_chance(faults.poll_errors)) {
+        stats.poll_errors++;
+        sim_spend(timing.poll_us);
+        return false;
+    }
+    if (field == nullptr) {
+        sim_spend(timing.poll_us);
+        return true;  // No card is not an error
+    }
+
+    stats.detections++;
+    sim_spend(timing.detect_us);
+    field->selected = 0;
+    field->authenticated = false;
+    if (field->random_id) {
+        u8_UidBuffer[0] = 0x08;  // Random ID
+        uint32_t random = sim_random();
+        memcpy(u8_UidBuffer + 1, &random, 3);
+        *pu8_UidLength = 4;
+        *pe_CardType = CARD_DesRandom;
+    } else {
+        memcpy(u8_UidBuffer, field->uid, sizeof(field->uid));
+        *pu8_UidLength = sizeof(field->uid);
+        *pe_CardType = CARD_Desfire;
+    }
+    return true;
+}
+
+// ----- Desfire -----
+
+Desfire::Desfire()
+    : mi_CmacBuffer(mu8_CmacBuffer_Data, sizeof(mu8_CmacBuffer_Data)) {
+    mpi_SessionKey = NULL;
+    mu8_LastAuthKeyNo = NOT_AUTHENTICATED;
+    mu8_LastPN532Error = 0;
+    mu32_LastApplication = 0x000000;
+
+    const byte ZERO_KEY[24] = {0};
+    DES2_DEFAULT_KEY.SetKeyData(ZERO_KEY, 8, 0);
+    DES3_DEFAULT_KEY.SetKeyData(ZERO_KEY, 24, 0);
+    AES_DEFAULT_KEY.SetKeyData(ZERO_KEY, 16, 0);
+}
+
+bool Desfire::SwitchOffRfField() {
+    mu8_LastAuthKeyNo = NOT_AUTHENTICATED;
+    mu32_LastApplication = 0x000000;
+    if (field != nullptr) {
+        field->selected = 0;
+        field->authenticated = false;
+    }
+    return PN532::SwitchOffRfField();
+}
+
+byte Desfire::GetLastPN532Error() {
+    return mu8_LastPN532Error;
+}
+
+bool Desfire::SelectApplication(uint32_t u32_AppID) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    if (u32_AppID != 0 && findApplication(*field, u32_AppID) == nullptr) {
+        return reject();
+    }
+    field->selected = u32_AppID;
+    field->authenticated = false;
+    mu32_LastApplication = u32_AppID;
+    mu8_LastAuthKeyNo = NOT_AUTHENTICATED;
+    return true;
+}
+
+bool Desfire::GetKeyVersion(byte u8_KeyNo, byte* pu8_Version) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    SimCardApplication* application = findApplication(*field, field->selected);
+    if (u8_KeyNo != 0 || (field->selected != 0 && application == nullptr)) {
+        return reject();
+    }
+    *pu8_Version = application != nullptr ? application->key.version : field->picc_key.version;
+    return true;
+}
+
+bool Desfire::Authenticate(byte u8_KeyNo, DESFireKey* pi_Key) {
+    if (!exchange(mu8_LastPN532Error, 2)) {
+        return false;
+    }
+    SimCardApplication* application = findApplication(*field, field->selected);
+    const SimCardKey& key = application != nullptr ? application->key : field->picc_key;
+    if (u8_KeyNo != 0 || !sameKey(key, pi_Key)) {
+        mu8_LastAuthKeyNo = NOT_AUTHENTICATED;
+        return reject();
+    }
+    field->authenticated = true;
+    mu8_LastAuthKeyNo = u8_KeyNo;
+    return true;
+}
+
+bool Desfire::ChangeKey(byte u8_KeyNo, DESFireKey* pi_NewKey, DESFireKey* pi_CurKey) {
+    (void)pi_CurKey;  // Only needed to change a key other than the authenticated one
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    SimCardApplication* application = findApplication(*field, field->selected);
+    uint8_t settings = application != nullptr ? application->settings : field->picc_settings;
+    if (u8_KeyNo != 0 || !field->authenticated || !(settings & KS_ALLOW_CHANGE_MK) ||
+        (application != nullptr && application->key.type != pi_NewKey->GetKeyType())) {
+        return reject();
+    }
+    copyKey(application != nullptr ? application->key : field->picc_key, pi_NewKey);
+
+    // The key of the authentication has changed
+    field->authenticated = false;
+    mu8_LastAuthKeyNo = NOT_AUTHENTICATED;
+    return true;
+}
+
+bool Desfire::ChangeKeySettings(DESFireKeySettings e_NewSettg) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    SimCardApplication* application = findApplication(*field, field->selected);
+    uint8_t& settings = application != nullptr ? application->settings : field->picc_settings;
+    if (!field->authenticated || !(settings & KS_CONFIGURATION_CHANGEABLE)) {
+        return reject();
+    }
+    settings = (uint8_t)e_NewSettg;
+    return true;
+}
+
+bool Desfire::CreateApplication(uint32_t u32_AppID, DESFireKeySettings e_Settg, byte u8_KeyCount, DESFireKeyType e_KeyType) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    if (field->selected != 0 || u32_AppID == 0 || u8_KeyCount == 0 ||
+        (!field->authenticated && !(field->picc_settings & KS_CREATE_DELETE_WITHOUT_MK)) ||
+        findApplication(*field, u32_AppID) != nullptr) {
+        return reject();
+    }
+    SimCardApplication* application = nullptr;
+    for (int i = 0; i < SIM_CARD_APPLICATIONS && application == nullptr; i++) {
+        if (field->applications[i].aid == 0) {
+            application = &field->applications[i];
+        }
+    }
+    if (application == nullptr) {
+        return reject();  // Out of EEPROM
+    }
+
+    // The keys of a new application are zero
+    const uint8_t zero[24] = {0};
+    memset(application, 0, sizeof(*application));
+    application->aid = u32_AppID;
+    application->settings = (uint8_t)e_Settg;
+    setKey(application->key, zero, e_KeyType == DF_KEY_3K3DES ? 24 : 16, (uint8_t)e_KeyType, 0);
+    application->file_size = -1;
+    return true;
+}
+
+bool Desfire::DeleteApplication(uint32_t u32_AppID) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    SimCardApplication* application = findApplication(*field, u32_AppID);
+    if (field->selected != 0 || !field->authenticated || application == nullptr) {
+        return reject();
+    }
+    memset(application, 0, sizeof(*application));
+    application->file_size = -1;
+    return true;
+}
+
+// Lists the applications first, like the library
+bool Desfire::DeleteApplicationIfExists(uint32_t u32_AppID) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    if (findApplication(*field, u32_AppID) == nullptr) {
+        return true;
+    }
+    return DeleteApplication(u32_AppID);
+}
+
+bool Desfire::CreateStdDataFile(byte u8_FileID, DESFireFilePermissions* pk_Permis, int s32_FileSize) {
+    (void)pk_Permis;
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    SimCardApplication* application = findApplication(*field, field->selected);
+    if (application == nullptr || application->file_size >= 0 || s32_FileSize > SIM_CARD_FILE_SIZE ||
+        (!field->authenticated && !(application->settings & KS_CREATE_DELETE_WITHOUT_MK))) {
+        return reject();
+    }
+    application->file_id = u8_FileID;
+    application->file_size = (int16_t)s32_FileSize;
+    memset(application->file, 0, sizeof(application->file));
+    return true;
+}
+
+// The file of the selected application, nullptr if the range is not in it
+static uint8_t* fileRange(byte u8_FileID, int s32_Offset, int s32_Length) {
+    SimCardApplication* application = findApplication(*field, field->selected);
+    if (application == nullptr || !field->authenticated || application->file_size < 0 ||
+        application->file_id != u8_FileID || s32_Offset < 0 || s32_Length < 0 ||
+        s32_Offset + s32_Length > application->file_size) {
+        return nullptr;
+    }
+    return application->file + s32_Offset;
+}
+
+bool Desfire::ReadFileData(byte u8_FileID, int s32_Offset, int s32_Length, byte* u8_DataBuffer) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    uint8_t* data = fileRange(u8_FileID, s32_Offset, s32_Length);
+    if (data == nullptr) {
+        return reject();
+    }
+    memcpy(u8_DataBuffer, data, s32_Length);
+    return true;
+}
+
+bool Desfire::WriteFileData(byte u8_FileID, int s32_Offset, int s32_Length, const byte* u8_DataBuffer) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    uint8_t* data = fileRange(u8_FileID, s32_Offset, s32_Length);
+    if (data == nullptr) {
+        return reject();
+    }
+    memcpy(data, u8_DataBuffer, s32_Length);
+    return true;
+}
+
+bool Desfire::GetRealCardID(byte u8_UID[7]) {
+    if (!exchange(mu8_LastPN532Error)) {
+        return false;
+    }
+    if (field->selected != 0 || !field->authenticated) {
+        return reject();
+    }
+    memcpy(u8_UID, field->uid, sizeof(field->uid));
+    return true;
+}
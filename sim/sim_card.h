@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+// Simulated PN532 and DESFire EV1 cards. sim_card.cpp defines the member functions of the
+// PN532 and Desfire classes of lib/RFID-Secure-Doorlock that card.cpp calls (PN532.cpp and
+// Desfire.cpp are not built), so card.cpp runs unchanged against a model of the card: the
+// PICC master key and key settings, applications with their master key, and one standard data
+// file per application. Keys are compared instead of running the 3-pass authentication, and
+// the data files need an authentication with key 0 (what card.cpp sets up). Every exchange
+// takes virtual time on the NFC task.
+
+#define SIM_CARD_APPLICATIONS 4
+#define SIM_CARD_FILE_SIZE 64
+
+struct SimCardKey {
+    uint8_t data[24];
+    uint8_t size;
+    uint8_t type;  // DESFireKeyType
+    uint8_t version;
+};
+
+struct SimCardApplication {
+    uint32_t aid;  // 0 -> slot unused
+    uint8_t settings;
+    SimCardKey key;
+    int16_t file_size;  // -1 -> no file
+    uint8_t file_id;
+    uint8_t file[SIM_CARD_FILE_SIZE];
+};
+
+struct SimCard {
+    uint8_t uid[7];
+    bool random_id;  // Answers polls with a random 4 byte UID
+    uint8_t picc_settings;
+    SimCardKey picc_key;
+    SimCardApplication applications[SIM_CARD_APPLICATIONS];
+
+    // Session, reset whenever the card is activated by a poll
+    uint32_t selected;
+    bool authenticated;
+};
+
+struct SimCardTiming {
+    uint32_t poll_us;     // InListPassiveTarget without a card in the field
+    uint32_t detect_us;   // InListPassiveTarget that activates a card
+    uint32_t command_us;  // One DESFire command through the PN532 (an authentication is two)
+    uint32_t reset_us;    // PN532 reset in begin()
+};
+
+struct SimCardFaults {
+    float poll_errors;  // A poll gets no valid answer from the PN532
+    float timeouts;     // A DESFire command times out (the card is at the edge of the field)
+};
+
+struct SimCardStats {
+    uint32_t polls;
+    uint32_t detections;
+    uint32_t commands;
+    uint32_t poll_errors;
+    uint32_t timeouts;
+    uint32_t rejected;  // Commands the card answered with an error status
+};
+
+// A card as it leaves the factory: UID from the serial, the default DES PICC master key
+void sim_card_init(SimCard& card, uint32_t serial, bool randomId = false);
+// Puts a card in the RF field, nullptr takes it away
+void sim_card_place(SimCard* card);
+SimCard* sim_card_in_field();
+
+void sim_card_set_timing(const SimCardTiming& timing);
+void sim_card_set_faults(const SimCardFaults& faults);
+const SimCardStats& sim_card_stats();
@@ -0,0 +1,116 @@
+#include <chrono>
+
+#include "sim_clock.h"
+
+enum class SimTask : uint8_t {
+    NONE,  // The harness, between two ticks
+    NFC,
+    NETWORK,
+};
+
+static int64_t now_us = 0;
+static int64_t tick_us = SIM_TICK_US;
+static int64_t nfc_next_us = 0;
+static int64_t network_next_us = 0;
+static SimTask current = SimTask::NONE;
+static void (*nfc_task)() = nullptr;
+static void (*network_task)() = nullptr;
+static void (*tick_hook)() = nullptr;
+static SimClockStats stats;
+static uint64_t outside_reader_ns = 0;  // Network ticks and tick hooks, also while the NFC task is busy
+
+static uint64_t hostNanos() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Network ticks due up to until_us
+static void runNetwork(int64_t until_us) {
+    while (network_next_us <= until_us) {
+        if (now_us < network_next_us) {
+            now_us = network_next_us;
+        }
+        uint64_t tick_started = hostNanos();
+        if (tick_hook != nullptr) {
+            tick_hook();
+        }
+
+        SimTask interrupted = current;
+        current = SimTask::NETWORK;
+        uint64_t started = hostNanos();
+        if (network_task != nullptr) {
+            network_task();
+        }
+        stats.network_ns += hostNanos() - started;
+        stats.network_loops++;
+        current = interrupted;
+        outside_reader_ns += hostNanos() - tick_started;
+
+        network_next_us = now_us + tick_us;
+    }
+}
+
+int64_t sim_now_us() {
+    return now_us;
+}
+
+void sim_spend(int64_t us) {
+    if (us <= 0) {
+        return;
+    }
+    int64_t until = now_us + us;
+    if (current == SimTask::NFC) {
+        runNetwork(until);
+    }
+    if (now_us < until) {
+        now_us = until;
+    }
+}
+
+bool sim_run(int64_t us, bool (*done)()) {
+    int64_t until = now_us + us;
+    while (nfc_next_us <= until) {
+        // On a tie the network task goes first: commands it receives are seen by this reader tick
+        runNetwork(nfc_next_us);
+        if (now_us < nfc_next_us) {
+            now_us = nfc_next_us;
+        }
+
+        current = SimTask::NFC;
+        uint64_t outside_before = outside_reader_ns;
+        uint64_t started = hostNanos();
+        if (nfc_task != nullptr) {
+            nfc_task();
+        }
+        stats.reader_ns += hostNanos() - started - (outside_reader_ns - outside_before);
+        stats.reader_loops++;
+        current = SimTask::NONE;
+
+        nfc_next_us = now_us + tick_us;
+        if (done != nullptr && done()) {
+            return true;
+        }
+    }
+    runNetwork(until);
+    if (now_us < until) {
+        now_us = until;
+    }
+    return false;
+}
+
+void sim_set_tasks(void (*nfc)(), void (*network)()) {
+    nfc_task = nfc;
+    network_task = network;
+}
+
+void sim_set_tick_hook(void (*hook)()) {
+    tick_hook = hook;
+}
+
+void sim_set_tick(int64_t us) {
+    tick_us = us > 0 ? us : SIM_TICK_US;
+}
+
+const SimClockStats& sim_clock_stats() {
+    return stats;
+}
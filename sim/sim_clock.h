@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+// Virtual time of the simulator and the two firmware tasks that run on it.
+// The NFC task (reader_loop) and the network task (network_loop) take turns on one thread,
+// each once per tick like after their vTaskDelay(1) on the device. Time only moves when a
+// task spends it: while a card exchange, a display update or a delay() holds the NFC task,
+// the network task keeps getting its ticks, as it does on its own core. A delay() on the
+// network task holds the network task only.
+// Tools that do not run the firmware leave the tasks unset and work in the tick hook.
+
+#define SIM_TICK_US 1000
+
+struct SimClockStats {
+    uint64_t reader_loops;
+    uint64_t network_loops;
+    uint64_t reader_ns;   // Host time in the NFC task, without the network ticks run inside it
+    uint64_t network_ns;  // Host time in the network task
+};
+
+int64_t sim_now_us();
+
+// Run both tasks until the virtual time has advanced by us. With done, stops after the first
+// tick at which it returns true; returns whether it did.
+bool sim_run(int64_t us, bool (*done)() = nullptr);
+
+// The running task is busy for us (card exchange, display, delay)
+void sim_spend(int64_t us);
+
+// Loop functions of the two tasks (reader_loop and network_loop), nullptr for none
+void sim_set_tasks(void (*nfc)(), void (*network)());
+
+// Called at every tick before the tasks run, e.g. for the backend
+void sim_set_tick_hook(void (*hook)());
+
+// Ticks of more than SIM_TICK_US trade timing resolution for a faster run
+void sim_set_tick(int64_t us);
+
+const SimClockStats& sim_clock_stats();
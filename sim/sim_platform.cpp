@@ -0,0 +1,236 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <LiquidCrystal_I2C.h>
+#include <Adafruit_SSD1306.h>
+#include <map>
+
+#include "sim_platform.h"
+#include "sim_clock.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+TwoWire Wire;
+
+static SimPlatformTiming timing = {
+    23000,  // 1 KB frame + addressing at 400 kHz
+    2000,
+};
+static SimPlatformStats stats;
+static bool serial_output = false;
+static uint32_t sim_state = 1;
+static uint32_t esp_state = 1;
+
+static uint32_t xorshift(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+void sim_set_platform_timing(const SimPlatformTiming& value) {
+    timing = value;
+}
+
+void sim_serial_output(bool enabled) {
+    serial_output = enabled;
+}
+
+const SimPlatformStats& sim_platform_stats() {
+    return stats;
+}
+
+void sim_seed(uint32_t seed) {
+    sim_state = seed != 0 ? seed : 1;
+    esp_state = (seed ^ 0x9E3779B9u) != 0 ? seed ^ 0x9E3779B9u : 1;
+}
+
+uint32_t sim_random() {
+    return xorshift(sim_state);
+}
+
+bool sim_chance(float probability) {
+    return probability > 0 && (sim_random() >> 8) < (uint32_t)(probability * (1 << 24));
+}
+
+// ----- Arduino core -----
+
+size_t HardwareSerial::print(const char* text) {
+    if (serial_output) {
+        fputs(text, stdout);
+    }
+    return strlen(text);
+}
+
+size_t HardwareSerial::print(char c) {
+    if (serial_output) {
+        fputc(c, stdout);
+    }
+    return 1;
+}
+
+size_t HardwareSerial::print(long long value, int base) {
+    if (base != DEC) {
+        return print((unsigned long long)value, base);
+    }
+    char text[24];
+    snprintf(text, sizeof(text), "%lld", value);
+    return print(text);
+}
+
+size_t HardwareSerial::print(unsigned long long value, int base) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%llX" : "%llu", value);
+    return print(text);
+}
+
+size_t HardwareSerial::print(double value, int digits) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return print(text);
+}
+
+void EspClass::restart() {
+    stats.restarts++;
+    Serial.println("[sim] ESP.restart() - the simulation goes on");
+}
+
+extern "C" int64_t esp_timer_get_time() {
+    return sim_now_us();
+}
+
+unsigned long millis() {
+    return (unsigned long)(uint32_t)(sim_now_us() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)(uint32_t)sim_now_us();
+}
+
+void delay(uint32_t ms) {
+    sim_spend((int64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    sim_spend(us);
+}
+
+void yield() {
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    (void)pin;
+    (void)value;
+}
+
+int digitalRead(uint8_t pin) {
+    (void)pin;
+    return HIGH;
+}
+
+long random(long max) {
+    return max > 0 ? (long)(esp_random() % (uint32_t)max) : 0;
+}
+
+long random(long min, long max) {
+    return min < max ? min + random(max - min) : min;
+}
+
+extern "C" uint32_t esp_random() {
+    return xorshift(esp_state);
+}
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char* server1,
+                const char* server2, const char* server3) {
+    (void)gmtOffset_sec;
+    (void)daylightOffset_sec;
+    (void)server1;
+    (void)server2;
+    (void)server3;
+}
+
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t length = strlen(src);
+    if (size > 0) {
+        size_t count = length >= size ? size - 1 : length;
+        memcpy(dst, src, count);
+        dst[count] = '\0';
+    }
+    return length;
+}
+
+// ----- Preferences -----
+
+static std::map<std::string, std::string>& nvs() {
+    static std::map<std::string, std::string> entries;
+    return entries;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    space = std::string(name) + "/";
+    this->readOnly = readOnly;
+    opened = true;
+    return true;
+}
+
+void Preferences::end() {
+    opened = false;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    if (!opened || readOnly) {
+        return 0;
+    }
+    nvs()[space + key].assign((const char*)value, length);
+    return length;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+    std::map<std::string, std::string>::const_iterator entry = nvs().find(space + key);
+    if (!opened || entry == nvs().end() || entry->second.size() > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, entry->second.data(), entry->second.size());
+    return entry->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    std::map<std::string, std::string>::const_iterator entry = nvs().find(space + key);
+    return opened && entry != nvs().end() ? entry->second.size() : 0;
+}
+
+bool Preferences::remove(const char* key) {
+    return opened && !readOnly && nvs().erase(space + key) > 0;
+}
+
+size_t Preferences::putString(const char* key, const String& value) {
+    return putBytes(key, value.c_str(), value.length());
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+    std::map<std::string, std::string>::const_iterator entry = nvs().find(space + key);
+    return opened && entry != nvs().end() ? String(entry->second) : defaultValue;
+}
+
+// ----- Displays -----
+
+void LiquidCrystal_I2C::clear() {
+    sim_spend(timing.lcd_command_us);
+}
+
+size_t LiquidCrystal_I2C::print(const String& text) {
+    sim_spend(timing.lcd_command_us);
+    return text.length();
+}
+
+void Adafruit_SSD1306::display() {
+    stats.display_frames++;
+    sim_spend(timing.display_frame_us);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+// Controls of the platform stand-ins in sim/ (Arduino.h, esp_timer.h, Preferences.h, WiFi.h and
+// the displays). The hardware they stand for takes virtual time on the task that uses it.
+
+struct SimPlatformTiming {
+    uint32_t display_frame_us;  // One SSD1306 frame over I2C at 400 kHz
+    uint32_t lcd_command_us;    // LiquidCrystal_I2C clear or print
+};
+
+struct SimPlatformStats {
+    uint32_t restarts;  // ESP.restart() is counted, the run goes on
+    uint32_t display_frames;
+};
+
+void sim_set_platform_timing(const SimPlatformTiming& timing);
+// Firmware output (Serial) on stdout
+void sim_serial_output(bool enabled);
+const SimPlatformStats& sim_platform_stats();
+
+// Random numbers for the simulator (fault injection, the scripted taps), reproducible from the
+// seed. The firmware's esp_random() draws from a stream of its own.
+void sim_seed(uint32_t seed);
+uint32_t sim_random();
+bool sim_chance(float probability);
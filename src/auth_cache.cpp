@@ -0,0 +1,266 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+
+#include "auth_cache.h"
+#include "mqtt_serialization.h"
+
+#define AUTH_CACHE_NAMESPACE "authcache"
+#define AUTH_CACHE_LEGACY_KEY "entries" // Whole table in one blob, larger than NVS takes on IDF 3.3
+#define AUTH_CACHE_SLOT_KEY "s%02u"       // One blob per slot, an empty slot has none
+#define NVS_MAX_BLOB_SIZE 1984              // One NVS page, IDF before 4.2 does not split blobs
+
+enum SlotState : uint8_t
+{
+  SLOT_EMPTY = 0,
+  SLOT_USED,
+  SLOT_DELETED // Tombstone, keeps probe chains intact
+};
+
+struct AuthCacheSlot
+{
+  uint8_t state;
+  AuthCacheEntry entry;
+};
+
+static_assert(sizeof(AuthCacheSlot) <= NVS_MAX_BLOB_SIZE, "a cache slot does not fit into one NVS blob");
+
+static AuthCacheSlot slots[AUTH_CACHE_CAPACITY];
+static bool dirty[AUTH_CACHE_CAPACITY]; // Changed since the last persist()
+static size_t used_slots = 0;
+
+static uint32_t hashUid(const uint8_t uid[8])
+{
+  // FNV-1a
+  uint32_t hash = 2166136261UL;
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    hash ^= uid[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Slot holding uid, or -1
+static int findSlot(const uint8_t uid[8])
+{
+  uint32_t index = hashUid(uid) & (AUTH_CACHE_CAPACITY - 1);
+  for (size_t probe = 0; probe < AUTH_CACHE_CAPACITY; probe++)
+  {
+    AuthCacheSlot &slot = slots[index];
+    if (slot.state == SLOT_EMPTY)
+    {
+      return -1;
+    }
+    if (slot.state == SLOT_USED && memcmp(slot.entry.uid, uid, 8) == 0)
+    {
+      return (int)index;
+    }
+    index = (index + 1) & (AUTH_CACHE_CAPACITY - 1);
+  }
+  return -1;
+}
+
+static bool insertEntry(const AuthCacheEntry &entry)
+{
+  int existing = findSlot(entry.uid);
+  if (existing >= 0)
+  {
+    slots[existing].entry = entry;
+    dirty[existing] = true;
+    return true;
+  }
+
+  uint32_t index = hashUid(entry.uid) & (AUTH_CACHE_CAPACITY - 1);
+  for (size_t probe = 0; probe < AUTH_CACHE_CAPACITY; probe++)
+  {
+    AuthCacheSlot &slot = slots[index];
+    if (slot.state != SLOT_USED)
+    {
+      slot.state = SLOT_USED;
+      slot.entry = entry;
+      dirty[index] = true;
+      used_slots++;
+      return true;
+    }
+    index = (index + 1) & (AUTH_CACHE_CAPACITY - 1);
+  }
+  return false;
+}
+
+static void removeEntry(const uint8_t uid[8])
+{
+  int index = findSlot(uid);
+  if (index >= 0)
+  {
+    slots[index].state = SLOT_DELETED;
+    memset(&slots[index].entry, 0, sizeof(AuthCacheEntry));
+    dirty[index] = true;
+    used_slots--;
+  }
+}
+
+// Write the slots changed since the last call, each as its own small blob: a sync of a few
+// entries rewrites a few hundred bytes of flash, not the table, and an entry synced again
+// unchanged is not written at all. Tombstones are kept so the probe chains are the same
+// after a restart. A slot that failed stays dirty.
+static void persist()
+{
+  Preferences store;
+  store.begin(AUTH_CACHE_NAMESPACE, false);
+  bool failed = false;
+  char key[8];
+  AuthCacheSlot stored;
+  for (size_t i = 0; i < AUTH_CACHE_CAPACITY; i++)
+  {
+    if (!dirty[i])
+    {
+      continue;
+    }
+    snprintf(key, sizeof(key), AUTH_CACHE_SLOT_KEY, (unsigned)i);
+    if (slots[i].state == SLOT_EMPTY)
+    {
+      store.remove(key); // Fails only if there is nothing stored
+      dirty[i] = false;
+    }
+    else if ((store.getBytes(key, &stored, sizeof(stored)) == sizeof(stored) &&
+              memcmp(&stored, &slots[i], sizeof(stored)) == 0) ||
+             store.putBytes(key, &slots[i], sizeof(AuthCacheSlot)) == sizeof(AuthCacheSlot))
+    {
+      dirty[i] = false; // Unchanged (the same entry synced again) or written
+    }
+    else
+    {
+      failed = true;
+    }
+  }
+  store.end();
+
+  if (failed)
+  {
+    Serial.println("Failed to persist auth cache");
+  }
+}
+
+void auth_cache_begin()
+{
+  memset(slots, 0, sizeof(slots));
+  memset(dirty, 0, sizeof(dirty));
+  used_slots = 0;
+
+  Preferences store;
+  store.begin(AUTH_CACHE_NAMESPACE, false);
+  store.remove(AUTH_CACHE_LEGACY_KEY);
+
+  char key[8];
+  for (size_t i = 0; i < AUTH_CACHE_CAPACITY; i++)
+  {
+    snprintf(key, sizeof(key), AUTH_CACHE_SLOT_KEY, (unsigned)i);
+    // A blob of another size was written by a firmware with a different layout -> slot empty
+    if (store.getBytesLength(key) != sizeof(AuthCacheSlot) ||
+        store.getBytes(key, &slots[i], sizeof(AuthCacheSlot)) != sizeof(AuthCacheSlot) ||
+        (slots[i].state != SLOT_USED && slots[i].state != SLOT_DELETED))
+    {
+      memset(&slots[i], 0, sizeof(AuthCacheSlot));
+      continue;
+    }
+    if (slots[i].state == SLOT_USED)
+    {
+      used_slots++;
+    }
+  }
+  store.end();
+
+  Serial.print("Auth cache entries: ");
+  Serial.println(used_slots);
+}
+
+bool auth_cache_apply(const AuthCacheSyncPayload &sync)
+{
+  bool complete = true;
+
+  if (sync.replace)
+  {
+    auth_cache_clear();
+  }
+
+  for (uint8_t i = 0; i < sync.entry_count; i++)
+  {
+    const AuthCacheEntryPayload &item = sync.entries[i];
+
+    AuthCacheEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    if (!tagUidToBinary(item.tag_uid, entry.uid, sizeof(entry.uid)))
+    {
+      continue; // Validated by the parser already
+    }
+
+    if (item.key[0] == '\0')
+    {
+      removeEntry(entry.uid);
+      continue;
+    }
+
+    for (uint8_t b = 0; b < sizeof(entry.key); b++)
+    {
+      sscanf(&item.key[b * 2], "%2hhx", &entry.key[b]);
+    }
+    entry.permissions = item.permissions;
+    entry.expires_at = item.expires_at;
+    strlcpy(entry.username, item.username, sizeof(entry.username));
+
+    if (!insertEntry(entry))
+    {
+      Serial.print("Auth cache full - dropping ");
+      Serial.println(item.tag_uid);
+      complete = false;
+    }
+  }
+
+  persist();
+
+  Serial.print("Auth cache synced, entries: ");
+  Serial.println(used_slots);
+  return complete;
+}
+
+bool auth_cache_find(const uint8_t uid[8], AuthCacheEntry *entry)
+{
+  int index = findSlot(uid);
+  if (index < 0)
+  {
+    return false;
+  }
+
+  const AuthCacheEntry &cached = slots[index].entry;
+  if (cached.expires_at != 0)
+  {
+    time_t now = time(nullptr);
+    if (now < (time_t)AUTH_CACHE_MIN_VALID_TIME || (uint32_t)now >= cached.expires_at)
+    {
+      return false;
+    }
+  }
+
+  *entry = cached;
+  return true;
+}
+
+size_t auth_cache_size()
+{
+  return used_slots;
+}
+
+// Also drops the persisted entries with the next persist()
+void auth_cache_clear()
+{
+  for (size_t i = 0; i < AUTH_CACHE_CAPACITY; i++)
+  {
+    if (slots[i].state != SLOT_EMPTY)
+    {
+      dirty[i] = true;
+    }
+  }
+  memset(slots, 0, sizeof(slots));
+  used_slots = 0;
+}
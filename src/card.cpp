@@ -1,5 +1,6 @@
 #include "card.h"
 #include "display.h"
+#include "tap_trace.h"
 #include "Utils.h"
 
 #if USE_DESFIRE
@@ -160,9 +161,8 @@ bool customize_card(const char *user_buff, const unsigned char *encript_key, uns
     // Card is already read and validated by caller - no need to wait again
     kUser k_User;
     
-    // Copy the card UID from the already-read card
-    // Extract UID from the last read card (stored in register_state.tag_uid_binary in main.cpp)
-    // Note: The caller should ensure pk_Card contains valid data
+    // The secrets are derived from the UID of the card that was read, as authenticate_user() does
+    memcpy(k_User.ID.u8, ID, 7);
     
     // First the entire memory of s8_Name is filled with random data.
     // Then the username + terminating zero is written over it.
@@ -205,12 +205,6 @@ bool customize_card(const char *user_buff, const unsigned char *encript_key, uns
 
     // vault = k_User; // hab ich eingebaut und bin nicht stolz
 
-    // Note: We need to get the ID from somewhere. Since the card is already read,
-    // we should get it from the register_state in main.cpp
-    // For now, we'll return the UID that was passed to us
-    // The caller should have already stored the UID in register_state.tag_uid_binary
-    // memcpy(ID, k_User.ID.u8, 7);
-    
     Utils::Print("Customisatzion done");
     return true;
     // UserManager::StoreNewUser(&k_User);
@@ -330,6 +324,25 @@ bool authenticate_user(unsigned char *ID, char *user_buffer, kCard *pk_Card, uns
     return true;
 }
 
+// Authenticate the card and compare the key stored on it with the expected keys.
+// The key is read from the card once, so any number of candidates costs a single authentication.
+// Returns the index of the matching key, -1 if authentication failed or no key matches.
+int authenticate_user_keys(unsigned char *ID, char *user_buffer, kCard *pk_Card, const unsigned char (*expected_keys)[enc_key_length], uint8_t key_count)
+{
+    unsigned char key[enc_key_length] = {0};
+    if (!authenticate_user(ID, user_buffer, pk_Card, key))
+        return -1;
+
+    for (uint8_t i = 0; i < key_count; i++)
+    {
+        if (memcmp(key, expected_keys[i], enc_key_length) == 0)
+            return i;
+    }
+
+    Utils::Print("The card key does not match the expected keys.\r\n");
+    return -1;
+}
+
 // =================================== DESFIRE ONLY =========================================
 
 #if USE_DESFIRE
@@ -338,6 +351,8 @@ bool authenticate_user(unsigned char *ID, char *user_buffer, kCard *pk_Card, uns
 // otherwise authenticate with the factory default DES key.
 bool AuthenticatePICC(byte *pu8_KeyVersion)
 {
+    TapTraceScope span(TraceSpan::PICC_AUTH);
+
     if (!gi_PN532.SelectApplication(0x000000)) // PICC level
         return false;
 
@@ -363,6 +378,8 @@ bool AuthenticatePICC(byte *pu8_KeyVersion)
 // This function takes only 6 milliseconds to do the cryptographic calculations.
 bool GenerateDesfireSecrets(kUser *pk_User, DESFireKey *pi_AppMasterKey, byte u8_StoreValue[16])
 {
+    TapTraceScope span(TraceSpan::CRYPTO);
+
     // The buffer is initialized to zero here
     byte u8_Data[24] = {0};
 
@@ -397,10 +414,19 @@ bool GenerateDesfireSecrets(kUser *pk_User, DESFireKey *pi_AppMasterKey, byte u8
     return true;
 }
 
+// Read from the file of the application that holds the secret and the key
+static bool ReadCardFile(int s32_Offset, int s32_Length, byte *u8_DataBuffer)
+{
+    TapTraceScope span(TraceSpan::FILE_READ);
+    return gi_PN532.ReadFileData(CARD_FILE_ID, s32_Offset, s32_Length, u8_DataBuffer);
+}
+
 // Check that the data stored on the card is the same as the secret generated by GenerateDesfireSecrets()
 // get the enctiption key from the card
 bool CheckDesfireSecret(kUser *pk_User, unsigned char *enc_key)
 {
+    TapTraceScope span(TraceSpan::APP_AUTH);
+
     DESFIRE_KEY_TYPE i_AppMasterKey;
     byte u8_StoreValue[16];
     if (!GenerateDesfireSecrets(pk_User, &i_AppMasterKey, u8_StoreValue))
@@ -425,14 +451,14 @@ bool CheckDesfireSecret(kUser *pk_User, unsigned char *enc_key)
 
     // Read the 16 byte secret from the card
     byte u8_FileData[16];
-    if (!gi_PN532.ReadFileData(CARD_FILE_ID, 0, 16, u8_FileData))
+    if (!ReadCardFile(0, 16, u8_FileData))
         return false;
 
     if (memcmp(u8_FileData, u8_StoreValue, 16) != 0)
         return false;
 
     // reading the encription key from the card and putting it into the return variable
-    if (!gi_PN532.ReadFileData(CARD_FILE_ID, 16, enc_key_length, enc_key))
+    if (!ReadCardFile(16, enc_key_length, enc_key))
         return false;
 
     return true;
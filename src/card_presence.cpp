@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include "card_presence.h"
+
+static CardPresence current;
+
+bool card_presence_seen(const uint8_t uid[8], uint32_t now)
+{
+  bool sameTag = memcmp(current.uid, uid, sizeof(current.uid)) == 0;
+
+  if (sameTag && current.present)
+  {
+    current.last_seen_ms = now;
+    return !current.handled; // Handled: still lying on the reader
+  }
+
+  if (sameTag && current.handled && now - current.last_seen_ms < CARD_DUPLICATE_WINDOW_MS)
+  {
+    // Back within the duplicate window: same presence, nothing new to report
+    current.present = true;
+    current.last_seen_ms = now;
+    return false;
+  }
+
+  memcpy(current.uid, uid, sizeof(current.uid));
+  current.first_seen_ms = now;
+  current.last_seen_ms = now;
+  current.present = true;
+  current.handled = false;
+  return true;
+}
+
+bool card_presence_replaced(const uint8_t uid[8], CardPresence *replaced)
+{
+  if (!current.present || memcmp(current.uid, uid, sizeof(current.uid)) == 0)
+  {
+    return false;
+  }
+
+  current.present = false;
+  *replaced = current;
+  return true;
+}
+
+bool card_presence_absent(CardPresence *removed, uint32_t now)
+{
+  if (!current.present || now - current.last_seen_ms < CARD_REMOVED_DEBOUNCE_MS)
+  {
+    return false;
+  }
+
+  current.present = false;
+  *removed = current;
+  return true;
+}
+
+void card_presence_mark_handled()
+{
+  current.handled = true;
+}
+
+void card_presence_rearm()
+{
+  current.handled = false;
+}
+
+bool card_presence_present()
+{
+  return current.present;
+}
+
+void card_presence_clear()
+{
+  memset(&current, 0, sizeof(current));
+}
@@ -0,0 +1,365 @@
+#include <string.h>
+
+#include "event_journal.h"
+#include "journal_storage.h"
+
+// Sector layout: SectorHeader, then records back to back (4-byte aligned) until 0xFF space.
+// A record is written in three steps so a power loss leaves it recognizable:
+// header with STATE_WRITING and payload, then STATE_COMMITTED; STATE_ACKED deletes it.
+// Every step only clears bits, so no step needs an erase.
+
+#define SECTOR_MAGIC 0x4A564545UL // "EEVJ"
+#define RECORD_FREE 0xFFFF        // Length of unwritten space
+
+#define STATE_WRITING 0xFF
+#define STATE_COMMITTED 0x7F
+#define STATE_ACKED 0x3F
+
+struct SectorHeader
+{
+  uint32_t magic;
+  uint32_t seq; // Grows with every sector taken into use; the ring order survives restarts
+};
+
+struct RecordHeader
+{
+  uint16_t length;
+  uint8_t type;
+  uint8_t flags;
+  uint8_t state;
+  uint8_t reserved;
+  uint16_t crc;
+};
+
+#define STATE_OFFSET offsetof(RecordHeader, state)
+
+static size_t sector_size = 0;
+static size_t sector_count = 0;
+static bool mounted = false;
+static uint32_t next_seq = 1;
+
+// Next write position
+static size_t head_sector = 0;
+static size_t head_offset = 0;
+// Oldest record that may still be unacknowledged
+static size_t tail_sector = 0;
+static size_t tail_offset = 0;
+
+static size_t pending = 0;
+static EventJournalStats stats;
+
+static size_t recordSpan(size_t length)
+{
+  return (sizeof(RecordHeader) + length + 3) & ~(size_t)3;
+}
+
+static size_t address(size_t sector, size_t offset)
+{
+  return sector * sector_size + offset;
+}
+
+// CRC-16/CCITT-FALSE
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+static bool readSectorHeader(size_t sector, SectorHeader *header)
+{
+  return journal_storage_read(address(sector, 0), header, sizeof(SectorHeader)) && header->magic == SECTOR_MAGIC;
+}
+
+// Record at offset, false at the end of the sector's records
+static bool readRecord(size_t sector, size_t offset, RecordHeader *record)
+{
+  if (offset + sizeof(RecordHeader) > sector_size ||
+      !journal_storage_read(address(sector, offset), record, sizeof(RecordHeader)))
+  {
+    return false;
+  }
+  return record->length != RECORD_FREE && offset + recordSpan(record->length) <= sector_size;
+}
+
+static bool setState(size_t sector, size_t offset, uint8_t state)
+{
+  return journal_storage_write(address(sector, offset) + STATE_OFFSET, &state, 1);
+}
+
+// Committed records from offset to the end of the sector
+static size_t countPending(size_t sector, size_t offset)
+{
+  size_t count = 0;
+  RecordHeader record;
+  while (readRecord(sector, offset, &record))
+  {
+    if (record.state == STATE_COMMITTED)
+    {
+      count++;
+    }
+    offset += recordSpan(record.length);
+  }
+  return count;
+}
+
+// Move the tail forward to the oldest committed record (or to the head if there is none)
+static void seekTail()
+{
+  for (;;)
+  {
+    if (tail_sector == head_sector && tail_offset >= head_offset)
+    {
+      tail_offset = head_offset;
+      return;
+    }
+
+    RecordHeader record;
+    if (!readRecord(tail_sector, tail_offset, &record))
+    {
+      tail_sector = (tail_sector + 1) % sector_count;
+      tail_offset = sizeof(SectorHeader);
+      continue;
+    }
+    if (record.state == STATE_COMMITTED)
+    {
+      return;
+    }
+    tail_offset += recordSpan(record.length);
+  }
+}
+
+static bool startSector(size_t sector)
+{
+  SectorHeader header;
+  header.magic = SECTOR_MAGIC;
+  header.seq = next_seq++;
+  if (!journal_storage_erase(sector) || !journal_storage_write(address(sector, 0), &header, sizeof(header)))
+  {
+    return false;
+  }
+  stats.erases++;
+  head_sector = sector;
+  head_offset = sizeof(SectorHeader);
+  return true;
+}
+
+// Continue in the next sector of the ring
+static bool advanceHead()
+{
+  size_t next = (head_sector + 1) % sector_count;
+
+  if (pending > 0 && next == tail_sector)
+  {
+#if EVENT_JOURNAL_OVERFLOW == EVENT_JOURNAL_DROP_NEWEST
+    return false;
+#else
+    size_t lost = countPending(tail_sector, tail_offset);
+    pending -= lost;
+    stats.dropped += lost;
+    tail_sector = (next + 1) % sector_count;
+    tail_offset = sizeof(SectorHeader);
+    seekTail();
+#endif
+  }
+
+  return startSector(next);
+}
+
+bool event_journal_begin()
+{
+  mounted = false;
+  memset(&stats, 0, sizeof(stats));
+  pending = 0;
+
+  if (!journal_storage_begin(&sector_size, &sector_count) || sector_count < 2)
+  {
+    return false;
+  }
+
+  // The newest sector holds the head
+  bool found = false;
+  uint32_t newest_seq = 0;
+  for (size_t sector = 0; sector < sector_count; sector++)
+  {
+    SectorHeader header;
+    if (readSectorHeader(sector, &header) && (!found || header.seq > newest_seq))
+    {
+      found = true;
+      newest_seq = header.seq;
+      head_sector = sector;
+    }
+  }
+
+  if (!found)
+  {
+    next_seq = 1;
+    if (!startSector(0))
+    {
+      return false;
+    }
+    tail_sector = head_sector;
+    tail_offset = head_offset;
+    mounted = true;
+    return true;
+  }
+
+  next_seq = newest_seq + 1;
+  head_offset = sizeof(SectorHeader);
+  RecordHeader record;
+  while (readRecord(head_sector, head_offset, &record))
+  {
+    head_offset += recordSpan(record.length);
+  }
+
+  // Sectors were taken into use round robin: oldest first when walking on from the head
+  tail_sector = head_sector;
+  tail_offset = head_offset;
+  bool tail_found = false;
+  for (size_t i = 1; i <= sector_count; i++)
+  {
+    size_t sector = (head_sector + i) % sector_count;
+    SectorHeader header;
+    if (!readSectorHeader(sector, &header))
+    {
+      continue;
+    }
+    size_t count = countPending(sector, sizeof(SectorHeader));
+    if (count > 0 && !tail_found)
+    {
+      tail_found = true;
+      tail_sector = sector;
+      tail_offset = sizeof(SectorHeader);
+    }
+    pending += count;
+  }
+  if (tail_found)
+  {
+    seekTail();
+  }
+
+  mounted = true;
+  return true;
+}
+
+bool event_journal_append(uint8_t type, uint8_t flags, const uint8_t *data, size_t length)
+{
+  if (!mounted || length == 0 || length > EVENT_JOURNAL_MAX_RECORD ||
+      sizeof(SectorHeader) + recordSpan(length) > sector_size)
+  {
+    return false;
+  }
+
+  if (head_offset + recordSpan(length) > sector_size && !advanceHead())
+  {
+    stats.dropped++;
+    return false;
+  }
+
+  RecordHeader record;
+  record.length = (uint16_t)length;
+  record.type = type;
+  record.flags = flags;
+  record.state = STATE_WRITING;
+  record.reserved = 0xFF;
+  record.crc = crc16(data, length);
+
+  size_t offset = head_offset;
+  head_offset += recordSpan(length); // A failed write still occupies its space
+  if (!journal_storage_write(address(head_sector, offset), &record, sizeof(record)) ||
+      !journal_storage_write(address(head_sector, offset + sizeof(record)), data, length) ||
+      !setState(head_sector, offset, STATE_COMMITTED))
+  {
+    return false;
+  }
+
+  if (pending == 0)
+  {
+    tail_sector = head_sector;
+    tail_offset = offset;
+  }
+  pending++;
+  stats.appended++;
+  return true;
+}
+
+bool event_journal_peek(EventJournalRecord *record, uint8_t *data, size_t capacity)
+{
+  while (mounted && pending > 0)
+  {
+    seekTail();
+
+    RecordHeader header;
+    if (!readRecord(tail_sector, tail_offset, &header))
+    {
+      return false;
+    }
+
+    bool valid = header.length <= capacity &&
+                 journal_storage_read(address(tail_sector, tail_offset + sizeof(header)), data, header.length) &&
+                 crc16(data, header.length) == header.crc;
+    if (!valid)
+    {
+      setState(tail_sector, tail_offset, STATE_ACKED);
+      tail_offset += recordSpan(header.length);
+      pending--;
+      stats.corrupt++;
+      continue;
+    }
+
+    record->type = header.type;
+    record->flags = header.flags;
+    record->length = header.length;
+    return true;
+  }
+  return false;
+}
+
+void event_journal_ack()
+{
+  if (!mounted || pending == 0)
+  {
+    return;
+  }
+
+  seekTail();
+  RecordHeader header;
+  if (!readRecord(tail_sector, tail_offset, &header))
+  {
+    return;
+  }
+  setState(tail_sector, tail_offset, STATE_ACKED);
+  tail_offset += recordSpan(header.length);
+  pending--;
+  stats.acked++;
+}
+
+size_t event_journal_pending()
+{
+  return pending;
+}
+
+const EventJournalStats &event_journal_stats()
+{
+  return stats;
+}
+
+void event_journal_format()
+{
+  if (sector_count == 0)
+  {
+    return;
+  }
+  for (size_t sector = 0; sector < sector_count; sector++)
+  {
+    journal_storage_erase(sector);
+  }
+  event_journal_begin();
+}
@@ -0,0 +1,104 @@
+#include <Arduino.h>
+
+#include "feedback.h"
+#include "display.h"
+#include "config.h"
+#include "tap_trace.h"
+
+struct FeedbackTimer
+{
+  uint32_t due_ms;
+  FeedbackCallback callback; // nullptr -> slot is free
+};
+
+static FeedbackTimer timers[FEEDBACK_TIMER_SLOTS];
+static FeedbackCallback base_screen = nullptr;
+static bool transient_active = false;
+
+bool feedback_schedule(uint32_t delayMs, FeedbackCallback callback)
+{
+  for (uint8_t i = 0; i < FEEDBACK_TIMER_SLOTS; i++)
+  {
+    if (timers[i].callback == nullptr)
+    {
+      timers[i].due_ms = millis() + delayMs;
+      timers[i].callback = callback;
+      return true;
+    }
+  }
+  Serial.println("Feedback timers exhausted");
+  return false;
+}
+
+void feedback_cancel(FeedbackCallback callback)
+{
+  for (uint8_t i = 0; i < FEEDBACK_TIMER_SLOTS; i++)
+  {
+    if (timers[i].callback == callback)
+    {
+      timers[i].callback = nullptr;
+    }
+  }
+}
+
+static void draw(FeedbackCallback screen)
+{
+  TapTraceScope span(TraceSpan::DISPLAY);
+  screen();
+}
+
+static void restoreBaseScreen()
+{
+  transient_active = false;
+  if (base_screen)
+  {
+    draw(base_screen);
+  }
+}
+
+void feedback_set_base(FeedbackCallback screen)
+{
+  base_screen = screen;
+  if (!transient_active && screen)
+  {
+    draw(screen);
+  }
+}
+
+void feedback_show(FeedbackCallback screen, uint32_t durationMs)
+{
+  // A new transient replaces the running one and restarts the duration
+  feedback_cancel(restoreBaseScreen);
+  draw(screen);
+  transient_active = feedback_schedule(durationMs, restoreBaseScreen);
+}
+
+void feedback_success()
+{
+  feedback_show(display_success, FEEDBACK_DURATION_MS);
+}
+
+void feedback_fail()
+{
+  feedback_show(display_fail, FEEDBACK_DURATION_MS);
+}
+
+bool feedback_active()
+{
+  return transient_active;
+}
+
+void feedback_loop()
+{
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < FEEDBACK_TIMER_SLOTS; i++)
+  {
+    FeedbackCallback callback = timers[i].callback;
+    // Signed difference keeps working across the millis() wrap-around
+    if (callback != nullptr && (int32_t)(now - timers[i].due_ms) >= 0)
+    {
+      timers[i].callback = nullptr; // free the slot first, the callback may schedule again
+      callback();
+    }
+  }
+}
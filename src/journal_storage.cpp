@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "journal_storage.h"
+#include "event_journal.h"
+
+#if defined(ARDUINO_ARCH_NATIVE)
+
+// File-backed stand-in with the geometry and write semantics of the flash partition
+#include <stdio.h>
+
+#define NATIVE_SECTOR_SIZE 4096
+
+static FILE *file = nullptr;
+
+bool journal_storage_begin(size_t *sectorSize, size_t *sectorCount)
+{
+  if (file != nullptr)
+  {
+    fclose(file);
+  }
+  file = fopen(EVENT_JOURNAL_FILE, "r+b");
+  if (file == nullptr)
+  {
+    // New file: erased flash
+    file = fopen(EVENT_JOURNAL_FILE, "w+b");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    uint8_t erased[NATIVE_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    for (size_t sector = 0; sector < EVENT_JOURNAL_SECTORS; sector++)
+    {
+      fwrite(erased, 1, sizeof(erased), file);
+    }
+    fflush(file);
+  }
+
+  *sectorSize = NATIVE_SECTOR_SIZE;
+  *sectorCount = EVENT_JOURNAL_SECTORS;
+  return true;
+}
+
+bool journal_storage_read(size_t offset, void *data, size_t length)
+{
+  return file != nullptr && fseek(file, (long)offset, SEEK_SET) == 0 &&
+         fread(data, 1, length, file) == length;
+}
+
+bool journal_storage_write(size_t offset, const void *data, size_t length)
+{
+  // Like NOR flash, a write can only clear bits
+  uint8_t current[64];
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  while (length > 0)
+  {
+    size_t chunk = length < sizeof(current) ? length : sizeof(current);
+    if (!journal_storage_read(offset, current, chunk))
+    {
+      return false;
+    }
+    for (size_t i = 0; i < chunk; i++)
+    {
+      current[i] &= bytes[i];
+    }
+    if (fseek(file, (long)offset, SEEK_SET) != 0 || fwrite(current, 1, chunk, file) != chunk)
+    {
+      return false;
+    }
+    offset += chunk;
+    bytes += chunk;
+    length -= chunk;
+  }
+  return fflush(file) == 0;
+}
+
+bool journal_storage_erase(size_t sector)
+{
+  uint8_t erased[NATIVE_SECTOR_SIZE];
+  memset(erased, 0xFF, sizeof(erased));
+  return file != nullptr && fseek(file, (long)(sector * NATIVE_SECTOR_SIZE), SEEK_SET) == 0 &&
+         fwrite(erased, 1, sizeof(erased), file) == sizeof(erased) && fflush(file) == 0;
+}
+
+#else
+
+// The firmware keeps no files, so the spiffs data partition of the default partition table
+// is used raw. Only the first EVENT_JOURNAL_SECTORS sectors are touched.
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+
+static const esp_partition_t *partition = nullptr;
+
+bool journal_storage_begin(size_t *sectorSize, size_t *sectorCount)
+{
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+  if (partition == nullptr)
+  {
+    return false;
+  }
+
+  size_t available = partition->size / SPI_FLASH_SEC_SIZE;
+  *sectorSize = SPI_FLASH_SEC_SIZE;
+  *sectorCount = available < EVENT_JOURNAL_SECTORS ? available : EVENT_JOURNAL_SECTORS;
+  return true;
+}
+
+bool journal_storage_read(size_t offset, void *data, size_t length)
+{
+  return partition != nullptr && esp_partition_read(partition, offset, data, length) == ESP_OK;
+}
+
+bool journal_storage_write(size_t offset, const void *data, size_t length)
+{
+  return partition != nullptr && esp_partition_write(partition, offset, data, length) == ESP_OK;
+}
+
+bool journal_storage_erase(size_t sector)
+{
+  return partition != nullptr &&
+         esp_partition_erase_range(partition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE) == ESP_OK;
+}
+
+#endif
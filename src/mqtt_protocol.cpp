@@ -1,8 +1,10 @@
 #include "mqtt_protocol.h"
+#include "time_service.h"
 
 // ===== MQTTMessageBuilder Implementation =====
 
-MQTTMessageBuilder::MQTTMessageBuilder() {
+MQTTMessageBuilder::MQTTMessageBuilder() : messageLength(0), eventTimeMs(0), eventTimeSynced(true), encoding(PayloadEncoding::JSON),
+                                           batch(batchBuffer, sizeof(batchBuffer)), batchCount(0) {
     memset(deviceId, 0, sizeof(deviceId));
     memset(buffer, 0, sizeof(buffer));
 }
@@ -13,31 +15,47 @@ void MQTTMessageBuilder::setDeviceId(const char* id) {
 
 const char* MQTTMessageBuilder::buildMessage(EventType eventType, const char* requestId,
                                              bool (*serializePayload)(JsonObject, const void*),
+                                             bool (*writePayload)(JsonWriter&, const void*),
                                              const void* payloadData) {
-    doc.clear();
-    
     // Generate timestamp
     char timestamp[32];
-    generateTimestamp(timestamp, sizeof(timestamp));
+    bool synced = eventTimeSynced;
+    int64_t timeMs = eventTimeMs > 0 ? eventTimeMs : time_service_now_ms(&synced);
+    timestamps.format(timestamp, sizeof(timestamp), timeMs);
     
-    // Build envelope
-    doc["version"] = MQTT_PROTOCOL_VERSION;
-    doc["timestamp"] = timestamp;
-    doc["device_id"] = deviceId;
-    doc["event_type"] = eventTypeToString(eventType);
-    doc["request_id"] = requestId;
-    
-    // Serialize payload
-    JsonObject payload = doc.createNestedObject("payload");
-    if (payloadData != nullptr && serializePayload != nullptr) {
-        serializePayload(payload, payloadData);
+    if (encoding == PayloadEncoding::JSON && writePayload != nullptr) {
+        // One pass into the buffer, no document
+        JsonWriter out(buffer, sizeof(buffer));
+        writeEnvelopeStart(out, timestamp, deviceId, eventType, requestId, synced);
+        if (payloadData != nullptr) {
+            writePayload(out, payloadData);
+        }
+        writeEnvelopeEnd(out);
+        messageLength = out.length();
+    } else {
+        doc.clear();
+        
+        // Build envelope
+        doc["version"] = protocolVersionFor(encoding);
+        doc["timestamp"] = timestamp;
+        if (!synced) {
+            doc["time_synced"] = false;
+        }
+        doc["device_id"] = deviceId;
+        doc["event_type"] = eventTypeToString(eventType);
+        doc["request_id"] = requestId;
+        
+        // Serialize payload
+        JsonObject payload = doc.createNestedObject("payload");
+        if (payloadData != nullptr && serializePayload != nullptr) {
+            serializePayload(payload, payloadData);
+        }
+        
+        // Serialize to buffer
+        messageLength = encodeDocument(doc, encoding, reinterpret_cast<uint8_t*>(buffer), sizeof(buffer));
     }
     
-    // Serialize to buffer
-    memset(buffer, 0, sizeof(buffer));
-    size_t size = serializeJson(doc, buffer, sizeof(buffer));
-    
-    if (size == 0) {
+    if (messageLength == 0) {
         Serial.println(F("Failed to serialize message"));
         return nullptr;
     }
@@ -82,63 +100,175 @@ static bool serializeReadSuccessWrapper(JsonObject payload, const void* data) {
     return serializeReadSuccess(payload, *static_cast<const ReadSuccessPayload*>(data));
 }
 
+static bool serializeTagRemovedWrapper(JsonObject payload, const void* data) {
+    return serializeTagRemoved(payload, *static_cast<const TagRemovedPayload*>(data));
+}
+
+static bool serializeTapTraceWrapper(JsonObject payload, const void* data) {
+    return serializeTapTrace(payload, *static_cast<const TapTracePayload*>(data));
+}
+
+// Wrapper functions for the direct JSON writers
+static bool writeStatusChangeWrapper(JsonWriter& out, const void* data) {
+    return writeStatusChange(out, *static_cast<const StatusChangePayload*>(data));
+}
+
+static bool writeModeChangeWrapper(JsonWriter& out, const void* data) {
+    return writeModeChange(out, *static_cast<const ModeChangePayload*>(data));
+}
+
+static bool writeTagDetectedWrapper(JsonWriter& out, const void* data) {
+    return writeTagDetected(out, *static_cast<const TagDetectedPayload*>(data));
+}
+
+static bool writeRegisterSuccessWrapper(JsonWriter& out, const void* data) {
+    return writeRegisterSuccess(out, *static_cast<const RegisterSuccessPayload*>(data));
+}
+
+static bool writeAuthSuccessWrapper(JsonWriter& out, const void* data) {
+    return writeAuthSuccess(out, *static_cast<const AuthSuccessPayload*>(data));
+}
+
+static bool writeAuthFailedWrapper(JsonWriter& out, const void* data) {
+    return writeAuthFailed(out, *static_cast<const AuthFailedPayload*>(data));
+}
+
+static bool writeErrorWrapper(JsonWriter& out, const void* data) {
+    return writeError(out, *static_cast<const ErrorPayload*>(data));
+}
+
+static bool writeReadSuccessWrapper(JsonWriter& out, const void* data) {
+    return writeReadSuccess(out, *static_cast<const ReadSuccessPayload*>(data));
+}
+
+static bool writeTagRemovedWrapper(JsonWriter& out, const void* data) {
+    return writeTagRemoved(out, *static_cast<const TagRemovedPayload*>(data));
+}
+
+static bool writeTapTraceWrapper(JsonWriter& out, const void* data) {
+    return writeTapTrace(out, *static_cast<const TapTracePayload*>(data));
+}
+
 const char* MQTTMessageBuilder::buildStatusChange(const char* requestId, const StatusChangePayload& payload) {
-    return buildMessage(EventType::STATUS_CHANGE, requestId, serializeStatusChangeWrapper, &payload);
+    return buildMessage(EventType::STATUS_CHANGE, requestId, serializeStatusChangeWrapper, writeStatusChangeWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildModeChange(const char* requestId, const ModeChangePayload& payload) {
-    return buildMessage(EventType::MODE_CHANGE, requestId, serializeModeChangeWrapper, &payload);
+    return buildMessage(EventType::MODE_CHANGE, requestId, serializeModeChangeWrapper, writeModeChangeWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildTagDetected(const char* requestId, const TagDetectedPayload& payload) {
-    return buildMessage(EventType::AUTH_TAG_DETECTED, requestId, serializeTagDetectedWrapper, &payload);
+    return buildMessage(EventType::AUTH_TAG_DETECTED, requestId, serializeTagDetectedWrapper, writeTagDetectedWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildRegisterSuccess(const char* requestId, const RegisterSuccessPayload& payload) {
-    return buildMessage(EventType::REGISTER_SUCCESS, requestId, serializeRegisterSuccessWrapper, &payload);
+    return buildMessage(EventType::REGISTER_SUCCESS, requestId, serializeRegisterSuccessWrapper, writeRegisterSuccessWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildRegisterError(const char* requestId, const ErrorPayload& payload) {
-    return buildMessage(EventType::REGISTER_ERROR, requestId, serializeErrorWrapper, &payload);
+    return buildMessage(EventType::REGISTER_ERROR, requestId, serializeErrorWrapper, writeErrorWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildAuthSuccess(const char* requestId, const AuthSuccessPayload& payload) {
-    return buildMessage(EventType::AUTH_SUCCESS, requestId, serializeAuthSuccessWrapper, &payload);
+    return buildMessage(EventType::AUTH_SUCCESS, requestId, serializeAuthSuccessWrapper, writeAuthSuccessWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildAuthFailed(const char* requestId, const AuthFailedPayload& payload) {
-    return buildMessage(EventType::AUTH_FAILED, requestId, serializeAuthFailedWrapper, &payload);
+    return buildMessage(EventType::AUTH_FAILED, requestId, serializeAuthFailedWrapper, writeAuthFailedWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildAuthError(const char* requestId, const ErrorPayload& payload) {
-    return buildMessage(EventType::AUTH_ERROR, requestId, serializeErrorWrapper, &payload);
+    return buildMessage(EventType::AUTH_ERROR, requestId, serializeErrorWrapper, writeErrorWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildReadSuccess(const char* requestId, const ReadSuccessPayload& payload) {
-    return buildMessage(EventType::READ_SUCCESS, requestId, serializeReadSuccessWrapper, &payload);
+    return buildMessage(EventType::READ_SUCCESS, requestId, serializeReadSuccessWrapper, writeReadSuccessWrapper, &payload);
 }
 
 const char* MQTTMessageBuilder::buildReadError(const char* requestId, const ErrorPayload& payload) {
-    return buildMessage(EventType::READ_ERROR, requestId, serializeErrorWrapper, &payload);
+    return buildMessage(EventType::READ_ERROR, requestId, serializeErrorWrapper, writeErrorWrapper, &payload);
 }
 
+// No direct writer: the float of the heartbeat is formatted by ArduinoJson
 const char* MQTTMessageBuilder::buildHeartbeat(const char* requestId, const HeartbeatPayload& payload) {
-    return buildMessage(EventType::HEARTBEAT, requestId, serializeHeartbeatWrapper, &payload);
+    return buildMessage(EventType::HEARTBEAT, requestId, serializeHeartbeatWrapper, nullptr, &payload);
+}
+
+const char* MQTTMessageBuilder::buildTagRemoved(const char* requestId, const TagRemovedPayload& payload) {
+    return buildMessage(EventType::TAG_REMOVED, requestId, serializeTagRemovedWrapper, writeTagRemovedWrapper, &payload);
+}
+
+const char* MQTTMessageBuilder::buildTapTrace(const char* requestId, const TapTracePayload& payload) {
+    return buildMessage(EventType::TAP_TRACE, requestId, serializeTapTraceWrapper, writeTapTraceWrapper, &payload);
+}
+
+// Closing "]}}" of a batch
+#define BATCH_END_LENGTH 3
+
+void MQTTMessageBuilder::beginBatch(const char* requestId) {
+    char timestamp[32];
+    bool synced;
+    timestamps.format(timestamp, sizeof(timestamp), time_service_now_ms(&synced));
+    
+    batch.reset();
+    batchCount = 0;
+    writeEnvelopeStart(batch, timestamp, deviceId, EventType::BATCH, requestId, synced);
+    batch.beginArray("events");
+}
+
+bool MQTTMessageBuilder::addToBatch() {
+    if (encoding != PayloadEncoding::JSON || messageLength == 0) {
+        return false;
+    }
+    
+    size_t mark = batch.position();
+    batch.json(buffer, messageLength);
+    if (batch.overflowed() || batch.available() < BATCH_END_LENGTH) {
+        batch.rewind(mark);
+        return false;
+    }
+    batchCount++;
+    return true;
+}
+
+const char* MQTTMessageBuilder::endBatch() {
+    batch.endArray();
+    writeEnvelopeEnd(batch);
+    messageLength = batch.length();
+    if (messageLength == 0) {
+        Serial.println(F("Failed to serialize batch"));
+        return nullptr;
+    }
+    return batchBuffer;
 }
 
 // ===== MQTTMessageParser Implementation =====
 
-MQTTMessageParser::MQTTMessageParser() {
+MQTTMessageParser::MQTTMessageParser() : encoding(PayloadEncoding::JSON) {
     memset(&envelope, 0, sizeof(envelope));
 }
 
 bool MQTTMessageParser::parse(const char* jsonBuffer) {
+    return parse(reinterpret_cast<const uint8_t*>(jsonBuffer), strlen(jsonBuffer));
+}
+
+bool MQTTMessageParser::parse(const uint8_t* data, size_t length) {
+    if (length > sizeof(input)) {
+        Serial.println(F("MQTTMessageParser message too large"));
+        return false;
+    }
+    memcpy(input, data, length);
+    return parseInPlace(input, length);
+}
+
+bool MQTTMessageParser::parseInPlace(char* data, size_t length) {
     // Clear previous state
     doc.clear();
     memset(&envelope, 0, sizeof(envelope));
     
-    // Parse JSON
-    DeserializationError error = deserializeJson(doc, jsonBuffer);
+    // Parse JSON or MessagePack without copying its strings
+    encoding = detectEncoding(reinterpret_cast<const uint8_t*>(data), length);
+    DeserializationError error = decodeDocumentInPlace(doc, data, length, encoding);
     if (error) {
         Serial.print(F("MQTTMessageParser parse failed: "));
         Serial.println(error.c_str());
@@ -153,16 +283,16 @@ bool MQTTMessageParser::parse(const char* jsonBuffer) {
         return false;
     }
     
-    strlcpy(envelope.version, doc["version"] | "", sizeof(envelope.version));
-    strlcpy(envelope.timestamp, doc["timestamp"] | "", sizeof(envelope.timestamp));
-    strlcpy(envelope.device_id, doc["device_id"] | "", sizeof(envelope.device_id));
-    strlcpy(envelope.event_type, doc["event_type"] | "", sizeof(envelope.event_type));
-    strlcpy(envelope.request_id, doc["request_id"] | "", sizeof(envelope.request_id));
+    envelope.version = doc["version"] | "";
+    envelope.timestamp = doc["timestamp"] | "";
+    envelope.device_id = doc["device_id"] | "";
+    envelope.event_type = doc["event_type"] | "";
+    envelope.request_id = doc["request_id"] | "";
     
     envelope.payload = doc["payload"].as<JsonObject>();
     
     // Validate protocol version
-    if (strcmp(envelope.version, MQTT_PROTOCOL_VERSION) != 0) {
+    if (strcmp(envelope.version, protocolVersionFor(encoding)) != 0) {
         Serial.print(F("Unsupported protocol version: "));
         Serial.println(envelope.version);
         return false;
@@ -183,6 +313,10 @@ bool MQTTMessageParser::parseAuthStart(AuthStartPayload& payload) {
     return deserializeAuthStart(envelope.payload, payload);
 }
 
+bool MQTTMessageParser::parseAuthPrearm(AuthStartPayload& payload) {
+    return deserializeAuthPrearm(envelope.payload, payload);
+}
+
 bool MQTTMessageParser::parseAuthVerify(AuthVerifyPayload& payload) {
     return deserializeAuthVerify(envelope.payload, payload);
 }
@@ -191,6 +325,10 @@ bool MQTTMessageParser::parseReadStart(ReadStartPayload& payload) {
     return deserializeReadStart(envelope.payload, payload);
 }
 
+bool MQTTMessageParser::parseAuthCacheSync(AuthCacheSyncPayload& payload) {
+    return deserializeAuthCacheSync(envelope.payload, payload);
+}
+
 bool MQTTMessageParser::isCancel() const {
     CommandType type = getCommandType();
     return type == CommandType::REGISTER_CANCEL ||
@@ -201,118 +339,3 @@ bool MQTTMessageParser::isCancel() const {
 bool MQTTMessageParser::isReset() const {
     return getCommandType() == CommandType::RESET;
 }
-
-// ===== MQTTTopicBuilder Implementation =====
-
-MQTTTopicBuilder::MQTTTopicBuilder() {
-    memset(deviceId, 0, sizeof(deviceId));
-    memset(topicBuffer, 0, sizeof(topicBuffer));
-}
-
-void MQTTTopicBuilder::setDeviceId(const char* id) {
-    strlcpy(deviceId, id, sizeof(deviceId));
-}
-
-// Command topics (Subscribe)
-const char* MQTTTopicBuilder::registerStart() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/register/start", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::registerCancel() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/register/cancel", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::authStart() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/auth/start", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::authVerify() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/auth/verify", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::authCancel() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/auth/cancel", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::readStart() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/read/start", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::readCancel() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/read/cancel", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::reset() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/reset", deviceId);
-    return topicBuffer;
-}
-
-// Event topics (Publish)
-const char* MQTTTopicBuilder::registerSuccess() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/register/success", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::registerError() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/register/error", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::authTagDetected() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/auth/tag_detected", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::authSuccess() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/auth/success", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::authFailed() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/auth/failed", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::authError() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/auth/error", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::readSuccess() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/read/success", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::readError() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/read/error", deviceId);
-    return topicBuffer;
-}
-
-// State topics (Publish with retain)
-const char* MQTTTopicBuilder::status() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/status", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::mode() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/mode", deviceId);
-    return topicBuffer;
-}
-
-const char* MQTTTopicBuilder::heartbeat() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/heartbeat", deviceId);
-    return topicBuffer;
-}
-
-// Wildcard subscription
-const char* MQTTTopicBuilder::allCommands() {
-    snprintf(topicBuffer, sizeof(topicBuffer), "devices/%s/#", deviceId);
-    return topicBuffer;
-}
@@ -1,6 +1,6 @@
 #include "mqtt_serialization.h"
+#include "time_service.h"
 #include <time.h>
-#include <sys/time.h>
 
 #if defined(UNIT_TEST) && defined(ARDUINO_ARCH_NATIVE)
 #include "arduino_mocks.h"
@@ -8,12 +8,14 @@
 
 // Generate ISO 8601 UTC timestamp
 void generateTimestamp(char* buffer, size_t bufferSize) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    
-    time_t now = tv.tv_sec;
+    formatTimestamp(buffer, bufferSize, time_service_now_ms());
+}
+
+// ISO 8601 UTC timestamp of a point in time given in Unix milliseconds
+void formatTimestamp(char* buffer, size_t bufferSize, int64_t unixMs) {
+    time_t seconds = (time_t)(unixMs / 1000);
     struct tm timeinfo;
-    gmtime_r(&now, &timeinfo);
+    gmtime_r(&seconds, &timeinfo);
     
     // Format: 2025-11-11T12:00:00.000Z
     snprintf(buffer, bufferSize, "%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ",
@@ -23,7 +25,36 @@ void generateTimestamp(char* buffer, size_t bufferSize) {
              timeinfo.tm_hour,
              timeinfo.tm_min,
              timeinfo.tm_sec,
-             tv.tv_usec / 1000);
+             (long)(unixMs % 1000));
+}
+
+#define TIMESTAMP_PREFIX_LENGTH 17  // Up to the minutes and their ':'
+
+void TimestampFormatter::format(char* buffer, size_t bufferSize, int64_t unixMs) {
+    if (unixMs < 0 || bufferSize <= MQTT_TIMESTAMP_LENGTH) {
+        formatTimestamp(buffer, bufferSize, unixMs);
+        return;
+    }
+    
+    int64_t currentMinute = unixMs / 60000;
+    if (currentMinute != minute) {
+        formatTimestamp(prefix, sizeof(prefix), currentMinute * 60000);
+        minute = currentMinute;
+    }
+    
+    uint32_t rest = (uint32_t)(unixMs - currentMinute * 60000);
+    uint32_t seconds = rest / 1000;
+    uint32_t ms = rest % 1000;
+    memcpy(buffer, prefix, TIMESTAMP_PREFIX_LENGTH);
+    char* digits = buffer + TIMESTAMP_PREFIX_LENGTH;
+    digits[0] = (char)('0' + seconds / 10);
+    digits[1] = (char)('0' + seconds % 10);
+    digits[2] = '.';
+    digits[3] = (char)('0' + ms / 100);
+    digits[4] = (char)('0' + ms / 10 % 10);
+    digits[5] = (char)('0' + ms % 10);
+    digits[6] = 'Z';
+    digits[7] = '\0';
 }
 
 // Generate UUID v4 (simplified version for ESP32)
@@ -39,6 +70,49 @@ void generateUUID(char* buffer, size_t bufferSize) {
              ((uint64_t)esp_random() << 16) | (esp_random() & 0xFFFF));
 }
 
+// A JSON message starts with '{' (after optional whitespace), a MessagePack message with a map
+PayloadEncoding detectEncoding(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t first = data[i];
+        if (first == ' ' || first == '\t' || first == '\r' || first == '\n') {
+            continue;
+        }
+        bool map = (first & 0xF0) == 0x80 || first == 0xDE || first == 0xDF;
+        return map ? PayloadEncoding::MSGPACK : PayloadEncoding::JSON;
+    }
+    return PayloadEncoding::JSON;
+}
+
+const char* protocolVersionFor(PayloadEncoding encoding) {
+    return encoding == PayloadEncoding::MSGPACK ? MQTT_PROTOCOL_VERSION_MSGPACK : MQTT_PROTOCOL_VERSION;
+}
+
+size_t encodeDocument(const JsonDocument& doc, PayloadEncoding encoding, uint8_t* buffer, size_t bufferSize) {
+    if (encoding == PayloadEncoding::MSGPACK) {
+        // serializeMsgPack() truncates silently, so check the size first
+        size_t size = measureMsgPack(doc);
+        return size <= bufferSize ? serializeMsgPack(doc, buffer, bufferSize) : 0;
+    }
+    
+    // Room for the terminator
+    size_t size = measureJson(doc);
+    return size < bufferSize ? serializeJson(doc, reinterpret_cast<char*>(buffer), bufferSize) : 0;
+}
+
+DeserializationError decodeDocument(JsonDocument& doc, const uint8_t* data, size_t length, PayloadEncoding encoding) {
+    if (encoding == PayloadEncoding::MSGPACK) {
+        return deserializeMsgPack(doc, data, length);
+    }
+    return deserializeJson(doc, reinterpret_cast<const char*>(data), length);
+}
+
+DeserializationError decodeDocumentInPlace(JsonDocument& doc, char* data, size_t length, PayloadEncoding encoding) {
+    if (encoding == PayloadEncoding::MSGPACK) {
+        return deserializeMsgPack(doc, data, length);
+    }
+    return deserializeJson(doc, data, length);
+}
+
 // Serialize Message Envelope
 bool serializeEnvelope(const MQTTMessageEnvelope& envelope, char* jsonBuffer, size_t bufferSize) {
     StaticJsonDocument<MQTT_ENVELOPE_DOC_SIZE> doc;
@@ -58,7 +132,11 @@ bool serializeEnvelope(const MQTTMessageEnvelope& envelope, char* jsonBuffer, si
 
 // Deserialize Message Envelope
 bool deserializeEnvelope(const char* jsonBuffer, MQTTMessageEnvelope& envelope, StaticJsonDocument<MQTT_ENVELOPE_DOC_SIZE>& doc) {
-    DeserializationError error = deserializeJson(doc, jsonBuffer);
+    return deserializeEnvelope(reinterpret_cast<const uint8_t*>(jsonBuffer), strlen(jsonBuffer), envelope, doc);
+}
+
+bool deserializeEnvelope(const uint8_t* data, size_t length, MQTTMessageEnvelope& envelope, StaticJsonDocument<MQTT_ENVELOPE_DOC_SIZE>& doc) {
+    DeserializationError error = decodeDocument(doc, data, length, detectEncoding(data, length));
     if (error) {
         Serial.print(F("deserializeEnvelope failed: "));
         Serial.println(error.c_str());
@@ -106,6 +184,25 @@ bool deserializeRegisterStart(JsonObject payload, RegisterStartPayload& data) {
     return true;
 }
 
+// Deserialize one candidate key of auth_start
+static bool deserializeKeyCandidate(JsonObject obj, AuthKeyCandidate& candidate) {
+    candidate.clear();
+    
+    strlcpy(candidate.key, obj["key"] | "", sizeof(candidate.key));
+    if (!isValidHexKey(candidate.key)) {
+        return false;
+    }
+    
+    if (obj.containsKey("tag_uid")) {
+        strlcpy(candidate.tag_uid, obj["tag_uid"] | "", sizeof(candidate.tag_uid));
+        if (!isValidTagUID(candidate.tag_uid)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
 // Deserialize Auth Start Command
 bool deserializeAuthStart(JsonObject payload, AuthStartPayload& data) {
     data.clear();
@@ -120,9 +217,51 @@ bool deserializeAuthStart(JsonObject payload, AuthStartPayload& data) {
         return false;
     }
     
+    // Optional continuous session, one result per tap until the duration or tap count is reached
+    data.session_duration_seconds = payload["session_duration_seconds"] | 0;
+    data.session_max_taps = payload["session_max_taps"] | 0;
+    if (data.session_duration_seconds < 0 || data.session_duration_seconds > 86400 ||
+        data.session_max_taps < 0 || data.session_max_taps > 65535) {
+        return false;
+    }
+    
+    // Optional key material: a single "key" (with optional "tag_uid") and/or a "keys" array
+    if (payload.containsKey("key")) {
+        if (!deserializeKeyCandidate(payload, data.keys[data.key_count])) {
+            return false;
+        }
+        data.key_count++;
+    }
+    
+    if (payload.containsKey("keys")) {
+        JsonArray keys = payload["keys"].as<JsonArray>();
+        if (keys.isNull()) {
+            return false;
+        }
+        for (JsonObject candidate : keys) {
+            if (data.key_count >= AUTH_START_MAX_KEYS ||
+                !deserializeKeyCandidate(candidate, data.keys[data.key_count])) {
+                return false;
+            }
+            data.key_count++;
+        }
+    }
+    
+    if (payload.containsKey("user_data")) {
+        JsonObject userData = payload["user_data"].as<JsonObject>();
+        if (!deserializeUserData(userData, data.user_data)) {
+            return false;
+        }
+    }
+    
     return true;
 }
 
+// Deserialize Auth Prearm Command (auth_start that must carry key material)
+bool deserializeAuthPrearm(JsonObject payload, AuthStartPayload& data) {
+    return deserializeAuthStart(payload, data) && data.key_count > 0;
+}
+
 // Deserialize Auth Verify Command
 bool deserializeAuthVerify(JsonObject payload, AuthVerifyPayload& data) {
     data.clear();
@@ -165,6 +304,51 @@ bool deserializeReadStart(JsonObject payload, ReadStartPayload& data) {
     return true;
 }
 
+// Deserialize Auth Cache Sync Command
+bool deserializeAuthCacheSync(JsonObject payload, AuthCacheSyncPayload& data) {
+    data.clear();
+    
+    if (!payload.containsKey("entries")) {
+        return false;
+    }
+    
+    data.replace = payload["replace"] | false;
+    
+    JsonArray entries = payload["entries"].as<JsonArray>();
+    if (entries.isNull() || entries.size() > AUTH_CACHE_SYNC_MAX_ENTRIES) {
+        return false;
+    }
+    
+    for (JsonObject entry : entries) {
+        AuthCacheEntryPayload& cached = data.entries[data.entry_count];
+        
+        if (!entry.containsKey("tag_uid")) {
+            return false;
+        }
+        
+        strlcpy(cached.tag_uid, entry["tag_uid"] | "", sizeof(cached.tag_uid));
+        if (!isValidTagUID(cached.tag_uid)) {
+            return false;
+        }
+        
+        // An entry without key revokes the tag
+        if (entry.containsKey("key")) {
+            strlcpy(cached.key, entry["key"] | "", sizeof(cached.key));
+            if (!isValidHexKey(cached.key)) {
+                return false;
+            }
+        }
+        
+        cached.permissions = entry["permissions"] | (uint32_t)AUTH_PERMISSION_ACCESS;
+        cached.expires_at = entry["expires_at"] | (uint32_t)0;
+        strlcpy(cached.username, entry["username"] | "", sizeof(cached.username));
+        
+        data.entry_count++;
+    }
+    
+    return true;
+}
+
 // Serialize Status Change Event
 bool serializeStatusChange(JsonObject payload, const StatusChangePayload& data) {
     payload["status"] = deviceStatusToString(data.status);
@@ -225,10 +409,55 @@ bool serializeError(JsonObject payload, const ErrorPayload& data) {
 }
 
 // Serialize Heartbeat Event
+// A latency is [count, p50, p99, max], as an array to keep the heartbeat within one MQTT packet
+static void serializeLatency(JsonArray latency, const HeartbeatLatency& data) {
+    latency.add(data.count);
+    latency.add(data.p50);
+    latency.add(data.p99);
+    latency.add(data.max);
+}
+
 bool serializeHeartbeat(JsonObject payload, const HeartbeatPayload& data) {
     payload["uptime_seconds"] = data.uptime_seconds;
     payload["memory_usage_percent"] = data.memory_usage_percent;
     payload["operations_completed"] = data.operations_completed;
+    
+    JsonObject heap = payload.createNestedObject("heap");
+    heap["free"] = data.free_heap;
+    heap["min_free"] = data.min_free_heap;
+    heap["largest_block"] = data.largest_free_block;
+    
+    JsonObject rf = payload.createNestedObject("rf");
+    rf["polls"] = data.rf_polls;
+    rf["taps"] = data.rf_taps;
+    rf["errors"] = data.rf_pn532_errors;
+    rf["timeouts"] = data.rf_pn532_timeouts;
+    
+    // Tiers this reader never used are left out
+    JsonObject tiers = payload.createNestedObject("tiers");
+    for (size_t i = 0; i < HEARTBEAT_TIER_COUNT; i++) {
+        const HeartbeatTier& stats = data.tiers[i];
+        if (stats.decision_ms.count == 0) {
+            continue;
+        }
+        JsonObject tier = tiers.createNestedObject(decisionTierToString((DecisionTier)i));
+        serializeLatency(tier.createNestedArray("decision_ms"), stats.decision_ms);
+        tier["errors"] = stats.pn532_errors;
+        tier["timeouts"] = stats.pn532_timeouts;
+    }
+    
+    JsonObject loops = payload.createNestedObject("loop_us");
+    serializeLatency(loops.createNestedArray("reader"), data.reader_loop_us);
+    serializeLatency(loops.createNestedArray("network"), data.network_loop_us);
+    
+    JsonObject queues = payload.createNestedObject("queues");
+    queues["commands"] = data.command_queue;
+    queues["control"] = data.control_queue;
+    queues["events"] = data.event_queue;
+    queues["publish"] = data.publish_queue;
+    queues["journal"] = data.journal_pending;
+    queues["commands_rejected"] = data.command_rejected;
+    queues["control_rejected"] = data.control_rejected;
     return true;
 }
 
@@ -240,6 +469,136 @@ bool serializeReadSuccess(JsonObject payload, const ReadSuccessPayload& data) {
     return true;
 }
 
+// Serialize Tag Removed Event
+bool serializeTagRemoved(JsonObject payload, const TagRemovedPayload& data) {
+    payload["tag_uid"] = data.tag_uid;
+    payload["present_ms"] = data.present_ms;
+    return true;
+}
+
+// Serialize Tap Trace Event, each span is [name, start_us, duration_us]
+bool serializeTapTrace(JsonObject payload, const TapTracePayload& data) {
+    payload["total_us"] = data.total_us;
+    payload["dropped"] = data.dropped;
+    JsonArray spans = payload.createNestedArray("spans");
+    for (uint8_t i = 0; i < data.count && i < TAP_TRACE_MAX_SPANS; i++) {
+        JsonArray span = spans.createNestedArray();
+        span.add(traceSpanToString(data.spans[i].span));
+        span.add(data.spans[i].start_us);
+        span.add(data.spans[i].duration_us);
+    }
+    return true;
+}
+
+// ===== Direct JSON writers (same fields and order as the serialize* functions) =====
+
+void writeEnvelopeStart(JsonWriter& out, const char* timestamp, const char* deviceId,
+                        EventType eventType, const char* requestId, bool timeSynced) {
+    out.beginObject();
+    out.field("version", MQTT_PROTOCOL_VERSION);
+    out.field("timestamp", timestamp);
+    if (!timeSynced) {
+        out.field("time_synced", false);
+    }
+    out.field("device_id", deviceId);
+    out.field("event_type", eventTypeToString(eventType));
+    out.field("request_id", requestId);
+    out.beginObject("payload");
+}
+
+void writeEnvelopeEnd(JsonWriter& out) {
+    out.endObject();
+    out.endObject();
+}
+
+static void writeUserData(JsonWriter& out, const UserData& userData) {
+    out.beginObject("user_data");
+    if (strlen(userData.username) > 0) {
+        out.field("username", userData.username);
+    }
+    if (strlen(userData.context) > 0) {
+        out.field("context", userData.context);
+    }
+    out.endObject();
+}
+
+bool writeStatusChange(JsonWriter& out, const StatusChangePayload& data) {
+    out.field("status", deviceStatusToString(data.status));
+    out.field("firmware_version", data.firmware_version);
+    out.field("ip_address", data.ip_address);
+    return true;
+}
+
+bool writeModeChange(JsonWriter& out, const ModeChangePayload& data) {
+    out.field("mode", deviceModeToString(data.mode));
+    out.field("previous_mode", deviceModeToString(data.previous_mode));
+    return true;
+}
+
+bool writeTagDetected(JsonWriter& out, const TagDetectedPayload& data) {
+    out.field("tag_uid", data.tag_uid);
+    out.field("message", data.message);
+    return true;
+}
+
+bool writeRegisterSuccess(JsonWriter& out, const RegisterSuccessPayload& data) {
+    out.field("tag_uid", data.tag_uid);
+    out.field("blocks_written", data.blocks_written);
+    out.field("message", data.message);
+    return true;
+}
+
+bool writeAuthSuccess(JsonWriter& out, const AuthSuccessPayload& data) {
+    out.field("tag_uid", data.tag_uid);
+    out.field("authenticated", data.authenticated);
+    out.field("message", data.message);
+    writeUserData(out, data.user_data);
+    return true;
+}
+
+bool writeAuthFailed(JsonWriter& out, const AuthFailedPayload& data) {
+    out.field("tag_uid", data.tag_uid);
+    out.field("authenticated", data.authenticated);
+    out.field("reason", data.reason);
+    return true;
+}
+
+bool writeError(JsonWriter& out, const ErrorPayload& data) {
+    out.field("error", data.error);
+    out.field("error_code", errorCodeToString(data.error_code));
+    out.field("retry_possible", data.retry_possible);
+    out.field("component", errorComponentToString(data.component));
+    return true;
+}
+
+bool writeReadSuccess(JsonWriter& out, const ReadSuccessPayload& data) {
+    out.field("tag_uid", data.tag_uid);
+    out.field("message", data.message);
+    return true;
+}
+
+bool writeTagRemoved(JsonWriter& out, const TagRemovedPayload& data) {
+    out.field("tag_uid", data.tag_uid);
+    out.field("present_ms", data.present_ms);
+    return true;
+}
+
+// Each span is [name, start_us, duration_us]
+bool writeTapTrace(JsonWriter& out, const TapTracePayload& data) {
+    out.field("total_us", data.total_us);
+    out.field("dropped", data.dropped);
+    out.beginArray("spans");
+    for (uint8_t i = 0; i < data.count && i < TAP_TRACE_MAX_SPANS; i++) {
+        out.beginArray();
+        out.string(traceSpanToString(data.spans[i].span));
+        out.number(data.spans[i].start_us);
+        out.number(data.spans[i].duration_us);
+        out.endArray();
+    }
+    out.endArray();
+    return true;
+}
+
 // Serialize User Data helper
 bool serializeUserData(JsonObject obj, const UserData& userData) {
     if (strlen(userData.username) > 0) {
@@ -283,6 +642,23 @@ bool isValidTagUID(const char* uid) {
     return true;
 }
 
+// Convert a colon-separated tag UID to binary, zero padded to binaryLen
+bool tagUidToBinary(const char* uid, uint8_t* binary, size_t binaryLen) {
+    memset(binary, 0, binaryLen);
+    if (uid == nullptr) return false;
+    
+    size_t n = 0;
+    const char* p = uid;
+    while (*p) {
+        if (n >= binaryLen || !isxdigit(p[0]) || !isxdigit(p[1])) return false;
+        sscanf(p, "%2hhx", &binary[n++]);
+        p += 2;
+        if (*p == ':') p++;
+    }
+    
+    return n > 0;
+}
+
 // Validation: Hex key (32 hex characters)
 bool isValidHexKey(const char* key) {
     if (key == nullptr) return false;
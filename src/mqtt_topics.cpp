@@ -0,0 +1,135 @@
+#include "mqtt_topics.h"
+#include <stdio.h>
+#include <string.h>
+
+// Suffix of every topic, in the order of MQTTTopic
+static constexpr const char* TOPIC_SUFFIXES[MQTT_TOPIC_COUNT] = {
+    "register/start",
+    "register/cancel",
+    "auth/start",
+    "auth/verify",
+    "auth/cancel",
+    "read/start",
+    "read/cancel",
+    "reset",
+    "auth/cache",
+    "auth/prearm",
+    "register/success",
+    "register/error",
+    "auth/tag_detected",
+    "auth/success",
+    "auth/failed",
+    "auth/error",
+    "read/success",
+    "read/error",
+    "tag/removed",
+    "batch",
+    "debug/trace",
+    "status",
+    "mode",
+    "heartbeat",
+    "#",
+};
+
+// Compile-time sizes for the arena check (recursive, C++11 constexpr has no loops)
+static constexpr size_t stringBytes(const char* s) {
+    return *s ? 1 + stringBytes(s + 1) : 1;
+}
+
+static constexpr size_t suffixBytes(size_t i) {
+    return i < MQTT_TOPIC_COUNT ? stringBytes(TOPIC_SUFFIXES[i]) + suffixBytes(i + 1) : 0;
+}
+
+static_assert(suffixBytes(0) == MQTT_TOPIC_SUFFIX_BYTES, "MQTT_TOPIC_SUFFIX_BYTES does not match the topic table");
+static_assert(MQTT_TOPIC_ARENA_SIZE <= UINT16_MAX, "topic offsets are 16 bit");
+
+MQTTTopicBuilder::MQTTTopicBuilder() {
+    setDeviceId("");
+}
+
+void MQTTTopicBuilder::setDeviceId(const char* id) {
+    char deviceId[MAX_DEVICE_ID_LENGTH + 1];
+    strncpy(deviceId, id, MAX_DEVICE_ID_LENGTH);
+    deviceId[MAX_DEVICE_ID_LENGTH] = '\0';
+    
+    prefixLength = (uint16_t)snprintf(nullptr, 0, "devices/%s/", deviceId);
+    
+    // The arena is sized for the longest id; should it still run out, the topic is cut and
+    // the rest point at the last byte (an empty string) instead of past the arena
+    size_t used = 0;
+    for (size_t i = 0; i < MQTT_TOPIC_COUNT; i++) {
+        offsets[i] = (uint16_t)used;
+        int length = snprintf(arena + used, sizeof(arena) - used, "devices/%s/%s", deviceId, TOPIC_SUFFIXES[i]);
+        used += (size_t)length + 1;
+        if (used > sizeof(arena) - 1) {
+            used = sizeof(arena) - 1;
+        }
+    }
+}
+
+// Character i of the suffix, '\0' past its end
+static char at(const char* suffix, size_t length, size_t i) {
+    return i < length ? suffix[i] : '\0';
+}
+
+// Trie over the suffixes, unrolled into switches: each level branches on the first character
+// in which the remaining candidates differ
+static MQTTTopic candidate(const char* s, size_t n) {
+    switch (at(s, n, 0)) {
+        case 'r':
+            switch (at(s, n, 2)) {
+                case 'g':  // register/
+                    switch (at(s, n, 9)) {
+                        case 's': return at(s, n, 11) == 'a' ? MQTTTopic::REGISTER_START : MQTTTopic::REGISTER_SUCCESS;
+                        case 'c': return MQTTTopic::REGISTER_CANCEL;
+                        case 'e': return MQTTTopic::REGISTER_ERROR;
+                    }
+                    break;
+                case 'a':  // read/
+                    switch (at(s, n, 5)) {
+                        case 's': return at(s, n, 7) == 'a' ? MQTTTopic::READ_START : MQTTTopic::READ_SUCCESS;
+                        case 'c': return MQTTTopic::READ_CANCEL;
+                        case 'e': return MQTTTopic::READ_ERROR;
+                    }
+                    break;
+                case 's':
+                    return MQTTTopic::RESET;
+            }
+            break;
+        case 'a':  // auth/
+            switch (at(s, n, 5)) {
+                case 's': return at(s, n, 7) == 'a' ? MQTTTopic::AUTH_START : MQTTTopic::AUTH_SUCCESS;
+                case 'c': return at(s, n, 7) == 'n' ? MQTTTopic::AUTH_CANCEL : MQTTTopic::AUTH_CACHE_SYNC;
+                case 'v': return MQTTTopic::AUTH_VERIFY;
+                case 'p': return MQTTTopic::AUTH_PREARM;
+                case 't': return MQTTTopic::AUTH_TAG_DETECTED;
+                case 'f': return MQTTTopic::AUTH_FAILED;
+                case 'e': return MQTTTopic::AUTH_ERROR;
+            }
+            break;
+        case 't': return MQTTTopic::TAG_REMOVED;
+        case 'b': return MQTTTopic::BATCH;
+        case 'd': return MQTTTopic::TAP_TRACE;
+        case 's': return MQTTTopic::STATUS;
+        case 'm': return MQTTTopic::MODE;
+        case 'h': return MQTTTopic::HEARTBEAT;
+    }
+    return MQTTTopic::COUNT;
+}
+
+MQTTTopic MQTTTopicBuilder::route(const char* topic, size_t length) const {
+    // The prefix is the wildcard topic without its '#'
+    if (length <= prefixLength || memcmp(topic, allCommands(), prefixLength) != 0) {
+        return MQTTTopic::COUNT;
+    }
+    
+    const char* suffix = topic + prefixLength;
+    size_t suffixLength = length - prefixLength;
+    MQTTTopic match = candidate(suffix, suffixLength);
+    if (match == MQTTTopic::COUNT) {
+        return match;
+    }
+    
+    const char* expected = TOPIC_SUFFIXES[(size_t)match];
+    return strncmp(expected, suffix, suffixLength) == 0 && expected[suffixLength] == '\0' ? match : MQTTTopic::COUNT;
+}
@@ -1,153 +1,269 @@
 #include "mqtt_types.h"
+#include <string.h>
+
+// Every protocol enum has one table of length-prefixed names, indexed by the enum value,
+// used in both directions. String to enum hashes the string once and switches on the hash:
+// the case labels are hashed by the compiler, so two names of one enum with the same hash
+// are a duplicate case label (a build error), which makes the hash perfect for the vocabulary.
+// The only string compare is the final check against the one candidate.
+
+struct ProtocolName {
+    const char* text;
+    uint8_t length;
+};
+
+#define PROTOCOL_NAME(text) { text, sizeof(text) - 1 }
+#define NAME_COUNT(names) (sizeof(names) / sizeof(names[0]))
+
+// FNV-1a, evaluated by the compiler for the case labels
+static constexpr uint32_t nameHash(const char* text, uint32_t hash = 2166136261UL) {
+    return *text == '\0' ? hash : nameHash(text + 1, (hash ^ (uint8_t)*text) * 16777619UL);
+}
+
+// Same hash at run time, in one pass that also measures the string
+static uint32_t hashName(const char* text, size_t* length) {
+    uint32_t hash = 2166136261UL;
+    const char* c = text;
+    for (; *c != '\0'; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619UL;
+    }
+    *length = (size_t)(c - text);
+    return hash;
+}
+
+static bool matches(const ProtocolName& name, const char* text, size_t length) {
+    return name.length == length && memcmp(name.text, text, length) == 0;
+}
 
 // Command Type conversions
+static const ProtocolName COMMAND_TYPE_NAMES[] = {
+    PROTOCOL_NAME("register_start"),
+    PROTOCOL_NAME("register_cancel"),
+    PROTOCOL_NAME("auth_start"),
+    PROTOCOL_NAME("auth_verify"),
+    PROTOCOL_NAME("auth_cancel"),
+    PROTOCOL_NAME("read_start"),
+    PROTOCOL_NAME("read_cancel"),
+    PROTOCOL_NAME("reset"),
+    PROTOCOL_NAME("auth_cache_sync"),
+    PROTOCOL_NAME("auth_prearm"),
+};
+
 const char* commandTypeToString(CommandType type) {
-    switch (type) {
-        case CommandType::REGISTER_START: return "register_start";
-        case CommandType::REGISTER_CANCEL: return "register_cancel";
-        case CommandType::AUTH_START: return "auth_start";
-        case CommandType::AUTH_VERIFY: return "auth_verify";
-        case CommandType::AUTH_CANCEL: return "auth_cancel";
-        case CommandType::READ_START: return "read_start";
-        case CommandType::READ_CANCEL: return "read_cancel";
-        case CommandType::RESET: return "reset";
-        default: return "unknown";
-    }
+    size_t index = (size_t)type;
+    return index < NAME_COUNT(COMMAND_TYPE_NAMES) ? COMMAND_TYPE_NAMES[index].text : "unknown";
 }
 
 CommandType stringToCommandType(const char* str) {
-    if (strcmp(str, "register_start") == 0) return CommandType::REGISTER_START;
-    if (strcmp(str, "register_cancel") == 0) return CommandType::REGISTER_CANCEL;
-    if (strcmp(str, "auth_start") == 0) return CommandType::AUTH_START;
-    if (strcmp(str, "auth_verify") == 0) return CommandType::AUTH_VERIFY;
-    if (strcmp(str, "auth_cancel") == 0) return CommandType::AUTH_CANCEL;
-    if (strcmp(str, "read_start") == 0) return CommandType::READ_START;
-    if (strcmp(str, "read_cancel") == 0) return CommandType::READ_CANCEL;
-    if (strcmp(str, "reset") == 0) return CommandType::RESET;
-    return CommandType::UNKNOWN;
+    size_t length;
+    CommandType type;
+    switch (hashName(str, &length)) {
+        case nameHash("register_start"): type = CommandType::REGISTER_START; break;
+        case nameHash("register_cancel"): type = CommandType::REGISTER_CANCEL; break;
+        case nameHash("auth_start"): type = CommandType::AUTH_START; break;
+        case nameHash("auth_verify"): type = CommandType::AUTH_VERIFY; break;
+        case nameHash("auth_cancel"): type = CommandType::AUTH_CANCEL; break;
+        case nameHash("read_start"): type = CommandType::READ_START; break;
+        case nameHash("read_cancel"): type = CommandType::READ_CANCEL; break;
+        case nameHash("reset"): type = CommandType::RESET; break;
+        case nameHash("auth_cache_sync"): type = CommandType::AUTH_CACHE_SYNC; break;
+        case nameHash("auth_prearm"): type = CommandType::AUTH_PREARM; break;
+        default: return CommandType::UNKNOWN;
+    }
+    return matches(COMMAND_TYPE_NAMES[(size_t)type], str, length) ? type : CommandType::UNKNOWN;
 }
 
 // Event Type conversions
+static const ProtocolName EVENT_TYPE_NAMES[] = {
+    PROTOCOL_NAME("register_success"),
+    PROTOCOL_NAME("register_error"),
+    PROTOCOL_NAME("auth_tag_detected"),
+    PROTOCOL_NAME("auth_success"),
+    PROTOCOL_NAME("auth_failed"),
+    PROTOCOL_NAME("auth_error"),
+    PROTOCOL_NAME("read_success"),
+    PROTOCOL_NAME("read_error"),
+    PROTOCOL_NAME("status_change"),
+    PROTOCOL_NAME("mode_change"),
+    PROTOCOL_NAME("heartbeat"),
+    PROTOCOL_NAME("tag_removed"),
+    PROTOCOL_NAME("batch"),
+    PROTOCOL_NAME("tap_trace"),
+};
+
 const char* eventTypeToString(EventType type) {
-    switch (type) {
-        case EventType::REGISTER_SUCCESS: return "register_success";
-        case EventType::REGISTER_ERROR: return "register_error";
-        case EventType::AUTH_TAG_DETECTED: return "auth_tag_detected";
-        case EventType::AUTH_SUCCESS: return "auth_success";
-        case EventType::AUTH_FAILED: return "auth_failed";
-        case EventType::AUTH_ERROR: return "auth_error";
-        case EventType::READ_SUCCESS: return "read_success";
-        case EventType::READ_ERROR: return "read_error";
-        case EventType::STATUS_CHANGE: return "status_change";
-        case EventType::MODE_CHANGE: return "mode_change";
-        case EventType::HEARTBEAT: return "heartbeat";
-        default: return "unknown";
-    }
+    size_t index = (size_t)type;
+    return index < NAME_COUNT(EVENT_TYPE_NAMES) ? EVENT_TYPE_NAMES[index].text : "unknown";
 }
 
 EventType stringToEventType(const char* str) {
-    if (strcmp(str, "register_success") == 0) return EventType::REGISTER_SUCCESS;
-    if (strcmp(str, "register_error") == 0) return EventType::REGISTER_ERROR;
-    if (strcmp(str, "auth_tag_detected") == 0) return EventType::AUTH_TAG_DETECTED;
-    if (strcmp(str, "auth_success") == 0) return EventType::AUTH_SUCCESS;
-    if (strcmp(str, "auth_failed") == 0) return EventType::AUTH_FAILED;
-    if (strcmp(str, "auth_error") == 0) return EventType::AUTH_ERROR;
-    if (strcmp(str, "read_success") == 0) return EventType::READ_SUCCESS;
-    if (strcmp(str, "read_error") == 0) return EventType::READ_ERROR;
-    if (strcmp(str, "status_change") == 0) return EventType::STATUS_CHANGE;
-    if (strcmp(str, "mode_change") == 0) return EventType::MODE_CHANGE;
-    if (strcmp(str, "heartbeat") == 0) return EventType::HEARTBEAT;
-    return EventType::UNKNOWN;
+    size_t length;
+    EventType type;
+    switch (hashName(str, &length)) {
+        case nameHash("register_success"): type = EventType::REGISTER_SUCCESS; break;
+        case nameHash("register_error"): type = EventType::REGISTER_ERROR; break;
+        case nameHash("auth_tag_detected"): type = EventType::AUTH_TAG_DETECTED; break;
+        case nameHash("auth_success"): type = EventType::AUTH_SUCCESS; break;
+        case nameHash("auth_failed"): type = EventType::AUTH_FAILED; break;
+        case nameHash("auth_error"): type = EventType::AUTH_ERROR; break;
+        case nameHash("read_success"): type = EventType::READ_SUCCESS; break;
+        case nameHash("read_error"): type = EventType::READ_ERROR; break;
+        case nameHash("status_change"): type = EventType::STATUS_CHANGE; break;
+        case nameHash("mode_change"): type = EventType::MODE_CHANGE; break;
+        case nameHash("heartbeat"): type = EventType::HEARTBEAT; break;
+        case nameHash("tag_removed"): type = EventType::TAG_REMOVED; break;
+        case nameHash("batch"): type = EventType::BATCH; break;
+        case nameHash("tap_trace"): type = EventType::TAP_TRACE; break;
+        default: return EventType::UNKNOWN;
+    }
+    return matches(EVENT_TYPE_NAMES[(size_t)type], str, length) ? type : EventType::UNKNOWN;
 }
 
 // Device Mode conversions
+static const ProtocolName DEVICE_MODE_NAMES[] = {
+    PROTOCOL_NAME("idle"),
+    PROTOCOL_NAME("register"),
+    PROTOCOL_NAME("auth"),
+    PROTOCOL_NAME("read"),
+    PROTOCOL_NAME("unknown"),
+};
+
 const char* deviceModeToString(DeviceMode mode) {
-    switch (mode) {
-        case DeviceMode::IDLE: return "idle";
-        case DeviceMode::REGISTER: return "register";
-        case DeviceMode::AUTH: return "auth";
-        case DeviceMode::READ: return "read";
-        case DeviceMode::UNKNOWN: return "unknown";
-        default: return "unknown";
-    }
+    size_t index = (size_t)mode;
+    return index < NAME_COUNT(DEVICE_MODE_NAMES) ? DEVICE_MODE_NAMES[index].text : "unknown";
 }
 
 DeviceMode stringToDeviceMode(const char* str) {
-    if (strcmp(str, "idle") == 0) return DeviceMode::IDLE;
-    if (strcmp(str, "register") == 0) return DeviceMode::REGISTER;
-    if (strcmp(str, "auth") == 0) return DeviceMode::AUTH;
-    if (strcmp(str, "read") == 0) return DeviceMode::READ;
-    if (strcmp(str, "unknown") == 0) return DeviceMode::UNKNOWN;
-    return DeviceMode::UNKNOWN;
+    size_t length;
+    DeviceMode mode;
+    switch (hashName(str, &length)) {
+        case nameHash("idle"): mode = DeviceMode::IDLE; break;
+        case nameHash("register"): mode = DeviceMode::REGISTER; break;
+        case nameHash("auth"): mode = DeviceMode::AUTH; break;
+        case nameHash("read"): mode = DeviceMode::READ; break;
+        default: return DeviceMode::UNKNOWN;
+    }
+    return matches(DEVICE_MODE_NAMES[(size_t)mode], str, length) ? mode : DeviceMode::UNKNOWN;
 }
 
 // Device Status conversions
+static const ProtocolName DEVICE_STATUS_NAMES[] = {
+    PROTOCOL_NAME("online"),
+    PROTOCOL_NAME("offline"),
+};
+
 const char* deviceStatusToString(DeviceStatus status) {
-    switch (status) {
-        case DeviceStatus::ONLINE: return "online";
-        case DeviceStatus::OFFLINE: return "offline";
-        default: return "offline";
-    }
+    size_t index = (size_t)status;
+    return index < NAME_COUNT(DEVICE_STATUS_NAMES) ? DEVICE_STATUS_NAMES[index].text : "offline";
 }
 
 DeviceStatus stringToDeviceStatus(const char* str) {
-    if (strcmp(str, "online") == 0) return DeviceStatus::ONLINE;
-    if (strcmp(str, "offline") == 0) return DeviceStatus::OFFLINE;
-    return DeviceStatus::OFFLINE;
+    size_t length;
+    DeviceStatus status;
+    switch (hashName(str, &length)) {
+        case nameHash("online"): status = DeviceStatus::ONLINE; break;
+        default: return DeviceStatus::OFFLINE;
+    }
+    return matches(DEVICE_STATUS_NAMES[(size_t)status], str, length) ? status : DeviceStatus::OFFLINE;
 }
 
 // Error Code conversions
+static const ProtocolName ERROR_CODE_NAMES[] = {
+    PROTOCOL_NAME("NFC_TIMEOUT"),
+    PROTOCOL_NAME("NFC_TAG_LOST"),
+    PROTOCOL_NAME("NFC_AUTH_FAILED"),
+    PROTOCOL_NAME("NFC_READ_ERROR"),
+    PROTOCOL_NAME("NFC_WRITE_ERROR"),
+    PROTOCOL_NAME("NFC_UNSUPPORTED_TAG"),
+    PROTOCOL_NAME("NFC_INVALID_KEY"),
+    PROTOCOL_NAME("NFC_DEVICE_BUSY"),
+    PROTOCOL_NAME("NFC_DEVICE_ERROR"),
+    PROTOCOL_NAME("INVALID_COMMAND"),
+    PROTOCOL_NAME("SESSION_NOT_FOUND"),
+    PROTOCOL_NAME("TIMEOUT_EXCEEDED"),
+};
+
 const char* errorCodeToString(ErrorCode code) {
-    switch (code) {
-        case ErrorCode::NFC_TIMEOUT: return "NFC_TIMEOUT";
-        case ErrorCode::NFC_TAG_LOST: return "NFC_TAG_LOST";
-        case ErrorCode::NFC_AUTH_FAILED: return "NFC_AUTH_FAILED";
-        case ErrorCode::NFC_READ_ERROR: return "NFC_READ_ERROR";
-        case ErrorCode::NFC_WRITE_ERROR: return "NFC_WRITE_ERROR";
-        case ErrorCode::NFC_UNSUPPORTED_TAG: return "NFC_UNSUPPORTED_TAG";
-        case ErrorCode::NFC_INVALID_KEY: return "NFC_INVALID_KEY";
-        case ErrorCode::NFC_DEVICE_BUSY: return "NFC_DEVICE_BUSY";
-        case ErrorCode::NFC_DEVICE_ERROR: return "NFC_DEVICE_ERROR";
-        case ErrorCode::INVALID_COMMAND: return "INVALID_COMMAND";
-        case ErrorCode::SESSION_NOT_FOUND: return "SESSION_NOT_FOUND";
-        case ErrorCode::TIMEOUT_EXCEEDED: return "TIMEOUT_EXCEEDED";
-        default: return "UNKNOWN";
-    }
+    size_t index = (size_t)code;
+    return index < NAME_COUNT(ERROR_CODE_NAMES) ? ERROR_CODE_NAMES[index].text : "UNKNOWN";
 }
 
 ErrorCode stringToErrorCode(const char* str) {
-    if (strcmp(str, "NFC_TIMEOUT") == 0) return ErrorCode::NFC_TIMEOUT;
-    if (strcmp(str, "NFC_TAG_LOST") == 0) return ErrorCode::NFC_TAG_LOST;
-    if (strcmp(str, "NFC_AUTH_FAILED") == 0) return ErrorCode::NFC_AUTH_FAILED;
-    if (strcmp(str, "NFC_READ_ERROR") == 0) return ErrorCode::NFC_READ_ERROR;
-    if (strcmp(str, "NFC_WRITE_ERROR") == 0) return ErrorCode::NFC_WRITE_ERROR;
-    if (strcmp(str, "NFC_UNSUPPORTED_TAG") == 0) return ErrorCode::NFC_UNSUPPORTED_TAG;
-    if (strcmp(str, "NFC_INVALID_KEY") == 0) return ErrorCode::NFC_INVALID_KEY;
-    if (strcmp(str, "NFC_DEVICE_BUSY") == 0) return ErrorCode::NFC_DEVICE_BUSY;
-    if (strcmp(str, "NFC_DEVICE_ERROR") == 0) return ErrorCode::NFC_DEVICE_ERROR;
-    if (strcmp(str, "INVALID_COMMAND") == 0) return ErrorCode::INVALID_COMMAND;
-    if (strcmp(str, "SESSION_NOT_FOUND") == 0) return ErrorCode::SESSION_NOT_FOUND;
-    if (strcmp(str, "TIMEOUT_EXCEEDED") == 0) return ErrorCode::TIMEOUT_EXCEEDED;
-    return ErrorCode::UNKNOWN;
+    size_t length;
+    ErrorCode code;
+    switch (hashName(str, &length)) {
+        case nameHash("NFC_TIMEOUT"): code = ErrorCode::NFC_TIMEOUT; break;
+        case nameHash("NFC_TAG_LOST"): code = ErrorCode::NFC_TAG_LOST; break;
+        case nameHash("NFC_AUTH_FAILED"): code = ErrorCode::NFC_AUTH_FAILED; break;
+        case nameHash("NFC_READ_ERROR"): code = ErrorCode::NFC_READ_ERROR; break;
+        case nameHash("NFC_WRITE_ERROR"): code = ErrorCode::NFC_WRITE_ERROR; break;
+        case nameHash("NFC_UNSUPPORTED_TAG"): code = ErrorCode::NFC_UNSUPPORTED_TAG; break;
+        case nameHash("NFC_INVALID_KEY"): code = ErrorCode::NFC_INVALID_KEY; break;
+        case nameHash("NFC_DEVICE_BUSY"): code = ErrorCode::NFC_DEVICE_BUSY; break;
+        case nameHash("NFC_DEVICE_ERROR"): code = ErrorCode::NFC_DEVICE_ERROR; break;
+        case nameHash("INVALID_COMMAND"): code = ErrorCode::INVALID_COMMAND; break;
+        case nameHash("SESSION_NOT_FOUND"): code = ErrorCode::SESSION_NOT_FOUND; break;
+        case nameHash("TIMEOUT_EXCEEDED"): code = ErrorCode::TIMEOUT_EXCEEDED; break;
+        default: return ErrorCode::UNKNOWN;
+    }
+    return matches(ERROR_CODE_NAMES[(size_t)code], str, length) ? code : ErrorCode::UNKNOWN;
 }
 
 // Error Component conversions
+static const ProtocolName ERROR_COMPONENT_NAMES[] = {
+    PROTOCOL_NAME("nfc"),
+    PROTOCOL_NAME("pn532"),
+    PROTOCOL_NAME("crypto"),
+    PROTOCOL_NAME("device"),
+    PROTOCOL_NAME("protocol"),
+};
+
 const char* errorComponentToString(ErrorComponent component) {
-    switch (component) {
-        case ErrorComponent::NFC: return "nfc";
-        case ErrorComponent::PN532: return "pn532";
-        case ErrorComponent::CRYPTO: return "crypto";
-        case ErrorComponent::DEVICE: return "device";
-        case ErrorComponent::PROTOCOL: return "protocol";
-        default: return "device";
-    }
+    size_t index = (size_t)component;
+    return index < NAME_COUNT(ERROR_COMPONENT_NAMES) ? ERROR_COMPONENT_NAMES[index].text : "device";
 }
 
 ErrorComponent stringToErrorComponent(const char* str) {
-    if (strcmp(str, "nfc") == 0) return ErrorComponent::NFC;
-    if (strcmp(str, "pn532") == 0) return ErrorComponent::PN532;
-    if (strcmp(str, "crypto") == 0) return ErrorComponent::CRYPTO;
-    if (strcmp(str, "device") == 0) return ErrorComponent::DEVICE;
-    if (strcmp(str, "protocol") == 0) return ErrorComponent::PROTOCOL;
-    return ErrorComponent::DEVICE;
+    size_t length;
+    ErrorComponent component;
+    switch (hashName(str, &length)) {
+        case nameHash("nfc"): component = ErrorComponent::NFC; break;
+        case nameHash("pn532"): component = ErrorComponent::PN532; break;
+        case nameHash("crypto"): component = ErrorComponent::CRYPTO; break;
+        case nameHash("device"): component = ErrorComponent::DEVICE; break;
+        case nameHash("protocol"): component = ErrorComponent::PROTOCOL; break;
+        default: return ErrorComponent::DEVICE;
+    }
+    return matches(ERROR_COMPONENT_NAMES[(size_t)component], str, length) ? component : ErrorComponent::DEVICE;
+}
+
+// Decision Tier conversions (only sent)
+static const ProtocolName DECISION_TIER_NAMES[] = {
+    PROTOCOL_NAME("keyed"),
+    PROTOCOL_NAME("cached"),
+    PROTOCOL_NAME("backend"),
+    PROTOCOL_NAME("offline"),
+};
+
+const char* decisionTierToString(DecisionTier tier) {
+    size_t index = (size_t)tier;
+    return index < NAME_COUNT(DECISION_TIER_NAMES) ? DECISION_TIER_NAMES[index].text : "unknown";
+}
+
+// Trace Span conversions (only sent)
+static const ProtocolName TRACE_SPAN_NAMES[] = {
+    PROTOCOL_NAME("read_card"),
+    PROTOCOL_NAME("picc_auth"),
+    PROTOCOL_NAME("app_auth"),
+    PROTOCOL_NAME("file_read"),
+    PROTOCOL_NAME("crypto"),
+    PROTOCOL_NAME("backend"),
+    PROTOCOL_NAME("display"),
+    PROTOCOL_NAME("build"),
+    PROTOCOL_NAME("publish"),
+};
+
+const char* traceSpanToString(TraceSpan span) {
+    size_t index = (size_t)span;
+    return index < NAME_COUNT(TRACE_SPAN_NAMES) ? TRACE_SPAN_NAMES[index].text : "unknown";
 }
@@ -0,0 +1,785 @@
+#include <Arduino.h>
+#include <EspMQTTClient.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+#include <atomic>
+
+#include "network.h"
+#include "reader_messages.h"
+#include "config.h"
+#include "mqtt_protocol.h"
+#include "mqtt_types.h"
+#include "event_journal.h"
+#include "publish_queue.h"
+#include "telemetry.h"
+#include "tap_trace.h"
+#include "time_service.h"
+
+#define FIRMWARE_VERSION "1.0.0"
+
+EspMQTTClient client;
+
+// MQTT Protocol objects (only touched by the network task)
+MQTTMessageBuilder mqttBuilder;
+MQTTMessageParser mqttParser;
+MQTTTopicBuilder mqttTopics;
+
+static String deviceTopicId;
+static std::atomic<bool> online(false);
+
+char last_will[200] = {}; // to fix wierd pointer issure with the last will message
+const char *last_msg = last_will;
+
+// Scratch command and event, only touched by the network task
+static ReaderCommand incoming_command;
+static ReaderEvent busy_event;
+
+static CommandQueueStats command_stats;
+
+// Events that wait for the broker are kept in the flash journal
+static bool journal_ready = false;
+static uint8_t journal_record[EVENT_JOURNAL_MAX_RECORD + 1];
+static unsigned long last_replay = 0;
+
+static unsigned long last_heartbeat = 0;
+
+#if TRACE_TAPS
+static ReaderEvent pending_trace; // Waits for the messages of its tap to go out
+static bool trace_pending = false;
+static uint32_t trace_held_ms = 0;
+#endif
+
+void onConnectionEstablished();
+void handleMessage(const String &topic, const String &payload);
+void handleCommand(CommandType type, const String &payload);
+void handleDisplay(const String &payload);
+
+// SNTP sets the system clock in the background; it is only trusted once it is past the time
+// this firmware was written
+static bool sntpTime(int64_t *unixMs)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  if (now.tv_sec < SNTP_VALID_AFTER)
+  {
+    return false;
+  }
+  *unixMs = (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+  return true;
+}
+
+void network_begin(const MqttSettings &settings, const String &deviceId)
+{
+  deviceTopicId = deviceId;
+
+  client.setWifiCredentials(settings.SSID.c_str(), settings.KEY.c_str());
+  client.setMqttServer(settings.url.c_str(), settings.usr.c_str(), settings.pw.c_str(), settings.port);
+  client.setMqttClientName(settings.id.c_str());
+
+  // Initialize MQTT protocol objects with device ID
+  mqttBuilder.setDeviceId(deviceId.c_str());
+  mqttTopics.setDeviceId(deviceId.c_str());
+
+  client.setMaxPacketSize(1024); // auth_cache_sync batches are larger than the other commands
+
+  // Timestamps are UTC, SNTP keeps syncing once WiFi is up
+  configTime(0, 0, SNTP_SERVER);
+  time_service_begin(sntpTime);
+
+  // Optional functionalities of EspMQTTClient
+  client.enableDebuggingMessages(); // Enable debugging messages sent to serial output
+  // client.enableHTTPWebUpdater(); // Enable the web updater. User and password default to values of MQTTUsername and MQTTPassword. These can be overridded with enableHTTPWebUpdater("user", "password").
+  //  client.enableOTA(); // Enable OTA (Over The Air) updates. Password defaults to MQTTPassword. Port is the default OTA port. Can be overridden with enableOTA("password", port).
+  client.enableDrasticResetOnConnectionFailures();
+
+  String message3 = "device/" + deviceId + "/register";
+  message3.toCharArray(last_will, message3.length() + 1);
+  client.enableLastWillMessage(last_msg, "disconnect", true); // You can activate the retain flag by setting the third parameter to true
+
+  journal_ready = event_journal_begin();
+  if (!journal_ready)
+  {
+    Serial.println("Event journal unavailable - events are lost while offline");
+  }
+  else if (event_journal_pending() > 0)
+  {
+    Serial.print("Event journal: ");
+    Serial.print(event_journal_pending());
+    Serial.println(" events from the last run to replay");
+  }
+}
+
+bool network_is_online()
+{
+  return online.load(std::memory_order_relaxed);
+}
+
+// Topic of an event type, nullptr for types that are not published
+static const char *eventTopic(EventType type)
+{
+  switch (type)
+  {
+  case EventType::STATUS_CHANGE:
+    return mqttTopics.status();
+  case EventType::MODE_CHANGE:
+    return mqttTopics.mode();
+  case EventType::AUTH_TAG_DETECTED:
+    return mqttTopics.authTagDetected();
+  case EventType::AUTH_SUCCESS:
+    return mqttTopics.authSuccess();
+  case EventType::AUTH_FAILED:
+    return mqttTopics.authFailed();
+  case EventType::AUTH_ERROR:
+    return mqttTopics.authError();
+  case EventType::REGISTER_SUCCESS:
+    return mqttTopics.registerSuccess();
+  case EventType::REGISTER_ERROR:
+    return mqttTopics.registerError();
+  case EventType::READ_SUCCESS:
+    return mqttTopics.readSuccess();
+  case EventType::READ_ERROR:
+    return mqttTopics.readError();
+  case EventType::TAG_REMOVED:
+    return mqttTopics.tagRemoved();
+  case EventType::HEARTBEAT:
+    return mqttTopics.heartbeat();
+  case EventType::BATCH:
+    return mqttTopics.batch();
+  case EventType::TAP_TRACE:
+    return mqttTopics.tapTrace();
+  default:
+    return nullptr;
+  }
+}
+
+// Keep a message in the flash journal for the replay
+static void journal(uint8_t type, uint8_t flags, const char *message, size_t length)
+{
+  if (!journal_ready)
+  {
+    Serial.println("Event journal unavailable - event dropped");
+    return;
+  }
+  if (!event_journal_append(type, (flags & PUBLISH_RETAINED) ? EVENT_JOURNAL_RETAINED : 0,
+                            (const uint8_t *)message, length))
+  {
+    Serial.println("Event journal rejected event - not published");
+  }
+}
+
+// Move a queued message to the journal, spilling the oldest first keeps the journal in order.
+// Telemetry (PUBLISH_NO_SPILL) is dropped instead.
+static void spill(PublishMessage *message)
+{
+  if (message->flags & PUBLISH_NO_SPILL)
+  {
+    publish_queue_drop(message);
+    return;
+  }
+  journal(message->type, message->flags, message->data, message->length);
+  publish_queue_spill(message);
+}
+
+// Hand one message to the client. EspMQTTClient publishes a String, i.e. up to the first NUL,
+// so the payload has to be text; deliver() keeps anything else out of the queue and journal.
+static bool publishPayload(const char *topic, const char *data, size_t length, bool retained)
+{
+  (void)length; // Equal to strlen(data) for text
+  return client.publish(topic, data, retained);
+}
+
+// Queue the message of length bytes for servicePublishQueue; a full queue makes room by
+// spilling its oldest. flags are PUBLISH_*.
+static void deliver(EventType type, const char *message, size_t length, uint8_t flags, uint32_t delay = 0)
+{
+  if (memchr(message, '\0', length) != nullptr)
+  {
+    Serial.println("Binary payload cannot be published - event dropped"); // MessagePack, see publishPayload()
+    return;
+  }
+  if (publish_queue_push((uint8_t)type, flags, message, length, millis(), delay))
+  {
+    return;
+  }
+  if (flags & PUBLISH_NO_SPILL)
+  {
+    return; // Not worth moving an event to flash for
+  }
+
+  PublishMessage *oldest = publish_queue_oldest();
+  if (oldest != nullptr)
+  {
+    spill(oldest);
+  }
+  if (!publish_queue_push((uint8_t)type, flags, message, length, millis()))
+  {
+    journal((uint8_t)type, flags, message, length);
+  }
+}
+
+// Serialize one event produced by the NFC task, nullptr if it is not published
+static const char *buildEvent(ReaderEvent &event, bool *retained)
+{
+  const char *message = nullptr;
+  *retained = false;
+
+  // Stamp the event with the time it happened, not the time it is published. A time taken
+  // before the first sync is re-based if the clock has been synced since, otherwise flagged.
+  int64_t occurred_ms = event.occurred_ms;
+  bool synced = !(event.flags & READER_EVENT_TIME_UNSYNCED) || time_service_rebase(event.occurred_ms, &occurred_ms);
+  mqttBuilder.setEventTime(occurred_ms, synced);
+
+  switch (event.type)
+  {
+  case EventType::STATUS_CHANGE:
+    strlcpy(event.payload.status_change.firmware_version, FIRMWARE_VERSION, sizeof(event.payload.status_change.firmware_version));
+    strlcpy(event.payload.status_change.ip_address, WiFi.localIP().toString().c_str(), sizeof(event.payload.status_change.ip_address));
+    message = mqttBuilder.buildStatusChange(event.request_id, event.payload.status_change);
+    *retained = true;
+    break;
+  case EventType::MODE_CHANGE:
+    message = mqttBuilder.buildModeChange(event.request_id, event.payload.mode_change);
+    *retained = true;
+    break;
+  case EventType::AUTH_TAG_DETECTED:
+    message = mqttBuilder.buildTagDetected(event.request_id, event.payload.tag_detected);
+    break;
+  case EventType::AUTH_SUCCESS:
+    message = mqttBuilder.buildAuthSuccess(event.request_id, event.payload.auth_success);
+    break;
+  case EventType::AUTH_FAILED:
+    message = mqttBuilder.buildAuthFailed(event.request_id, event.payload.auth_failed);
+    break;
+  case EventType::AUTH_ERROR:
+    message = mqttBuilder.buildAuthError(event.request_id, event.payload.error);
+    break;
+  case EventType::REGISTER_SUCCESS:
+    message = mqttBuilder.buildRegisterSuccess(event.request_id, event.payload.register_success);
+    break;
+  case EventType::REGISTER_ERROR:
+    message = mqttBuilder.buildRegisterError(event.request_id, event.payload.error);
+    break;
+  case EventType::READ_SUCCESS:
+    message = mqttBuilder.buildReadSuccess(event.request_id, event.payload.read_success);
+    break;
+  case EventType::READ_ERROR:
+    message = mqttBuilder.buildReadError(event.request_id, event.payload.error);
+    break;
+  case EventType::TAG_REMOVED:
+    message = mqttBuilder.buildTagRemoved(event.request_id, event.payload.tag_removed);
+    break;
+  case EventType::TAP_TRACE:
+    message = mqttBuilder.buildTapTrace(event.request_id, event.payload.tap_trace);
+    break;
+  default:
+    Serial.println("Unknown event type - not published");
+    break;
+  }
+  return message;
+}
+
+#if TRACE_TAPS
+static void sendTapTrace()
+{
+  trace_pending = false;
+  tap_trace_merge(pending_trace.payload.tap_trace);
+  bool retained;
+  const char *message = buildEvent(pending_trace, &retained);
+  if (message != nullptr)
+  {
+    deliver(EventType::TAP_TRACE, message, mqttBuilder.length(), PUBLISH_NO_SPILL);
+  }
+}
+
+// The trace of a tap follows its result. It is held until the messages queued before it are
+// out, so publishing the result is part of the trace.
+static void holdTapTrace(const ReaderEvent &event)
+{
+  if (trace_pending)
+  {
+    sendTapTrace(); // Taps in quick succession, the previous one goes out as it is
+  }
+  pending_trace = event;
+  trace_pending = true;
+  trace_held_ms = millis();
+}
+
+static void flushTapTrace(bool connected)
+{
+  if (!trace_pending)
+  {
+    return;
+  }
+  if (!connected)
+  {
+    trace_pending = false; // Not worth a place in the journal
+    return;
+  }
+  PublishMessage *oldest = publish_queue_oldest();
+  if (oldest == nullptr || (int32_t)(oldest->queued_ms - trace_held_ms) > 0)
+  {
+    sendTapTrace();
+  }
+}
+#endif
+
+// Publish the oldest journaled record and delete it, false if there is none or it failed
+static bool publishJournaled()
+{
+  EventJournalRecord record;
+  if (!event_journal_peek(&record, journal_record, EVENT_JOURNAL_MAX_RECORD))
+  {
+    return false;
+  }
+  journal_record[record.length] = '\0';
+
+  const char *topic = eventTopic((EventType)record.type);
+  if (topic != nullptr &&
+      !publishPayload(topic, (const char *)journal_record, record.length, (record.flags & EVENT_JOURNAL_RETAINED) != 0))
+  {
+    return false; // Keep it for the next attempt
+  }
+  event_journal_ack();
+  return true;
+}
+
+// Before a restart, publish the journal and the queue right away and in order, so the retained
+// mode the reset queued is on the broker before the device goes down. Only what cannot be
+// published is left in the journal for the replay after the restart.
+static void flushBeforeRestart()
+{
+  bool connected = client.isMqttConnected();
+  while (connected && journal_ready && event_journal_pending() > 0)
+  {
+    connected = publishJournaled();
+  }
+
+  PublishMessage *queued;
+  while ((queued = publish_queue_oldest()) != nullptr)
+  {
+    const char *topic = eventTopic((EventType)queued->type);
+    if (connected && (topic == nullptr || publishPayload(topic, queued->data, queued->length, (queued->flags & PUBLISH_RETAINED) != 0)))
+    {
+      publish_queue_published(queued, millis());
+    }
+    else
+    {
+      connected = false; // The rest follows it into the journal, in order
+      spill(queued);
+    }
+  }
+}
+
+// Serialize an event, timed for the tap trace
+static const char *buildTracedEvent(ReaderEvent &event, bool *retained)
+{
+  int64_t started_us = esp_timer_get_time();
+  const char *message = buildEvent(event, retained);
+  tap_trace_network_span(TraceSpan::BUILD, started_us);
+  return message;
+}
+
+// Serialize and publish one event produced by the NFC task
+static void publishEvent(ReaderEvent &event)
+{
+#if TRACE_TAPS
+  if (event.type == EventType::TAP_TRACE)
+  {
+    holdTapTrace(event);
+    return;
+  }
+#endif
+
+  bool retained;
+  const char *message = buildTracedEvent(event, &retained);
+  if (message == nullptr)
+  {
+    return;
+  }
+
+  if (event.flags & READER_EVENT_RESTART_AFTER)
+  {
+    flushBeforeRestart();
+    publishPayload(eventTopic(event.type), message, mqttBuilder.length(), retained);
+    delay(500); // Give time for message to be sent
+    ESP.restart();
+  }
+
+  deliver(event.type, message, mqttBuilder.length(), retained ? PUBLISH_RETAINED : 0);
+}
+
+#if BATCH_EVENTS
+// Publish the events waiting in reader_events as batch messages of up to BATCH_MAX_EVENTS.
+// Retained state is also published on its own topic for new subscribers, delayed by
+// STATE_PUBLISH_DELAY_MS so the state changes of one tap coalesce into one message.
+// Takes at least the first event; stops at an event that restarts the reader.
+static void publishBatch()
+{
+  char requestId[MAX_UUID_LENGTH + 1];
+  generateUUID(requestId, sizeof(requestId));
+  mqttBuilder.beginBatch(requestId);
+
+  ReaderEvent *event;
+  while (mqttBuilder.batchSize() < BATCH_MAX_EVENTS && (event = reader_events.front()) != nullptr &&
+         !(event->flags & READER_EVENT_RESTART_AFTER))
+  {
+#if TRACE_TAPS
+    if (event->type == EventType::TAP_TRACE)
+    {
+      holdTapTrace(*event);
+      reader_events.popFront();
+      continue;
+    }
+#endif
+
+    bool retained;
+    const char *message = buildTracedEvent(*event, &retained);
+    if (message != nullptr && !mqttBuilder.addToBatch())
+    {
+      if (mqttBuilder.batchSize() > 0)
+      {
+        break; // Goes into the next batch
+      }
+      deliver(event->type, message, mqttBuilder.length(), retained ? PUBLISH_RETAINED : 0); // Too large for a batch (or not JSON)
+    }
+    else if (message != nullptr && retained)
+    {
+      deliver(event->type, message, mqttBuilder.length(), PUBLISH_RETAINED, STATE_PUBLISH_DELAY_MS);
+    }
+    reader_events.popFront();
+  }
+
+  if (mqttBuilder.batchSize() > 0)
+  {
+    const char *batch = mqttBuilder.endBatch();
+    if (batch != nullptr)
+    {
+      deliver(EventType::BATCH, batch, mqttBuilder.length(), 0);
+    }
+  }
+}
+#endif
+
+void network_print_command_queue_stats()
+{
+  char line[96];
+  snprintf(line, sizeof(line), "control: %u accepted, %u rejected, depth %u (max %u)",
+           (unsigned)command_stats.control.accepted, (unsigned)command_stats.control.rejected,
+           (unsigned)command_stats.control.depth, (unsigned)command_stats.control.max_depth);
+  Serial.println(line);
+  snprintf(line, sizeof(line), "commands: %u accepted, %u rejected, depth %u (max %u)",
+           (unsigned)command_stats.commands.accepted, (unsigned)command_stats.commands.rejected,
+           (unsigned)command_stats.commands.depth, (unsigned)command_stats.commands.max_depth);
+  Serial.println(line);
+}
+
+void network_print_publish_queue_stats()
+{
+  const PublishQueueStats &stats = publish_queue_stats();
+  char line[128];
+  snprintf(line, sizeof(line), "publish: %u queued, %u published, %u coalesced, %u retries, %u spilled, %u dropped, depth %u (max %u)",
+           (unsigned)stats.queued, (unsigned)stats.published, (unsigned)stats.coalesced, (unsigned)stats.retries,
+           (unsigned)stats.spilled, (unsigned)stats.dropped, (unsigned)stats.depth, (unsigned)stats.max_depth);
+  Serial.println(line);
+  snprintf(line, sizeof(line), "publish latency: p50 %u ms, p99 %u ms, max %u ms",
+           (unsigned)stats.latency.percentile(50), (unsigned)stats.latency.percentile(99),
+           (unsigned)stats.latency.max());
+  Serial.println(line);
+}
+
+static void countAccepted(CommandLaneStats &stats, size_t depth)
+{
+  stats.accepted++;
+  stats.depth = (uint8_t)depth;
+  if (stats.depth > stats.max_depth)
+  {
+    stats.max_depth = stats.depth;
+  }
+}
+
+// Backpressure: tell the backend right away that the reader cannot take the command
+static void rejectBusy(const ReaderCommand &command)
+{
+  switch (command.type)
+  {
+  case CommandType::REGISTER_START:
+  case CommandType::REGISTER_CANCEL:
+    busy_event.type = EventType::REGISTER_ERROR;
+    break;
+  case CommandType::READ_START:
+  case CommandType::READ_CANCEL:
+    busy_event.type = EventType::READ_ERROR;
+    break;
+  case CommandType::RESET:
+    return; // No error topic for reset
+  default:
+    busy_event.type = EventType::AUTH_ERROR;
+    break;
+  }
+
+  busy_event.flags = 0;
+  busy_event.occurred_ms = 0;
+  strlcpy(busy_event.request_id, command.request_id, sizeof(busy_event.request_id));
+  ErrorPayload &error = busy_event.payload.error;
+  error.clear();
+  strlcpy(error.error, "Reader busy - command queue full", sizeof(error.error));
+  error.error_code = ErrorCode::NFC_DEVICE_BUSY;
+  error.retry_possible = true;
+  error.component = ErrorComponent::DEVICE;
+  publishEvent(busy_event);
+}
+
+// Publish a batch of journaled events, at most one batch per EVENT_JOURNAL_REPLAY_INTERVAL_MS
+// so a long outage does not flood the broker. Records are deleted once published.
+static void replayJournal()
+{
+  if (!journal_ready || event_journal_pending() == 0 ||
+      millis() - last_replay < EVENT_JOURNAL_REPLAY_INTERVAL_MS)
+  {
+    return;
+  }
+  last_replay = millis();
+
+  for (uint8_t i = 0; i < EVENT_JOURNAL_REPLAY_BATCH; i++)
+  {
+    if (!publishJournaled())
+    {
+      return;
+    }
+  }
+}
+
+// Publish the due messages of the queue, at most PUBLISH_QUEUE_BATCH per loop so a burst
+// does not hold off client.loop(). Failed publishes are retried with a backoff and go to the
+// journal once out of attempts. Events go out between the batches of a journal replay; state
+// waits for it, so an older retained state from the journal cannot overwrite a newer one.
+static void servicePublishQueue(bool connected)
+{
+  PublishMessage *message;
+  if (!connected)
+  {
+    // The journal keeps them across a restart; without one they wait here
+    while (journal_ready && (message = publish_queue_oldest()) != nullptr)
+    {
+      spill(message);
+    }
+    return;
+  }
+  bool replaying = journal_ready && event_journal_pending() > 0;
+
+  for (uint8_t i = 0; i < PUBLISH_QUEUE_BATCH; i++)
+  {
+    message = publish_queue_next(millis(), !replaying);
+    if (message == nullptr)
+    {
+      return;
+    }
+
+    const char *topic = eventTopic((EventType)message->type);
+    int64_t publish_started_us = esp_timer_get_time();
+    bool published = topic == nullptr || publishPayload(topic, message->data, message->length, (message->flags & PUBLISH_RETAINED) != 0);
+    if (message->type != (uint8_t)EventType::TAP_TRACE)
+    {
+      tap_trace_network_span(TraceSpan::PUBLISH, publish_started_us);
+    }
+
+    if (published)
+    {
+      publish_queue_published(message, millis());
+    }
+    else if (!publish_queue_failed(message, millis()))
+    {
+      spill(message);
+    }
+  }
+}
+
+// Telemetry every HEARTBEAT_INTERVAL_MS while connected; not journaled, a stale heartbeat is worthless
+static void publishHeartbeat()
+{
+  if (millis() - last_heartbeat < HEARTBEAT_INTERVAL_MS)
+  {
+    return;
+  }
+  last_heartbeat = millis();
+
+  HeartbeatPayload payload;
+  payload.clear();
+  telemetry_fill_heartbeat(payload);
+  payload.command_queue = (uint8_t)reader_commands.size();
+  payload.control_queue = (uint8_t)reader_control.size();
+  payload.event_queue = (uint8_t)reader_events.size();
+  payload.publish_queue = (uint8_t)publish_queue_depth();
+  payload.journal_pending = journal_ready ? (uint16_t)event_journal_pending() : 0;
+  payload.command_rejected = command_stats.commands.rejected;
+  payload.control_rejected = command_stats.control.rejected;
+
+  char requestId[MAX_UUID_LENGTH + 1];
+  generateUUID(requestId, sizeof(requestId));
+  mqttBuilder.setEventTime(0);
+  const char *message = mqttBuilder.buildHeartbeat(requestId, payload);
+  if (message != nullptr)
+  {
+    deliver(EventType::HEARTBEAT, message, mqttBuilder.length(), PUBLISH_NO_SPILL);
+  }
+}
+
+void network_loop()
+{
+  int64_t loop_started_us = esp_timer_get_time();
+
+  client.loop();
+
+  bool connected = client.isMqttConnected() && client.isWifiConnected();
+  online.store(connected, std::memory_order_relaxed);
+
+  time_service_loop();
+
+  // Events of an outage are replayed in order, live events are not held back by them
+  if (connected)
+  {
+    replayJournal();
+  }
+
+  ReaderEvent *event;
+  while ((event = reader_events.front()) != nullptr)
+  {
+#if BATCH_EVENTS
+    if (reader_events.size() > 1 && !(event->flags & READER_EVENT_RESTART_AFTER))
+    {
+      publishBatch();
+      continue;
+    }
+#endif
+    publishEvent(*event);
+    reader_events.popFront();
+  }
+
+  if (connected)
+  {
+    publishHeartbeat();
+  }
+
+  servicePublishQueue(connected);
+#if TRACE_TAPS
+  flushTapTrace(connected);
+#endif
+
+  telemetry_network_loop((uint32_t)(esp_timer_get_time() - loop_started_us));
+}
+
+void onConnectionEstablished()
+{
+  // One subscription for every command topic. The wildcard also matches the topics the
+  // reader publishes to, handleMessage drops those on the topic alone.
+  client.subscribe(mqttTopics.allCommands(), MessageReceivedCallbackWithTopic(handleMessage), qos);
+
+  // Also keep backward compatibility with display commands for now
+  client.subscribe("device/" + deviceTopicId + "/receive/display", [](const String &payload)
+                   {
+        Serial.println("Remote Display Command");
+        handleDisplay(payload); }, qos);
+
+  // Send status_change event (ONLINE)
+  StatusChangePayload statusPayload;
+  statusPayload.status = DeviceStatus::ONLINE;
+  strlcpy(statusPayload.firmware_version, FIRMWARE_VERSION, sizeof(statusPayload.firmware_version));
+  strlcpy(statusPayload.ip_address, WiFi.localIP().toString().c_str(), sizeof(statusPayload.ip_address));
+
+  char requestId[MAX_UUID_LENGTH + 1];
+  generateUUID(requestId, sizeof(requestId));
+
+  mqttBuilder.setEventTime(0);
+  const char* statusMessage = mqttBuilder.buildStatusChange(requestId, statusPayload);
+  if (statusMessage != nullptr)
+  {
+    publishPayload(mqttTopics.status(), statusMessage, mqttBuilder.length(), true); // retained
+  }
+
+  Serial.println("MQTT Connected - Published status change (ONLINE)");
+}
+
+// Route a message of the wildcard subscription by its topic
+void handleMessage(const String &topic, const String &payload)
+{
+  CommandType type = commandForTopic(mqttTopics.route(topic.c_str(), topic.length()));
+  if (type != CommandType::UNKNOWN)
+  {
+    handleCommand(type, payload);
+  }
+}
+
+// Parse the command on the network core and hand the typed result to the NFC task
+void handleCommand(CommandType type, const String &payload)
+{
+  // Parse the incoming MQTT message (one copy into the parser's buffer, parsed there in place)
+  if (!mqttParser.parse(reinterpret_cast<const uint8_t *>(payload.c_str()), payload.length())) {
+    Serial.println("Failed to parse MQTT command message");
+    return;
+  }
+
+  ReaderCommand &command = incoming_command;
+  command.type = type; // From the topic, the event_type of the envelope is not looked at
+  command.flags = 0;
+  strlcpy(command.request_id, mqttParser.getRequestId(), sizeof(command.request_id));
+
+  Serial.print("Parsed command type: ");
+  Serial.println(commandTypeToString(command.type));
+
+  bool valid = true;
+  switch (command.type) {
+    case CommandType::AUTH_START:
+      valid = mqttParser.parseAuthStart(command.payload.auth_start);
+      break;
+    case CommandType::AUTH_PREARM:
+      valid = mqttParser.parseAuthPrearm(command.payload.auth_start);
+      break;
+    case CommandType::REGISTER_START:
+      valid = mqttParser.parseRegisterStart(command.payload.register_start);
+      break;
+    case CommandType::AUTH_VERIFY:
+      valid = mqttParser.parseAuthVerify(command.payload.auth_verify);
+      break;
+    case CommandType::READ_START:
+      valid = mqttParser.parseReadStart(command.payload.read_start);
+      break;
+    case CommandType::AUTH_CACHE_SYNC:
+      valid = mqttParser.parseAuthCacheSync(command.payload.auth_cache_sync);
+      break;
+    case CommandType::AUTH_CANCEL:
+    case CommandType::REGISTER_CANCEL:
+    case CommandType::READ_CANCEL:
+    case CommandType::RESET:
+      break;
+    default:
+      Serial.println("Unknown or unhandled command type");
+      return;
+  }
+
+  if (!valid) {
+    Serial.print("Failed to parse payload for ");
+    Serial.println(commandTypeToString(command.type));
+    return;
+  }
+
+  bool control = isControlCommand(command.type);
+  CommandLaneStats &stats = control ? command_stats.control : command_stats.commands;
+  bool queued = control ? reader_control.push(command) : reader_commands.push(command);
+  if (!queued) {
+    Serial.println("Command queue full - rejecting command");
+    stats.rejected++;
+    rejectBusy(command);
+    return;
+  }
+  countAccepted(stats, control ? reader_control.size() : reader_commands.size());
+}
+
+void handleDisplay(const String &payload)
+{
+  // Legacy display handler - kept for backward compatibility
+  // In the new protocol, display updates are handled internally based on device state
+  Serial.println("Display command received (legacy):");
+  Serial.println(payload);
+
+  // For now, just log it - can be extended if needed for debugging
+}
@@ -0,0 +1,183 @@
+#include <string.h>
+
+#include "publish_queue.h"
+
+static PublishMessage slots[PUBLISH_QUEUE_SLOTS];
+static uint32_t next_seq = 0;
+static size_t depth = 0;
+static PublishQueueStats stats;
+
+static bool isState(const PublishMessage &message)
+{
+  return (message.flags & PUBLISH_RETAINED) != 0;
+}
+
+// Oldest message of a class
+static PublishMessage *oldestOf(bool state)
+{
+  PublishMessage *oldest = nullptr;
+  for (size_t i = 0; i < PUBLISH_QUEUE_SLOTS; i++)
+  {
+    PublishMessage &slot = slots[i];
+    if (slot.used && isState(slot) == state && (oldest == nullptr || (int32_t)(slot.seq - oldest->seq) < 0))
+    {
+      oldest = &slot;
+    }
+  }
+  return oldest;
+}
+
+static void release(PublishMessage *message)
+{
+  message->used = false;
+  depth--;
+  stats.depth = (uint8_t)depth;
+}
+
+bool publish_queue_push(uint8_t type, uint8_t flags, const char *data, size_t length, uint32_t now,
+                        uint32_t delay)
+{
+  if (length > PUBLISH_QUEUE_MAX_MESSAGE)
+  {
+    return false;
+  }
+
+  PublishMessage *slot = nullptr;
+  if (flags & PUBLISH_RETAINED)
+  {
+    // A newer state supersedes the queued one, in its place in the queue
+    for (size_t i = 0; i < PUBLISH_QUEUE_SLOTS; i++)
+    {
+      if (slots[i].used && slots[i].type == type && isState(slots[i]))
+      {
+        slot = &slots[i];
+        stats.coalesced++;
+        break;
+      }
+    }
+  }
+
+  if (slot == nullptr)
+  {
+    for (size_t i = 0; i < PUBLISH_QUEUE_SLOTS && slot == nullptr; i++)
+    {
+      if (!slots[i].used)
+      {
+        slot = &slots[i];
+      }
+    }
+    if (slot == nullptr)
+    {
+      return false;
+    }
+
+    slot->used = true;
+    slot->seq = next_seq++;
+    slot->queued_ms = now;
+    slot->retry_ms = now + delay;
+    depth++;
+    stats.depth = (uint8_t)depth;
+    if (stats.depth > stats.max_depth)
+    {
+      stats.max_depth = stats.depth;
+    }
+  }
+
+  slot->type = type;
+  slot->flags = flags;
+  slot->attempts = 0;
+  slot->length = (uint16_t)length;
+  memcpy(slot->data, data, length);
+  slot->data[length] = '\0';
+  stats.queued++;
+  return true;
+}
+
+PublishMessage *publish_queue_next(uint32_t now, bool withState)
+{
+  PublishMessage *state = withState ? oldestOf(true) : nullptr;
+  if (state != nullptr && (int32_t)(now - state->retry_ms) >= 0)
+  {
+    return state;
+  }
+  PublishMessage *event = oldestOf(false);
+  if (event != nullptr && (int32_t)(now - event->retry_ms) >= 0)
+  {
+    return event;
+  }
+  return nullptr;
+}
+
+PublishMessage *publish_queue_oldest()
+{
+  PublishMessage *state = oldestOf(true);
+  PublishMessage *event = oldestOf(false);
+  if (state == nullptr)
+  {
+    return event;
+  }
+  if (event == nullptr)
+  {
+    return state;
+  }
+  return (int32_t)(state->seq - event->seq) < 0 ? state : event;
+}
+
+void publish_queue_published(PublishMessage *message, uint32_t now)
+{
+  stats.published++;
+  stats.latency.record(now - message->queued_ms);
+  release(message);
+}
+
+bool publish_queue_failed(PublishMessage *message, uint32_t now)
+{
+  message->attempts++;
+  if (message->attempts >= PUBLISH_QUEUE_MAX_ATTEMPTS)
+  {
+    return false;
+  }
+  stats.retries++;
+  message->retry_ms = now + (PUBLISH_QUEUE_RETRY_MS << (message->attempts - 1));
+  return true;
+}
+
+void publish_queue_spill(PublishMessage *message)
+{
+  stats.spilled++;
+  release(message);
+}
+
+void publish_queue_drop(PublishMessage *message)
+{
+  stats.dropped++;
+  release(message);
+}
+
+size_t publish_queue_depth()
+{
+  return depth;
+}
+
+const PublishQueueStats &publish_queue_stats()
+{
+  return stats;
+}
+
+void publish_queue_clear()
+{
+  for (size_t i = 0; i < PUBLISH_QUEUE_SLOTS; i++)
+  {
+    slots[i].used = false;
+  }
+  depth = 0;
+  stats.queued = 0;
+  stats.published = 0;
+  stats.coalesced = 0;
+  stats.retries = 0;
+  stats.spilled = 0;
+  stats.dropped = 0;
+  stats.depth = 0;
+  stats.max_depth = 0;
+  stats.latency.reset();
+}
@@ -0,0 +1,1411 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <Crypto.h>
+#include <AES.h>
+#include <string.h>
+
+#include "Utils.h"
+
+#include "reader.h"
+#include "reader_fsm.h"
+#include "reader_sessions.h"
+#include "network.h"
+#include "display.h"
+#include "feedback.h"
+#include "card.h"
+#include "auth_cache.h"
+#include "card_presence.h"
+#include "deadline_heap.h"
+#include "config.h"
+#include "mqtt_serialization.h"
+#include "telemetry.h"
+#include "tap_trace.h"
+#include "time_service.h"
+
+ReaderControlQueue reader_control;
+ReaderCommandQueue reader_commands;
+ReaderEventQueue reader_events;
+
+AES128 aes128;
+
+// Scratch event, only touched by the NFC task
+static ReaderEvent outgoing_event;
+static ReaderCommand discarded_command;
+
+// Context of the input that is currently dispatched
+static const ReaderCommand *active_command = nullptr;
+static ReaderInput active_input;
+static unsigned char card_id[8];
+static char card_uid_hex[MAX_TAG_UID_LENGTH + 1];
+static AuthCacheEntry cached_auth;
+
+// Session that owns the reader, nullptr while idle. Further sessions wait in the session table.
+static ReaderSession *active_session = nullptr;
+
+static ReaderState current_state = ReaderState::IDLE;
+static uint64_t state_entered_us = 0;
+static uint32_t card_retry_at_ms = 0;
+static int64_t verify_requested_us = 0; // auth_tag_detected posted, the backend round trip starts
+
+// Timeouts of the pending sessions, keyed by their request_id
+static DeadlineHeap<READER_DEADLINE_CAPACITY> deadlines;
+
+// Utility functions for hex/binary conversion
+void hexStringToBinary(const char* hexStr, unsigned char* binary, size_t binaryLen) {
+  for (size_t i = 0; i < binaryLen; i++) {
+    sscanf(&hexStr[i * 2], "%2hhx", &binary[i]);
+  }
+}
+
+// Closing a session also drops its pending deadlines
+static void closeSession(ReaderSession *session)
+{
+  if (session == nullptr)
+  {
+    return;
+  }
+  deadlines.cancel(session->request_id);
+  if (session == active_session)
+  {
+    active_session = nullptr;
+  }
+  reader_session_close(session);
+}
+
+static void armDeadline(const char *requestId, DeadlineKind kind, uint32_t seconds)
+{
+  if (!deadlines.arm(requestId, kind, millis() + seconds * 1000UL))
+  {
+    Serial.println("Deadline table full - timeout not armed");
+  }
+}
+
+// Binary UID -> colon-separated hex string
+static void formatTagUid(const unsigned char uid[8], char *tagUidHex, size_t size)
+{
+  snprintf(tagUidHex, size, "%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X",
+           uid[0], uid[1], uid[2], uid[3], uid[4], uid[5], uid[6], uid[7]);
+}
+
+// A card that just failed is most likely still in the field; give the user the
+// duration of the fail screen to reposition it instead of failing it again right away.
+static void holdCardRetry()
+{
+  card_retry_at_ms = millis() + FEEDBACK_DURATION_MS;
+}
+
+// Hand an event to the network task. Never blocks: a stalled network must not delay a tap.
+template <typename Payload>
+static void post_event(EventType type, const char *requestId, const Payload &payload, uint8_t flags = 0)
+{
+  static_assert(sizeof(Payload) <= sizeof(outgoing_event.payload), "payload does not fit into ReaderEvent");
+
+  bool synced;
+  outgoing_event.type = type;
+  outgoing_event.occurred_ms = time_service_now_ms(&synced);
+  outgoing_event.flags = synced ? flags : flags | READER_EVENT_TIME_UNSYNCED;
+  strlcpy(outgoing_event.request_id, requestId, sizeof(outgoing_event.request_id));
+  memcpy(&outgoing_event.payload, &payload, sizeof(Payload));
+
+  if (!reader_events.push(outgoing_event))
+  {
+    Serial.print("Event queue full - dropping ");
+    Serial.println(eventTypeToString(type));
+  }
+}
+
+static void postModeChange(const char *requestId, DeviceMode mode, DeviceMode previousMode)
+{
+  ModeChangePayload modePayload;
+  modePayload.mode = mode;
+  modePayload.previous_mode = previousMode;
+  post_event(EventType::MODE_CHANGE, requestId, modePayload);
+}
+
+// ===== Per-mode data shared by the transitions of that mode =====
+
+struct ModeInfo
+{
+  DeviceMode mode;
+  EventType error_event;
+  const char *card_error_text; // Reported for ReaderInput::CARD_ERROR
+  ErrorCode card_error_code;
+  ReaderInput start_input;
+};
+
+static const ModeInfo MODE_INFO_IDLE = {DeviceMode::IDLE, EventType::UNKNOWN, "", ErrorCode::UNKNOWN, ReaderInput::COUNT};
+static const ModeInfo MODE_INFO_AUTH = {DeviceMode::AUTH, EventType::AUTH_ERROR, "Authentication error", ErrorCode::NFC_AUTH_FAILED, ReaderInput::AUTH_START};
+static const ModeInfo MODE_INFO_READ = {DeviceMode::READ, EventType::READ_ERROR, "NFC read error", ErrorCode::NFC_READ_ERROR, ReaderInput::READ_START};
+static const ModeInfo MODE_INFO_REGISTER = {DeviceMode::REGISTER, EventType::REGISTER_ERROR, "NFC read error", ErrorCode::NFC_READ_ERROR, ReaderInput::REGISTER_START};
+
+static const ModeInfo &modeInfo(DeviceMode mode)
+{
+  switch (mode)
+  {
+  case DeviceMode::AUTH:
+    return MODE_INFO_AUTH;
+  case DeviceMode::READ:
+    return MODE_INFO_READ;
+  case DeviceMode::REGISTER:
+    return MODE_INFO_REGISTER;
+  default:
+    return MODE_INFO_IDLE;
+  }
+}
+
+static const ModeInfo &activeModeInfo()
+{
+  return modeInfo(active_session != nullptr ? active_session->mode : DeviceMode::IDLE);
+}
+
+// Mode the reader reports while in state
+static DeviceMode stateMode(ReaderState state)
+{
+  switch (state)
+  {
+  case ReaderState::AUTH_WAIT_CARD:
+  case ReaderState::AUTH_WAIT_VERIFY:
+    return DeviceMode::AUTH;
+  case ReaderState::READ_WAIT_CARD:
+    return DeviceMode::READ;
+  case ReaderState::REGISTER_WAIT_CARD:
+    return DeviceMode::REGISTER;
+  default:
+    return DeviceMode::IDLE;
+  }
+}
+
+// Error event of the session's mode
+static void postSessionError(const ReaderSession &session, const char *text, ErrorCode code, ErrorComponent component)
+{
+  ErrorPayload errorPayload;
+  errorPayload.clear();
+  strlcpy(errorPayload.error, text, sizeof(errorPayload.error));
+  errorPayload.error_code = code;
+  errorPayload.retry_possible = true;
+  errorPayload.component = component;
+  post_event(modeInfo(session.mode).error_event, session.request_id, errorPayload);
+}
+
+// Count a tap of the running session, true if the session is over
+static bool countSessionTap()
+{
+  AuthSession &auth = active_session->auth;
+  if (auth.session_taps_left > 0 && --auth.session_taps_left == 0)
+  {
+    return true;
+  }
+  return auth.session_timed && (int32_t)(millis() - auth.session_end_ms) >= 0;
+}
+
+// Forget the per-tap data but keep the session armed
+static void rearmAuth(AuthSession &auth)
+{
+  memset(auth.tag_uid_binary, 0, sizeof(auth.tag_uid_binary));
+  memset(auth.key, 0, sizeof(auth.key));
+  memset(auth.key_binary, 0, sizeof(auth.key_binary));
+  memset(auth.encryption_data, 0, sizeof(auth.encryption_data));
+  strlcpy(auth.username, auth.armed_username, sizeof(auth.username));
+  strlcpy(auth.context, auth.armed_context, sizeof(auth.context));
+}
+
+static void endAuth()
+{
+  // Send mode change back to idle
+  postModeChange(active_session->request_id, DeviceMode::IDLE, DeviceMode::AUTH);
+  closeSession(active_session);
+}
+
+// ===== Session setup from the start commands =====
+// Runs when the command arrives, also for sessions that queue behind the running one;
+// the operation deadline covers the time spent waiting in the queue.
+
+static void prepareAuth(ReaderSession &session, const ReaderCommand &command)
+{
+  const AuthStartPayload &authPayload = command.payload.auth_start;
+  AuthSession &auth = session.auth;
+  auth.timeout_seconds = (uint16_t)authPayload.timeout_seconds;
+
+  // Optional key material: the card is authenticated right on detection
+  auth.prearmed = command.type == CommandType::AUTH_PREARM;
+  auth.key_count = authPayload.key_count;
+  for (uint8_t i = 0; i < authPayload.key_count; i++)
+  {
+    const AuthKeyCandidate &candidate = authPayload.keys[i];
+    auth.candidate_bound[i] = candidate.tag_uid[0] != '\0' &&
+                              tagUidToBinary(candidate.tag_uid, auth.candidate_uid[i], 8);
+    hexStringToBinary(candidate.key, auth.candidate_key[i], 16);
+  }
+  strlcpy(auth.armed_username, authPayload.user_data.username, sizeof(auth.armed_username));
+  strlcpy(auth.armed_context, authPayload.user_data.context, sizeof(auth.armed_context));
+  rearmAuth(auth);
+
+  // Continuous session: one result per tap without re-arming
+  auth.session = authPayload.session_duration_seconds > 0 || authPayload.session_max_taps > 0;
+  auth.session_timed = authPayload.session_duration_seconds > 0;
+  auth.session_duration_seconds = (uint32_t)authPayload.session_duration_seconds;
+  auth.session_taps_left = (uint16_t)authPayload.session_max_taps;
+
+  armDeadline(session.request_id, DeadlineKind::OPERATION, auth.timeout_seconds);
+}
+
+static void prepareRegister(ReaderSession &session, const ReaderCommand &command)
+{
+  const RegisterStartPayload &registerPayload = command.payload.register_start;
+  RegisterSession &reg = session.reg;
+  strlcpy(reg.tag_uid, registerPayload.tag_uid, sizeof(reg.tag_uid));
+  strlcpy(reg.key, registerPayload.key, sizeof(reg.key));
+
+  // Convert hex key to binary
+  hexStringToBinary(registerPayload.key, reg.key_binary, 16);
+
+  armDeadline(session.request_id, DeadlineKind::OPERATION, registerPayload.timeout_seconds);
+}
+
+static void prepareRead(ReaderSession &session, const ReaderCommand &command)
+{
+  armDeadline(session.request_id, DeadlineKind::OPERATION, command.payload.read_start.timeout_seconds);
+}
+
+// ===== Actions =====
+// An action returns true if the transition's next state applies, false for next_on_failure.
+// The start actions run when a session takes over the reader (active_session is already set).
+
+static bool startAuth()
+{
+  AuthSession &auth = active_session->auth;
+  Serial.println("Enable Authenticate Mode");
+  Serial.print("Timeout: ");
+  Serial.println(auth.timeout_seconds);
+
+  // A timed session ends with its duration; otherwise timeout_seconds limits the wait
+  // for the (next) tap
+  if (auth.session_timed)
+  {
+    auth.session_end_ms = millis() + auth.session_duration_seconds * 1000UL;
+    deadlines.cancel(active_session->request_id, DeadlineKind::OPERATION);
+    armDeadline(active_session->request_id, DeadlineKind::SESSION, auth.session_duration_seconds);
+  }
+  if (auth.session)
+  {
+    Serial.print("Session: ");
+    Serial.print(auth.session_duration_seconds);
+    Serial.print(" s, ");
+    Serial.print(auth.session_taps_left);
+    Serial.println(" taps (0 = no limit)");
+  }
+
+  if (auth.key_count > 0)
+  {
+    Serial.print(auth.prearmed ? "Pre-armed, candidate keys: " : "Candidate keys: ");
+    Serial.println(auth.key_count);
+  }
+
+  feedback_show(display_authenticate_mode, FEEDBACK_DURATION_MS);
+  postModeChange(active_session->request_id, DeviceMode::AUTH, stateMode(current_state));
+  card_presence_rearm(); // A tag already lying on the reader counts for the new operation
+  return true;
+}
+
+static bool startRegister()
+{
+  const RegisterSession &reg = active_session->reg;
+  Serial.println("Enable Register Mode");
+  Serial.print("Tag UID: ");
+  Serial.println(reg.tag_uid);
+  Serial.print("Key: ");
+  Serial.println(reg.key);
+
+  feedback_show(display_register_mode, FEEDBACK_DURATION_MS);
+  postModeChange(active_session->request_id, DeviceMode::REGISTER, stateMode(current_state));
+  card_presence_rearm(); // A tag already lying on the reader counts for the new operation
+  return true;
+}
+
+static bool startRead()
+{
+  Serial.println("Enable Read Mode");
+
+  postModeChange(active_session->request_id, DeviceMode::READ, stateMode(current_state));
+  card_presence_rearm(); // A tag already lying on the reader counts for the new operation
+  return true;
+}
+
+static bool cancelMode()
+{
+  Serial.println("Cancel Mode");
+
+  // Echo the request_id of the operation that is cancelled, if there is one
+  const char *cancelRequestId = active_session != nullptr ? active_session->request_id : active_command->request_id;
+  postModeChange(cancelRequestId, DeviceMode::IDLE, stateMode(current_state));
+
+  closeSession(active_session);
+  return true;
+}
+
+static bool resetDevice()
+{
+  Serial.println("Resetting device");
+
+  // Send mode change to IDLE (mode is retained, so we must always update it before reset)
+  // IDLE means we're in an unknown/idle state
+  DeviceMode previousMode = current_state == ReaderState::IDLE ? DeviceMode::UNKNOWN : stateMode(current_state);
+  postModeChange(active_command->request_id, DeviceMode::IDLE, previousMode);
+
+  // Drop every session, queued ones included (will be in IDLE after reboot)
+  deadlines.clear();
+  reader_session_clear();
+  active_session = nullptr;
+
+  // Send status change (OFFLINE); the network task restarts the device once it is published.
+  // Firmware version and IP address are filled in by the network task.
+  StatusChangePayload statusPayload;
+  statusPayload.clear();
+  statusPayload.status = DeviceStatus::OFFLINE;
+  post_event(EventType::STATUS_CHANGE, active_command->request_id, statusPayload, READER_EVENT_RESTART_AFTER);
+  return true;
+}
+
+static bool authCardDetected()
+{
+  AuthSession &auth = active_session->auth;
+
+  // Store binary UID in auth state
+  memcpy(auth.tag_uid_binary, card_id, 8);
+
+  // Within a session the backend gets timeout_seconds per tap to answer with AUTH_VERIFY,
+  // a single auth stays bounded by its operation deadline
+  if (auth.session)
+  {
+    deadlines.cancel(active_session->request_id, DeadlineKind::OPERATION);
+    armDeadline(active_session->request_id, DeadlineKind::VERIFY, auth.timeout_seconds);
+  }
+
+  // Build and publish TAG_DETECTED event
+  TagDetectedPayload tagPayload;
+  strlcpy(tagPayload.tag_uid, card_uid_hex, sizeof(tagPayload.tag_uid));
+  strlcpy(tagPayload.message, "Tag detected. Awaiting verification.", sizeof(tagPayload.message));
+  post_event(EventType::AUTH_TAG_DETECTED, active_session->request_id, tagPayload);
+  verify_requested_us = esp_timer_get_time();
+
+  printUnsignedCharArrayAsHex(card_id, 8);
+  return true;
+}
+
+// Telemetry of a decided tap: a card authentication that failed counts against its tier if the
+// PN532 caused it. Must run before postAuthResult, which clears last_card.
+static void recordDecision(DecisionTier tier, bool cardFailed)
+{
+  bool pn532Error = cardFailed && last_card.b_PN532_Error;
+  telemetry_tap_decided(tier, pn532Error, pn532Error && IsDesfireTimeout());
+}
+
+// End of a tap, once its result is shown: its trace goes out on the debug topic if enabled
+static void postTapTrace(const char *requestId)
+{
+  TapTracePayload trace;
+  if (tap_trace_close(trace) && TRACE_TAPS)
+  {
+    post_event(EventType::TAP_TRACE, requestId, trace);
+  }
+}
+
+// Publish auth_success (echoing user_data) or auth_failed and show the result
+static void postAuthResult(const char *requestId, bool authenticated, const char *tagUid, const char *text,
+                           const char *username, const char *context)
+{
+  if (authenticated)
+  {
+    AuthSuccessPayload authPayload;
+    authPayload.clear();
+    strlcpy(authPayload.tag_uid, tagUid, sizeof(authPayload.tag_uid));
+    authPayload.authenticated = true;
+    strlcpy(authPayload.message, text, sizeof(authPayload.message));
+    strlcpy(authPayload.user_data.username, username, sizeof(authPayload.user_data.username));
+    strlcpy(authPayload.user_data.context, context, sizeof(authPayload.user_data.context));
+    post_event(EventType::AUTH_SUCCESS, requestId, authPayload);
+
+    feedback_success();
+  }
+  else
+  {
+    AuthFailedPayload failedPayload;
+    strlcpy(failedPayload.tag_uid, tagUid, sizeof(failedPayload.tag_uid));
+    failedPayload.authenticated = false;
+    strlcpy(failedPayload.reason, text, sizeof(failedPayload.reason));
+    post_event(EventType::AUTH_FAILED, requestId, failedPayload);
+
+    feedback_fail();
+  }
+
+  postTapTrace(requestId);
+  clear_kCard(&last_card);
+}
+
+// Publish the result of the session's auth.
+// Returns true if the auth is over (-> idle), false if a session stays armed for the next tap.
+static bool finishAuth(bool authenticated, const char *tagUid, const char *text)
+{
+  AuthSession &auth = active_session->auth;
+
+  postAuthResult(active_session->request_id, authenticated, tagUid, text, auth.username, auth.context);
+
+  if (auth.session && !countSessionTap())
+  {
+    rearmAuth(auth);
+    if (!auth.session_timed)
+    {
+      armDeadline(active_session->request_id, DeadlineKind::OPERATION, auth.timeout_seconds);
+    }
+    return false;
+  }
+
+  endAuth();
+  return true;
+}
+
+// Session duration elapsed while waiting for a card
+static bool endSession()
+{
+  Serial.println("Auth session ended");
+  endAuth();
+  return true;
+}
+
+// Keys of the running auth_start/auth_prearm that apply to uid: the ones bound to this tag and the unbound ones
+static uint8_t candidateKeysFor(const unsigned char uid[8], unsigned char keys[][16])
+{
+  const AuthSession &auth = active_session->auth;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < auth.key_count; i++)
+  {
+    if (auth.candidate_bound[i] && memcmp(auth.candidate_uid[i], uid, 8) != 0)
+    {
+      continue;
+    }
+    if (keys != nullptr)
+    {
+      memcpy(keys[count], auth.candidate_key[i], 16);
+    }
+    count++;
+  }
+  return count;
+}
+
+// Authenticate a tap with the key material of auth_start/auth_prearm, no backend round trip
+static bool authKeyed()
+{
+  unsigned char keys[AUTH_START_MAX_KEYS][16];
+  uint8_t count = candidateKeysFor(card_id, keys);
+
+  Serial.print("Authenticating with candidate keys: ");
+  Serial.println(count);
+
+  if (count == 0) // Only possible for auth_prearm
+  {
+    recordDecision(DecisionTier::KEYED, false);
+    return finishAuth(false, card_uid_hex, "Tag not expected");
+  }
+
+  bool authenticated = authenticate_user_keys(card_id, card_uid_hex, &last_card, keys, count) >= 0;
+  recordDecision(DecisionTier::KEYED, !authenticated);
+  return finishAuth(authenticated, card_uid_hex, authenticated ? "Authentication successful" : "Invalid credentials or key mismatch");
+}
+
+// Authenticate a tap against the offline auth cache, no backend round trip
+static bool authCached()
+{
+  Serial.print("Card found in auth cache: ");
+  Serial.println(card_uid_hex);
+
+  strlcpy(active_session->auth.username, cached_auth.username, sizeof(active_session->auth.username));
+
+  bool done;
+  if ((cached_auth.permissions & AUTH_PERMISSION_ACCESS) == 0)
+  {
+    recordDecision(DecisionTier::CACHED, false);
+    done = finishAuth(false, card_uid_hex, "Access not permitted");
+  }
+  else
+  {
+    bool authenticated = authenticate_user_keys(card_id, card_uid_hex, &last_card, &cached_auth.key, 1) >= 0;
+    recordDecision(DecisionTier::CACHED, !authenticated);
+    done = finishAuth(authenticated, card_uid_hex, authenticated ? "Authentication successful (offline cache)" : "Invalid credentials or key mismatch");
+  }
+
+  memset(&cached_auth, 0, sizeof(cached_auth));
+  return done;
+}
+
+// Unknown tag while the backend is unreachable: fail right away instead of waiting for AUTH_VERIFY
+static bool authOffline()
+{
+  recordDecision(DecisionTier::OFFLINE, false);
+  return finishAuth(false, card_uid_hex, "Backend unreachable - tag not in auth cache");
+}
+
+// Tap while offline and idle: decide with the offline auth cache alone.
+// Results get a request_id of their own and are delivered once the backend is reachable again.
+static bool offlineAuth()
+{
+  char requestId[MAX_UUID_LENGTH + 1];
+  generateUUID(requestId, sizeof(requestId));
+
+  Serial.print("Offline tap: ");
+  Serial.println(card_uid_hex);
+
+  if (active_input != ReaderInput::CARD_CACHED)
+  {
+    recordDecision(DecisionTier::OFFLINE, false);
+    postAuthResult(requestId, false, card_uid_hex, "Tag not in offline auth cache", "", "");
+  }
+  else if ((cached_auth.permissions & AUTH_PERMISSION_ACCESS) == 0)
+  {
+    recordDecision(DecisionTier::CACHED, false);
+    postAuthResult(requestId, false, card_uid_hex, "Access not permitted", cached_auth.username, "");
+  }
+  else
+  {
+    bool authenticated = authenticate_user_keys(card_id, card_uid_hex, &last_card, &cached_auth.key, 1) >= 0;
+    recordDecision(DecisionTier::CACHED, !authenticated);
+    postAuthResult(requestId, authenticated, card_uid_hex,
+                   authenticated ? "Authentication successful (offline cache)" : "Invalid credentials or key mismatch",
+                   cached_auth.username, "");
+  }
+
+  memset(&cached_auth, 0, sizeof(cached_auth));
+  return true;
+}
+
+static bool networkLost()
+{
+  Serial.println("Backend unreachable - deciding taps with the offline auth cache");
+  return true;
+}
+
+static bool networkRestored()
+{
+  Serial.println("Backend reachable again");
+  return true;
+}
+
+// Authenticate the card detected before with the data of AUTH_VERIFY
+static bool authVerify()
+{
+  const AuthVerifyPayload &verifyPayload = active_command->payload.auth_verify;
+  AuthSession &auth = active_session->auth;
+  Serial.println("Received AUTH_VERIFY command");
+  tap_trace_end(TraceSpan::BACKEND, verify_requested_us);
+  deadlines.cancel(active_session->request_id, DeadlineKind::VERIFY);
+
+  // Store key and convert to binary
+  strlcpy(auth.key, verifyPayload.key, sizeof(auth.key));
+  hexStringToBinary(verifyPayload.key, auth.key_binary, 16);
+
+  // Store user_data to echo back in the response
+  strlcpy(auth.username, verifyPayload.user_data.username, sizeof(auth.username));
+  strlcpy(auth.context, verifyPayload.user_data.context, sizeof(auth.context));
+
+  // encryption_data should remain as-is (can be used for challenge-response if needed)
+  // For now, just clear it - the authenticate_user function may populate it
+  memset(auth.encryption_data, 0, sizeof(auth.encryption_data));
+
+  unsigned char key[enc_key_length] = {0};
+
+  // Convert tag UID to colon-separated hex string
+  char tagUidHex[MAX_TAG_UID_LENGTH + 1];
+  formatTagUid(auth.tag_uid_binary, tagUidHex, sizeof(tagUidHex));
+
+  // Pass the tag UID string as user_buffer (to match what was used during registration)
+  bool authenticated = authenticate_user(auth.tag_uid_binary, tagUidHex, &last_card, key);
+  recordDecision(DecisionTier::BACKEND, !authenticated);
+  if (authenticated)
+  {
+    aes128.setKey(key, enc_key_length);
+    unsigned char encr_data[16] = {0};
+    aes128.encryptBlock(encr_data, auth.encryption_data);
+  }
+
+  return finishAuth(authenticated, tagUidHex, authenticated ? "Authentication successful" : "Invalid credentials or key mismatch");
+}
+
+static bool verifyTimeout()
+{
+  Serial.println("Timeout while waiting for user buffer");
+  feedback_fail();
+  if (!active_session->auth.session_timed)
+  {
+    armDeadline(active_session->request_id, DeadlineKind::OPERATION, active_session->auth.timeout_seconds);
+  }
+  return true;
+}
+
+// timeout_seconds of the start command elapsed without a result
+static bool operationTimeout()
+{
+  Serial.print("Operation timed out: ");
+  Serial.println(active_session->request_id);
+
+  postSessionError(*active_session, "Operation timed out", ErrorCode::TIMEOUT_EXCEEDED, ErrorComponent::DEVICE);
+  postModeChange(active_session->request_id, DeviceMode::IDLE, active_session->mode);
+
+  feedback_fail();
+  closeSession(active_session);
+  clear_kCard(&last_card);
+  return true;
+}
+
+static bool readCard()
+{
+  Serial.print("Card detected for reading: ");
+  Serial.println(card_uid_hex);
+
+  ReadSuccessPayload readPayload;
+  strlcpy(readPayload.tag_uid, card_uid_hex, sizeof(readPayload.tag_uid));
+  strlcpy(readPayload.message, "Tag read successfully", sizeof(readPayload.message));
+  post_event(EventType::READ_SUCCESS, active_session->request_id, readPayload);
+
+  feedback_success();
+  postTapTrace(active_session->request_id);
+
+  // Reset to idle mode
+  postModeChange(active_session->request_id, DeviceMode::IDLE, DeviceMode::READ);
+
+  closeSession(active_session);
+  clear_kCard(&last_card);
+  return true;
+}
+
+static bool registerCard()
+{
+  RegisterSession &reg = active_session->reg;
+  Serial.print("Card detected for registration: ");
+  Serial.println(card_uid_hex);
+  Serial.print("Expected UID: ");
+  Serial.println(reg.tag_uid);
+
+  // Check if this is the correct card
+  if (strcmp(card_uid_hex, reg.tag_uid) != 0)
+  {
+    Serial.println("UID does not match - wrong card");
+    postSessionError(*active_session, "Wrong card - UID mismatch", ErrorCode::NFC_UNSUPPORTED_TAG, ErrorComponent::NFC);
+
+    feedback_fail();
+    return false;
+  }
+
+  Serial.println("UID matches - proceeding with registration");
+  memcpy(reg.tag_uid_binary, card_id, 8);
+
+  // Customize the card with the key (key_binary was already converted in REGISTER_START)
+  // Use the tag_uid as the user_buff parameter (for deriving application keys)
+  // Pass the already-read card data to avoid waiting for card again
+  if (!customize_card(reg.tag_uid, reg.key_binary, reg.tag_uid_binary, &last_card))
+  {
+    Serial.println("Card registration failed");
+    postSessionError(*active_session, "Failed to write to card", ErrorCode::NFC_WRITE_ERROR, ErrorComponent::NFC);
+
+    feedback_fail();
+    card_presence_rearm(); // Retry writing while the card stays on the reader
+    holdCardRetry();
+    return false;
+  }
+
+  Serial.println("Card registration successful");
+
+  RegisterSuccessPayload registerPayload;
+  strlcpy(registerPayload.tag_uid, reg.tag_uid, sizeof(registerPayload.tag_uid));
+  strlcpy(registerPayload.message, "Tag registered successfully", sizeof(registerPayload.message));
+  registerPayload.blocks_written = 1;
+  post_event(EventType::REGISTER_SUCCESS, active_session->request_id, registerPayload);
+
+  feedback_success();
+  postTapTrace(active_session->request_id);
+
+  // Reset to idle mode
+  postModeChange(active_session->request_id, DeviceMode::IDLE, DeviceMode::REGISTER);
+
+  closeSession(active_session);
+  clear_kCard(&last_card);
+  return true;
+}
+
+// Publish an NFC error for whichever mode is waiting for a card (offline taps only show it)
+static bool reportCardError()
+{
+  const ModeInfo &info = activeModeInfo();
+
+  switch (active_session == nullptr ? ReaderInput::COUNT : active_input)
+  {
+  case ReaderInput::COUNT:
+    break;
+  case ReaderInput::CARD_TIMEOUT:
+    postSessionError(*active_session, "NFC timeout", ErrorCode::NFC_TIMEOUT, ErrorComponent::NFC);
+    break;
+  case ReaderInput::CARD_PN532_ERROR:
+    postSessionError(*active_session, "PN532 communication error", ErrorCode::NFC_DEVICE_ERROR, ErrorComponent::NFC);
+    break;
+  default: // e.g. Error while authenticating with master key
+    postSessionError(*active_session, info.card_error_text, info.card_error_code, ErrorComponent::NFC);
+    break;
+  }
+
+  feedback_fail();
+  holdCardRetry();
+
+  if (active_input == ReaderInput::CARD_PN532_ERROR)
+  {
+    InitReader(true); // Another error from PN532 -> reset the chip
+  }
+
+  Utils::Print("> ");
+  return true;
+}
+
+// ===== Transition table =====
+
+typedef bool (*ReaderAction)();
+
+struct ReaderTransition
+{
+  ReaderState from;
+  ReaderInput input;
+  ReaderAction action;
+  ReaderState next;            // action returned true
+  ReaderState next_on_failure; // action returned false
+};
+
+static const ReaderTransition transitions[] = {
+    // Commands valid in every state. A start only reaches the table when its session takes over
+    // the reader: from idle, or when the running session is restarted with its own request_id.
+    {ReaderState::ANY, ReaderInput::AUTH_START, startAuth, ReaderState::AUTH_WAIT_CARD, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::ANY, ReaderInput::REGISTER_START, startRegister, ReaderState::REGISTER_WAIT_CARD, ReaderState::REGISTER_WAIT_CARD},
+    {ReaderState::ANY, ReaderInput::READ_START, startRead, ReaderState::READ_WAIT_CARD, ReaderState::READ_WAIT_CARD},
+    {ReaderState::ANY, ReaderInput::CANCEL, cancelMode, ReaderState::IDLE, ReaderState::IDLE},
+    {ReaderState::ANY, ReaderInput::RESET, resetDevice, ReaderState::IDLE, ReaderState::IDLE},
+
+    // Authenticate: tap -> auth_tag_detected -> AUTH_VERIFY from the backend -> result,
+    // or tap -> result if auth_start carried the key or the tag is in the offline auth cache
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::CARD_DETECTED, authCardDetected, ReaderState::AUTH_WAIT_VERIFY, ReaderState::AUTH_WAIT_CARD},
+    // Results go back to idle, or stay armed (action returns false) while a continuous session lasts
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::CARD_KEYED, authKeyed, ReaderState::IDLE, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::CARD_CACHED, authCached, ReaderState::IDLE, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::CARD_OFFLINE, authOffline, ReaderState::IDLE, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::CARD_TIMEOUT, reportCardError, ReaderState::AUTH_WAIT_CARD, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::CARD_PN532_ERROR, reportCardError, ReaderState::AUTH_WAIT_CARD, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::CARD_ERROR, reportCardError, ReaderState::AUTH_WAIT_CARD, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::SESSION_EXPIRED, endSession, ReaderState::IDLE, ReaderState::IDLE},
+    {ReaderState::AUTH_WAIT_CARD, ReaderInput::OPERATION_TIMEOUT, operationTimeout, ReaderState::IDLE, ReaderState::IDLE},
+    {ReaderState::AUTH_WAIT_VERIFY, ReaderInput::AUTH_VERIFY, authVerify, ReaderState::IDLE, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_VERIFY, ReaderInput::VERIFY_TIMEOUT, verifyTimeout, ReaderState::AUTH_WAIT_CARD, ReaderState::AUTH_WAIT_CARD},
+    {ReaderState::AUTH_WAIT_VERIFY, ReaderInput::SESSION_EXPIRED, endSession, ReaderState::IDLE, ReaderState::IDLE},
+    {ReaderState::AUTH_WAIT_VERIFY, ReaderInput::OPERATION_TIMEOUT, operationTimeout, ReaderState::IDLE, ReaderState::IDLE},
+
+    // Read: tap -> read_success
+    {ReaderState::READ_WAIT_CARD, ReaderInput::CARD_DETECTED, readCard, ReaderState::IDLE, ReaderState::READ_WAIT_CARD},
+    {ReaderState::READ_WAIT_CARD, ReaderInput::CARD_TIMEOUT, reportCardError, ReaderState::READ_WAIT_CARD, ReaderState::READ_WAIT_CARD},
+    {ReaderState::READ_WAIT_CARD, ReaderInput::CARD_PN532_ERROR, reportCardError, ReaderState::READ_WAIT_CARD, ReaderState::READ_WAIT_CARD},
+    {ReaderState::READ_WAIT_CARD, ReaderInput::CARD_ERROR, reportCardError, ReaderState::READ_WAIT_CARD, ReaderState::READ_WAIT_CARD},
+    {ReaderState::READ_WAIT_CARD, ReaderInput::OPERATION_TIMEOUT, operationTimeout, ReaderState::IDLE, ReaderState::IDLE},
+
+    // Register: tap of the expected card -> personalize -> register_success
+    {ReaderState::REGISTER_WAIT_CARD, ReaderInput::CARD_DETECTED, registerCard, ReaderState::IDLE, ReaderState::REGISTER_WAIT_CARD},
+    {ReaderState::REGISTER_WAIT_CARD, ReaderInput::CARD_TIMEOUT, reportCardError, ReaderState::REGISTER_WAIT_CARD, ReaderState::REGISTER_WAIT_CARD},
+    {ReaderState::REGISTER_WAIT_CARD, ReaderInput::CARD_PN532_ERROR, reportCardError, ReaderState::REGISTER_WAIT_CARD, ReaderState::REGISTER_WAIT_CARD},
+    {ReaderState::REGISTER_WAIT_CARD, ReaderInput::CARD_ERROR, reportCardError, ReaderState::REGISTER_WAIT_CARD, ReaderState::REGISTER_WAIT_CARD},
+    {ReaderState::REGISTER_WAIT_CARD, ReaderInput::OPERATION_TIMEOUT, operationTimeout, ReaderState::IDLE, ReaderState::IDLE},
+
+    // Offline: idle without a backend keeps deciding taps with the offline auth cache.
+    // Running sessions keep running offline; their events are delivered after the reconnect.
+    {ReaderState::IDLE, ReaderInput::NETWORK_LOST, networkLost, ReaderState::OFFLINE, ReaderState::OFFLINE},
+    {ReaderState::OFFLINE, ReaderInput::NETWORK_RESTORED, networkRestored, ReaderState::IDLE, ReaderState::IDLE},
+    {ReaderState::OFFLINE, ReaderInput::CARD_CACHED, offlineAuth, ReaderState::OFFLINE, ReaderState::OFFLINE},
+    {ReaderState::OFFLINE, ReaderInput::CARD_OFFLINE, offlineAuth, ReaderState::OFFLINE, ReaderState::OFFLINE},
+    {ReaderState::OFFLINE, ReaderInput::CARD_TIMEOUT, reportCardError, ReaderState::OFFLINE, ReaderState::OFFLINE},
+    {ReaderState::OFFLINE, ReaderInput::CARD_PN532_ERROR, reportCardError, ReaderState::OFFLINE, ReaderState::OFFLINE},
+    {ReaderState::OFFLINE, ReaderInput::CARD_ERROR, reportCardError, ReaderState::OFFLINE, ReaderState::OFFLINE},
+};
+
+#define TRANSITION_ROWS (sizeof(transitions) / sizeof(transitions[0]))
+#define STATE_COUNT ((size_t)ReaderState::COUNT)
+#define INPUT_COUNT ((size_t)ReaderInput::COUNT)
+
+// [state][input] -> row in transitions, -1 if the input is ignored in that state
+static int8_t transition_index[STATE_COUNT][INPUT_COUNT];
+
+static ReaderTransitionStats transition_stats[TRANSITION_ROWS];
+static ReaderTransitionRecord transition_log[READER_TRANSITION_LOG_LENGTH];
+static size_t transition_log_count = 0;
+
+static void buildTransitionIndex()
+{
+  memset(transition_index, -1, sizeof(transition_index));
+
+  // Specific rows first, wildcard rows fill the remaining cells
+  for (size_t row = 0; row < TRANSITION_ROWS; row++)
+  {
+    const ReaderTransition &t = transitions[row];
+    if (t.from != ReaderState::ANY)
+    {
+      transition_index[(size_t)t.from][(size_t)t.input] = (int8_t)row;
+    }
+  }
+  for (size_t row = 0; row < TRANSITION_ROWS; row++)
+  {
+    const ReaderTransition &t = transitions[row];
+    if (t.from != ReaderState::ANY)
+    {
+      continue;
+    }
+    for (size_t state = 0; state < STATE_COUNT; state++)
+    {
+      if (transition_index[state][(size_t)t.input] < 0)
+      {
+        transition_index[state][(size_t)t.input] = (int8_t)row;
+      }
+    }
+  }
+}
+
+static uint32_t clampMicros(uint64_t us)
+{
+  return us > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)us;
+}
+
+// Base screen of each state, restored by the feedback scheduler once transient feedback expires
+static FeedbackCallback stateScreen(ReaderState state)
+{
+  switch (state)
+  {
+  case ReaderState::IDLE:
+    return display_mode_standby;
+  case ReaderState::AUTH_WAIT_VERIFY:
+    return display_processing;
+  case ReaderState::OFFLINE:
+    return display_connectionloss;
+  default:
+    return display_place_card;
+  }
+}
+
+static void showStateScreen()
+{
+  feedback_set_base(stateScreen(current_state));
+}
+
+static void dispatch(ReaderInput input)
+{
+  int8_t row = transition_index[(size_t)current_state][(size_t)input];
+  if (row < 0)
+  {
+    Serial.print("Ignoring ");
+    Serial.print(readerInputToString(input));
+    Serial.print(" in state ");
+    Serial.println(readerStateToString(current_state));
+    return;
+  }
+
+  const ReaderTransition &t = transitions[row];
+
+  uint64_t started_us = esp_timer_get_time();
+  active_input = input;
+  bool ok = t.action();
+  uint64_t finished_us = esp_timer_get_time();
+
+  ReaderState from = current_state;
+  ReaderState next = ok ? t.next : t.next_on_failure;
+
+  ReaderTransitionStats &stats = transition_stats[row];
+  stats.count++;
+  stats.last_at_us = finished_us;
+  stats.dwell.record(clampMicros(started_us - state_entered_us));
+  stats.action.record(clampMicros(finished_us - started_us));
+
+  ReaderTransitionRecord &record = transition_log[transition_log_count % READER_TRANSITION_LOG_LENGTH];
+  record.at_us = finished_us;
+  record.row = (uint8_t)row;
+  record.from = from;
+  record.to = next;
+  transition_log_count++;
+
+  current_state = next;
+  state_entered_us = finished_us;
+  showStateScreen();
+}
+
+static void postTagRemoved(const CardPresence &removed)
+{
+  TagRemovedPayload removedPayload;
+  removedPayload.clear();
+  formatTagUid(removed.uid, removedPayload.tag_uid, sizeof(removedPayload.tag_uid));
+  removedPayload.present_ms = removed.last_seen_ms - removed.first_seen_ms;
+
+  // Correlate with the running operation if there is one
+  char requestId[MAX_UUID_LENGTH + 1];
+  if (active_session != nullptr)
+    strlcpy(requestId, active_session->request_id, sizeof(requestId));
+  else
+    generateUUID(requestId, sizeof(requestId));
+
+  post_event(EventType::TAG_REMOVED, requestId, removedPayload);
+}
+
+// Reads the card in the RF field and translates the outcome into a state machine input.
+// Returns false if there is no card in the field.
+static bool pollCard(ReaderInput *input)
+{
+  memset(card_id, 0, sizeof(card_id));
+  clear_kCard(&last_card);
+  telemetry_rf_poll();
+
+  tap_trace_poll();
+  bool read = ReadCard(card_id, &last_card);
+  tap_trace_polled();
+
+  if (read)
+  {
+    if (last_card.u8_UidLength == 0)
+    {
+      gu64_LastID = 0;
+      CardPresence removed;
+      if (card_presence_absent(&removed, millis()))
+      {
+        postTagRemoved(removed);
+      }
+      return false;
+    }
+
+    // Another tag in place of the present one, without an empty poll in between: the previous one is gone
+    CardPresence replaced;
+    if (card_presence_replaced(card_id, &replaced))
+    {
+      postTagRemoved(replaced);
+    }
+
+    // A tag that was already handled is ignored while it stays on the reader
+    if (!card_presence_seen(card_id, millis()))
+    {
+      return false;
+    }
+
+    formatTagUid(card_id, card_uid_hex, sizeof(card_uid_hex));
+    *input = ReaderInput::CARD_DETECTED;
+
+    // Key material from auth_start/auth_prearm or the offline auth cache skips the backend round trip
+    if (transition_index[(size_t)current_state][(size_t)ReaderInput::CARD_KEYED] >= 0 &&
+        (active_session->auth.prearmed || candidateKeysFor(card_id, nullptr) > 0))
+    {
+      *input = ReaderInput::CARD_KEYED;
+    }
+    else if (transition_index[(size_t)current_state][(size_t)ReaderInput::CARD_CACHED] >= 0 &&
+             auth_cache_find(card_id, &cached_auth))
+    {
+      *input = ReaderInput::CARD_CACHED;
+    }
+    else if (transition_index[(size_t)current_state][(size_t)ReaderInput::CARD_OFFLINE] >= 0 &&
+             !network_is_online())
+    {
+      *input = ReaderInput::CARD_OFFLINE;
+    }
+
+    // Polled only to notice the removal (or a tag the state has no use for): not a tap, and
+    // not handled, so it is taken up as soon as the state accepts it, e.g. back in AUTH_WAIT_CARD
+    if (transition_index[(size_t)current_state][(size_t)*input] < 0)
+    {
+      return false;
+    }
+    card_presence_mark_handled();
+    telemetry_tap_detected();
+    tap_trace_open();
+    return true;
+  }
+
+  if (IsDesfireTimeout())
+    *input = ReaderInput::CARD_TIMEOUT;
+  else if (last_card.b_PN532_Error)
+    *input = ReaderInput::CARD_PN532_ERROR;
+  else
+    *input = ReaderInput::CARD_ERROR;
+
+  if (*input != ReaderInput::CARD_ERROR)
+  {
+    telemetry_rf_error(*input == ReaderInput::CARD_TIMEOUT);
+  }
+  return true;
+}
+
+static void dispatchCommand(const ReaderCommand &command, ReaderInput input)
+{
+  active_command = &command;
+  dispatch(input);
+  active_command = nullptr;
+}
+
+// Hand the reader to a session: from idle, or restart the running session
+static void startSession(ReaderSession *session)
+{
+  active_session = session;
+  session->started = true;
+  dispatch(modeInfo(session->mode).start_input);
+}
+
+// A start command opens a session. It takes over the reader if the reader is idle,
+// otherwise it waits in the session table until the running session is done.
+static void openSession(const ReaderCommand &command, DeviceMode mode)
+{
+  bool restart = active_session != nullptr && strcmp(active_session->request_id, command.request_id) == 0;
+
+  ReaderSession *session = reader_session_open(command.request_id, mode);
+  if (session == nullptr)
+  {
+    Serial.println("Session table full - rejecting start");
+    ErrorPayload errorPayload;
+    errorPayload.clear();
+    strlcpy(errorPayload.error, "Too many pending operations", sizeof(errorPayload.error));
+    errorPayload.error_code = ErrorCode::NFC_DEVICE_BUSY;
+    errorPayload.retry_possible = true;
+    errorPayload.component = ErrorComponent::DEVICE;
+    post_event(modeInfo(mode).error_event, command.request_id, errorPayload);
+    return;
+  }
+
+  deadlines.cancel(session->request_id); // A repeated start re-arms its deadlines
+  switch (mode)
+  {
+  case DeviceMode::AUTH:
+    prepareAuth(*session, command);
+    break;
+  case DeviceMode::REGISTER:
+    prepareRegister(*session, command);
+    break;
+  default:
+    prepareRead(*session, command);
+    break;
+  }
+
+  if (restart || active_session == nullptr)
+  {
+    startSession(session);
+    return;
+  }
+
+  Serial.print("Queued behind ");
+  Serial.print(active_session->request_id);
+  Serial.print(", pending sessions: ");
+  Serial.println(reader_session_count() - 1);
+}
+
+// Cancels go to the session of their request_id. A cancel that names no known session
+// cancels the running one, like before sessions were tracked.
+static void cancelSession(const ReaderCommand &command)
+{
+  // Cancels overtake the starts, so the start may not have been handled yet
+  ReaderCommand *queued;
+  for (size_t i = 0; (queued = reader_commands.peek(i)) != nullptr; i++)
+  {
+    if (!(queued->flags & READER_COMMAND_CANCELLED) && strcmp(queued->request_id, command.request_id) == 0)
+    {
+      Serial.print("Cancelled start before it was handled: ");
+      Serial.println(queued->request_id);
+      queued->flags |= READER_COMMAND_CANCELLED;
+      return;
+    }
+  }
+
+  ReaderSession *session = reader_session_find(command.request_id);
+  if (session != nullptr && session != active_session)
+  {
+    // Never took over the reader, so there is no mode change to undo
+    Serial.print("Cancelled queued session ");
+    Serial.println(session->request_id);
+    closeSession(session);
+    return;
+  }
+  dispatchCommand(command, ReaderInput::CANCEL);
+}
+
+// AUTH_VERIFY goes to the auth session of its request_id that waits for it
+static void verifySession(const ReaderCommand &command)
+{
+  ReaderSession *session = reader_session_find(command.request_id);
+  if (session == nullptr)
+  {
+    session = active_session; // Backend that does not echo the request_id of auth_start
+  }
+  if (session == nullptr || session != active_session || current_state != ReaderState::AUTH_WAIT_VERIFY)
+  {
+    Serial.println("No session waiting for AUTH_VERIFY");
+    ErrorPayload errorPayload;
+    errorPayload.clear();
+    strlcpy(errorPayload.error, "No session waiting for verification", sizeof(errorPayload.error));
+    errorPayload.error_code = ErrorCode::SESSION_NOT_FOUND;
+    errorPayload.retry_possible = false;
+    errorPayload.component = ErrorComponent::DEVICE;
+    post_event(EventType::AUTH_ERROR, command.request_id, errorPayload);
+    return;
+  }
+  dispatchCommand(command, ReaderInput::AUTH_VERIFY);
+}
+
+static void handleCommand(const ReaderCommand &command)
+{
+  Serial.print("Handling command: ");
+  Serial.println(commandTypeToString(command.type));
+
+  if (command.flags & READER_COMMAND_CANCELLED)
+  {
+    return;
+  }
+
+  switch (command.type)
+  {
+  case CommandType::AUTH_START:
+  case CommandType::AUTH_PREARM:
+    openSession(command, DeviceMode::AUTH);
+    break;
+  case CommandType::REGISTER_START:
+    openSession(command, DeviceMode::REGISTER);
+    break;
+  case CommandType::READ_START:
+    openSession(command, DeviceMode::READ);
+    break;
+  case CommandType::AUTH_VERIFY:
+    verifySession(command);
+    break;
+  case CommandType::AUTH_CANCEL:
+  case CommandType::REGISTER_CANCEL:
+  case CommandType::READ_CANCEL:
+    cancelSession(command);
+    break;
+  case CommandType::RESET:
+    dispatchCommand(command, ReaderInput::RESET);
+    // The device restarts, starts still queued behind the reset are void
+    while (reader_commands.pop(discarded_command))
+    {
+      Serial.print("Discarding after reset: ");
+      Serial.println(commandTypeToString(discarded_command.type));
+    }
+    break;
+  case CommandType::AUTH_CACHE_SYNC:
+    // Not part of the state machine, the cache is only consulted on the next tap
+    auth_cache_apply(command.payload.auth_cache_sync);
+    break;
+  default:
+    Serial.println("Unknown or unhandled command type");
+    break;
+  }
+}
+
+// A queued session ran out of time before it got the reader
+static void expireQueuedSession(ReaderSession *session)
+{
+  Serial.print("Queued session timed out: ");
+  Serial.println(session->request_id);
+  postSessionError(*session, "Operation timed out while queued", ErrorCode::TIMEOUT_EXCEEDED, ErrorComponent::DEVICE);
+  closeSession(session);
+}
+
+void reader_begin()
+{
+  auth_cache_begin();
+  reader_session_clear();
+  card_presence_clear();
+  buildTransitionIndex();
+  current_state = ReaderState::IDLE;
+  state_entered_us = esp_timer_get_time();
+  showStateScreen();
+}
+
+void reader_loop()
+{
+  int64_t loop_started_us = esp_timer_get_time();
+
+  // Safe point: no card operation is in flight between two loop iterations.
+  // The control lane is checked again before every start.
+  ReaderCommand command;
+  while (reader_control.pop(command) || reader_commands.pop(command))
+  {
+    handleCommand(command);
+  }
+
+  feedback_loop();
+
+  // The reader keeps working without a backend; events wait in the network task until it is back
+  bool online = network_is_online();
+  if (!online && current_state == ReaderState::IDLE)
+  {
+    dispatch(ReaderInput::NETWORK_LOST);
+  }
+  else if (online && current_state == ReaderState::OFFLINE)
+  {
+    dispatch(ReaderInput::NETWORK_RESTORED);
+  }
+
+  // Only the earliest deadline is looked at, so this is cheap when nothing is due
+  Deadline expired;
+  while (deadlines.popExpired(millis(), expired))
+  {
+    ReaderSession *session = reader_session_find(expired.request_id);
+    if (session == nullptr)
+    {
+      continue; // Session already closed
+    }
+    if (session != active_session)
+    {
+      expireQueuedSession(session);
+      continue;
+    }
+    switch (expired.kind)
+    {
+    case DeadlineKind::OPERATION:
+      dispatch(ReaderInput::OPERATION_TIMEOUT);
+      break;
+    case DeadlineKind::VERIFY:
+      dispatch(ReaderInput::VERIFY_TIMEOUT);
+      break;
+    case DeadlineKind::SESSION:
+      dispatch(ReaderInput::SESSION_EXPIRED);
+      break;
+    }
+  }
+
+  // Next queued session takes over once the result of the previous one has been shown
+  if (active_session == nullptr && !feedback_active())
+  {
+    ReaderSession *next = reader_session_next_queued();
+    if (next != nullptr)
+    {
+      startSession(next);
+    }
+  }
+
+  // Only poll the RF field if the current state has something to do with a card,
+  // or to notice the removal of the tag that is still in the field
+  bool acceptsCard = transition_index[(size_t)current_state][(size_t)ReaderInput::CARD_DETECTED] >= 0 ||
+                     transition_index[(size_t)current_state][(size_t)ReaderInput::CARD_CACHED] >= 0;
+  if ((acceptsCard || card_presence_present()) && (int32_t)(millis() - card_retry_at_ms) >= 0)
+  {
+    ReaderInput input;
+    if (pollCard(&input) && acceptsCard)
+    {
+      dispatch(input);
+    }
+  }
+
+  telemetry_reader_loop((uint32_t)(esp_timer_get_time() - loop_started_us));
+}
+
+// ===== Introspection =====
+
+const char *readerStateToString(ReaderState state)
+{
+  switch (state)
+  {
+  case ReaderState::IDLE: return "idle";
+  case ReaderState::AUTH_WAIT_CARD: return "auth_wait_card";
+  case ReaderState::AUTH_WAIT_VERIFY: return "auth_wait_verify";
+  case ReaderState::READ_WAIT_CARD: return "read_wait_card";
+  case ReaderState::REGISTER_WAIT_CARD: return "register_wait_card";
+  case ReaderState::OFFLINE: return "offline";
+  case ReaderState::ANY: return "any";
+  default: return "unknown";
+  }
+}
+
+const char *readerInputToString(ReaderInput input)
+{
+  switch (input)
+  {
+  case ReaderInput::AUTH_START: return "auth_start";
+  case ReaderInput::REGISTER_START: return "register_start";
+  case ReaderInput::READ_START: return "read_start";
+  case ReaderInput::AUTH_VERIFY: return "auth_verify";
+  case ReaderInput::CANCEL: return "cancel";
+  case ReaderInput::RESET: return "reset";
+  case ReaderInput::CARD_DETECTED: return "card_detected";
+  case ReaderInput::CARD_KEYED: return "card_keyed";
+  case ReaderInput::CARD_CACHED: return "card_cached";
+  case ReaderInput::CARD_OFFLINE: return "card_offline";
+  case ReaderInput::CARD_TIMEOUT: return "card_timeout";
+  case ReaderInput::CARD_PN532_ERROR: return "card_pn532_error";
+  case ReaderInput::CARD_ERROR: return "card_error";
+  case ReaderInput::VERIFY_TIMEOUT: return "verify_timeout";
+  case ReaderInput::SESSION_EXPIRED: return "session_expired";
+  case ReaderInput::OPERATION_TIMEOUT: return "operation_timeout";
+  case ReaderInput::NETWORK_LOST: return "network_lost";
+  case ReaderInput::NETWORK_RESTORED: return "network_restored";
+  default: return "unknown";
+  }
+}
+
+ReaderState reader_state()
+{
+  return current_state;
+}
+
+size_t reader_transition_rows()
+{
+  return TRANSITION_ROWS;
+}
+
+bool reader_transition_row(size_t row, ReaderState *from, ReaderInput *input, ReaderState *next)
+{
+  if (row >= TRANSITION_ROWS)
+  {
+    return false;
+  }
+  *from = transitions[row].from;
+  *input = transitions[row].input;
+  *next = transitions[row].next;
+  return true;
+}
+
+const ReaderTransitionStats &reader_transition_stats(size_t row)
+{
+  return transition_stats[row < TRANSITION_ROWS ? row : 0];
+}
+
+size_t reader_recent_transitions(ReaderTransitionRecord *records, size_t maxRecords)
+{
+  size_t available = transition_log_count < READER_TRANSITION_LOG_LENGTH ? transition_log_count : READER_TRANSITION_LOG_LENGTH;
+  size_t n = available < maxRecords ? available : maxRecords;
+  for (size_t i = 0; i < n; i++)
+  {
+    records[i] = transition_log[(transition_log_count - n + i) % READER_TRANSITION_LOG_LENGTH];
+  }
+  return n;
+}
+
+void reader_reset_transition_stats()
+{
+  for (size_t row = 0; row < TRANSITION_ROWS; row++)
+  {
+    transition_stats[row].count = 0;
+    transition_stats[row].last_at_us = 0;
+    transition_stats[row].dwell.reset();
+    transition_stats[row].action.reset();
+  }
+  transition_log_count = 0;
+}
+
+void reader_print_transition_stats()
+{
+  char line[160];
+  Serial.println("from -[input]-> next: count, dwell p50/p95/max us, action p50/p95/max us");
+  for (size_t row = 0; row < TRANSITION_ROWS; row++)
+  {
+    const ReaderTransition &t = transitions[row];
+    const ReaderTransitionStats &s = transition_stats[row];
+    if (s.count == 0)
+    {
+      continue;
+    }
+    snprintf(line, sizeof(line), "%s -[%s]-> %s: %u, %u/%u/%u, %u/%u/%u",
+             readerStateToString(t.from), readerInputToString(t.input), readerStateToString(t.next),
+             (unsigned)s.count,
+             (unsigned)s.dwell.percentile(50), (unsigned)s.dwell.percentile(95), (unsigned)s.dwell.max(),
+             (unsigned)s.action.percentile(50), (unsigned)s.action.percentile(95), (unsigned)s.action.max());
+    Serial.println(line);
+  }
+}
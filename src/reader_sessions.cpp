@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "reader_sessions.h"
+
+#define SLOT_EMPTY 0
+#define SLOT_DELETED -1 // Tombstone, keeps probe chains intact
+
+static ReaderSession sessions[READER_SESSION_CAPACITY];
+static bool session_used[READER_SESSION_CAPACITY];
+// Hash slot -> index into sessions + 1
+static int8_t slots[READER_SESSION_SLOTS];
+static size_t session_count = 0;
+static uint32_t next_seq = 0;
+
+static uint32_t hashRequestId(const char *requestId)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261UL;
+  while (*requestId)
+  {
+    hash ^= (uint8_t)*requestId++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Hash slot of requestId, or -1
+static int findSlot(const char *requestId)
+{
+  uint32_t index = hashRequestId(requestId) & (READER_SESSION_SLOTS - 1);
+  for (size_t probe = 0; probe < READER_SESSION_SLOTS; probe++)
+  {
+    int8_t entry = slots[index];
+    if (entry == SLOT_EMPTY)
+    {
+      return -1;
+    }
+    if (entry > 0 && strcmp(sessions[entry - 1].request_id, requestId) == 0)
+    {
+      return (int)index;
+    }
+    index = (index + 1) & (READER_SESSION_SLOTS - 1);
+  }
+  return -1;
+}
+
+static void resetSession(ReaderSession &session, const char *requestId, DeviceMode mode)
+{
+  memset(&session, 0, sizeof(session));
+  strlcpy(session.request_id, requestId, sizeof(session.request_id));
+  session.mode = mode;
+  session.queued_seq = next_seq++;
+}
+
+ReaderSession *reader_session_open(const char *requestId, DeviceMode mode)
+{
+  int existing = findSlot(requestId);
+  if (existing >= 0)
+  {
+    ReaderSession &session = sessions[slots[existing] - 1];
+    resetSession(session, requestId, mode);
+    return &session;
+  }
+
+  if (session_count == READER_SESSION_CAPACITY)
+  {
+    return nullptr;
+  }
+
+  int8_t unused = 0;
+  while (session_used[unused])
+  {
+    unused++;
+  }
+
+  uint32_t index = hashRequestId(requestId) & (READER_SESSION_SLOTS - 1);
+  while (slots[index] > 0)
+  {
+    index = (index + 1) & (READER_SESSION_SLOTS - 1);
+  }
+
+  slots[index] = (int8_t)(unused + 1);
+  session_used[unused] = true;
+  session_count++;
+  resetSession(sessions[unused], requestId, mode);
+  return &sessions[unused];
+}
+
+ReaderSession *reader_session_find(const char *requestId)
+{
+  int index = findSlot(requestId);
+  return index >= 0 ? &sessions[slots[index] - 1] : nullptr;
+}
+
+ReaderSession *reader_session_next_queued()
+{
+  ReaderSession *oldest = nullptr;
+  for (size_t i = 0; i < READER_SESSION_CAPACITY; i++)
+  {
+    if (session_used[i] && !sessions[i].started &&
+        (oldest == nullptr || (int32_t)(sessions[i].queued_seq - oldest->queued_seq) < 0))
+    {
+      oldest = &sessions[i];
+    }
+  }
+  return oldest;
+}
+
+void reader_session_close(ReaderSession *session)
+{
+  if (session == nullptr)
+  {
+    return;
+  }
+  int index = findSlot(session->request_id);
+  if (index < 0)
+  {
+    return;
+  }
+
+  int8_t entry = slots[index] - 1;
+  slots[index] = SLOT_DELETED;
+  session_used[entry] = false;
+  memset(&sessions[entry], 0, sizeof(ReaderSession));
+  session_count--;
+
+  // Nothing left to probe past: drop the tombstones
+  if (session_count == 0)
+  {
+    memset(slots, SLOT_EMPTY, sizeof(slots));
+  }
+}
+
+size_t reader_session_count()
+{
+  return session_count;
+}
+
+void reader_session_clear()
+{
+  memset(sessions, 0, sizeof(sessions));
+  memset(session_used, 0, sizeof(session_used));
+  memset(slots, SLOT_EMPTY, sizeof(slots));
+  session_count = 0;
+}
@@ -0,0 +1,142 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "tap_trace.h"
+
+struct NetworkSpan
+{
+  TraceSpan span;
+  int64_t started_us;
+  uint32_t duration_us;
+};
+
+// NFC task
+static TraceSpanRecord spans[TAP_TRACE_MAX_SPANS];
+static uint32_t written = 0; // Ring position, spans ever written since the tap (or poll) started
+static int64_t origin_us = 0;
+static int64_t polled_us = 0;
+static bool in_progress = false;
+static bool recording = false;
+
+// Network task
+static NetworkSpan network_spans[TAP_TRACE_NETWORK_SPANS];
+static uint32_t network_written = 0;
+
+static uint32_t clampMicros(int64_t us)
+{
+  if (us < 0)
+  {
+    return 0;
+  }
+  return us > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static void restart(int64_t now)
+{
+  written = 0;
+  origin_us = now;
+}
+
+void tap_trace_poll()
+{
+  recording = !in_progress;
+  if (recording)
+  {
+    restart(esp_timer_get_time());
+  }
+}
+
+void tap_trace_polled()
+{
+  polled_us = esp_timer_get_time();
+  recording = in_progress;
+}
+
+static void append(TraceSpan span, int64_t started_us, int64_t ended_us)
+{
+  TraceSpanRecord &record = spans[written % TAP_TRACE_MAX_SPANS];
+  record.span = span;
+  record.start_us = clampMicros(started_us - origin_us);
+  record.duration_us = clampMicros(ended_us - started_us);
+  written++;
+}
+
+void tap_trace_open()
+{
+  if (in_progress)
+  {
+    // The previous tap never showed a result; this poll was not recorded
+    restart(polled_us);
+  }
+  in_progress = true;
+  recording = true;
+  append(TraceSpan::READ_CARD, origin_us, polled_us);
+}
+
+void tap_trace_end(TraceSpan span, int64_t started_us)
+{
+  if (recording)
+  {
+    append(span, started_us, esp_timer_get_time());
+  }
+}
+
+bool tap_trace_close(TapTracePayload &trace)
+{
+  if (!in_progress)
+  {
+    return false;
+  }
+
+  trace.clear();
+  trace.started_us = origin_us;
+  trace.total_us = clampMicros(esp_timer_get_time() - origin_us);
+
+  // Oldest first; a full ring has lost the earliest spans
+  uint32_t count = written < TAP_TRACE_MAX_SPANS ? written : TAP_TRACE_MAX_SPANS;
+  uint32_t dropped = written - count;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    trace.spans[i] = spans[(written - count + i) % TAP_TRACE_MAX_SPANS];
+  }
+  trace.count = (uint8_t)count;
+  trace.dropped = dropped > UINT8_MAX ? UINT8_MAX : (uint8_t)dropped;
+
+  in_progress = false;
+  recording = false;
+  return true;
+}
+
+void tap_trace_network_span(TraceSpan span, int64_t started_us)
+{
+  NetworkSpan &record = network_spans[network_written % TAP_TRACE_NETWORK_SPANS];
+  record.span = span;
+  record.started_us = started_us;
+  record.duration_us = clampMicros(esp_timer_get_time() - started_us);
+  network_written++;
+}
+
+void tap_trace_merge(TapTracePayload &trace)
+{
+  uint32_t count = network_written < TAP_TRACE_NETWORK_SPANS ? network_written : TAP_TRACE_NETWORK_SPANS;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const NetworkSpan &record = network_spans[(network_written - count + i) % TAP_TRACE_NETWORK_SPANS];
+    if (record.started_us < trace.started_us)
+    {
+      continue;
+    }
+    if (trace.count == TAP_TRACE_MAX_SPANS)
+    {
+      if (trace.dropped < UINT8_MAX)
+      {
+        trace.dropped++;
+      }
+      continue;
+    }
+    TraceSpanRecord &merged = trace.spans[trace.count++];
+    merged.span = record.span;
+    merged.start_us = clampMicros(record.started_us - trace.started_us);
+    merged.duration_us = record.duration_us;
+  }
+}
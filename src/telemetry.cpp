@@ -0,0 +1,105 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "telemetry.h"
+#include "latency_histogram.h"
+
+struct TierTelemetry
+{
+  LatencyHistogram decision_ms;
+  uint32_t pn532_errors;
+  uint32_t pn532_timeouts;
+};
+
+// NFC task
+static uint32_t rf_polls = 0;
+static uint32_t rf_taps = 0;
+static uint32_t rf_pn532_errors = 0;
+static uint32_t rf_pn532_timeouts = 0;
+static uint32_t decisions = 0;
+static int64_t tap_detected_us = 0;
+static TierTelemetry tiers[HEARTBEAT_TIER_COUNT];
+static LatencyHistogram reader_loop_us;
+
+// Network task
+static LatencyHistogram network_loop_us;
+
+void telemetry_rf_poll()
+{
+  rf_polls++;
+}
+
+void telemetry_rf_error(bool timeout)
+{
+  rf_pn532_errors++;
+  if (timeout)
+  {
+    rf_pn532_timeouts++;
+  }
+}
+
+void telemetry_tap_detected()
+{
+  rf_taps++;
+  tap_detected_us = esp_timer_get_time();
+}
+
+void telemetry_tap_decided(DecisionTier tier, bool pn532Error, bool timeout)
+{
+  TierTelemetry &stats = tiers[(size_t)tier < HEARTBEAT_TIER_COUNT ? (size_t)tier : 0];
+  int64_t elapsed_ms = (esp_timer_get_time() - tap_detected_us) / 1000;
+  stats.decision_ms.record(elapsed_ms > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed_ms);
+  if (pn532Error)
+  {
+    stats.pn532_errors++;
+  }
+  if (timeout)
+  {
+    stats.pn532_timeouts++;
+  }
+  decisions++;
+}
+
+void telemetry_reader_loop(uint32_t micros)
+{
+  reader_loop_us.record(micros);
+}
+
+void telemetry_network_loop(uint32_t micros)
+{
+  network_loop_us.record(micros);
+}
+
+static void fillLatency(HeartbeatLatency &latency, const LatencyHistogram &histogram)
+{
+  latency.count = histogram.count();
+  latency.p50 = histogram.percentile(50);
+  latency.p99 = histogram.percentile(99);
+  latency.max = histogram.max();
+}
+
+void telemetry_fill_heartbeat(HeartbeatPayload &payload)
+{
+  payload.uptime_seconds = (unsigned long)(esp_timer_get_time() / 1000000);
+  payload.operations_completed = decisions;
+
+  payload.free_heap = ESP.getFreeHeap();
+  payload.min_free_heap = ESP.getMinFreeHeap();
+  payload.largest_free_block = ESP.getMaxAllocHeap();
+  payload.memory_usage_percent = 100.0f * (1.0f - (float)payload.free_heap / (float)ESP.getHeapSize());
+
+  payload.rf_polls = rf_polls;
+  payload.rf_taps = rf_taps;
+  payload.rf_pn532_errors = rf_pn532_errors;
+  payload.rf_pn532_timeouts = rf_pn532_timeouts;
+
+  for (size_t i = 0; i < HEARTBEAT_TIER_COUNT; i++)
+  {
+    fillLatency(payload.tiers[i].decision_ms, tiers[i].decision_ms);
+    payload.tiers[i].pn532_errors = tiers[i].pn532_errors;
+    payload.tiers[i].pn532_timeouts = tiers[i].pn532_timeouts;
+  }
+
+  fillLatency(payload.reader_loop_us, reader_loop_us);
+  fillLatency(payload.network_loop_us, network_loop_us);
+}
@@ -0,0 +1,144 @@
+#include <atomic>
+
+#include "time_service.h"
+
+#if defined(UNIT_TEST) && defined(ARDUINO_ARCH_NATIVE)
+#include <chrono>
+
+static int64_t platformClock()
+{
+  static const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+}
+#else
+#include <esp_timer.h>
+
+static int64_t platformClock()
+{
+  return esp_timer_get_time();
+}
+#endif
+
+// Network task
+static TimeServiceSource time_source = nullptr;
+static TimeServiceClock monotonic = platformClock;
+static int64_t next_sync_us = 0;
+static TimeServiceStats stats;
+
+// Offset in ms, as two halves, and whether it is synced: the sequence counter is odd while
+// they are written, a reader that sees it change tries again
+static std::atomic<uint32_t> sequence(0);
+static std::atomic<uint32_t> offset_low(0);
+static std::atomic<uint32_t> offset_high(0);
+static std::atomic<bool> synced(false);
+
+static void storeOffset(int64_t offset, bool isSynced)
+{
+  uint32_t seq = sequence.load(std::memory_order_relaxed);
+  sequence.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  offset_low.store((uint32_t)offset, std::memory_order_relaxed);
+  offset_high.store((uint32_t)((uint64_t)offset >> 32), std::memory_order_relaxed);
+  synced.store(isSynced, std::memory_order_relaxed);
+  sequence.store(seq + 2, std::memory_order_release);
+}
+
+static int64_t loadOffset(bool *isSynced = nullptr)
+{
+  uint32_t before;
+  uint32_t low;
+  uint32_t high;
+  bool offsetSynced;
+  do
+  {
+    before = sequence.load(std::memory_order_acquire);
+    low = offset_low.load(std::memory_order_relaxed);
+    high = offset_high.load(std::memory_order_relaxed);
+    offsetSynced = synced.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((before & 1) != 0 || sequence.load(std::memory_order_relaxed) != before);
+  if (isSynced != nullptr)
+  {
+    *isSynced = offsetSynced;
+  }
+  return (int64_t)(((uint64_t)high << 32) | low);
+}
+
+static void applySync(int64_t unixMs, int64_t now_us)
+{
+  int64_t offset = unixMs - now_us / 1000;
+  stats.last_step_ms = offset - loadOffset();
+  stats.syncs++;
+  storeOffset(offset, true);
+  next_sync_us = now_us + (int64_t)TIME_SYNC_INTERVAL_MS * 1000;
+}
+
+void time_service_begin(TimeServiceSource source, TimeServiceClock clock)
+{
+  time_source = source;
+  monotonic = clock != nullptr ? clock : platformClock;
+  next_sync_us = monotonic();
+  stats = TimeServiceStats();
+  storeOffset(0, false);
+}
+
+void time_service_loop()
+{
+  if (time_source == nullptr)
+  {
+    return;
+  }
+  int64_t now_us = monotonic();
+  if (now_us < next_sync_us)
+  {
+    return;
+  }
+
+  int64_t unixMs;
+  if (!time_source(&unixMs))
+  {
+    stats.failures++;
+    next_sync_us = now_us + (int64_t)TIME_SYNC_RETRY_MS * 1000;
+    return;
+  }
+  applySync(unixMs, now_us);
+}
+
+void time_service_sync(int64_t unixMs)
+{
+  applySync(unixMs, monotonic());
+}
+
+int64_t time_service_now_ms()
+{
+  return monotonic() / 1000 + loadOffset();
+}
+
+int64_t time_service_now_ms(bool *synced)
+{
+  return monotonic() / 1000 + loadOffset(synced);
+}
+
+bool time_service_rebase(int64_t bootMs, int64_t *unixMs)
+{
+  bool isSynced;
+  int64_t offset = loadOffset(&isSynced);
+  if (!isSynced)
+  {
+    return false;
+  }
+  *unixMs = bootMs + offset;
+  return true;
+}
+
+bool time_service_synced()
+{
+  bool isSynced;
+  loadOffset(&isSynced);
+  return isSynced;
+}
+
+const TimeServiceStats &time_service_stats()
+{
+  return stats;
+}
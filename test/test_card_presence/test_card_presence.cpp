@@ -0,0 +1,115 @@
+#include <unity.h>
+#include <string.h>
+
+#include "../../include/card_presence.h"
+
+static const uint8_t TAG_A[8] = {0x04, 0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6, 0x00};
+static const uint8_t TAG_B[8] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x00};
+
+// One poll of the NFC task that returned uid, as pollCard() does it: a swapped-out tag is
+// reported removed, a tag is marked handled only if the state takes it. Returns whether
+// the tag was dispatched; replacedOut is set if the previous tag was replaced.
+static bool poll(const uint8_t uid[8], uint32_t now, bool stateTakesCard, bool *replacedOut = nullptr) {
+    CardPresence replaced;
+    bool wasReplaced = card_presence_replaced(uid, &replaced);
+    if (replacedOut != nullptr) {
+        *replacedOut = wasReplaced;
+    }
+    if (!card_presence_seen(uid, now) || !stateTakesCard) {
+        return false;
+    }
+    card_presence_mark_handled();
+    return true;
+}
+
+// =============================================================================
+// TEST: A tag is handled once while it stays on the reader
+// =============================================================================
+
+void test_card_presence_handled_once() {
+    TEST_ASSERT_TRUE(poll(TAG_A, 0, true));
+    TEST_ASSERT_FALSE(poll(TAG_A, 100, true));
+    TEST_ASSERT_TRUE(card_presence_present());
+
+    // A new operation takes up the tag that is still there
+    card_presence_rearm();
+    TEST_ASSERT_TRUE(poll(TAG_A, 200, true));
+}
+
+// =============================================================================
+// TEST: Removal is debounced, a return within the duplicate window is no new tap
+// =============================================================================
+
+void test_card_presence_removed() {
+    TEST_ASSERT_TRUE(poll(TAG_A, 0, true));
+
+    CardPresence removed;
+    TEST_ASSERT_FALSE(card_presence_absent(&removed, CARD_REMOVED_DEBOUNCE_MS - 1));
+    TEST_ASSERT_TRUE(card_presence_absent(&removed, CARD_REMOVED_DEBOUNCE_MS));
+    TEST_ASSERT_EQUAL_MEMORY(TAG_A, removed.uid, sizeof(TAG_A));
+    TEST_ASSERT_FALSE(card_presence_absent(&removed, CARD_REMOVED_DEBOUNCE_MS + 1));
+
+    TEST_ASSERT_FALSE(poll(TAG_A, CARD_DUPLICATE_WINDOW_MS - 1, true));
+    CardPresence again;
+    TEST_ASSERT_TRUE(card_presence_absent(&again, 2 * CARD_DUPLICATE_WINDOW_MS));
+    TEST_ASSERT_TRUE(poll(TAG_A, 4 * CARD_DUPLICATE_WINDOW_MS, true));
+}
+
+// =============================================================================
+// TEST: A tag swapped in while the state has no use for it (continuous auth in
+// AUTH_WAIT_VERIFY) is reported, and dispatched once the state takes cards again
+// =============================================================================
+
+void test_card_presence_swapped_while_busy() {
+    TEST_ASSERT_TRUE(poll(TAG_A, 0, true));
+
+    // AUTH_WAIT_VERIFY: the next person's tag replaces the previous one without an empty poll
+    bool replaced = false;
+    TEST_ASSERT_FALSE(poll(TAG_B, 50, false, &replaced));
+    TEST_ASSERT_TRUE(replaced);
+    TEST_ASSERT_FALSE(poll(TAG_B, 100, false, &replaced));
+    TEST_ASSERT_FALSE(replaced);
+
+    // Back in AUTH_WAIT_CARD, no rearm: the tag on the reader is a tap
+    TEST_ASSERT_TRUE(poll(TAG_B, 150, true));
+    TEST_ASSERT_FALSE(poll(TAG_B, 200, true));
+}
+
+// =============================================================================
+// TEST: A tag lifted before the state took it is not a duplicate when put back
+// =============================================================================
+
+void test_card_presence_unhandled_returns() {
+    TEST_ASSERT_TRUE(poll(TAG_A, 0, true));
+    TEST_ASSERT_FALSE(poll(TAG_B, 50, false));
+
+    CardPresence removed;
+    TEST_ASSERT_TRUE(card_presence_absent(&removed, 50 + CARD_REMOVED_DEBOUNCE_MS));
+    TEST_ASSERT_EQUAL_MEMORY(TAG_B, removed.uid, sizeof(TAG_B));
+
+    // Back within the duplicate window, after the state accepts cards again
+    TEST_ASSERT_TRUE(poll(TAG_B, 500, true));
+}
+
+// =============================================================================
+// MAIN TEST SETUP
+// =============================================================================
+
+void setUp(void) {
+    card_presence_clear();
+}
+
+void tearDown(void) {
+    // Clean up after each test
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_card_presence_handled_once);
+    RUN_TEST(test_card_presence_removed);
+    RUN_TEST(test_card_presence_swapped_while_busy);
+    RUN_TEST(test_card_presence_unhandled_returns);
+
+    return UNITY_END();
+}
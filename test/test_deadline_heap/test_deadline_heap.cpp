@@ -0,0 +1,195 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../include/deadline_heap.h"
+
+#define HEAP_CAPACITY 16
+#define REQUEST_IDS 5
+
+static DeadlineHeap<HEAP_CAPACITY> heap;
+
+static void requestId(char *id, size_t size, int n) {
+    snprintf(id, size, "request-%d", n);
+}
+
+// Pop everything due and check the deadlines come out in due order
+static size_t drainInOrder(uint32_t now, const char *cancelled) {
+    Deadline expired;
+    size_t popped = 0;
+    uint32_t last = 0;
+    while (heap.popExpired(now, expired)) {
+        TEST_ASSERT_TRUE(strcmp(expired.request_id, cancelled) != 0);
+        if (popped > 0) {
+            TEST_ASSERT_TRUE((int32_t)(expired.due_ms - last) >= 0);
+        }
+        last = expired.due_ms;
+        popped++;
+    }
+    return popped;
+}
+
+// =============================================================================
+// TEST: Deadlines expire earliest first, only once due
+// =============================================================================
+
+void test_deadline_heap_order() {
+    TEST_ASSERT_TRUE(heap.arm("a", DeadlineKind::OPERATION, 300));
+    TEST_ASSERT_TRUE(heap.arm("b", DeadlineKind::OPERATION, 100));
+    TEST_ASSERT_TRUE(heap.arm("c", DeadlineKind::VERIFY, 200));
+
+    Deadline expired;
+    TEST_ASSERT_FALSE(heap.popExpired(99, expired));
+    TEST_ASSERT_TRUE(heap.popExpired(250, expired));
+    TEST_ASSERT_EQUAL_STRING("b", expired.request_id);
+    TEST_ASSERT_TRUE(heap.popExpired(250, expired));
+    TEST_ASSERT_EQUAL_STRING("c", expired.request_id);
+    TEST_ASSERT_TRUE(expired.kind == DeadlineKind::VERIFY);
+    TEST_ASSERT_FALSE(heap.popExpired(250, expired));
+    TEST_ASSERT_EQUAL(1, heap.size());
+}
+
+// =============================================================================
+// TEST: Re-arming replaces the deadline of the same request and kind
+// =============================================================================
+
+void test_deadline_heap_rearm() {
+    TEST_ASSERT_TRUE(heap.arm("a", DeadlineKind::OPERATION, 100));
+    TEST_ASSERT_TRUE(heap.arm("a", DeadlineKind::SESSION, 500));
+    TEST_ASSERT_TRUE(heap.arm("a", DeadlineKind::OPERATION, 400));
+    TEST_ASSERT_EQUAL(2, heap.size());
+    TEST_ASSERT_EQUAL(400, heap.next()->due_ms);
+
+    heap.cancel("a", DeadlineKind::OPERATION);
+    TEST_ASSERT_EQUAL(1, heap.size());
+    TEST_ASSERT_TRUE(heap.next()->kind == DeadlineKind::SESSION);
+}
+
+// =============================================================================
+// TEST: A full heap refuses new deadlines
+// =============================================================================
+
+void test_deadline_heap_full() {
+    char id[16];
+    for (int i = 0; i < HEAP_CAPACITY; i++) {
+        requestId(id, sizeof(id), i);
+        TEST_ASSERT_TRUE(heap.arm(id, DeadlineKind::OPERATION, i));
+    }
+    TEST_ASSERT_FALSE(heap.arm("overflow", DeadlineKind::OPERATION, 0));
+
+    // Re-arming one that is already there still works
+    TEST_ASSERT_TRUE(heap.arm("request-3", DeadlineKind::OPERATION, 1000));
+    TEST_ASSERT_EQUAL(HEAP_CAPACITY, heap.size());
+}
+
+// =============================================================================
+// TEST: Times are compared across the millis() wrap
+// =============================================================================
+
+void test_deadline_heap_wraparound() {
+    TEST_ASSERT_TRUE(heap.arm("late", DeadlineKind::OPERATION, 100));
+    TEST_ASSERT_TRUE(heap.arm("early", DeadlineKind::OPERATION, 0xFFFFFF00UL));
+
+    Deadline expired;
+    TEST_ASSERT_TRUE(heap.popExpired(0xFFFFFF80UL, expired));
+    TEST_ASSERT_EQUAL_STRING("early", expired.request_id);
+    TEST_ASSERT_FALSE(heap.popExpired(50, expired));
+    TEST_ASSERT_TRUE(heap.popExpired(100, expired));
+}
+
+// =============================================================================
+// TEST: Cancelling a request removes all of its deadlines, whatever the heap
+// looks like (random arm/cancel sequences against a plain count per request)
+// =============================================================================
+
+void test_deadline_heap_cancel_all() {
+    uint32_t seed = 12345;
+    char id[16];
+
+    for (int trial = 0; trial < 2000; trial++) {
+        heap.clear();
+        size_t armed[REQUEST_IDS] = {0};
+
+        for (int step = 0; step < 40; step++) {
+            seed = seed * 1103515245UL + 12345UL;
+            int request = (seed >> 16) % REQUEST_IDS;
+            int kind = (seed >> 8) % 3;
+            uint32_t due = (seed >> 4) % 1000;
+            requestId(id, sizeof(id), request);
+
+            if ((seed >> 24) % 4 == 0) {
+                heap.cancel(id);
+                armed[request] = 0;
+            } else {
+                // Whether the request/kind pair is new: cancel it first, then re-arm
+                size_t before = heap.size();
+                heap.cancel(id, (DeadlineKind)kind);
+                bool existed = heap.size() < before;
+                TEST_ASSERT_TRUE(heap.arm(id, (DeadlineKind)kind, due));
+                if (!existed) {
+                    armed[request]++;
+                }
+            }
+
+            // The heap holds exactly what the model says, for every request
+            size_t total = 0;
+            for (int r = 0; r < REQUEST_IDS; r++) {
+                total += armed[r];
+            }
+            TEST_ASSERT_EQUAL(total, heap.size());
+        }
+
+        // Cancel each request in turn, nothing of it may stay behind
+        for (int r = 0; r < REQUEST_IDS; r++) {
+            requestId(id, sizeof(id), r);
+            size_t before = heap.size();
+            heap.cancel(id);
+            TEST_ASSERT_EQUAL(armed[r], before - heap.size());
+        }
+        TEST_ASSERT_EQUAL(0, heap.size());
+    }
+}
+
+// =============================================================================
+// TEST: The heap stays ordered after cancelling from the middle
+// =============================================================================
+
+void test_deadline_heap_order_after_cancel() {
+    char id[16];
+    for (int i = 0; i < HEAP_CAPACITY; i++) {
+        // Three deadlines of one request spread through the heap, the others one each
+        requestId(id, sizeof(id), i % 6 == 0 ? 1 : i + 100);
+        TEST_ASSERT_TRUE(heap.arm(id, (DeadlineKind)(i / 6), (i * 7919) % 1000));
+    }
+    TEST_ASSERT_EQUAL(HEAP_CAPACITY, heap.size());
+    heap.cancel("request-1");
+    TEST_ASSERT_EQUAL(HEAP_CAPACITY - 3, heap.size());
+
+    TEST_ASSERT_EQUAL(HEAP_CAPACITY - 3, drainInOrder(1000, "request-1"));
+    TEST_ASSERT_EQUAL(0, heap.size());
+}
+
+// =============================================================================
+// MAIN TEST SETUP
+// =============================================================================
+
+void setUp(void) {
+    heap.clear();
+}
+
+void tearDown(void) {
+    // Clean up after each test
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_deadline_heap_order);
+    RUN_TEST(test_deadline_heap_rearm);
+    RUN_TEST(test_deadline_heap_full);
+    RUN_TEST(test_deadline_heap_wraparound);
+    RUN_TEST(test_deadline_heap_cancel_all);
+    RUN_TEST(test_deadline_heap_order_after_cancel);
+
+    return UNITY_END();
+}
@@ -0,0 +1,146 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../include/event_journal.h"
+
+// Runs against the file-backed journal storage of the native build
+
+static void appendText(uint8_t type, const char* text) {
+    TEST_ASSERT_TRUE(event_journal_append(type, 0, (const uint8_t*)text, strlen(text)));
+}
+
+static void expectNext(uint8_t type, const char* text) {
+    EventJournalRecord record;
+    uint8_t data[EVENT_JOURNAL_MAX_RECORD + 1];
+    TEST_ASSERT_TRUE(event_journal_peek(&record, data, EVENT_JOURNAL_MAX_RECORD));
+    data[record.length] = '\0';
+    TEST_ASSERT_EQUAL(type, record.type);
+    TEST_ASSERT_EQUAL_STRING(text, (const char*)data);
+    event_journal_ack();
+}
+
+// =============================================================================
+// TEST: Records come back in order and are gone once acknowledged
+// =============================================================================
+
+void test_journal_fifo() {
+    appendText(1, "first");
+    appendText(2, "second");
+    appendText(3, "third");
+    TEST_ASSERT_EQUAL(3, event_journal_pending());
+
+    expectNext(1, "first");
+    expectNext(2, "second");
+    expectNext(3, "third");
+
+    EventJournalRecord record;
+    uint8_t data[16];
+    TEST_ASSERT_FALSE(event_journal_peek(&record, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(0, event_journal_pending());
+}
+
+// =============================================================================
+// TEST: Unacknowledged records survive a restart
+// =============================================================================
+
+void test_journal_replay_after_restart() {
+    appendText(1, "acked before restart");
+    appendText(2, "pending 1");
+    appendText(3, "pending 2");
+    expectNext(1, "acked before restart");
+
+    TEST_ASSERT_TRUE(event_journal_begin());
+    TEST_ASSERT_EQUAL(2, event_journal_pending());
+    expectNext(2, "pending 1");
+
+    // New records go behind the replayed ones
+    appendText(4, "after restart");
+    expectNext(3, "pending 2");
+    expectNext(4, "after restart");
+}
+
+// =============================================================================
+// TEST: A full ring drops the oldest sector, sectors wear evenly
+// =============================================================================
+
+void test_journal_overflow_drops_oldest() {
+    char text[512];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    // Far more than the ring holds
+    const int total = EVENT_JOURNAL_SECTORS * 10;
+    for (int i = 0; i < total; i++) {
+        text[0] = (char)('A' + i % 26);
+        appendText((uint8_t)(i % 200), text);
+    }
+
+    const EventJournalStats& stats = event_journal_stats();
+    TEST_ASSERT_TRUE(stats.dropped > 0);
+    TEST_ASSERT_EQUAL(total, stats.appended);
+    TEST_ASSERT_EQUAL(total - (int)stats.dropped, (int)event_journal_pending());
+
+    // What is left is the newest events, still in order
+    EventJournalRecord record;
+    uint8_t data[EVENT_JOURNAL_MAX_RECORD];
+    int expected = total - (int)event_journal_pending();
+    while (event_journal_peek(&record, data, sizeof(data))) {
+        TEST_ASSERT_EQUAL(expected % 200, record.type);
+        TEST_ASSERT_EQUAL((char)('A' + expected % 26), (char)data[0]);
+        event_journal_ack();
+        expected++;
+    }
+    TEST_ASSERT_EQUAL(total, expected);
+}
+
+// =============================================================================
+// TEST: A record torn by a power loss is skipped
+// =============================================================================
+
+void test_journal_skips_corrupt_record() {
+    appendText(1, "good");
+    appendText(2, "torn");
+    appendText(3, "good again");
+
+    // Flip bits in the payload of the second record (clear bits like a half-written flash page)
+    FILE* file = fopen(EVENT_JOURNAL_FILE, "r+b");
+    TEST_ASSERT_NOT_NULL(file);
+    char sector[4096];
+    TEST_ASSERT_EQUAL(sizeof(sector), fread(sector, 1, sizeof(sector), file));
+    char* torn = (char*)memmem(sector, sizeof(sector), "torn", 4);
+    TEST_ASSERT_NOT_NULL(torn);
+    torn[0] = 0;
+    fseek(file, 0, SEEK_SET);
+    fwrite(sector, 1, sizeof(sector), file);
+    fclose(file);
+
+    TEST_ASSERT_TRUE(event_journal_begin());
+    expectNext(1, "good");
+    expectNext(3, "good again");
+    TEST_ASSERT_EQUAL(1, event_journal_stats().corrupt);
+}
+
+// =============================================================================
+// MAIN TEST SETUP
+// =============================================================================
+
+void setUp(void) {
+    remove(EVENT_JOURNAL_FILE);
+    TEST_ASSERT_TRUE(event_journal_begin());
+}
+
+void tearDown(void) {
+    remove(EVENT_JOURNAL_FILE);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_journal_fifo);
+    RUN_TEST(test_journal_replay_after_restart);
+    RUN_TEST(test_journal_overflow_drops_oldest);
+    RUN_TEST(test_journal_skips_corrupt_record);
+
+    return UNITY_END();
+}
@@ -1,4 +1,5 @@
 #include <unity.h>
+#include <chrono>
 
 #ifdef UNIT_TEST
 #include "arduino_mocks.h"
@@ -6,6 +7,7 @@
 
 #include "../../include/mqtt_serialization.h"
 #include "../../include/mqtt_types.h"
+#include "../../include/mqtt_topics.h"
 
 // =============================================================================
 // TEST: Message Envelope Round-Trip
@@ -299,9 +301,28 @@ void test_mode_change_serialization() {
 
 void test_heartbeat_serialization() {
     HeartbeatPayload payload;
+    payload.clear();
     payload.uptime_seconds = 3600;
     payload.memory_usage_percent = 45;
     payload.operations_completed = 42;
+    payload.free_heap = 150000;
+    payload.min_free_heap = 120000;
+    payload.largest_free_block = 110000;
+    payload.rf_polls = 72000;
+    payload.rf_taps = 42;
+    payload.rf_pn532_errors = 3;
+    payload.rf_pn532_timeouts = 1;
+    HeartbeatTier& cached = payload.tiers[(size_t)DecisionTier::CACHED];
+    cached.decision_ms.count = 40;
+    cached.decision_ms.p50 = 63;
+    cached.decision_ms.p99 = 255;
+    cached.decision_ms.max = 180;
+    cached.pn532_errors = 2;
+    payload.reader_loop_us.count = 72000;
+    payload.reader_loop_us.p99 = 4095;
+    payload.publish_queue = 2;
+    payload.journal_pending = 5;
+    payload.command_rejected = 7;
     
     StaticJsonDocument<MQTT_EVENT_DOC_SIZE> doc;
     JsonObject obj = doc.to<JsonObject>();
@@ -312,12 +333,752 @@ void test_heartbeat_serialization() {
     TEST_ASSERT_EQUAL(3600, obj["uptime_seconds"]);
     TEST_ASSERT_EQUAL(45, obj["memory_usage_percent"]);
     TEST_ASSERT_EQUAL(42, obj["operations_completed"]);
+    TEST_ASSERT_EQUAL(110000, obj["heap"]["largest_block"]);
+    TEST_ASSERT_EQUAL(120000, obj["heap"]["min_free"]);
+    TEST_ASSERT_EQUAL(72000, obj["rf"]["polls"]);
+    TEST_ASSERT_EQUAL(1, obj["rf"]["timeouts"]);
     
-    char jsonBuffer[256];
+    // Only the tiers that decided taps
+    TEST_ASSERT_EQUAL(1, obj["tiers"].size());
+    TEST_ASSERT_TRUE(obj["tiers"]["keyed"].isNull());
+    TEST_ASSERT_EQUAL(40, obj["tiers"]["cached"]["decision_ms"][0]);
+    TEST_ASSERT_EQUAL(255, obj["tiers"]["cached"]["decision_ms"][2]);
+    TEST_ASSERT_EQUAL(2, obj["tiers"]["cached"]["errors"]);
+    
+    TEST_ASSERT_EQUAL(4095, obj["loop_us"]["reader"][2]);
+    TEST_ASSERT_EQUAL(2, obj["queues"]["publish"]);
+    TEST_ASSERT_EQUAL(5, obj["queues"]["journal"]);
+    TEST_ASSERT_EQUAL(7, obj["queues"]["commands_rejected"]);
+    TEST_ASSERT_EQUAL(0, obj["queues"]["control_rejected"]);
+    TEST_ASSERT_FALSE(doc.overflowed());
+    
+    char jsonBuffer[1024];
     serializeJson(doc, jsonBuffer, sizeof(jsonBuffer));
     printf("Heartbeat: %s\n", jsonBuffer);
 }
 
+// =============================================================================
+// TEST: Auth Cache Sync Command Deserialization
+// =============================================================================
+
+void test_auth_cache_sync_deserialization() {
+    const char* json = R"({
+        "replace": true,
+        "entries": [
+            {
+                "tag_uid": "04:A1:B2:C3:D4:E5:F6",
+                "key": "0123456789ABCDEF0123456789ABCDEF",
+                "permissions": 1,
+                "expires_at": 1893456000,
+                "username": "john.doe"
+            },
+            {
+                "tag_uid": "04:11:22:33:44:55:66"
+            }
+        ]
+    })";
+    
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    DeserializationError error = deserializeJson(doc, json);
+    TEST_ASSERT_FALSE(error);
+    
+    AuthCacheSyncPayload data;
+    bool result = deserializeAuthCacheSync(doc.as<JsonObject>(), data);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Failed to deserialize auth_cache_sync");
+    
+    TEST_ASSERT_TRUE(data.replace);
+    TEST_ASSERT_EQUAL(2, data.entry_count);
+    TEST_ASSERT_EQUAL_STRING("04:A1:B2:C3:D4:E5:F6", data.entries[0].tag_uid);
+    TEST_ASSERT_EQUAL_STRING("0123456789ABCDEF0123456789ABCDEF", data.entries[0].key);
+    TEST_ASSERT_EQUAL_UINT32(AUTH_PERMISSION_ACCESS, data.entries[0].permissions);
+    TEST_ASSERT_EQUAL_UINT32(1893456000UL, data.entries[0].expires_at);
+    TEST_ASSERT_EQUAL_STRING("john.doe", data.entries[0].username);
+    
+    // Entry without key revokes the tag
+    TEST_ASSERT_EQUAL_STRING("04:11:22:33:44:55:66", data.entries[1].tag_uid);
+    TEST_ASSERT_EQUAL_STRING("", data.entries[1].key);
+    TEST_ASSERT_EQUAL_UINT32(0, data.entries[1].expires_at);
+    
+    // Invalid key is rejected
+    const char* json2 = R"({"entries": [{"tag_uid": "04:AA:BB:CC", "key": "0123"}]})";
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc2;
+    deserializeJson(doc2, json2);
+    TEST_ASSERT_FALSE(deserializeAuthCacheSync(doc2.as<JsonObject>(), data));
+    
+    TEST_ASSERT_TRUE(stringToCommandType("auth_cache_sync") == CommandType::AUTH_CACHE_SYNC);
+    
+    printf("Auth Cache Sync deserialized successfully\n");
+}
+
+// =============================================================================
+// TEST: Auth Start / Prearm With Key Material
+// =============================================================================
+
+void test_auth_start_with_keys() {
+    const char* json = R"({
+        "timeout_seconds": 30,
+        "tag_uid": "04:A1:B2:C3:D4:E5:F6",
+        "key": "0123456789ABCDEF0123456789ABCDEF",
+        "keys": [
+            {"key": "FEDCBA9876543210FEDCBA9876543210"}
+        ],
+        "user_data": {"username": "john.doe"}
+    })";
+    
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    DeserializationError error = deserializeJson(doc, json);
+    TEST_ASSERT_FALSE(error);
+    
+    AuthStartPayload data;
+    TEST_ASSERT_TRUE(deserializeAuthStart(doc.as<JsonObject>(), data));
+    TEST_ASSERT_EQUAL(30, data.timeout_seconds);
+    TEST_ASSERT_EQUAL(2, data.key_count);
+    TEST_ASSERT_EQUAL_STRING("04:A1:B2:C3:D4:E5:F6", data.keys[0].tag_uid);
+    TEST_ASSERT_EQUAL_STRING("0123456789ABCDEF0123456789ABCDEF", data.keys[0].key);
+    TEST_ASSERT_EQUAL_STRING("", data.keys[1].tag_uid);
+    TEST_ASSERT_EQUAL_STRING("FEDCBA9876543210FEDCBA9876543210", data.keys[1].key);
+    TEST_ASSERT_EQUAL_STRING("john.doe", data.user_data.username);
+    TEST_ASSERT_TRUE(deserializeAuthPrearm(doc.as<JsonObject>(), data));
+    
+    // Plain auth_start is still valid, auth_prearm needs key material
+    const char* json2 = R"({"timeout_seconds": 30})";
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc2;
+    deserializeJson(doc2, json2);
+    TEST_ASSERT_TRUE(deserializeAuthStart(doc2.as<JsonObject>(), data));
+    TEST_ASSERT_EQUAL(0, data.key_count);
+    TEST_ASSERT_FALSE(deserializeAuthPrearm(doc2.as<JsonObject>(), data));
+    
+    // Tag UID to binary, zero padded
+    uint8_t uid[8];
+    TEST_ASSERT_TRUE(tagUidToBinary("04:A1:B2:C3:D4:E5:F6", uid, sizeof(uid)));
+    const uint8_t expected[8] = {0x04, 0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6, 0x00};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, uid, 8);
+    TEST_ASSERT_FALSE(tagUidToBinary("04:ZZ", uid, sizeof(uid)));
+    
+    printf("Auth Start with keys deserialized successfully\n");
+}
+
+// =============================================================================
+// TEST: Auth Start Continuous Session
+// =============================================================================
+
+void test_auth_start_session() {
+    const char* json = R"({
+        "timeout_seconds": 30,
+        "session_duration_seconds": 3600,
+        "session_max_taps": 500
+    })";
+    
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    deserializeJson(doc, json);
+    
+    AuthStartPayload data;
+    TEST_ASSERT_TRUE(deserializeAuthStart(doc.as<JsonObject>(), data));
+    TEST_ASSERT_EQUAL(3600, data.session_duration_seconds);
+    TEST_ASSERT_EQUAL(500, data.session_max_taps);
+    
+    // Session fields are optional
+    const char* json2 = R"({"timeout_seconds": 30})";
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc2;
+    deserializeJson(doc2, json2);
+    TEST_ASSERT_TRUE(deserializeAuthStart(doc2.as<JsonObject>(), data));
+    TEST_ASSERT_EQUAL(0, data.session_duration_seconds);
+    TEST_ASSERT_EQUAL(0, data.session_max_taps);
+    
+    // Negative session values are rejected
+    const char* json3 = R"({"timeout_seconds": 30, "session_max_taps": -1})";
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc3;
+    deserializeJson(doc3, json3);
+    TEST_ASSERT_FALSE(deserializeAuthStart(doc3.as<JsonObject>(), data));
+    
+    printf("Auth Start session deserialized successfully\n");
+}
+
+// =============================================================================
+// TEST: Tag Removed Event
+// =============================================================================
+
+void test_tag_removed_serialization() {
+    TagRemovedPayload payload;
+    payload.clear();
+    strcpy(payload.tag_uid, "04:A1:B2:C3:D4:E5:F6:00");
+    payload.present_ms = 1500;
+    
+    StaticJsonDocument<MQTT_EVENT_DOC_SIZE> doc;
+    JsonObject obj = doc.to<JsonObject>();
+    
+    bool result = serializeTagRemoved(obj, payload);
+    TEST_ASSERT_TRUE(result);
+    
+    TEST_ASSERT_EQUAL_STRING("04:A1:B2:C3:D4:E5:F6:00", obj["tag_uid"]);
+    TEST_ASSERT_EQUAL(1500, obj["present_ms"]);
+    TEST_ASSERT_EQUAL_STRING("tag_removed", eventTypeToString(EventType::TAG_REMOVED));
+    
+    char jsonBuffer[256];
+    serializeJson(doc, jsonBuffer, sizeof(jsonBuffer));
+    printf("Tag Removed: %s\n", jsonBuffer);
+}
+
+// =============================================================================
+// TEST: Timestamp of a buffered event
+// =============================================================================
+
+void test_format_timestamp() {
+    char timestamp[32];
+    
+    formatTimestamp(timestamp, sizeof(timestamp), 1762862400123LL);
+    TEST_ASSERT_EQUAL_STRING("2025-11-11T12:00:00.123Z", timestamp);
+    
+    formatTimestamp(timestamp, sizeof(timestamp), 0);
+    TEST_ASSERT_EQUAL_STRING("1970-01-01T00:00:00.000Z", timestamp);
+    
+    printf("Formatted timestamp: %s\n", timestamp);
+}
+
+// =============================================================================
+// TEST: Direct JSON Writer Matches The Document Output
+// =============================================================================
+
+// Builds the message both ways, through the document like before and with the writer
+template <typename T>
+static void assertWriterMatchesDocument(EventType type, const char* requestId,
+                                        bool (*serialize)(JsonObject, const T&),
+                                        bool (*write)(JsonWriter&, const T&),
+                                        const T& data) {
+    const char* timestamp = "2025-11-13T12:00:00.000Z";
+    const char* deviceId = "test-device-001";
+    
+    StaticJsonDocument<MQTT_EVENT_DOC_SIZE> doc;
+    doc["version"] = MQTT_PROTOCOL_VERSION;
+    doc["timestamp"] = timestamp;
+    doc["device_id"] = deviceId;
+    doc["event_type"] = eventTypeToString(type);
+    doc["request_id"] = requestId;
+    serialize(doc.createNestedObject("payload"), data);
+    char expected[1024];
+    TEST_ASSERT_TRUE(serializeJson(doc, expected, sizeof(expected)) > 0);
+    
+    char actual[1024];
+    memset(actual, 'x', sizeof(actual));
+    JsonWriter out(actual, sizeof(actual));
+    writeEnvelopeStart(out, timestamp, deviceId, type, requestId);
+    write(out, data);
+    writeEnvelopeEnd(out);
+    
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+    TEST_ASSERT_EQUAL(strlen(expected), out.length());
+}
+
+void test_json_writer_matches_document() {
+    const char* requestId = "550e8400-e29b-41d4-a716-446655440000";
+    
+    StatusChangePayload status;
+    status.clear();
+    status.status = DeviceStatus::ONLINE;
+    strcpy(status.firmware_version, "1.0.0");
+    strcpy(status.ip_address, "192.168.1.100");
+    assertWriterMatchesDocument(EventType::STATUS_CHANGE, requestId, serializeStatusChange, writeStatusChange, status);
+    
+    ModeChangePayload mode;
+    mode.mode = DeviceMode::AUTH;
+    mode.previous_mode = DeviceMode::IDLE;
+    assertWriterMatchesDocument(EventType::MODE_CHANGE, requestId, serializeModeChange, writeModeChange, mode);
+    
+    TagDetectedPayload detected;
+    detected.clear();
+    strcpy(detected.tag_uid, "04:A1:B2:C3:D4:E5:F6");
+    strcpy(detected.message, "Tag detected, verifying");
+    assertWriterMatchesDocument(EventType::AUTH_TAG_DETECTED, requestId, serializeTagDetected, writeTagDetected, detected);
+    
+    RegisterSuccessPayload registered;
+    registered.clear();
+    strcpy(registered.tag_uid, "04:A1:B2:C3:D4:E5:F6");
+    registered.blocks_written = 12;
+    strcpy(registered.message, "Tag registered");
+    assertWriterMatchesDocument(EventType::REGISTER_SUCCESS, requestId, serializeRegisterSuccess, writeRegisterSuccess, registered);
+    
+    // Strings that need escaping, UTF-8 is written as is
+    AuthSuccessPayload success;
+    success.clear();
+    strcpy(success.tag_uid, "04:A1:B2:C3");
+    success.authenticated = true;
+    strcpy(success.message, "Welcome \"Jos\xC3\xA9\"\n\tpath C:\\doors/1\r\b\f");
+    strcpy(success.user_data.username, "jos\xC3\xA9");
+    assertWriterMatchesDocument(EventType::AUTH_SUCCESS, requestId, serializeAuthSuccess, writeAuthSuccess, success);
+    
+    // Empty user data is an empty object
+    success.user_data.clear();
+    assertWriterMatchesDocument(EventType::AUTH_SUCCESS, requestId, serializeAuthSuccess, writeAuthSuccess, success);
+    strcpy(success.user_data.context, "building-a");
+    assertWriterMatchesDocument(EventType::AUTH_SUCCESS, requestId, serializeAuthSuccess, writeAuthSuccess, success);
+    
+    AuthFailedPayload failed;
+    failed.clear();
+    strcpy(failed.tag_uid, "04:A1:B2:C3");
+    strcpy(failed.reason, "Key mismatch");
+    assertWriterMatchesDocument(EventType::AUTH_FAILED, requestId, serializeAuthFailed, writeAuthFailed, failed);
+    
+    ErrorPayload error;
+    error.clear();
+    strcpy(error.error, "Reader busy - command queue full");
+    error.error_code = ErrorCode::NFC_DEVICE_BUSY;
+    error.retry_possible = true;
+    error.component = ErrorComponent::DEVICE;
+    assertWriterMatchesDocument(EventType::AUTH_ERROR, requestId, serializeError, writeError, error);
+    
+    ReadSuccessPayload read;
+    read.clear();
+    strcpy(read.tag_uid, "04:A1:B2:C3");
+    strcpy(read.message, "Read complete");
+    assertWriterMatchesDocument(EventType::READ_SUCCESS, requestId, serializeReadSuccess, writeReadSuccess, read);
+    
+    TagRemovedPayload removed;
+    removed.clear();
+    strcpy(removed.tag_uid, "04:A1:B2:C3");
+    removed.present_ms = 4294967295UL;
+    assertWriterMatchesDocument(EventType::TAG_REMOVED, requestId, serializeTagRemoved, writeTagRemoved, removed);
+    
+    // Missing request id is null, an empty one an empty string
+    assertWriterMatchesDocument(EventType::TAG_REMOVED, nullptr, serializeTagRemoved, writeTagRemoved, removed);
+    assertWriterMatchesDocument(EventType::TAG_REMOVED, "", serializeTagRemoved, writeTagRemoved, removed);
+}
+
+// =============================================================================
+// TEST: Direct JSON Writer Overflow
+// =============================================================================
+
+void test_json_writer_overflow() {
+    char buffer[16];
+    JsonWriter out(buffer, sizeof(buffer));
+    out.beginObject();
+    out.field("tag_uid", "04:A1:B2:C3:D4:E5:F6");
+    out.endObject();
+    
+    TEST_ASSERT_TRUE(out.overflowed());
+    TEST_ASSERT_EQUAL(0, out.length());
+    TEST_ASSERT_TRUE(strlen(buffer) < sizeof(buffer));
+    
+    // Exactly fits, terminator included
+    char exact[12];
+    JsonWriter fits(exact, sizeof(exact));
+    fits.beginObject();
+    fits.field("n", -1234);
+    fits.endObject();
+    TEST_ASSERT_FALSE(fits.overflowed());
+    TEST_ASSERT_EQUAL_STRING("{\"n\":-1234}", exact);
+}
+
+// =============================================================================
+// TEST: An envelope stamped before the first time sync is flagged
+// =============================================================================
+
+void test_envelope_time_unsynced() {
+    char buffer[256];
+    JsonWriter out(buffer, sizeof(buffer));
+    writeEnvelopeStart(out, "1970-01-01T00:00:05.000Z", "reader-01", EventType::HEARTBEAT, "request-1", false);
+    writeEnvelopeEnd(out);
+    TEST_ASSERT_EQUAL_STRING(R"({"version":"1.0","timestamp":"1970-01-01T00:00:05.000Z","time_synced":false,)"
+                             R"("device_id":"reader-01","event_type":"heartbeat","request_id":"request-1","payload":{}})",
+                             buffer);
+    
+    // Synced: no flag, as before
+    JsonWriter synced(buffer, sizeof(buffer));
+    writeEnvelopeStart(synced, "2025-11-13T12:00:00.000Z", "reader-01", EventType::HEARTBEAT, "request-1", true);
+    writeEnvelopeEnd(synced);
+    TEST_ASSERT_NULL(strstr(buffer, "time_synced"));
+}
+
+// =============================================================================
+// TEST: Command Parsed In Place
+// =============================================================================
+
+void test_command_parsed_in_place() {
+    char message[] = R"({"version":"1.0","timestamp":"2025-11-13T12:00:00.000Z",)"
+                     R"("device_id":"test-device-001","event_type":"register_start",)"
+                     R"("request_id":"550e8400-e29b-41d4-a716-446655440000",)"
+                     R"("payload":{"tag_uid":"04:A1:B2:C3:D4:E5:F6","key":"0123456789ABCDEF0123456789ABCDEF","timeout_seconds":30}})";
+    
+    StaticJsonDocument<MQTT_COMMAND_INPLACE_DOC_SIZE> doc;
+    TEST_ASSERT_FALSE(decodeDocumentInPlace(doc, message, strlen(message), PayloadEncoding::JSON));
+    
+    // Strings are views into the message, not copies
+    const char* requestId = doc["request_id"];
+    TEST_ASSERT_TRUE(requestId >= message && requestId < message + sizeof(message));
+    TEST_ASSERT_EQUAL_STRING("550e8400-e29b-41d4-a716-446655440000", requestId);
+    
+    RegisterStartPayload data;
+    TEST_ASSERT_TRUE(deserializeRegisterStart(doc["payload"].as<JsonObject>(), data));
+    TEST_ASSERT_EQUAL_STRING("04:A1:B2:C3:D4:E5:F6", data.tag_uid);
+    TEST_ASSERT_EQUAL(30, data.timeout_seconds);
+    
+    // Copying the same message needs room for all its strings as well
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> copied;
+    TEST_ASSERT_FALSE(deserializeJson(copied, (const char*)R"({"version":"1.0","request_id":"550e8400-e29b-41d4-a716-446655440000"})"));
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> viewed;
+    char small[] = R"({"version":"1.0","request_id":"550e8400-e29b-41d4-a716-446655440000"})";
+    TEST_ASSERT_FALSE(deserializeJson(viewed, small));
+    TEST_ASSERT_TRUE(viewed.memoryUsage() < copied.memoryUsage());
+}
+
+// =============================================================================
+// TEST: The Largest Command Fits The In-Place Document
+// =============================================================================
+
+void test_full_auth_cache_sync_in_place() {
+    // AUTH_CACHE_SYNC_MAX_ENTRIES entries with every field at its longest
+    char username[MAX_CACHE_USERNAME_LENGTH + 1];
+    memset(username, 'u', MAX_CACHE_USERNAME_LENGTH);
+    username[MAX_CACHE_USERNAME_LENGTH] = '\0';
+    
+    static char message[MQTT_COMMAND_BUFFER_SIZE + 1];
+    size_t length = snprintf(message, sizeof(message),
+                             R"({"version":"1.0","timestamp":"2025-11-13T12:00:00.000Z",)"
+                             R"("device_id":"test-device-001","event_type":"auth_cache_sync",)"
+                             R"("request_id":"550e8400-e29b-41d4-a716-446655440000",)"
+                             R"("payload":{"replace":true,"entries":[)");
+    for (int i = 0; i < AUTH_CACHE_SYNC_MAX_ENTRIES; i++) {
+        length += snprintf(message + length, sizeof(message) - length,
+                           R"(%s{"tag_uid":"04:A1:B2:C3:D4:E5:%02X","key":"0123456789ABCDEF0123456789ABCDEF",)"
+                           R"("permissions":4294967295,"expires_at":4102444800,"username":"%s"})",
+                           i > 0 ? "," : "", i, username);
+    }
+    length += snprintf(message + length, sizeof(message) - length, "]}}");
+    TEST_ASSERT_TRUE(length <= MQTT_COMMAND_BUFFER_SIZE);
+    
+    // As MQTTMessageParser parses it
+    static StaticJsonDocument<MQTT_COMMAND_INPLACE_DOC_SIZE> doc;
+    TEST_ASSERT_FALSE(decodeDocumentInPlace(doc, message, length, PayloadEncoding::JSON));
+    AuthCacheSyncPayload data;
+    TEST_ASSERT_TRUE(deserializeAuthCacheSync(doc["payload"].as<JsonObject>(), data));
+    TEST_ASSERT_EQUAL(AUTH_CACHE_SYNC_MAX_ENTRIES, data.entry_count);
+    TEST_ASSERT_EQUAL_STRING("04:A1:B2:C3:D4:E5:03", data.entries[AUTH_CACHE_SYNC_MAX_ENTRIES - 1].tag_uid);
+    TEST_ASSERT_EQUAL_STRING(username, data.entries[AUTH_CACHE_SYNC_MAX_ENTRIES - 1].username);
+}
+
+// =============================================================================
+// TEST: Topic Table
+// =============================================================================
+
+void test_topic_table() {
+    MQTTTopicBuilder builder;
+    builder.setDeviceId("test-device-001");
+    
+    // The getters are const: the publish path only reads the table, nothing is formatted
+    const MQTTTopicBuilder& topics = builder;
+    const char* authError = topics.authError();
+    const char* mode = topics.mode();
+    
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/auth/error", authError);
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/mode", mode);
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/register/start", topics.registerStart());
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/auth/cache", topics.authCacheSync());
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/tag/removed", topics.tagRemoved());
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/heartbeat", topics.heartbeat());
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/#", topics.allCommands());
+    
+    // Stable pointers, and two topics can be held at once
+    TEST_ASSERT_TRUE(authError == topics.authError());
+    TEST_ASSERT_TRUE(authError == topics.topic(MQTTTopic::AUTH_ERROR));
+    TEST_ASSERT_TRUE(authError != mode);
+    TEST_ASSERT_EQUAL_STRING("devices/test-device-001/auth/error", authError);
+    
+    // Every topic is distinct
+    for (size_t i = 0; i < MQTT_TOPIC_COUNT; i++) {
+        for (size_t j = i + 1; j < MQTT_TOPIC_COUNT; j++) {
+            TEST_ASSERT_TRUE(strcmp(topics.topic((MQTTTopic)i), topics.topic((MQTTTopic)j)) != 0);
+        }
+    }
+    
+    // The longest device id still fits
+    char longId[MAX_DEVICE_ID_LENGTH + 1];
+    memset(longId, 'a', MAX_DEVICE_ID_LENGTH);
+    longId[MAX_DEVICE_ID_LENGTH] = '\0';
+    builder.setDeviceId(longId);
+    const char* allCommands = topics.allCommands();
+    TEST_ASSERT_EQUAL(strlen("devices/") + MAX_DEVICE_ID_LENGTH + strlen("/#"), strlen(allCommands));
+    TEST_ASSERT_EQUAL(strlen("devices/") + MAX_DEVICE_ID_LENGTH + strlen("/heartbeat"), strlen(topics.heartbeat()));
+    const char* authStart = topics.authStart();
+    TEST_ASSERT_TRUE(topics.route(authStart, strlen(authStart)) == MQTTTopic::AUTH_START);
+}
+
+// =============================================================================
+// TEST: Enum/String Conversions Over The Full Vocabulary
+// =============================================================================
+
+void test_enum_string_vocabulary() {
+    for (int i = 0; i < (int)CommandType::UNKNOWN; i++) {
+        TEST_ASSERT_TRUE(stringToCommandType(commandTypeToString((CommandType)i)) == (CommandType)i);
+    }
+    for (int i = 0; i < (int)EventType::UNKNOWN; i++) {
+        TEST_ASSERT_TRUE(stringToEventType(eventTypeToString((EventType)i)) == (EventType)i);
+    }
+    for (int i = 0; i <= (int)DeviceMode::UNKNOWN; i++) {
+        TEST_ASSERT_TRUE(stringToDeviceMode(deviceModeToString((DeviceMode)i)) == (DeviceMode)i);
+    }
+    TEST_ASSERT_TRUE(stringToDeviceStatus("online") == DeviceStatus::ONLINE);
+    TEST_ASSERT_TRUE(stringToDeviceStatus("offline") == DeviceStatus::OFFLINE);
+    for (int i = 0; i < (int)ErrorCode::UNKNOWN; i++) {
+        TEST_ASSERT_TRUE(stringToErrorCode(errorCodeToString((ErrorCode)i)) == (ErrorCode)i);
+    }
+    for (int i = 0; i <= (int)ErrorComponent::PROTOCOL; i++) {
+        TEST_ASSERT_TRUE(stringToErrorComponent(errorComponentToString((ErrorComponent)i)) == (ErrorComponent)i);
+    }
+    
+    // Near misses and unknown strings fall back to the defaults
+    TEST_ASSERT_TRUE(stringToCommandType("") == CommandType::UNKNOWN);
+    TEST_ASSERT_TRUE(stringToCommandType("reset ") == CommandType::UNKNOWN);
+    TEST_ASSERT_TRUE(stringToCommandType("auth_star") == CommandType::UNKNOWN);
+    TEST_ASSERT_TRUE(stringToCommandType("AUTH_START") == CommandType::UNKNOWN);
+    TEST_ASSERT_TRUE(stringToEventType("unknown") == EventType::UNKNOWN);
+    TEST_ASSERT_TRUE(stringToErrorCode("nfc_timeout") == ErrorCode::UNKNOWN);
+    TEST_ASSERT_TRUE(stringToErrorComponent("reader") == ErrorComponent::DEVICE);
+    TEST_ASSERT_EQUAL_STRING("unknown", commandTypeToString(CommandType::UNKNOWN));
+    TEST_ASSERT_EQUAL_STRING("UNKNOWN", errorCodeToString(ErrorCode::UNKNOWN));
+}
+
+// =============================================================================
+// BENCHMARK: Hashed Lookup vs strcmp Chain
+// =============================================================================
+
+// The string to enum lookup as it was before the hashed tables
+static CommandType stringToCommandTypeLinear(const char* str) {
+    for (int i = 0; i < (int)CommandType::UNKNOWN; i++) {
+        if (strcmp(str, commandTypeToString((CommandType)i)) == 0) {
+            return (CommandType)i;
+        }
+    }
+    return CommandType::UNKNOWN;
+}
+
+void test_enum_lookup_benchmark() {
+    const int rounds = 20000;
+    const char* words[(int)CommandType::UNKNOWN + 1];
+    for (int i = 0; i < (int)CommandType::UNKNOWN; i++) {
+        words[i] = commandTypeToString((CommandType)i);
+    }
+    words[(int)CommandType::UNKNOWN] = "display";
+    const int count = (int)CommandType::UNKNOWN + 1;
+    
+    volatile int sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < count; i++) {
+            sink += (int)stringToCommandTypeLinear(words[i]);
+        }
+    }
+    std::chrono::duration<double, std::nano> linear = std::chrono::steady_clock::now() - start;
+    
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < count; i++) {
+            sink += (int)stringToCommandType(words[i]);
+        }
+    }
+    std::chrono::duration<double, std::nano> hashed = std::chrono::steady_clock::now() - start;
+    
+    printf("stringToCommandType over %d words: strcmp chain %.1f ns, hashed %.1f ns per lookup\n",
+           count, linear.count() / (rounds * count), hashed.count() / (rounds * count));
+    TEST_ASSERT_TRUE(sink > 0);
+}
+
+// =============================================================================
+// TEST: Topic Router
+// =============================================================================
+
+void test_topic_router() {
+    MQTTTopicBuilder topics;
+    topics.setDeviceId("reader-01");
+    
+    // Every topic of the device routes to itself
+    for (size_t i = 0; i < (size_t)MQTTTopic::ALL_COMMANDS; i++) {
+        const char* topic = topics.topic((MQTTTopic)i);
+        TEST_ASSERT_TRUE(topics.route(topic, strlen(topic)) == (MQTTTopic)i);
+    }
+    TEST_ASSERT_TRUE(commandForTopic(MQTTTopic::AUTH_CACHE_SYNC) == CommandType::AUTH_CACHE_SYNC);
+    TEST_ASSERT_TRUE(commandForTopic(MQTTTopic::AUTH_SUCCESS) == CommandType::UNKNOWN);
+    
+    // Other devices, prefixes, near misses and extra levels do not route
+    const char* others[] = {
+        "devices/reader-02/auth/start",
+        "devices/reader-01",
+        "devices/reader-01/",
+        "devices/reader-01/auth",
+        "devices/reader-01/auth/",
+        "devices/reader-01/auth/star",
+        "devices/reader-01/auth/started",
+        "devices/reader-01/auth/start/x",
+        "devices/reader-01/auth/cachesync",
+        "devices/reader-01/r",
+        "devices/reader-01/xyz",
+        "device/reader-01/receive/display",
+    };
+    for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+        TEST_ASSERT_TRUE_MESSAGE(topics.route(others[i], strlen(others[i])) == MQTTTopic::COUNT, others[i]);
+    }
+}
+
+// =============================================================================
+// TEST: Batch Message (complete event messages in payload.events)
+// =============================================================================
+
+void test_event_batch() {
+    const char* timestamp = "2025-11-13T12:00:00.000Z";
+    
+    AuthSuccessPayload success;
+    success.clear();
+    strcpy(success.tag_uid, "04:A1:B2:C3:D4:E5:F6");
+    success.authenticated = true;
+    strcpy(success.message, "Authentication successful");
+    char first[512];
+    JsonWriter event(first, sizeof(first));
+    writeEnvelopeStart(event, timestamp, "reader-01", EventType::AUTH_SUCCESS, "request-1");
+    writeAuthSuccess(event, success);
+    writeEnvelopeEnd(event);
+    size_t firstLength = event.length();
+    
+    ModeChangePayload mode;
+    mode.mode = DeviceMode::IDLE;
+    mode.previous_mode = DeviceMode::AUTH;
+    char second[256];
+    JsonWriter modeEvent(second, sizeof(second));
+    writeEnvelopeStart(modeEvent, timestamp, "reader-01", EventType::MODE_CHANGE, "request-1");
+    writeModeChange(modeEvent, mode);
+    writeEnvelopeEnd(modeEvent);
+    
+    // As MQTTMessageBuilder::beginBatch, addToBatch and endBatch
+    char buffer[1024];
+    JsonWriter batch(buffer, sizeof(buffer));
+    writeEnvelopeStart(batch, timestamp, "reader-01", EventType::BATCH, "batch-1");
+    batch.beginArray("events");
+    batch.json(first, firstLength);
+    batch.json(second, modeEvent.length());
+    batch.endArray();
+    writeEnvelopeEnd(batch);
+    TEST_ASSERT_FALSE(batch.overflowed());
+    
+    StaticJsonDocument<1024> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, buffer));
+    TEST_ASSERT_EQUAL_STRING("batch", doc["event_type"]);
+    TEST_ASSERT_TRUE(stringToEventType(doc["event_type"]) == EventType::BATCH);
+    JsonArray events = doc["payload"]["events"].as<JsonArray>();
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_EQUAL_STRING("auth_success", events[0]["event_type"]);
+    TEST_ASSERT_EQUAL_STRING("04:A1:B2:C3:D4:E5:F6", events[0]["payload"]["tag_uid"]);
+    TEST_ASSERT_EQUAL_STRING("mode_change", events[1]["event_type"]);
+    TEST_ASSERT_EQUAL_STRING("idle", events[1]["payload"]["mode"]);
+    
+    // An element that does not fit is taken back, the batch stays valid
+    char small[360];
+    JsonWriter partial(small, sizeof(small));
+    writeEnvelopeStart(partial, timestamp, "reader-01", EventType::BATCH, "batch-2");
+    partial.beginArray("events");
+    size_t mark = partial.position();
+    partial.json(first, firstLength);
+    TEST_ASSERT_TRUE(partial.overflowed());
+    partial.rewind(mark);
+    partial.json(second, modeEvent.length());
+    partial.endArray();
+    writeEnvelopeEnd(partial);
+    TEST_ASSERT_FALSE(partial.overflowed());
+    TEST_ASSERT_FALSE(deserializeJson(doc, small));
+    TEST_ASSERT_EQUAL(1, doc["payload"]["events"].size());
+}
+
+// =============================================================================
+// TEST: Tap Trace Serialization
+// =============================================================================
+
+void test_tap_trace_serialization() {
+    TapTracePayload trace;
+    trace.clear();
+    trace.total_us = 412345;
+    trace.count = 3;
+    trace.spans[0] = {TraceSpan::READ_CARD, 0, 18250};
+    trace.spans[1] = {TraceSpan::APP_AUTH, 18400, 96000};
+    trace.spans[2] = {TraceSpan::PUBLISH, 120000, 4294967295UL};
+    
+    StaticJsonDocument<MQTT_EVENT_DOC_SIZE> doc;
+    JsonObject obj = doc.to<JsonObject>();
+    TEST_ASSERT_TRUE(serializeTapTrace(obj, trace));
+    
+    TEST_ASSERT_EQUAL(412345, obj["total_us"]);
+    TEST_ASSERT_EQUAL(0, obj["dropped"]);
+    JsonArray spans = obj["spans"].as<JsonArray>();
+    TEST_ASSERT_EQUAL(3, spans.size());
+    TEST_ASSERT_EQUAL_STRING("read_card", spans[0][0].as<const char*>());
+    TEST_ASSERT_EQUAL(18250, spans[0][2]);
+    TEST_ASSERT_EQUAL_STRING("app_auth", spans[1][0].as<const char*>());
+    TEST_ASSERT_EQUAL(18400, spans[1][1]);
+    TEST_ASSERT_EQUAL_STRING("publish", spans[2][0].as<const char*>());
+    
+    // The direct writer gives the same bytes, also for a full trace and an empty one
+    const char* requestId = "550e8400-e29b-41d4-a716-446655440000";
+    assertWriterMatchesDocument(EventType::TAP_TRACE, requestId, serializeTapTrace, writeTapTrace, trace);
+    for (uint8_t i = 0; i < TAP_TRACE_MAX_SPANS; i++) {
+        trace.spans[i].span = (TraceSpan)(i % (uint8_t)TraceSpan::COUNT);
+        trace.spans[i].start_us = 100000UL * i;
+        trace.spans[i].duration_us = 999999;
+    }
+    trace.count = TAP_TRACE_MAX_SPANS;
+    trace.dropped = 255;
+    assertWriterMatchesDocument(EventType::TAP_TRACE, requestId, serializeTapTrace, writeTapTrace, trace);
+    trace.count = 0;
+    assertWriterMatchesDocument(EventType::TAP_TRACE, requestId, serializeTapTrace, writeTapTrace, trace);
+    
+    MQTTTopicBuilder topics;
+    topics.setDeviceId("reader-01");
+    TEST_ASSERT_EQUAL_STRING("devices/reader-01/debug/trace", topics.tapTrace());
+}
+
+// =============================================================================
+// TEST: Cached Timestamp Formatting
+// =============================================================================
+
+void test_timestamp_formatter() {
+    TimestampFormatter formatter;
+    char expected[32];
+    char actual[32];
+    
+    // Within a minute, across minutes, hours, days, a leap day and years, and back in time
+    const int64_t times[] = {
+        1762862400123LL, 1762862400124LL, 1762862459999LL, 1762862460000LL, 1762865999999LL,
+        1762905599999LL, 1762905600000LL, 1709164800000LL + 86399999LL, 1767225599999LL,
+        1767225600000LL, 1762862401000LL, 0, 999,
+    };
+    for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+        formatTimestamp(expected, sizeof(expected), times[i]);
+        formatter.format(actual, sizeof(actual), times[i]);
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+    }
+    
+    // Too small a buffer is truncated like formatTimestamp() does
+    char small[12];
+    formatter.format(small, sizeof(small), 1762862400123LL);
+    TEST_ASSERT_EQUAL_STRING("2025-11-11T", small);
+    
+    // One timestamp per millisecond for a while, as a busy reader would
+    const int count = 200000;
+    auto start = std::chrono::steady_clock::now();
+    unsigned sink = 0;
+    for (int i = 0; i < count; i++) {
+        formatTimestamp(expected, sizeof(expected), 1762862400000LL + i);
+        sink += expected[22];
+    }
+    std::chrono::duration<double, std::nano> full = std::chrono::steady_clock::now() - start;
+    
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        formatter.format(actual, sizeof(actual), 1762862400000LL + i);
+        sink += actual[22];
+    }
+    std::chrono::duration<double, std::nano> cached = std::chrono::steady_clock::now() - start;
+    
+    printf("Timestamp: formatTimestamp %.1f ns, cached %.1f ns per timestamp\n",
+           full.count() / count, cached.count() / count);
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+    TEST_ASSERT_TRUE(sink > 0);
+}
+
 // =============================================================================
 // MAIN TEST SETUP
 // =============================================================================
@@ -343,6 +1104,23 @@ int main(int argc, char **argv) {
     RUN_TEST(test_invalid_data_rejection);
     RUN_TEST(test_mode_change_serialization);
     RUN_TEST(test_heartbeat_serialization);
+    RUN_TEST(test_auth_cache_sync_deserialization);
+    RUN_TEST(test_auth_start_with_keys);
+    RUN_TEST(test_auth_start_session);
+    RUN_TEST(test_tag_removed_serialization);
+    RUN_TEST(test_format_timestamp);
+    RUN_TEST(test_json_writer_matches_document);
+    RUN_TEST(test_json_writer_overflow);
+    RUN_TEST(test_envelope_time_unsynced);
+    RUN_TEST(test_command_parsed_in_place);
+    RUN_TEST(test_full_auth_cache_sync_in_place);
+    RUN_TEST(test_topic_table);
+    RUN_TEST(test_enum_string_vocabulary);
+    RUN_TEST(test_enum_lookup_benchmark);
+    RUN_TEST(test_topic_router);
+    RUN_TEST(test_event_batch);
+    RUN_TEST(test_tap_trace_serialization);
+    RUN_TEST(test_timestamp_formatter);
     
     return UNITY_END();
 }
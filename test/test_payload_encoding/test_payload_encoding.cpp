@@ -0,0 +1,230 @@
+#include <unity.h>
+#include <chrono>
+
+#ifdef UNIT_TEST
+#include "arduino_mocks.h"
+#endif
+
+#include "../../include/mqtt_serialization.h"
+#include "../../include/mqtt_types.h"
+
+// Compares the JSON and MessagePack encodings of the same messages: size on the wire and
+// encode/decode time. Run with `pio test -e native -f test_payload_encoding -v` to see the table.
+
+#define BENCHMARK_ITERATIONS 2000
+
+static const char* DEVICE_ID = "reader-lobby-entrance-01";
+static const char* REQUEST_ID = "550e8400-e29b-41d4-a716-446655440000";
+
+static uint8_t buffer[2048];
+
+// Same envelope as MQTTMessageBuilder::buildMessage
+static JsonObject buildEnvelope(JsonDocument& doc, PayloadEncoding encoding, const char* eventType) {
+    doc.clear();
+    doc["version"] = protocolVersionFor(encoding);
+    doc["timestamp"] = "2025-11-13T12:00:00.000Z";
+    doc["device_id"] = DEVICE_ID;
+    doc["event_type"] = eventType;
+    doc["request_id"] = REQUEST_ID;
+    return doc.createNestedObject("payload");
+}
+
+static void buildStatusChange(JsonDocument& doc, PayloadEncoding encoding) {
+    StatusChangePayload payload;
+    payload.clear();
+    payload.status = DeviceStatus::ONLINE;
+    strcpy(payload.firmware_version, "1.0.0");
+    strcpy(payload.ip_address, "192.168.100.123");
+    serializeStatusChange(buildEnvelope(doc, encoding, "status_change"), payload);
+}
+
+static void buildModeChange(JsonDocument& doc, PayloadEncoding encoding) {
+    ModeChangePayload payload;
+    payload.mode = DeviceMode::AUTH;
+    payload.previous_mode = DeviceMode::IDLE;
+    serializeModeChange(buildEnvelope(doc, encoding, "mode_change"), payload);
+}
+
+static void buildAuthSuccess(JsonDocument& doc, PayloadEncoding encoding) {
+    AuthSuccessPayload payload;
+    payload.clear();
+    strcpy(payload.tag_uid, "04:A1:B2:C3:D4:E5:F6");
+    payload.authenticated = true;
+    strcpy(payload.message, "Authentication successful");
+    strcpy(payload.user_data.username, "john.doe");
+    strcpy(payload.user_data.context, "building-a/floor-2/lab");
+    serializeAuthSuccess(buildEnvelope(doc, encoding, "auth_success"), payload);
+}
+
+static void buildAuthError(JsonDocument& doc, PayloadEncoding encoding) {
+    ErrorPayload payload;
+    payload.clear();
+    strcpy(payload.error, "Tag removed before authentication completed");
+    payload.error_code = ErrorCode::NFC_TAG_LOST;
+    payload.retry_possible = true;
+    payload.component = ErrorComponent::NFC;
+    serializeError(buildEnvelope(doc, encoding, "auth_error"), payload);
+}
+
+// The largest command the reader receives
+static void buildAuthCacheSync(JsonDocument& doc, PayloadEncoding encoding) {
+    JsonObject payload = buildEnvelope(doc, encoding, "auth_cache_sync");
+    payload["replace"] = true;
+    JsonArray entries = payload.createNestedArray("entries");
+    for (int i = 0; i < 4; i++) {
+        JsonObject entry = entries.createNestedObject();
+        entry["tag_uid"] = "04:A1:B2:C3:D4:E5:F6";
+        entry["key"] = "0123456789ABCDEF0123456789ABCDEF";
+        entry["permissions"] = AUTH_PERMISSION_ACCESS;
+        entry["expires_at"] = 1893456000UL;
+        entry["username"] = "john.doe";
+    }
+}
+
+struct Sample {
+    const char* name;
+    void (*build)(JsonDocument&, PayloadEncoding);
+};
+
+static const Sample SAMPLES[] = {
+    {"status_change", buildStatusChange},
+    {"mode_change", buildModeChange},
+    {"auth_success", buildAuthSuccess},
+    {"auth_error", buildAuthError},
+    {"auth_cache_sync", buildAuthCacheSync},
+};
+
+static double microsPerIteration(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / BENCHMARK_ITERATIONS;
+}
+
+// =============================================================================
+// TEST: Encoding Detection
+// =============================================================================
+
+void test_detect_encoding() {
+    const uint8_t json[] = {'{', '"', 'a', '"', ':', '1', '}'};
+    const uint8_t indentedJson[] = {'\n', ' ', '{', '}'};
+    const uint8_t fixmap[] = {0x86, 0xA7};
+    const uint8_t map16[] = {0xDE, 0x00, 0x20};
+
+    TEST_ASSERT_TRUE(detectEncoding(json, sizeof(json)) == PayloadEncoding::JSON);
+    TEST_ASSERT_TRUE(detectEncoding(indentedJson, sizeof(indentedJson)) == PayloadEncoding::JSON);
+    TEST_ASSERT_TRUE(detectEncoding(fixmap, sizeof(fixmap)) == PayloadEncoding::MSGPACK);
+    TEST_ASSERT_TRUE(detectEncoding(map16, sizeof(map16)) == PayloadEncoding::MSGPACK);
+
+    TEST_ASSERT_EQUAL_STRING(MQTT_PROTOCOL_VERSION, protocolVersionFor(PayloadEncoding::JSON));
+    TEST_ASSERT_EQUAL_STRING(MQTT_PROTOCOL_VERSION_MSGPACK, protocolVersionFor(PayloadEncoding::MSGPACK));
+}
+
+// =============================================================================
+// TEST: MessagePack Envelope Round-Trip
+// =============================================================================
+
+void test_msgpack_envelope_round_trip() {
+    StaticJsonDocument<MQTT_ENVELOPE_DOC_SIZE> doc;
+    buildEnvelope(doc, PayloadEncoding::MSGPACK, "mode_change");
+    size_t size = encodeDocument(doc, PayloadEncoding::MSGPACK, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(size > 0);
+    TEST_ASSERT_TRUE(size < measureJson(doc));
+
+    MQTTMessageEnvelope envelope;
+    StaticJsonDocument<MQTT_ENVELOPE_DOC_SIZE> doc2;
+    TEST_ASSERT_TRUE(deserializeEnvelope(buffer, size, envelope, doc2));
+    TEST_ASSERT_EQUAL_STRING(MQTT_PROTOCOL_VERSION_MSGPACK, envelope.version);
+    TEST_ASSERT_EQUAL_STRING("2025-11-13T12:00:00.000Z", envelope.timestamp);
+    TEST_ASSERT_EQUAL_STRING(DEVICE_ID, envelope.device_id);
+    TEST_ASSERT_EQUAL_STRING("mode_change", envelope.event_type);
+    TEST_ASSERT_EQUAL_STRING(REQUEST_ID, envelope.request_id);
+
+    // Too small a buffer is an error, not a truncated message
+    TEST_ASSERT_EQUAL(0, encodeDocument(doc, PayloadEncoding::MSGPACK, buffer, size - 1));
+    TEST_ASSERT_EQUAL(0, encodeDocument(doc, PayloadEncoding::JSON, buffer, measureJson(doc)));
+}
+
+// =============================================================================
+// TEST: MessagePack Command Deserialization
+// =============================================================================
+
+void test_msgpack_command_deserialization() {
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    buildAuthCacheSync(doc, PayloadEncoding::MSGPACK);
+    size_t size = encodeDocument(doc, PayloadEncoding::MSGPACK, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(size > 0);
+
+    // The payload deserializers do not care about the encoding
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc2;
+    TEST_ASSERT_FALSE(decodeDocument(doc2, buffer, size, PayloadEncoding::MSGPACK));
+    AuthCacheSyncPayload data;
+    TEST_ASSERT_TRUE(deserializeAuthCacheSync(doc2["payload"].as<JsonObject>(), data));
+    TEST_ASSERT_TRUE(data.replace);
+    TEST_ASSERT_EQUAL(4, data.entry_count);
+    TEST_ASSERT_EQUAL_STRING("0123456789ABCDEF0123456789ABCDEF", data.entries[3].key);
+    TEST_ASSERT_EQUAL_UINT32(1893456000UL, data.entries[3].expires_at);
+}
+
+// =============================================================================
+// BENCHMARK: JSON vs MessagePack
+// =============================================================================
+
+void test_encoding_benchmark() {
+    static StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    static StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> decoded;
+    const PayloadEncoding encodings[] = {PayloadEncoding::JSON, PayloadEncoding::MSGPACK};
+
+    printf("%-16s %-8s %6s %12s %12s\n", "message", "encoding", "bytes", "encode [us]", "decode [us]");
+    for (size_t s = 0; s < sizeof(SAMPLES) / sizeof(SAMPLES[0]); s++) {
+        size_t sizes[2];
+        for (int e = 0; e < 2; e++) {
+            PayloadEncoding encoding = encodings[e];
+            SAMPLES[s].build(doc, encoding);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            size_t size = 0;
+            for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+                size = encodeDocument(doc, encoding, buffer, sizeof(buffer));
+            }
+            double encodeTime = microsPerIteration(start);
+            TEST_ASSERT_TRUE(size > 0);
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+                TEST_ASSERT_FALSE(decodeDocument(decoded, buffer, size, encoding));
+            }
+            double decodeTime = microsPerIteration(start);
+
+            // Both encodings carry the same content
+            TEST_ASSERT_TRUE(decoded["payload"] == doc["payload"]);
+
+            sizes[e] = size;
+            printf("%-16s %-8s %6u %12.2f %12.2f\n", SAMPLES[s].name,
+                   encoding == PayloadEncoding::JSON ? "json" : "msgpack",
+                   (unsigned)size, encodeTime, decodeTime);
+        }
+        TEST_ASSERT_TRUE_MESSAGE(sizes[1] < sizes[0], "MessagePack should be smaller than JSON");
+    }
+}
+
+// =============================================================================
+// MAIN TEST SETUP
+// =============================================================================
+
+void setUp(void) {
+    // Set up for each test
+}
+
+void tearDown(void) {
+    // Clean up after each test
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_detect_encoding);
+    RUN_TEST(test_msgpack_envelope_round_trip);
+    RUN_TEST(test_msgpack_command_deserialization);
+    RUN_TEST(test_encoding_benchmark);
+
+    return UNITY_END();
+}
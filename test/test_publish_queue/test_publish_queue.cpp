@@ -0,0 +1,192 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../include/publish_queue.h"
+
+#define TYPE_STATUS 8
+#define TYPE_MODE 9
+#define TYPE_SUCCESS 3
+
+static void push(uint8_t type, uint8_t flags, const char *text, uint32_t now) {
+    TEST_ASSERT_TRUE(publish_queue_push(type, flags, text, strlen(text), now));
+}
+
+// Publish the next due message and check it
+static void expectNext(const char *text, uint32_t now) {
+    PublishMessage *message = publish_queue_next(now);
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQUAL_STRING(text, message->data);
+    publish_queue_published(message, now);
+}
+
+// =============================================================================
+// TEST: State goes ahead of events, each class in order
+// =============================================================================
+
+void test_publish_queue_priority() {
+    push(TYPE_SUCCESS, 0, "event 1", 0);
+    push(TYPE_MODE, PUBLISH_RETAINED, "mode auth", 0);
+    push(TYPE_SUCCESS, 0, "event 2", 0);
+    push(TYPE_STATUS, PUBLISH_RETAINED, "online", 0);
+    TEST_ASSERT_EQUAL(4, publish_queue_depth());
+
+    expectNext("mode auth", 1);
+    expectNext("online", 1);
+    expectNext("event 1", 1);
+    expectNext("event 2", 1);
+    TEST_ASSERT_NULL(publish_queue_next(1));
+    TEST_ASSERT_EQUAL(0, publish_queue_depth());
+    TEST_ASSERT_EQUAL(4, publish_queue_stats().published);
+    TEST_ASSERT_EQUAL(1, publish_queue_stats().latency.max());
+}
+
+// =============================================================================
+// TEST: A newer retained message replaces the queued one of its type
+// =============================================================================
+
+void test_publish_queue_coalesces_state() {
+    push(TYPE_MODE, PUBLISH_RETAINED, "mode auth", 0);
+    push(TYPE_SUCCESS, 0, "success", 0);
+    push(TYPE_MODE, PUBLISH_RETAINED, "mode idle", 0);
+    push(TYPE_SUCCESS, 0, "success again", 0);
+
+    TEST_ASSERT_EQUAL(3, publish_queue_depth());
+    TEST_ASSERT_EQUAL(1, publish_queue_stats().coalesced);
+    expectNext("mode idle", 0);
+    expectNext("success", 0);
+    expectNext("success again", 0);
+}
+
+// =============================================================================
+// TEST: Failed publishes back off and hold the younger messages of their class
+// =============================================================================
+
+void test_publish_queue_retry() {
+    push(TYPE_SUCCESS, 0, "first", 0);
+    push(TYPE_SUCCESS, 0, "second", 0);
+
+    PublishMessage *message = publish_queue_next(0);
+    TEST_ASSERT_EQUAL_STRING("first", message->data);
+    TEST_ASSERT_TRUE(publish_queue_failed(message, 0));
+    TEST_ASSERT_NULL(publish_queue_next(PUBLISH_QUEUE_RETRY_MS - 1));
+
+    // State is not held back by a waiting event
+    push(TYPE_MODE, PUBLISH_RETAINED, "mode", 10);
+    expectNext("mode", 10);
+
+    message = publish_queue_next(PUBLISH_QUEUE_RETRY_MS);
+    TEST_ASSERT_EQUAL_STRING("first", message->data);
+    TEST_ASSERT_TRUE(publish_queue_failed(message, PUBLISH_QUEUE_RETRY_MS));
+    TEST_ASSERT_NULL(publish_queue_next(3 * PUBLISH_QUEUE_RETRY_MS - 1));
+
+    // Out of attempts: the caller takes it out
+    message = publish_queue_next(3 * PUBLISH_QUEUE_RETRY_MS);
+    TEST_ASSERT_FALSE(publish_queue_failed(message, 3 * PUBLISH_QUEUE_RETRY_MS));
+    publish_queue_spill(message);
+    expectNext("second", 3 * PUBLISH_QUEUE_RETRY_MS);
+
+    TEST_ASSERT_EQUAL(2, publish_queue_stats().retries);
+    TEST_ASSERT_EQUAL(1, publish_queue_stats().spilled);
+}
+
+// =============================================================================
+// TEST: A full queue rejects, the oldest message can be moved out to make room
+// =============================================================================
+
+void test_publish_queue_full() {
+    char text[16];
+    for (int i = 0; i < PUBLISH_QUEUE_SLOTS; i++) {
+        snprintf(text, sizeof(text), "event %d", i);
+        push(TYPE_SUCCESS, 0, text, 0);
+    }
+    TEST_ASSERT_FALSE(publish_queue_push(TYPE_SUCCESS, 0, "overflow", 8, 0));
+
+    // Neither does a retained message with nothing to replace
+    TEST_ASSERT_FALSE(publish_queue_push(TYPE_MODE, PUBLISH_RETAINED, "mode", 4, 0));
+
+    PublishMessage *oldest = publish_queue_oldest();
+    TEST_ASSERT_EQUAL_STRING("event 0", oldest->data);
+    publish_queue_spill(oldest);
+    push(TYPE_SUCCESS, 0, "overflow", 0);
+    TEST_ASSERT_EQUAL(PUBLISH_QUEUE_SLOTS, publish_queue_stats().max_depth);
+
+    expectNext("event 1", 0);
+
+    // Too large for a slot
+    static char large[PUBLISH_QUEUE_MAX_MESSAGE + 2];
+    memset(large, 'x', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+    TEST_ASSERT_FALSE(publish_queue_push(TYPE_SUCCESS, 0, large, strlen(large), 0));
+}
+
+// =============================================================================
+// TEST: Delayed state keeps its due time when it is replaced
+// =============================================================================
+
+void test_publish_queue_delayed_state() {
+    TEST_ASSERT_TRUE(publish_queue_push(TYPE_MODE, PUBLISH_RETAINED, "mode auth", 9, 0, 1000));
+    push(TYPE_SUCCESS, 0, "batch", 0);
+    TEST_ASSERT_TRUE(publish_queue_push(TYPE_MODE, PUBLISH_RETAINED, "mode idle", 9, 500, 1000));
+
+    expectNext("batch", 500);
+    TEST_ASSERT_NULL(publish_queue_next(999));
+    expectNext("mode idle", 1000);
+    TEST_ASSERT_EQUAL(1, publish_queue_stats().coalesced);
+}
+
+// =============================================================================
+// TEST: Events can go out while state is held back (journal replay)
+// =============================================================================
+
+void test_publish_queue_events_only() {
+    push(TYPE_MODE, PUBLISH_RETAINED, "mode", 0);
+    push(TYPE_SUCCESS, 0, "event", 0);
+
+    PublishMessage *message = publish_queue_next(0, false);
+    TEST_ASSERT_EQUAL_STRING("event", message->data);
+    publish_queue_published(message, 0);
+    TEST_ASSERT_NULL(publish_queue_next(0, false));
+    expectNext("mode", 0);
+}
+
+// =============================================================================
+// TEST: Dropped and spilled messages are counted apart
+// =============================================================================
+
+void test_publish_queue_drop() {
+    push(TYPE_SUCCESS, PUBLISH_NO_SPILL, "heartbeat", 0);
+    push(TYPE_SUCCESS, 0, "event", 0);
+
+    publish_queue_drop(publish_queue_oldest());
+    publish_queue_spill(publish_queue_oldest());
+    TEST_ASSERT_EQUAL(0, publish_queue_depth());
+    TEST_ASSERT_EQUAL(1, publish_queue_stats().dropped);
+    TEST_ASSERT_EQUAL(1, publish_queue_stats().spilled);
+}
+
+// =============================================================================
+// MAIN TEST SETUP
+// =============================================================================
+
+void setUp(void) {
+    publish_queue_clear();
+}
+
+void tearDown(void) {
+    // Clean up after each test
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_publish_queue_priority);
+    RUN_TEST(test_publish_queue_coalesces_state);
+    RUN_TEST(test_publish_queue_retry);
+    RUN_TEST(test_publish_queue_full);
+    RUN_TEST(test_publish_queue_delayed_state);
+    RUN_TEST(test_publish_queue_events_only);
+    RUN_TEST(test_publish_queue_drop);
+
+    return UNITY_END();
+}
@@ -0,0 +1,147 @@
+#include <unity.h>
+
+#include "../../include/time_service.h"
+
+// Virtual monotonic clock and a stand-in for SNTP
+static int64_t clock_us = 0;
+static bool source_ready = false;
+static int64_t source_ms = 0;
+static int source_calls = 0;
+
+static int64_t virtualClock() {
+    return clock_us;
+}
+
+static bool fakeSource(int64_t *unixMs) {
+    source_calls++;
+    if (!source_ready) {
+        return false;
+    }
+    *unixMs = source_ms;
+    return true;
+}
+
+static void advance(int64_t ms) {
+    clock_us += ms * 1000;
+    source_ms += ms;
+}
+
+// =============================================================================
+// TEST: Time since boot until the source answers, retried until then
+// =============================================================================
+
+void test_time_service_waits_for_source() {
+    advance(5000);
+    TEST_ASSERT_FALSE(time_service_synced());
+    TEST_ASSERT_EQUAL(5000, time_service_now_ms());
+
+    time_service_loop();
+    TEST_ASSERT_EQUAL(1, source_calls);
+    TEST_ASSERT_EQUAL(1, time_service_stats().failures);
+
+    // Not asked again before the retry is due
+    advance(TIME_SYNC_RETRY_MS - 1);
+    time_service_loop();
+    TEST_ASSERT_EQUAL(1, source_calls);
+
+    source_ready = true;
+    advance(1);
+    time_service_loop();
+    TEST_ASSERT_EQUAL(2, source_calls);
+    TEST_ASSERT_TRUE(time_service_synced());
+    TEST_ASSERT_TRUE(time_service_now_ms() == source_ms);
+}
+
+// =============================================================================
+// TEST: Between syncs the time follows the monotonic clock
+// =============================================================================
+
+void test_time_service_follows_clock() {
+    source_ready = true;
+    source_ms = 1762862400123LL;
+    time_service_loop();
+    TEST_ASSERT_TRUE(time_service_now_ms() == 1762862400123LL);
+
+    // A system clock that jumps does not matter until the next sync
+    source_ms += 3600000;
+    clock_us += 1500 * 1000;
+    TEST_ASSERT_TRUE(time_service_now_ms() == 1762862401623LL);
+    time_service_loop();
+    TEST_ASSERT_EQUAL(1, time_service_stats().syncs);
+
+    // Resync once the interval is over, the correction is reported
+    clock_us += (int64_t)TIME_SYNC_INTERVAL_MS * 1000;
+    source_ms = 1762866000000LL + 1500 + TIME_SYNC_INTERVAL_MS - 40;
+    time_service_loop();
+    TEST_ASSERT_EQUAL(2, time_service_stats().syncs);
+    TEST_ASSERT_TRUE(time_service_now_ms() == source_ms);
+    TEST_ASSERT_TRUE(time_service_stats().last_step_ms == 3600000 - 40 - 123);
+}
+
+// =============================================================================
+// TEST: A pushed sync sets the time right away
+// =============================================================================
+
+void test_time_service_pushed_sync() {
+    clock_us = 42000;
+    time_service_sync(1700000000000LL);
+    TEST_ASSERT_TRUE(time_service_synced());
+    TEST_ASSERT_TRUE(time_service_now_ms() == 1700000000000LL);
+    clock_us += 999;
+    TEST_ASSERT_TRUE(time_service_now_ms() == 1700000000000LL);
+    clock_us += 1;
+    TEST_ASSERT_TRUE(time_service_now_ms() == 1700000000001LL);
+}
+
+// =============================================================================
+// TEST: A time taken before the first sync is re-based once synced
+// =============================================================================
+
+void test_time_service_rebase() {
+    advance(3000);
+    bool synced = true;
+    int64_t taken = time_service_now_ms(&synced);
+    TEST_ASSERT_FALSE(synced);
+    TEST_ASSERT_TRUE(taken == 3000);
+
+    int64_t unixMs = 0;
+    TEST_ASSERT_FALSE(time_service_rebase(taken, &unixMs));
+
+    source_ready = true;
+    source_ms = 1762862400000LL;
+    advance(2000);
+    time_service_loop();
+    TEST_ASSERT_TRUE(time_service_now_ms(&synced) == 1762862402000LL);
+    TEST_ASSERT_TRUE(synced);
+
+    // 2 s before the sync, on the synced clock
+    TEST_ASSERT_TRUE(time_service_rebase(taken, &unixMs));
+    TEST_ASSERT_TRUE(unixMs == 1762862400000LL);
+}
+
+// =============================================================================
+// MAIN TEST SETUP
+// =============================================================================
+
+void setUp(void) {
+    clock_us = 0;
+    source_ready = false;
+    source_ms = 0;
+    source_calls = 0;
+    time_service_begin(fakeSource, virtualClock);
+}
+
+void tearDown(void) {
+    // Clean up after each test
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_time_service_waits_for_source);
+    RUN_TEST(test_time_service_follows_clock);
+    RUN_TEST(test_time_service_pushed_sync);
+    RUN_TEST(test_time_service_rebase);
+
+    return UNITY_END();
+}